@@ -25,10 +25,12 @@
 
 #include <protobluff/core/allocator.h>
 #include <protobluff/core/buffer.h>
+#include <protobluff/core/chain.h>
 #include <protobluff/core/common.h>
 #include <protobluff/core/decoder.h>
 #include <protobluff/core/descriptor.h>
 #include <protobluff/core/encoder.h>
+#include <protobluff/core/parser.h>
 #include <protobluff/core/string.h>
 
 #endif /* PB_INCLUDE_CORE_H */
@@ -30,6 +30,15 @@
 #include <protobluff/core/allocator.h>
 #include <protobluff/core/common.h>
 
+/* ----------------------------------------------------------------------------
+ * Enumerations
+ * ------------------------------------------------------------------------- */
+
+typedef enum pb_buffer_mode_t {
+  PB_BUFFER_READ,                      /*!< Private mapping, file unchanged */
+  PB_BUFFER_WRITE                      /*!< Shared mapping, file changed */
+} pb_buffer_mode_t;
+
 /* ----------------------------------------------------------------------------
  * Type definitions
  * ------------------------------------------------------------------------- */
@@ -38,6 +47,8 @@ typedef struct pb_buffer_t {
   pb_allocator_t *allocator;           /*!< Allocator */
   uint8_t *data;                       /*!< Raw data */
   size_t size;                         /*!< Raw data size */
+  size_t capacity;                     /*!< Raw data capacity */
+  uint8_t *storage;                    /*!< Inline storage */
 } pb_buffer_t;
 
 /* ----------------------------------------------------------------------------
@@ -66,16 +77,50 @@ pb_buffer_t
 pb_buffer_create_empty_with_allocator(
   pb_allocator_t *allocator);          /* Allocator */
 
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_buffer_t
+pb_buffer_create_inline(
+  uint8_t block[],                     /* Inline storage */
+  size_t size);                        /* Inline storage size */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_buffer_t
+pb_buffer_create_inline_with_allocator(
+  pb_allocator_t *allocator,           /* Allocator */
+  uint8_t block[],                     /* Inline storage */
+  size_t size);                        /* Inline storage size */
+
 PB_EXPORT PB_WARN_UNUSED_RESULT
 pb_buffer_t
 pb_buffer_create_zero_copy(
   uint8_t data[],                      /* Raw data */
   size_t size);                        /* Raw data size */
 
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_buffer_t
+pb_buffer_create_mmap(
+  const char path[],                   /* File path */
+  pb_buffer_mode_t mode);              /* Mapping mode */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_buffer_t
+pb_buffer_create_shm(
+  const char name[],                   /* Shared memory object name */
+  pb_buffer_mode_t mode);              /* Mapping mode */
+
 PB_EXPORT void
 pb_buffer_destroy(
   pb_buffer_t *buffer);                /* Buffer */
 
+PB_EXPORT void
+pb_buffer_reset(
+  pb_buffer_t *buffer);                /* Buffer */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_buffer_sync(
+  pb_buffer_t *buffer);                /* Buffer */
+
 /* ----------------------------------------------------------------------------
  * Inline functions
  * ------------------------------------------------------------------------- */
@@ -116,6 +161,18 @@ pb_buffer_size(const pb_buffer_t *buffer) {
   return buffer->size;
 }
 
+/*!
+ * Retrieve the capacity of a buffer.
+ *
+ * \param[in] buffer Buffer
+ * \return           Raw data capacity
+ */
+PB_INLINE size_t
+pb_buffer_capacity(const pb_buffer_t *buffer) {
+  assert(buffer);
+  return buffer->capacity;
+}
+
 /*!
  * Test whether a buffer is empty.
  *
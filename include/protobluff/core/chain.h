@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef PB_INCLUDE_CORE_CHAIN_H
+#define PB_INCLUDE_CORE_CHAIN_H
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <protobluff/core/buffer.h>
+#include <protobluff/core/common.h>
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_chain_t {
+  const pb_buffer_t *segments;         /*!< Segments */
+  size_t size;                         /*!< Segment count */
+} pb_chain_t;
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_chain_t
+pb_chain_create(
+  const pb_buffer_t segments[],        /* Segments */
+  size_t size);                        /* Segment count */
+
+PB_EXPORT void
+pb_chain_destroy(
+  pb_chain_t *chain);                  /* Chain */
+
+PB_EXPORT size_t
+pb_chain_length(
+  const pb_chain_t *chain);            /* Chain */
+
+PB_EXPORT pb_error_t
+pb_chain_error(
+  const pb_chain_t *chain);            /* Chain */
+
+/* ----------------------------------------------------------------------------
+ * Inline functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve the segment at the given index of a chain.
+ *
+ * \param[in] chain Chain
+ * \param[in] index Index
+ * \return          Segment
+ */
+PB_INLINE const pb_buffer_t *
+pb_chain_segment(const pb_chain_t *chain, size_t index) {
+  assert(chain && index < chain->size);
+  return &(chain->segments[index]);
+}
+
+/*!
+ * Retrieve the number of segments of a chain.
+ *
+ * \param[in] chain Chain
+ * \return          Segment count
+ */
+PB_INLINE size_t
+pb_chain_size(const pb_chain_t *chain) {
+  assert(chain);
+  return chain->size;
+}
+
+/*!
+ * Test whether a chain is valid.
+ *
+ * \param[in] chain Chain
+ * \return          Test result
+ */
+PB_INLINE int
+pb_chain_valid(const pb_chain_t *chain) {
+  assert(chain);
+  return !pb_chain_error(chain);
+}
+
+#endif /* PB_INCLUDE_CORE_CHAIN_H */
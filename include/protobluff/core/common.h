@@ -111,7 +111,9 @@ typedef enum pb_error_t {
   PB_ERROR_VARINT,                     /*!< Invalid varint */
   PB_ERROR_OFFSET,                     /*!< Invalid offset */
   PB_ERROR_ABSENT,                     /*!< Absent field or value */
-  PB_ERROR_EOM                         /*!< Cursor reached end of message */
+  PB_ERROR_EOM,                        /*!< Cursor reached end of message */
+  PB_ERROR_IO,                         /*!< Input/output operation failed */
+  PB_ERROR_PARTIAL                     /*!< Incomplete data, more needed */
 } pb_error_t;
 
 /* ------------------------------------------------------------------------- */
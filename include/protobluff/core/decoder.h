@@ -26,6 +26,7 @@
 #include <assert.h>
 
 #include <protobluff/core/buffer.h>
+#include <protobluff/core/chain.h>
 #include <protobluff/core/common.h>
 #include <protobluff/core/descriptor.h>
 
@@ -69,6 +70,15 @@ pb_decoder_decode(
   pb_decoder_handler_f handler,        /* Handler */
   void *user);                         /* User data */
 
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_decoder_decode_chain(
+  const pb_descriptor_t
+    *descriptor,                       /* Descriptor */
+  const pb_chain_t *chain,             /* Chain */
+  pb_decoder_handler_f handler,        /* Handler */
+  void *user);                         /* User data */
+
 /* ----------------------------------------------------------------------------
  * Inline functions
  * ------------------------------------------------------------------------- */
@@ -56,10 +56,29 @@ pb_encoder_create_with_allocator(
   pb_allocator_t *allocator,           /* Allocator */
   const pb_descriptor_t *descriptor);  /* Descriptor */
 
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_encoder_t
+pb_encoder_create_inline(
+  const pb_descriptor_t *descriptor,   /* Descriptor */
+  uint8_t block[],                     /* Inline storage */
+  size_t size);                        /* Inline storage size */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_encoder_t
+pb_encoder_create_inline_with_allocator(
+  pb_allocator_t *allocator,           /* Allocator */
+  const pb_descriptor_t *descriptor,   /* Descriptor */
+  uint8_t block[],                     /* Inline storage */
+  size_t size);                        /* Inline storage size */
+
 PB_EXPORT void
 pb_encoder_destroy(
   pb_encoder_t *encoder);              /* Encoder */
 
+PB_EXPORT void
+pb_encoder_reset(
+  pb_encoder_t *encoder);              /* Encoder */
+
 PB_EXPORT PB_WARN_UNUSED_RESULT
 pb_error_t
 pb_encoder_encode(
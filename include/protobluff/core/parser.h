@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef PB_INCLUDE_CORE_PARSER_H
+#define PB_INCLUDE_CORE_PARSER_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <protobluff/core/allocator.h>
+#include <protobluff/core/buffer.h>
+#include <protobluff/core/common.h>
+#include <protobluff/core/decoder.h>
+#include <protobluff/core/descriptor.h>
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef enum pb_parser_state_t {
+  PB_PARSER_STATE_TAG,                 /*!< Reading tag (default) */
+  PB_PARSER_STATE_VALUE,               /*!< Reading non-prefixed value */
+  PB_PARSER_STATE_LENGTH,              /*!< Reading length prefix */
+  PB_PARSER_STATE_DATA,                /*!< Reading length-prefixed value */
+  PB_PARSER_STATE_PACKED,              /*!< Reading values of packed field */
+  PB_PARSER_STATE_SKIP                 /*!< Skipping length-prefixed value */
+} pb_parser_state_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef enum pb_parser_event_t {
+  PB_PARSER_EVENT_ENTER,               /*!< Entering nested message */
+  PB_PARSER_EVENT_LEAVE                /*!< Leaving nested message */
+} pb_parser_event_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_parser_frame_t {
+  const pb_field_descriptor_t *field;  /*!< Field descriptor of message */
+  size_t end;                          /*!< Offset of end of message */
+} pb_parser_frame_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_parser_t {
+  const pb_descriptor_t *descriptor;   /*!< Descriptor */
+  const pb_field_descriptor_t *field;  /*!< Field descriptor, if known */
+  pb_buffer_t buffer;                  /*!< Buffer for partial values */
+  pb_buffer_t frames;                  /*!< Frames of nested messages */
+  pb_parser_state_t state;             /*!< State */
+  pb_wiretype_t wiretype;              /*!< Wiretype of current field */
+  size_t offset;                       /*!< Bytes consumed */
+  size_t remaining;                    /*!< Remaining bytes of prefixed value */
+  uint8_t bytes[10];                   /*!< Bytes of partial value */
+  size_t size;                         /*!< Size of partial value */
+} pb_parser_t;
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_parser_t
+pb_parser_create(
+  const pb_descriptor_t *descriptor);  /* Descriptor */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_parser_t
+pb_parser_create_with_allocator(
+  pb_allocator_t *allocator,           /* Allocator */
+  const pb_descriptor_t *descriptor);  /* Descriptor */
+
+PB_EXPORT void
+pb_parser_destroy(
+  pb_parser_t *parser);                /* Parser */
+
+PB_EXPORT void
+pb_parser_reset(
+  pb_parser_t *parser);                /* Parser */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_parser_feed(
+  pb_parser_t *parser,                 /* Parser */
+  const uint8_t data[],                /* Fragment */
+  size_t size,                         /* Fragment size */
+  pb_decoder_handler_f handler,        /* Handler */
+  void *user);                         /* User data */
+
+/* ----------------------------------------------------------------------------
+ * Inline functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve the descriptor of a parser.
+ *
+ * \param[in] parser Parser
+ * \return           Descriptor
+ */
+PB_INLINE const pb_descriptor_t *
+pb_parser_descriptor(const pb_parser_t *parser) {
+  assert(parser);
+  return parser->descriptor;
+}
+
+/*!
+ * Retrieve the number of nested messages a parser is located in.
+ *
+ * \param[in] parser Parser
+ * \return           Nesting depth
+ */
+PB_INLINE size_t
+pb_parser_depth(const pb_parser_t *parser) {
+  assert(parser);
+  return pb_buffer_size(&(parser->frames)) / sizeof(pb_parser_frame_t);
+}
+
+/*!
+ * Test whether a parser is located at a field boundary of the message.
+ *
+ * \param[in] parser Parser
+ * \return           Test result
+ */
+PB_INLINE int
+pb_parser_done(const pb_parser_t *parser) {
+  assert(parser);
+  return parser->state == PB_PARSER_STATE_TAG && !parser->size &&
+    !pb_parser_depth(parser);
+}
+
+/*!
+ * Retrieve the internal error state of a parser.
+ *
+ * \param[in] parser Parser
+ * \return           Error code
+ */
+PB_INLINE pb_error_t
+pb_parser_error(const pb_parser_t *parser) {
+  assert(parser);
+  return pb_buffer_error(&(parser->buffer));
+}
+
+/*!
+ * Test whether a parser is valid.
+ *
+ * \param[in] parser Parser
+ * \return           Test result
+ */
+PB_INLINE int
+pb_parser_valid(const pb_parser_t *parser) {
+  assert(parser);
+  return !pb_parser_error(parser);
+}
+
+#endif /* PB_INCLUDE_CORE_PARSER_H */
@@ -30,6 +30,12 @@
 #include <protobluff/message/common.h>
 #include <protobluff/message/message.h>
 
+/* ----------------------------------------------------------------------------
+ * Forward declarations
+ * ------------------------------------------------------------------------- */
+
+struct pb_index_t;
+
 /* ----------------------------------------------------------------------------
  * Type definitions
  * ------------------------------------------------------------------------- */
@@ -64,6 +70,12 @@ pb_cursor_create_nested(
   const pb_tag_t tags[],               /* Tags */
   size_t size);                        /* Tag count */
 
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_cursor_t
+pb_cursor_create_from_index(
+  struct pb_index_t *index,            /* Index */
+  size_t pos);                         /* Position */
+
 PB_EXPORT void
 pb_cursor_destroy(
   pb_cursor_t *cursor);                /* Cursor */
@@ -85,6 +97,19 @@ pb_cursor_seek(
   pb_cursor_t *cursor,                 /* Cursor */
   const void *value);                  /* Pointer holding value */
 
+PB_EXPORT int
+pb_cursor_seek_range(
+  pb_cursor_t *cursor,                 /* Cursor */
+  const void *min,                     /* Pointer holding lower bound */
+  const void *max);                    /* Pointer holding upper bound */
+
+PB_EXPORT size_t
+pb_cursor_find(
+  pb_cursor_t *cursor,                 /* Cursor */
+  const void *value,                   /* Pointer holding value */
+  size_t pos[],                        /* Positions */
+  size_t size);                        /* Maximum position count */
+
 PB_EXPORT int
 pb_cursor_match(
   pb_cursor_t *cursor,                 /* Cursor */
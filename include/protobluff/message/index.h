@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef PB_INCLUDE_MESSAGE_INDEX_H
+#define PB_INCLUDE_MESSAGE_INDEX_H
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <protobluff/core/allocator.h>
+#include <protobluff/message/common.h>
+#include <protobluff/message/message.h>
+
+/* ----------------------------------------------------------------------------
+ * Forward declarations
+ * ------------------------------------------------------------------------- */
+
+struct pb_index_span_t;
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_index_t {
+  pb_allocator_t *allocator;           /*!< Allocator */
+  pb_message_t message;                /*!< Message */
+  pb_tag_t tag;                        /*!< Tag */
+  pb_version_t version;                /*!< Version of index */
+  struct {
+    struct pb_index_span_t *data;      /*!< Index spans */
+    size_t size;                       /*!< Index span count */
+    size_t capacity;                   /*!< Index span capacity */
+  } span;
+  struct {
+    size_t start;                      /*!< Start offset of occurrences */
+    size_t end;                        /*!< End offset of occurrences */
+  } extent;
+  size_t size;                         /*!< Occurrence count */
+  pb_error_t error;                    /*!< Error code */
+} pb_index_t;
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_index_t
+pb_index_create(
+  pb_message_t *message,               /* Message */
+  pb_tag_t tag);                       /* Tag */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_index_t
+pb_index_create_with_allocator(
+  pb_allocator_t *allocator,           /* Allocator */
+  pb_message_t *message,               /* Message */
+  pb_tag_t tag);                       /* Tag */
+
+PB_EXPORT void
+pb_index_destroy(
+  pb_index_t *index);                  /* Index */
+
+PB_EXPORT size_t
+pb_index_size(
+  pb_index_t *index);                  /* Index */
+
+/* ----------------------------------------------------------------------------
+ * Macros
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve the underlying message of an index.
+ *
+ * \param[in] index Index
+ * \return          Message
+ */
+PB_INLINE const pb_message_t *
+pb_index_message(const pb_index_t *index) {
+  assert(index);
+  return &(index->message);
+}
+
+/*!
+ * Retrieve the tag of an index.
+ *
+ * \param[in] index Index
+ * \return          Tag
+ */
+PB_INLINE pb_tag_t
+pb_index_tag(const pb_index_t *index) {
+  assert(index);
+  return index->tag;
+}
+
+/*!
+ * Retrieve the internal error state of an index.
+ *
+ * \param[in] index Index
+ * \return          Error code
+ */
+PB_INLINE pb_error_t
+pb_index_error(const pb_index_t *index) {
+  assert(index);
+  return index->error;
+}
+
+/*!
+ * Test whether an index is valid.
+ *
+ * \param[in] index Index
+ * \return          Test result
+ */
+PB_INLINE int
+pb_index_valid(const pb_index_t *index) {
+  assert(index);
+  return !pb_index_error(index);
+}
+
+#endif /* PB_INCLUDE_MESSAGE_INDEX_H */
@@ -46,7 +46,9 @@ typedef struct pb_journal_t {
   struct {
     struct pb_journal_entry_t *data;   /*!< Journal entries */
     size_t size;                       /*!< Journal entry count */
+    size_t capacity;                   /*!< Journal entry capacity */
   } entry;
+  pb_allocator_t *allocator;           /*!< Allocator for entries and copy */
 } pb_journal_t;
 
 /* ----------------------------------------------------------------------------
@@ -75,16 +77,63 @@ pb_journal_t
 pb_journal_create_empty_with_allocator(
   pb_allocator_t *allocator);          /* Allocator */
 
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_journal_t
+pb_journal_create_inline(
+  uint8_t block[],                     /* Inline storage */
+  size_t size);                        /* Inline storage size */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_journal_t
+pb_journal_create_inline_with_allocator(
+  pb_allocator_t *allocator,           /* Allocator */
+  uint8_t block[],                     /* Inline storage */
+  size_t size);                        /* Inline storage size */
+
 PB_EXPORT PB_WARN_UNUSED_RESULT
 pb_journal_t
 pb_journal_create_zero_copy(
   uint8_t data[],                      /* Raw data */
   size_t size);                        /* Raw data size */
 
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_journal_t
+pb_journal_create_copy_on_write(
+  uint8_t data[],                      /* Raw data */
+  size_t size);                        /* Raw data size */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_journal_t
+pb_journal_create_copy_on_write_with_allocator(
+  pb_allocator_t *allocator,           /* Allocator */
+  uint8_t data[],                      /* Raw data */
+  size_t size);                        /* Raw data size */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_journal_t
+pb_journal_create_mmap(
+  const char path[],                   /* File path */
+  pb_buffer_mode_t mode);              /* Mapping mode */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_journal_t
+pb_journal_create_shm(
+  const char name[],                   /* Shared memory object name */
+  pb_buffer_mode_t mode);              /* Mapping mode */
+
 PB_EXPORT void
 pb_journal_destroy(
   pb_journal_t *journal);              /* Journal */
 
+PB_EXPORT void
+pb_journal_reset(
+  pb_journal_t *journal);              /* Journal */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_journal_sync(
+  pb_journal_t *journal);              /* Journal */
+
 /* ----------------------------------------------------------------------------
  * Macros
  * ------------------------------------------------------------------------- */
@@ -23,8 +23,24 @@
 #ifndef PB_INCLUDE_UTIL_H
 #define PB_INCLUDE_UTIL_H
 
+#include <protobluff/util/aggregate.h>
+#include <protobluff/util/arena_allocator.h>
+#include <protobluff/util/batch.h>
+#include <protobluff/util/block.h>
+#include <protobluff/util/budget_allocator.h>
+#include <protobluff/util/cache_allocator.h>
 #include <protobluff/util/chunk_allocator.h>
+#include <protobluff/util/container.h>
 #include <protobluff/util/descriptor.h>
+#include <protobluff/util/executor.h>
+#include <protobluff/util/filter.h>
+#include <protobluff/util/path.h>
+#include <protobluff/util/pool.h>
+#include <protobluff/util/record.h>
+#include <protobluff/util/ring.h>
+#include <protobluff/util/stats_allocator.h>
+#include <protobluff/util/stitcher.h>
+#include <protobluff/util/transposer.h>
 #include <protobluff/util/validator.h>
 
 #endif /* PB_INCLUDE_UTIL_H */
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef PB_INCLUDE_UTIL_AGGREGATE_H
+#define PB_INCLUDE_UTIL_AGGREGATE_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <protobluff/core/buffer.h>
+#include <protobluff/core/common.h>
+#include <protobluff/util/path.h>
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_aggregate_t {
+  const pb_path_t *path;               /*!< Path */
+  struct {
+    double lower;                      /*!< Lower bound */
+    double upper;                      /*!< Upper bound */
+    uint64_t *data;                    /*!< Bins */
+    size_t size;                       /*!< Bin count */
+  } histogram;
+  uint64_t count;                      /*!< Value count */
+  double sum;                          /*!< Sum of values */
+  double min;                          /*!< Minimum value */
+  double max;                          /*!< Maximum value */
+  pb_error_t error;                    /*!< Error code */
+} pb_aggregate_t;
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_aggregate_t
+pb_aggregate_create(
+  const pb_path_t *path);              /* Path */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_aggregate_t
+pb_aggregate_create_with_histogram(
+  const pb_path_t *path,               /* Path */
+  double lower,                        /* Lower bound */
+  double upper,                        /* Upper bound */
+  size_t size);                        /* Bin count */
+
+PB_EXPORT void
+pb_aggregate_destroy(
+  pb_aggregate_t *aggregate);          /* Aggregate */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_aggregate_buffers(
+  pb_aggregate_t *aggregate,           /* Aggregate */
+  const pb_buffer_t buffers[],         /* Buffers */
+  size_t size,                         /* Buffer count */
+  size_t threads);                     /* Thread count */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_aggregate_file(
+  pb_aggregate_t *aggregate,           /* Aggregate */
+  const char path[],                   /* Path of record file */
+  size_t threads);                     /* Thread count */
+
+PB_EXPORT void
+pb_aggregate_reset(
+  pb_aggregate_t *aggregate);          /* Aggregate */
+
+/* ----------------------------------------------------------------------------
+ * Inline functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve the number of aggregated values.
+ *
+ * \param[in] aggregate Aggregate
+ * \return              Value count
+ */
+PB_INLINE uint64_t
+pb_aggregate_count(const pb_aggregate_t *aggregate) {
+  assert(aggregate);
+  return aggregate->count;
+}
+
+/*!
+ * Retrieve the sum of aggregated values.
+ *
+ * \param[in] aggregate Aggregate
+ * \return              Sum of values
+ */
+PB_INLINE double
+pb_aggregate_sum(const pb_aggregate_t *aggregate) {
+  assert(aggregate);
+  return aggregate->sum;
+}
+
+/*!
+ * Retrieve the minimum of aggregated values.
+ *
+ * If no values were aggregated, positive infinity is returned.
+ *
+ * \param[in] aggregate Aggregate
+ * \return              Minimum value
+ */
+PB_INLINE double
+pb_aggregate_min(const pb_aggregate_t *aggregate) {
+  assert(aggregate);
+  return aggregate->min;
+}
+
+/*!
+ * Retrieve the maximum of aggregated values.
+ *
+ * If no values were aggregated, negative infinity is returned.
+ *
+ * \param[in] aggregate Aggregate
+ * \return              Maximum value
+ */
+PB_INLINE double
+pb_aggregate_max(const pb_aggregate_t *aggregate) {
+  assert(aggregate);
+  return aggregate->max;
+}
+
+/*!
+ * Retrieve the number of histogram bins of an aggregate.
+ *
+ * \param[in] aggregate Aggregate
+ * \return              Bin count
+ */
+PB_INLINE size_t
+pb_aggregate_bins(const pb_aggregate_t *aggregate) {
+  assert(aggregate);
+  return aggregate->histogram.size;
+}
+
+/*!
+ * Retrieve the number of values in a histogram bin.
+ *
+ * \param[in] aggregate Aggregate
+ * \param[in] bin       Bin
+ * \return              Value count
+ */
+PB_INLINE uint64_t
+pb_aggregate_bin(const pb_aggregate_t *aggregate, size_t bin) {
+  assert(aggregate && bin < aggregate->histogram.size);
+  return aggregate->histogram.data[bin];
+}
+
+/*!
+ * Retrieve the internal error state of an aggregate.
+ *
+ * \param[in] aggregate Aggregate
+ * \return              Error code
+ */
+PB_INLINE pb_error_t
+pb_aggregate_error(const pb_aggregate_t *aggregate) {
+  assert(aggregate);
+  return aggregate->error;
+}
+
+/*!
+ * Test whether an aggregate is valid.
+ *
+ * \param[in] aggregate Aggregate
+ * \return              Test result
+ */
+PB_INLINE int
+pb_aggregate_valid(const pb_aggregate_t *aggregate) {
+  assert(aggregate);
+  return !pb_aggregate_error(aggregate);
+}
+
+#endif /* PB_INCLUDE_UTIL_AGGREGATE_H */
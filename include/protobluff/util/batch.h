@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef PB_INCLUDE_UTIL_BATCH_H
+#define PB_INCLUDE_UTIL_BATCH_H
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <protobluff/core/buffer.h>
+#include <protobluff/core/common.h>
+#include <protobluff/core/decoder.h>
+#include <protobluff/core/descriptor.h>
+#include <protobluff/util/executor.h>
+#include <protobluff/util/pool.h>
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_batch_context_t {
+  size_t thread;                       /*!< Thread index */
+  size_t index;                        /*!< Buffer index */
+  pb_pool_t *pool;                     /*!< Pool of thread */
+  void *state;                         /*!< State of buffer, if any */
+  void *user;                          /*!< User data */
+} pb_batch_context_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef pb_error_t
+(*pb_batch_complete_f)(
+  pb_batch_context_t *context);        /*!< Context */
+
+/* ------------------------------------------------------------------------- */
+
+typedef enum pb_batch_order_t {
+  PB_BATCH_ORDER_NONE,                 /*!< Complete buffers in any order */
+  PB_BATCH_ORDER_INDEX                 /*!< Complete buffers in order */
+} pb_batch_order_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_batch_t {
+  pb_executor_t *executor;             /*!< Executor */
+  const pb_descriptor_t *descriptor;   /*!< Descriptor */
+  pb_decoder_handler_f handler;        /*!< Handler */
+  pb_batch_complete_f complete;        /*!< Completion handler, if any */
+  pb_batch_order_t order;              /*!< Completion order */
+  size_t state;                        /*!< Size of state per buffer */
+  struct {
+    pb_batch_context_t *data;          /*!< Contexts, one per thread */
+    size_t size;                       /*!< Context count */
+  } context;
+} pb_batch_t;
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_batch_t
+pb_batch_create(
+  pb_executor_t *executor,             /* Executor */
+  const pb_descriptor_t
+    *descriptor,                       /* Descriptor */
+  pb_decoder_handler_f handler);       /* Handler */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_batch_t
+pb_batch_create_with_completion(
+  pb_executor_t *executor,             /* Executor */
+  const pb_descriptor_t
+    *descriptor,                       /* Descriptor */
+  pb_decoder_handler_f handler,        /* Handler */
+  pb_batch_complete_f complete,        /* Completion handler */
+  pb_batch_order_t order);             /* Completion order */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_batch_t
+pb_batch_create_with_state(
+  pb_executor_t *executor,             /* Executor */
+  const pb_descriptor_t
+    *descriptor,                       /* Descriptor */
+  pb_decoder_handler_f handler,        /* Handler */
+  pb_batch_complete_f complete,        /* Completion handler */
+  pb_batch_order_t order,              /* Completion order */
+  size_t state);                       /* Size of state per buffer */
+
+PB_EXPORT void
+pb_batch_destroy(
+  pb_batch_t *batch);                  /* Batch */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_batch_decode(
+  pb_batch_t *batch,                   /* Batch */
+  const pb_buffer_t buffers[],         /* Buffers */
+  size_t size,                         /* Buffer count */
+  void *user);                         /* User data */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_batch_decode_field(
+  pb_batch_t *batch,                   /* Batch */
+  const pb_buffer_t *buffer,           /* Buffer */
+  pb_tag_t tag,                        /* Tag of repeated field */
+  void *user);                         /* User data */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_batch_check_field(
+  pb_batch_t *batch,                   /* Batch */
+  const pb_buffer_t *buffer,           /* Buffer */
+  pb_tag_t tag);                       /* Tag of repeated field */
+
+/* ----------------------------------------------------------------------------
+ * Inline functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve the descriptor of a batch.
+ *
+ * \param[in] batch Batch
+ * \return          Descriptor
+ */
+PB_INLINE const pb_descriptor_t *
+pb_batch_descriptor(const pb_batch_t *batch) {
+  assert(batch);
+  return batch->descriptor;
+}
+
+/*!
+ * Retrieve the number of threads of a batch.
+ *
+ * Per-thread state of the caller can be kept in an array of this size, which
+ * is indexed with the thread index of the context passed to the handlers. In
+ * ordered mode, a buffer may be completed by another thread than the one that
+ * decoded it, so results must be passed to the completion handler through the
+ * state of the buffer, see pb_batch_create_with_state().
+ *
+ * \param[in] batch Batch
+ * \return          Thread count
+ */
+PB_INLINE size_t
+pb_batch_threads(const pb_batch_t *batch) {
+  assert(batch);
+  return batch->context.size;
+}
+
+/*!
+ * Retrieve the internal error state of a batch.
+ *
+ * \param[in] batch Batch
+ * \return          Error code
+ */
+PB_INLINE pb_error_t
+pb_batch_error(const pb_batch_t *batch) {
+  assert(batch);
+  return batch->context.data
+    ? PB_ERROR_NONE
+    : PB_ERROR_ALLOC;
+}
+
+/*!
+ * Test whether a batch is valid.
+ *
+ * \param[in] batch Batch
+ * \return          Test result
+ */
+PB_INLINE int
+pb_batch_valid(const pb_batch_t *batch) {
+  assert(batch);
+  return !pb_batch_error(batch);
+}
+
+#endif /* PB_INCLUDE_UTIL_BATCH_H */
@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef PB_INCLUDE_UTIL_BLOCK_H
+#define PB_INCLUDE_UTIL_BLOCK_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <protobluff/core/buffer.h>
+#include <protobluff/core/common.h>
+#include <protobluff/util/record.h>
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_block_reader_t {
+  pb_record_reader_t reader;           /*!< Record reader for blocks */
+  pb_buffer_t block;                   /*!< Decompressed block */
+  const uint8_t *data;                 /*!< Current block data */
+  size_t size;                         /*!< Current block size */
+  size_t offset;                       /*!< Offset of next record */
+} pb_block_reader_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_block_writer_t {
+  pb_record_writer_t writer;           /*!< Record writer for blocks */
+  pb_buffer_t block;                   /*!< Pending block */
+  pb_buffer_t compressed;              /*!< Compressed block */
+  size_t size;                         /*!< Block size */
+} pb_block_writer_t;
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_block_reader_t
+pb_block_reader_create(
+  const char path[]);                  /* Path */
+
+PB_EXPORT void
+pb_block_reader_destroy(
+  pb_block_reader_t *reader);          /* Block reader */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_block_reader_next(
+  pb_block_reader_t *reader,           /* Block reader */
+  pb_buffer_t *record);                /* Buffer receiving record */
+
+/* ------------------------------------------------------------------------- */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_block_writer_t
+pb_block_writer_create(
+  const char path[],                   /* Path */
+  pb_record_sync_t sync);              /* Sync policy */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_block_writer_t
+pb_block_writer_create_with_size(
+  const char path[],                   /* Path */
+  pb_record_sync_t sync,               /* Sync policy */
+  size_t size);                        /* Block size */
+
+PB_EXPORT void
+pb_block_writer_destroy(
+  pb_block_writer_t *writer);          /* Block writer */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_block_writer_write(
+  pb_block_writer_t *writer,           /* Block writer */
+  const pb_buffer_t records[],         /* Records */
+  size_t size);                        /* Record count */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_block_writer_flush(
+  pb_block_writer_t *writer);          /* Block writer */
+
+/* ----------------------------------------------------------------------------
+ * Inline functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve the internal error state of a block reader.
+ *
+ * \param[in] reader Block reader
+ * \return           Error code
+ */
+PB_INLINE pb_error_t
+pb_block_reader_error(const pb_block_reader_t *reader) {
+  assert(reader);
+  pb_error_t error = pb_record_reader_error(&(reader->reader));
+  if (!error)
+    error = pb_buffer_error(&(reader->block));
+  return error;
+}
+
+/*!
+ * Test whether a block reader is valid.
+ *
+ * \param[in] reader Block reader
+ * \return           Test result
+ */
+PB_INLINE int
+pb_block_reader_valid(const pb_block_reader_t *reader) {
+  assert(reader);
+  return !pb_block_reader_error(reader);
+}
+
+/*!
+ * Retrieve the internal error state of a block writer.
+ *
+ * \param[in] writer Block writer
+ * \return           Error code
+ */
+PB_INLINE pb_error_t
+pb_block_writer_error(const pb_block_writer_t *writer) {
+  assert(writer);
+  pb_error_t error = pb_record_writer_error(&(writer->writer));
+  if (!error)
+    error = pb_buffer_error(&(writer->block));
+  if (!error)
+    error = pb_buffer_error(&(writer->compressed));
+  return error;
+}
+
+/*!
+ * Test whether a block writer is valid.
+ *
+ * \param[in] writer Block writer
+ * \return           Test result
+ */
+PB_INLINE int
+pb_block_writer_valid(const pb_block_writer_t *writer) {
+  assert(writer);
+  return !pb_block_writer_error(writer);
+}
+
+#endif /* PB_INCLUDE_UTIL_BLOCK_H */
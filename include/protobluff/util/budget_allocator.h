@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef PB_INCLUDE_UTIL_BUDGET_ALLOCATOR_H
+#define PB_INCLUDE_UTIL_BUDGET_ALLOCATOR_H
+
+#include <stddef.h>
+
+#include <protobluff/core/allocator.h>
+#include <protobluff/core/common.h>
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_allocator_t
+pb_budget_allocator_create(
+  size_t budget);                      /* Budget in bytes */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_allocator_t
+pb_budget_allocator_create_with_allocator(
+  pb_allocator_t *allocator,           /* Allocator */
+  size_t budget);                      /* Budget in bytes */
+
+PB_EXPORT void
+pb_budget_allocator_destroy(
+  pb_allocator_t *allocator);          /* Allocator */
+
+PB_EXPORT size_t
+pb_budget_allocator_current(
+  const pb_allocator_t *allocator);    /* Allocator */
+
+PB_EXPORT size_t
+pb_budget_allocator_peak(
+  const pb_allocator_t *allocator);    /* Allocator */
+
+PB_EXPORT void
+pb_budget_allocator_reset(
+  pb_allocator_t *allocator);          /* Allocator */
+
+#endif /* PB_INCLUDE_UTIL_BUDGET_ALLOCATOR_H */
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef PB_INCLUDE_UTIL_CONTAINER_H
+#define PB_INCLUDE_UTIL_CONTAINER_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <protobluff/core/buffer.h>
+#include <protobluff/core/common.h>
+#include <protobluff/util/path.h>
+#include <protobluff/util/record.h>
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_container_reader_t {
+  pb_buffer_t buffer;                  /*!< Memory-mapped file */
+  const uint64_t *index;               /*!< Record offsets */
+  const uint64_t *keys;                /*!< Key samples */
+  size_t records;                      /*!< Size of records */
+  size_t size;                         /*!< Record count */
+  size_t samples;                      /*!< Key sample count */
+  size_t interval;                     /*!< Key sampling interval */
+  pb_error_t error;                    /*!< Error code */
+} pb_container_reader_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_container_writer_t {
+  pb_record_writer_t writer;           /*!< Record writer */
+  pb_buffer_t index;                   /*!< Record offsets */
+  pb_buffer_t keys;                    /*!< Key samples */
+  const pb_path_t *key;                /*!< Key path */
+  size_t interval;                     /*!< Key sampling interval */
+  size_t offset;                       /*!< Offset of next record */
+  size_t size;                         /*!< Record count */
+} pb_container_writer_t;
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_container_reader_t
+pb_container_reader_create(
+  const char path[]);                  /* Path */
+
+PB_EXPORT void
+pb_container_reader_destroy(
+  pb_container_reader_t *reader);      /* Container reader */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_container_reader_get(
+  const pb_container_reader_t *reader, /* Container reader */
+  size_t position,                     /* Record number */
+  pb_buffer_t *record);                /* Buffer receiving record */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_container_reader_seek(
+  const pb_container_reader_t *reader, /* Container reader */
+  const pb_path_t *key,                /* Key path */
+  uint64_t value,                      /* Key */
+  size_t *position);                   /* Pointer receiving record number */
+
+/* ------------------------------------------------------------------------- */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_container_writer_t
+pb_container_writer_create(
+  const char path[]);                  /* Path */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_container_writer_t
+pb_container_writer_create_with_keys(
+  const char path[],                   /* Path */
+  const pb_path_t *key,                /* Key path */
+  size_t interval);                    /* Key sampling interval */
+
+PB_EXPORT void
+pb_container_writer_destroy(
+  pb_container_writer_t *writer);      /* Container writer */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_container_writer_write(
+  pb_container_writer_t *writer,       /* Container writer */
+  const pb_buffer_t records[],         /* Records */
+  size_t size);                        /* Record count */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_container_writer_finish(
+  pb_container_writer_t *writer);      /* Container writer */
+
+/* ----------------------------------------------------------------------------
+ * Inline functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve the number of records of a container.
+ *
+ * \param[in] reader Container reader
+ * \return           Record count
+ */
+PB_INLINE size_t
+pb_container_reader_size(const pb_container_reader_t *reader) {
+  assert(reader);
+  return reader->size;
+}
+
+/*!
+ * Retrieve the internal error state of a container reader.
+ *
+ * \param[in] reader Container reader
+ * \return           Error code
+ */
+PB_INLINE pb_error_t
+pb_container_reader_error(const pb_container_reader_t *reader) {
+  assert(reader);
+  return reader->error;
+}
+
+/*!
+ * Test whether a container reader is valid.
+ *
+ * \param[in] reader Container reader
+ * \return           Test result
+ */
+PB_INLINE int
+pb_container_reader_valid(const pb_container_reader_t *reader) {
+  assert(reader);
+  return !pb_container_reader_error(reader);
+}
+
+/*!
+ * Retrieve the number of records written to a container.
+ *
+ * \param[in] writer Container writer
+ * \return           Record count
+ */
+PB_INLINE size_t
+pb_container_writer_size(const pb_container_writer_t *writer) {
+  assert(writer);
+  return writer->size;
+}
+
+/*!
+ * Retrieve the internal error state of a container writer.
+ *
+ * \param[in] writer Container writer
+ * \return           Error code
+ */
+PB_INLINE pb_error_t
+pb_container_writer_error(const pb_container_writer_t *writer) {
+  assert(writer);
+  pb_error_t error = pb_record_writer_error(&(writer->writer));
+  if (!error)
+    error = pb_buffer_error(&(writer->index));
+  if (!error)
+    error = pb_buffer_error(&(writer->keys));
+  return error;
+}
+
+/*!
+ * Test whether a container writer is valid.
+ *
+ * \param[in] writer Container writer
+ * \return           Test result
+ */
+PB_INLINE int
+pb_container_writer_valid(const pb_container_writer_t *writer) {
+  assert(writer);
+  return !pb_container_writer_error(writer);
+}
+
+#endif /* PB_INCLUDE_UTIL_CONTAINER_H */
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef PB_INCLUDE_UTIL_EXECUTOR_H
+#define PB_INCLUDE_UTIL_EXECUTOR_H
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <protobluff/core/common.h>
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef pb_error_t
+(*pb_executor_task_f)(
+  size_t index,                        /*!< Task index */
+  size_t thread,                       /*!< Thread index */
+  void *user);                         /*!< User data */
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_executor_t {
+  struct pb_executor_state_t *state;   /*!< Shared state */
+  size_t size;                         /*!< Thread count */
+} pb_executor_t;
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_executor_t
+pb_executor_create(
+  size_t size);                        /* Thread count */
+
+PB_EXPORT void
+pb_executor_destroy(
+  pb_executor_t *executor);            /* Executor */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_executor_run(
+  pb_executor_t *executor,             /* Executor */
+  size_t size,                         /* Task count */
+  pb_executor_task_f task,             /* Task */
+  void *user);                         /* User data */
+
+/* ----------------------------------------------------------------------------
+ * Inline functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve the number of threads of an executor.
+ *
+ * The calling thread of pb_executor_run() is counted as the first thread.
+ *
+ * \param[in] executor Executor
+ * \return             Thread count
+ */
+PB_INLINE size_t
+pb_executor_size(const pb_executor_t *executor) {
+  assert(executor);
+  return executor->size;
+}
+
+/*!
+ * Retrieve the internal error state of an executor.
+ *
+ * \param[in] executor Executor
+ * \return             Error code
+ */
+PB_INLINE pb_error_t
+pb_executor_error(const pb_executor_t *executor) {
+  assert(executor);
+  return executor->state
+    ? PB_ERROR_NONE
+    : PB_ERROR_ALLOC;
+}
+
+/*!
+ * Test whether an executor is valid.
+ *
+ * \param[in] executor Executor
+ * \return             Test result
+ */
+PB_INLINE int
+pb_executor_valid(const pb_executor_t *executor) {
+  assert(executor);
+  return !pb_executor_error(executor);
+}
+
+#endif /* PB_INCLUDE_UTIL_EXECUTOR_H */
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef PB_INCLUDE_UTIL_FILTER_H
+#define PB_INCLUDE_UTIL_FILTER_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <protobluff/core/buffer.h>
+#include <protobluff/core/common.h>
+#include <protobluff/core/descriptor.h>
+
+/* ----------------------------------------------------------------------------
+ * Forward declarations
+ * ------------------------------------------------------------------------- */
+
+struct pb_filter_leaf_t;
+struct pb_filter_op_t;
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_filter_t {
+  const pb_descriptor_t *descriptor;   /*!< Descriptor */
+  struct {
+    struct pb_filter_leaf_t *data;     /*!< Predicates */
+    size_t size;                       /*!< Predicate count */
+  } leaf;
+  struct {
+    struct pb_filter_op_t *data;       /*!< Instructions */
+    size_t size;                       /*!< Instruction count */
+  } program;
+  size_t depth;                        /*!< Maximum stack depth */
+  pb_error_t error;                    /*!< Error code */
+} pb_filter_t;
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_filter_t
+pb_filter_create(
+  const pb_descriptor_t
+    *descriptor,                       /* Descriptor */
+  const char expression[]);            /* Expression */
+
+PB_EXPORT void
+pb_filter_destroy(
+  pb_filter_t *filter);                /* Filter */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_filter_match(
+  const pb_filter_t *filter,           /* Filter */
+  const pb_buffer_t *buffer,           /* Buffer */
+  int *match);                         /* Match */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_filter_select(
+  const pb_filter_t *filter,           /* Filter */
+  const pb_buffer_t buffers[],         /* Buffers */
+  size_t size,                         /* Buffer count */
+  uint8_t selection[]);                /* Selection bitmap */
+
+/* ----------------------------------------------------------------------------
+ * Inline functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve the descriptor of a filter.
+ *
+ * \param[in] filter Filter
+ * \return           Descriptor
+ */
+PB_INLINE const pb_descriptor_t *
+pb_filter_descriptor(const pb_filter_t *filter) {
+  assert(filter);
+  return filter->descriptor;
+}
+
+/*!
+ * Retrieve the internal error state of a filter.
+ *
+ * \param[in] filter Filter
+ * \return           Error code
+ */
+PB_INLINE pb_error_t
+pb_filter_error(const pb_filter_t *filter) {
+  assert(filter);
+  return filter->error;
+}
+
+/*!
+ * Test whether a filter is valid.
+ *
+ * \param[in] filter Filter
+ * \return           Test result
+ */
+PB_INLINE int
+pb_filter_valid(const pb_filter_t *filter) {
+  assert(filter);
+  return !pb_filter_error(filter);
+}
+
+/*!
+ * Test whether a buffer is selected in a selection bitmap.
+ *
+ * \param[in] selection[] Selection bitmap
+ * \param[in] index       Buffer index
+ * \return                Test result
+ */
+PB_INLINE int
+pb_filter_selected(const uint8_t selection[], size_t index) {
+  assert(selection);
+  return (selection[index >> 3] >> (index & 7)) & 1;
+}
+
+#endif /* PB_INCLUDE_UTIL_FILTER_H */
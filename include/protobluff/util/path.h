@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef PB_INCLUDE_UTIL_PATH_H
+#define PB_INCLUDE_UTIL_PATH_H
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <protobluff/core/buffer.h>
+#include <protobluff/core/common.h>
+#include <protobluff/core/decoder.h>
+#include <protobluff/core/descriptor.h>
+
+/* ----------------------------------------------------------------------------
+ * Forward declarations
+ * ------------------------------------------------------------------------- */
+
+struct pb_path_segment_t;
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_path_t {
+  const pb_descriptor_t *descriptor;   /*!< Descriptor */
+  struct {
+    struct pb_path_segment_t *data;    /*!< Path segments */
+    size_t size;                       /*!< Path segment count */
+  } segment;
+  pb_error_t error;                    /*!< Error code */
+} pb_path_t;
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_path_t
+pb_path_create(
+  const pb_descriptor_t
+    *descriptor,                       /* Descriptor */
+  const char path[]);                  /* Path */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_path_t
+pb_path_create_from_tags(
+  const pb_descriptor_t
+    *descriptor,                       /* Descriptor */
+  const pb_tag_t tags[],               /* Tags */
+  size_t size);                        /* Tag count */
+
+PB_EXPORT void
+pb_path_destroy(
+  pb_path_t *path);                    /* Path */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_path_evaluate(
+  const pb_path_t *path,               /* Path */
+  const pb_buffer_t *buffer,           /* Buffer */
+  pb_decoder_handler_f handler,        /* Handler */
+  void *user);                         /* User data */
+
+/* ----------------------------------------------------------------------------
+ * Inline functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve the descriptor of a path.
+ *
+ * \param[in] path Path
+ * \return         Descriptor
+ */
+PB_INLINE const pb_descriptor_t *
+pb_path_descriptor(const pb_path_t *path) {
+  assert(path);
+  return path->descriptor;
+}
+
+/*!
+ * Retrieve the number of segments of a path.
+ *
+ * \param[in] path Path
+ * \return         Path segment count
+ */
+PB_INLINE size_t
+pb_path_size(const pb_path_t *path) {
+  assert(path);
+  return path->segment.size;
+}
+
+/*!
+ * Retrieve the internal error state of a path.
+ *
+ * \param[in] path Path
+ * \return         Error code
+ */
+PB_INLINE pb_error_t
+pb_path_error(const pb_path_t *path) {
+  assert(path);
+  return path->error;
+}
+
+/*!
+ * Test whether a path is valid.
+ *
+ * \param[in] path Path
+ * \return         Test result
+ */
+PB_INLINE int
+pb_path_valid(const pb_path_t *path) {
+  assert(path);
+  return !pb_path_error(path);
+}
+
+#endif /* PB_INCLUDE_UTIL_PATH_H */
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef PB_INCLUDE_UTIL_POOL_H
+#define PB_INCLUDE_UTIL_POOL_H
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <protobluff/core/allocator.h>
+#include <protobluff/core/common.h>
+#include <protobluff/core/descriptor.h>
+#include <protobluff/core/encoder.h>
+#include <protobluff/message/journal.h>
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_pool_t {
+  pb_allocator_t *allocator;           /*!< Allocator */
+  struct {
+    pb_journal_t *data;                /*!< Recycled journals */
+    size_t size;                       /*!< Recycled journal count */
+  } journal;
+  struct {
+    pb_encoder_t *data;                /*!< Recycled encoders */
+    size_t size;                       /*!< Recycled encoder count */
+  } encoder;
+} pb_pool_t;
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_pool_t
+pb_pool_create(void);
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_pool_t
+pb_pool_create_with_allocator(
+  pb_allocator_t *allocator);          /* Allocator */
+
+PB_EXPORT void
+pb_pool_destroy(
+  pb_pool_t *pool);                    /* Pool */
+
+PB_EXPORT pb_pool_t *
+pb_pool_local(void);
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_journal_t
+pb_pool_acquire_journal(
+  pb_pool_t *pool);                    /* Pool */
+
+PB_EXPORT void
+pb_pool_release_journal(
+  pb_pool_t *pool,                     /* Pool */
+  pb_journal_t *journal);              /* Journal */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_encoder_t
+pb_pool_acquire_encoder(
+  pb_pool_t *pool,                     /* Pool */
+  const pb_descriptor_t *descriptor);  /* Descriptor */
+
+PB_EXPORT void
+pb_pool_release_encoder(
+  pb_pool_t *pool,                     /* Pool */
+  pb_encoder_t *encoder);              /* Encoder */
+
+/* ----------------------------------------------------------------------------
+ * Inline functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve the internal error state of a pool.
+ *
+ * \param[in] pool Pool
+ * \return         Error code
+ */
+PB_INLINE pb_error_t
+pb_pool_error(const pb_pool_t *pool) {
+  assert(pool);
+  return pool->journal.data
+    ? PB_ERROR_NONE
+    : PB_ERROR_ALLOC;
+}
+
+/*!
+ * Test whether a pool is valid.
+ *
+ * \param[in] pool Pool
+ * \return         Test result
+ */
+PB_INLINE int
+pb_pool_valid(const pb_pool_t *pool) {
+  assert(pool);
+  return !pb_pool_error(pool);
+}
+
+#endif /* PB_INCLUDE_UTIL_POOL_H */
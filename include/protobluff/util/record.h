@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef PB_INCLUDE_UTIL_RECORD_H
+#define PB_INCLUDE_UTIL_RECORD_H
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <protobluff/core/buffer.h>
+#include <protobluff/core/common.h>
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef enum pb_record_sync_t {
+  PB_RECORD_SYNC_NONE,                 /*!< Leave syncing to the system */
+  PB_RECORD_SYNC_WRITE,                /*!< Sync after every write */
+  PB_RECORD_SYNC_CLOSE                 /*!< Sync when writer is destroyed */
+} pb_record_sync_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_record_reader_t {
+  pb_buffer_t buffer;                  /*!< Memory-mapped file */
+  size_t offset;                       /*!< Offset of next record */
+  size_t advised;                      /*!< Offset of readahead */
+} pb_record_reader_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_record_writer_t {
+  int fd;                              /*!< File descriptor */
+  pb_record_sync_t sync;               /*!< Sync policy */
+} pb_record_writer_t;
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_record_reader_t
+pb_record_reader_create(
+  const char path[]);                  /* Path */
+
+PB_EXPORT void
+pb_record_reader_destroy(
+  pb_record_reader_t *reader);         /* Record reader */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_record_reader_next(
+  pb_record_reader_t *reader,          /* Record reader */
+  pb_buffer_t *record);                /* Buffer receiving record */
+
+/* ------------------------------------------------------------------------- */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_record_writer_t
+pb_record_writer_create(
+  const char path[],                   /* Path */
+  pb_record_sync_t sync);              /* Sync policy */
+
+PB_EXPORT void
+pb_record_writer_destroy(
+  pb_record_writer_t *writer);         /* Record writer */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_record_writer_write(
+  pb_record_writer_t *writer,          /* Record writer */
+  const pb_buffer_t records[],         /* Records */
+  size_t size);                        /* Record count */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_record_writer_sync(
+  pb_record_writer_t *writer);         /* Record writer */
+
+/* ----------------------------------------------------------------------------
+ * Inline functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve the internal error state of a record reader.
+ *
+ * \param[in] reader Record reader
+ * \return           Error code
+ */
+PB_INLINE pb_error_t
+pb_record_reader_error(const pb_record_reader_t *reader) {
+  assert(reader);
+  return pb_buffer_error(&(reader->buffer));
+}
+
+/*!
+ * Test whether a record reader is valid.
+ *
+ * \param[in] reader Record reader
+ * \return           Test result
+ */
+PB_INLINE int
+pb_record_reader_valid(const pb_record_reader_t *reader) {
+  assert(reader);
+  return !pb_record_reader_error(reader);
+}
+
+/*!
+ * Retrieve the internal error state of a record writer.
+ *
+ * \param[in] writer Record writer
+ * \return           Error code
+ */
+PB_INLINE pb_error_t
+pb_record_writer_error(const pb_record_writer_t *writer) {
+  assert(writer);
+  return writer->fd >= 0
+    ? PB_ERROR_NONE
+    : PB_ERROR_IO;
+}
+
+/*!
+ * Test whether a record writer is valid.
+ *
+ * \param[in] writer Record writer
+ * \return           Test result
+ */
+PB_INLINE int
+pb_record_writer_valid(const pb_record_writer_t *writer) {
+  assert(writer);
+  return !pb_record_writer_error(writer);
+}
+
+#endif /* PB_INCLUDE_UTIL_RECORD_H */
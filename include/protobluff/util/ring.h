@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef PB_INCLUDE_UTIL_RING_H
+#define PB_INCLUDE_UTIL_RING_H
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <protobluff/core/buffer.h>
+#include <protobluff/core/common.h>
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_ring_t {
+  void *data;                          /*!< Shared memory mapping */
+  size_t size;                         /*!< Shared memory mapping size */
+} pb_ring_t;
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_ring_t
+pb_ring_create(
+  const char name[],                   /* Shared memory object name */
+  size_t slots,                        /* Slot count */
+  size_t size);                        /* Slot size */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_ring_t
+pb_ring_open(
+  const char name[]);                  /* Shared memory object name */
+
+PB_EXPORT void
+pb_ring_destroy(
+  pb_ring_t *ring);                    /* Ring */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_ring_push(
+  pb_ring_t *ring,                     /* Ring */
+  const pb_buffer_t *buffer);          /* Buffer */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_ring_peek(
+  pb_ring_t *ring,                     /* Ring */
+  pb_buffer_t *buffer);                /* Buffer */
+
+PB_EXPORT void
+pb_ring_pop(
+  pb_ring_t *ring);                    /* Ring */
+
+/* ----------------------------------------------------------------------------
+ * Inline functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve the internal error state of a ring.
+ *
+ * \param[in] ring Ring
+ * \return         Error code
+ */
+PB_INLINE pb_error_t
+pb_ring_error(const pb_ring_t *ring) {
+  assert(ring);
+  return ring->data
+    ? PB_ERROR_NONE
+    : PB_ERROR_IO;
+}
+
+/*!
+ * Test whether a ring is valid.
+ *
+ * \param[in] ring Ring
+ * \return         Test result
+ */
+PB_INLINE int
+pb_ring_valid(const pb_ring_t *ring) {
+  assert(ring);
+  return !pb_ring_error(ring);
+}
+
+#endif /* PB_INCLUDE_UTIL_RING_H */
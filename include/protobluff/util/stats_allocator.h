@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef PB_INCLUDE_UTIL_STATS_ALLOCATOR_H
+#define PB_INCLUDE_UTIL_STATS_ALLOCATOR_H
+
+#include <stddef.h>
+
+#include <protobluff/core/allocator.h>
+#include <protobluff/core/common.h>
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_allocator_stats_t {
+  size_t allocations;                  /*!< Calls to allocate */
+  size_t resizes;                      /*!< Calls to resize */
+  size_t frees;                        /*!< Calls to free */
+  size_t requested;                    /*!< Bytes requested */
+  size_t moved;                        /*!< Bytes moved by resizing */
+  size_t current;                      /*!< Bytes currently allocated */
+  size_t peak;                         /*!< Peak bytes allocated */
+} pb_allocator_stats_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_allocator_site_t {
+  const void *address;                 /*!< Call site address */
+  size_t count;                        /*!< Sampled calls */
+  size_t bytes;                        /*!< Sampled bytes requested */
+} pb_allocator_site_t;
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_allocator_t
+pb_stats_allocator_create(void);
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_allocator_t
+pb_stats_allocator_create_with_allocator(
+  pb_allocator_t *allocator);          /* Allocator */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_allocator_t
+pb_stats_allocator_create_with_sampling(
+  pb_allocator_t *allocator,           /* Allocator */
+  size_t period);                      /* Sampling period */
+
+PB_EXPORT void
+pb_stats_allocator_destroy(
+  pb_allocator_t *allocator);          /* Allocator */
+
+PB_EXPORT void
+pb_stats_allocator_query(
+  const pb_allocator_t *allocator,     /* Allocator */
+  pb_allocator_stats_t *stats);        /* Statistics */
+
+PB_EXPORT size_t
+pb_stats_allocator_sites(
+  const pb_allocator_t *allocator,     /* Allocator */
+  pb_allocator_site_t sites[],         /* Call sites */
+  size_t size);                        /* Call site count */
+
+PB_EXPORT void
+pb_stats_allocator_reset(
+  pb_allocator_t *allocator);          /* Allocator */
+
+#endif /* PB_INCLUDE_UTIL_STATS_ALLOCATOR_H */
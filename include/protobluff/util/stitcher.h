@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef PB_INCLUDE_UTIL_STITCHER_H
+#define PB_INCLUDE_UTIL_STITCHER_H
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <protobluff/core/buffer.h>
+#include <protobluff/core/chain.h>
+#include <protobluff/core/common.h>
+#include <protobluff/core/encoder.h>
+#include <protobluff/util/executor.h>
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_stitcher_t {
+  pb_executor_t *executor;             /*!< Executor */
+  struct {
+    pb_encoder_t *data;                /*!< Encoders, one per chunk */
+    size_t size;                       /*!< Chunk count */
+  } chunk;
+  struct {
+    pb_buffer_t *data;                 /*!< Segments */
+    size_t size;                       /*!< Segment count */
+  } segment;
+} pb_stitcher_t;
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_stitcher_t
+pb_stitcher_create(
+  pb_executor_t *executor);            /* Executor */
+
+PB_EXPORT void
+pb_stitcher_destroy(
+  pb_stitcher_t *stitcher);            /* Stitcher */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_stitcher_encode(
+  pb_stitcher_t *stitcher,             /* Stitcher */
+  const pb_encoder_t *encoder,         /* Encoder */
+  pb_tag_t tag,                        /* Tag */
+  const void *values,                  /* Pointer holding values */
+  size_t size);                        /* Value count */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_stitcher_stitch(
+  pb_stitcher_t *stitcher,             /* Stitcher */
+  pb_encoder_t *encoder);              /* Encoder */
+
+/* ----------------------------------------------------------------------------
+ * Inline functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve a chain of the encoded message without copying.
+ *
+ * The first segment refers to the data of the encoder at the time of
+ * encoding, the other segments to the encoded chunks, so the chain is only
+ * valid until the encoder or stitcher is altered.
+ *
+ * \param[in] stitcher Stitcher
+ * \return             Chain
+ */
+PB_INLINE pb_chain_t
+pb_stitcher_chain(const pb_stitcher_t *stitcher) {
+  assert(stitcher);
+  return pb_chain_create(stitcher->segment.data, stitcher->segment.size);
+}
+
+/*!
+ * Retrieve the internal error state of a stitcher.
+ *
+ * \param[in] stitcher Stitcher
+ * \return             Error code
+ */
+PB_INLINE pb_error_t
+pb_stitcher_error(const pb_stitcher_t *stitcher) {
+  assert(stitcher);
+  return stitcher->chunk.data
+    ? PB_ERROR_NONE
+    : PB_ERROR_ALLOC;
+}
+
+/*!
+ * Test whether a stitcher is valid.
+ *
+ * \param[in] stitcher Stitcher
+ * \return             Test result
+ */
+PB_INLINE int
+pb_stitcher_valid(const pb_stitcher_t *stitcher) {
+  assert(stitcher);
+  return !pb_stitcher_error(stitcher);
+}
+
+#endif /* PB_INCLUDE_UTIL_STITCHER_H */
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef PB_INCLUDE_UTIL_TRANSPOSER_H
+#define PB_INCLUDE_UTIL_TRANSPOSER_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <protobluff/core/allocator.h>
+#include <protobluff/core/buffer.h>
+#include <protobluff/core/common.h>
+#include <protobluff/core/descriptor.h>
+#include <protobluff/util/path.h>
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_transposer_column_t {
+  const pb_path_t *path;               /*!< Path */
+  pb_buffer_t values;                  /*!< Values */
+  pb_buffer_t offsets;                 /*!< Offsets of strings and bytes */
+  pb_buffer_t validity;                /*!< Validity bitmap */
+} pb_transposer_column_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_transposer_t {
+  pb_allocator_t *allocator;           /*!< Allocator */
+  const pb_descriptor_t *descriptor;   /*!< Descriptor */
+  struct {
+    pb_transposer_column_t *data;      /*!< Columns */
+    size_t size;                       /*!< Column count */
+  } column;
+  size_t size;                         /*!< Row count */
+  pb_error_t error;                    /*!< Error code */
+} pb_transposer_t;
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_transposer_t
+pb_transposer_create(
+  const pb_descriptor_t
+    *descriptor,                       /* Descriptor */
+  const pb_path_t paths[],             /* Paths */
+  size_t size);                        /* Path count */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_transposer_t
+pb_transposer_create_with_allocator(
+  pb_allocator_t *allocator,           /* Allocator */
+  const pb_descriptor_t
+    *descriptor,                       /* Descriptor */
+  const pb_path_t paths[],             /* Paths */
+  size_t size);                        /* Path count */
+
+PB_EXPORT void
+pb_transposer_destroy(
+  pb_transposer_t *transposer);        /* Transposer */
+
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_transposer_append(
+  pb_transposer_t *transposer,         /* Transposer */
+  const pb_buffer_t messages[],        /* Messages */
+  size_t size);                        /* Message count */
+
+PB_EXPORT void
+pb_transposer_reset(
+  pb_transposer_t *transposer);        /* Transposer */
+
+/* ----------------------------------------------------------------------------
+ * Inline functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve the descriptor of a transposer.
+ *
+ * \param[in] transposer Transposer
+ * \return               Descriptor
+ */
+PB_INLINE const pb_descriptor_t *
+pb_transposer_descriptor(const pb_transposer_t *transposer) {
+  assert(transposer);
+  return transposer->descriptor;
+}
+
+/*!
+ * Retrieve the number of rows of a transposer.
+ *
+ * \param[in] transposer Transposer
+ * \return               Row count
+ */
+PB_INLINE size_t
+pb_transposer_size(const pb_transposer_t *transposer) {
+  assert(transposer);
+  return transposer->size;
+}
+
+/*!
+ * Retrieve the values of a column.
+ *
+ * Values of fixed-size types are stored in an array with one element of the
+ * field's native type per row, which is zero for rows without a value. Values
+ * of strings and bytes are stored back to back, delimited by their offsets.
+ *
+ * \param[in] transposer Transposer
+ * \param[in] column     Column
+ * \return               Values
+ */
+PB_INLINE const void *
+pb_transposer_values(const pb_transposer_t *transposer, size_t column) {
+  assert(transposer && column < transposer->column.size);
+  return pb_buffer_data(&(transposer->column.data[column].values));
+}
+
+/*!
+ * Retrieve the offsets of a column of strings or bytes.
+ *
+ * The offsets hold one more element than there are rows, so the value of a
+ * row spans from its offset to the offset of the next row. For columns of
+ * fixed-size types, there are no offsets.
+ *
+ * \param[in] transposer Transposer
+ * \param[in] column     Column
+ * \return               Offsets
+ */
+PB_INLINE const uint32_t *
+pb_transposer_offsets(const pb_transposer_t *transposer, size_t column) {
+  assert(transposer && column < transposer->column.size);
+  return (const uint32_t *)pb_buffer_data(
+    &(transposer->column.data[column].offsets));
+}
+
+/*!
+ * Retrieve the validity bitmap of a column.
+ *
+ * The bitmap holds one bit per row in least-significant bit order, which is
+ * set if the row has a value.
+ *
+ * \param[in] transposer Transposer
+ * \param[in] column     Column
+ * \return               Validity bitmap
+ */
+PB_INLINE const uint8_t *
+pb_transposer_validity(const pb_transposer_t *transposer, size_t column) {
+  assert(transposer && column < transposer->column.size);
+  return pb_buffer_data(&(transposer->column.data[column].validity));
+}
+
+/*!
+ * Test whether a row of a column has a value.
+ *
+ * \param[in] transposer Transposer
+ * \param[in] column     Column
+ * \param[in] row        Row
+ * \return               Test result
+ */
+PB_INLINE int
+pb_transposer_present(
+    const pb_transposer_t *transposer, size_t column, size_t row) {
+  assert(transposer && row < transposer->size);
+  return (pb_transposer_validity(transposer, column)[row / 8] >> row % 8) & 1;
+}
+
+/*!
+ * Retrieve the internal error state of a transposer.
+ *
+ * \param[in] transposer Transposer
+ * \return               Error code
+ */
+PB_INLINE pb_error_t
+pb_transposer_error(const pb_transposer_t *transposer) {
+  assert(transposer);
+  return transposer->error;
+}
+
+/*!
+ * Test whether a transposer is valid.
+ *
+ * \param[in] transposer Transposer
+ * \return               Test result
+ */
+PB_INLINE int
+pb_transposer_valid(const pb_transposer_t *transposer) {
+  assert(transposer);
+  return !pb_transposer_error(transposer);
+}
+
+#endif /* PB_INCLUDE_UTIL_TRANSPOSER_H */
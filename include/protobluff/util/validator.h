@@ -26,6 +26,7 @@
 #include <assert.h>
 
 #include <protobluff/core/buffer.h>
+#include <protobluff/core/chain.h>
 #include <protobluff/core/common.h>
 #include <protobluff/core/descriptor.h>
 
@@ -47,6 +48,12 @@ pb_validator_check(
   const pb_validator_t *validator,     /* Validator */
   const pb_buffer_t *buffer);          /* Buffer */
 
+PB_EXPORT PB_WARN_UNUSED_RESULT
+pb_error_t
+pb_validator_check_chain(
+  const pb_validator_t *validator,     /* Validator */
+  const pb_chain_t *chain);            /* Chain */
+
 /* ----------------------------------------------------------------------------
  * Inline functions
  * ------------------------------------------------------------------------- */
@@ -20,15 +20,257 @@
  * IN THE SOFTWARE.
  */
 
+/* Enable mremap, if available */
+#ifndef _GNU_SOURCE
+  #define _GNU_SOURCE
+#endif
+
 #include <assert.h>
+#include <fcntl.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "core/allocator.h"
 #include "core/buffer.h"
 #include "core/common.h"
 
+/* ----------------------------------------------------------------------------
+ * Forward declarations
+ * ------------------------------------------------------------------------- */
+
+static void *
+mmap_allocate(
+  void *data,                          /* Internal allocator data */
+  size_t size);                        /* Bytes to be allocated */
+
+static void *
+mmap_resize(
+  void *data,                          /* Internal allocator data */
+  void *block,                         /* Memory block to be resized */
+  size_t size);                        /* Bytes to be allocated */
+
+static void
+mmap_free(
+  void *data,                          /* Internal allocator data */
+  void *block);                        /* Memory block to be freed */
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_mmap_t {
+  pb_allocator_t allocator;            /*!< Allocator */
+  pb_buffer_mode_t mode;               /*!< Mapping mode */
+  int fd;                              /*!< File descriptor */
+  uint8_t *data;                       /*!< Mapped memory */
+  size_t capacity;                     /*!< Mapped memory size */
+} pb_mmap_t;
+
+/* ----------------------------------------------------------------------------
+ * Internal functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Round a size up to the next multiple of the page size.
+ *
+ * \param[in] size Size
+ * \return         Rounded size
+ */
+static size_t
+page_align(size_t size) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  return (size + page - 1) / page * page;
+}
+
+/*!
+ * Grow the memory mapping of a file to a given capacity.
+ *
+ * The mapping may extend beyond the end of the file, which is fine as long as
+ * the surplus is never accessed, so the file is truncated separately. If the
+ * mapping cannot be moved in place, a new one is set up before the old one is
+ * removed, which is safe as both are backed by the same file.
+ *
+ * \warning The lines excluded from code coverage cannot be triggered within
+ * the tests, as we're not going to mock the operating system.
+ *
+ * \param[in,out] map      Memory mapping
+ * \param[in]     capacity Capacity
+ * \return                 Error code
+ */
+static pb_error_t
+map_grow(pb_mmap_t *map, size_t capacity) {
+  assert(map && capacity > map->capacity);
+#ifdef MREMAP_MAYMOVE
+  uint8_t *data = map->data
+    ? mremap(map->data, map->capacity, capacity, MREMAP_MAYMOVE)
+    : mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, map->fd, 0);
+#else
+  uint8_t *data =
+    mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, map->fd, 0);
+  if (data != MAP_FAILED && map->data)
+    munmap(map->data, map->capacity);
+#endif
+  if (unlikely_(data == MAP_FAILED))
+    return PB_ERROR_IO;                                    /* LCOV_EXCL_LINE */
+
+  /* Update mapping */
+  map->data     = data;
+  map->capacity = capacity;
+  return PB_ERROR_NONE;
+}
+
+/*!
+ * Create a buffer by memory-mapping an open file.
+ *
+ * The buffer takes ownership of the file descriptor, which is closed when
+ * the buffer is destroyed or if the file cannot be mapped.
+ *
+ * \warning The lines excluded from code coverage cannot be triggered within
+ * the tests, as we're not going to mock malloc and fstat.
+ *
+ * \param[in] fd   File descriptor
+ * \param[in] mode Mapping mode
+ * \return         Buffer
+ */
+static pb_buffer_t
+map_create(int fd, pb_buffer_mode_t mode) {
+  struct stat info;
+  if (unlikely_(fd < 0))
+    return pb_buffer_create_invalid();
+
+  /* Determine size of file */
+  pb_mmap_t *map = malloc(sizeof(pb_mmap_t));
+  if (unlikely_(!map || fstat(fd, &info))) {
+    close(fd);                                             /* LCOV_EXCL_LINE */
+    free(map);                                             /* LCOV_EXCL_LINE */
+    return pb_buffer_create_invalid();                     /* LCOV_EXCL_LINE */
+  }
+
+  /* Map file, unless it is empty */
+  size_t size = (size_t)info.st_size;
+  *map = (pb_mmap_t){
+    .allocator = {
+      .proc = {
+        .allocate = mmap_allocate,
+        .resize   = mmap_resize,
+        .free     = mmap_free
+      },
+      .data = map
+    },
+    .mode     = mode,
+    .fd       = fd,
+    .data     = NULL,
+    .capacity = 0
+  };
+  if (size) {
+    uint8_t *data = mode == PB_BUFFER_WRITE
+      ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,  fd, 0)
+      : mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (unlikely_(data == MAP_FAILED)) {
+      close(fd);                                           /* LCOV_EXCL_LINE */
+      free(map);                                           /* LCOV_EXCL_LINE */
+      return pb_buffer_create_invalid();                   /* LCOV_EXCL_LINE */
+    }
+
+    /* Hint that read-only data is most likely decoded front to back */
+#ifdef MADV_SEQUENTIAL
+    if (mode == PB_BUFFER_READ)
+      madvise(data, size, MADV_SEQUENTIAL);
+#endif
+    map->data     = data;
+    map->capacity = size;
+  }
+
+  /* Create buffer using the mapping as its only memory block */
+  pb_buffer_t buffer = {
+    .allocator = &(map->allocator),
+    .data      = map->data,
+    .size      = size,
+    .capacity  = size
+  };
+  return buffer;
+}
+
+/* ----------------------------------------------------------------------------
+ * Allocator callbacks
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Allocate a memory block of given size.
+ *
+ * A memory-mapped buffer never allocates new memory blocks, as its only memory
+ * block is the mapping, which is set up when the buffer is created.
+ *
+ * \param[in,out] data Internal allocator data
+ * \param[in]     size Bytes to be allocated
+ * \return             Memory block
+ */
+static void *
+mmap_allocate(void *data, size_t size) {
+  assert(data && size);
+  return NULL;
+}
+
+/*!
+ * Change the size of the memory mapping of a file.
+ *
+ * Private mappings cannot grow beyond the end of the file, so they can only
+ * shrink in place. Shared mappings grow by truncating the file to the new
+ * size, and remapping it if the mapping is exhausted. The capacity of the
+ * mapping is doubled every time, so remapping is amortized constant.
+ *
+ * \param[in,out] data  Internal allocator data
+ * \param[in,out] block Memory block to be resized
+ * \param[in]     size  Bytes to be allocated
+ * \return              Memory block
+ */
+static void *
+mmap_resize(void *data, void *block, size_t size) {
+  assert(data && size);
+  pb_mmap_t *map = data;
+  assert(!block || block == map->data);
+  if (map->mode == PB_BUFFER_READ)
+    return map->data && size <= map->capacity ? map->data : NULL;
+
+  /* Grow mapping, if necessary */
+  if (size > map->capacity) {
+    size_t capacity = page_align(size > map->capacity * 2
+      ? size : map->capacity * 2);
+    if (unlikely_(map_grow(map, capacity)))
+      return NULL;                                         /* LCOV_EXCL_LINE */
+  }
+
+  /* Truncate file to new size */
+  if (unlikely_(ftruncate(map->fd, (off_t)size)))
+    return NULL;                                           /* LCOV_EXCL_LINE */
+  return map->data;
+}
+
+/*!
+ * Free the memory mapping of a file.
+ *
+ * This is only called when a buffer is cleared completely, so a shared file
+ * is truncated to zero, but the mapping is retained until the buffer is
+ * destroyed, so it can be reused when the buffer grows again.
+ *
+ * \param[in,out] data  Internal allocator data
+ * \param[in,out] block Memory block to be freed
+ */
+static void
+mmap_free(void *data, void *block) {
+  assert(data && block);
+  pb_mmap_t *map = data;
+  assert(block == map->data);
+  if (map->mode == PB_BUFFER_WRITE) {
+    int error = ftruncate(map->fd, (off_t)0);
+    (void)error;                       /* Freeing cannot fail */
+  }
+}
+
 /* ----------------------------------------------------------------------------
  * Interface
  * ------------------------------------------------------------------------- */
@@ -65,7 +307,8 @@ pb_buffer_create_with_allocator(
     pb_buffer_t buffer = {
       .allocator = allocator,
       .data      = memcpy(copy, data, size),
-      .size      = size
+      .size      = size,
+      .capacity  = size
     };
     return buffer;
   }
@@ -97,7 +340,51 @@ pb_buffer_create_empty_with_allocator(pb_allocator_t *allocator) {
   pb_buffer_t buffer = {
     .allocator = allocator,
     .data      = NULL,
-    .size      = 0
+    .size      = 0,
+    .capacity  = 0
+  };
+  return buffer;
+}
+
+/*!
+ * Create an empty buffer backed by inline storage.
+ *
+ * \param[in,out] block[] Inline storage
+ * \param[in]     size    Inline storage size
+ * \return                Buffer
+ */
+extern pb_buffer_t
+pb_buffer_create_inline(uint8_t block[], size_t size) {
+  return pb_buffer_create_inline_with_allocator(
+    &allocator_default, block, size);
+}
+
+/*!
+ * Create an empty buffer backed by inline storage using a custom allocator.
+ *
+ * The buffer is filled in the given block of memory, which is usually located
+ * on the stack, so small messages never need to allocate. Once the data
+ * outgrows the block, it is transparently moved to memory obtained from the
+ * allocator and the block is not used anymore.
+ *
+ * \warning A buffer does not take ownership of the provided allocator or block
+ * of memory, so the caller must ensure that neither is freed during operations.
+ *
+ * \param[in,out] allocator Allocator
+ * \param[in,out] block[]   Inline storage
+ * \param[in]     size      Inline storage size
+ * \return                  Buffer
+ */
+extern pb_buffer_t
+pb_buffer_create_inline_with_allocator(
+    pb_allocator_t *allocator, uint8_t block[], size_t size) {
+  assert(allocator && block && size);
+  pb_buffer_t buffer = {
+    .allocator = allocator,
+    .data      = block,
+    .size      = 0,
+    .capacity  = size,
+    .storage   = block
   };
   return buffer;
 }
@@ -121,6 +408,76 @@ pb_buffer_create_zero_copy(uint8_t data[], size_t size) {
   return pb_buffer_create_zero_copy_internal(data, size);
 }
 
+/*!
+ * Create a buffer backed by a memory-mapped file.
+ *
+ * In read mode, the file is mapped privately, so the buffer is zero-copy and
+ * writes that don't change the size of the data operate on the mapping without
+ * altering the file. As with zero-copy buffers, the buffer cannot grow.
+ *
+ * In write mode, the file is created if it doesn't exist and mapped shared,
+ * so all changes are written through to the file, which is truncated to the
+ * size of the buffer whenever it grows or shrinks. This allows to alter very
+ * large messages in place, without reading them into memory first.
+ *
+ * \warning The file must not be truncated by another process while mapped,
+ * as accessing the mapping beyond the end of the file raises SIGBUS.
+ *
+ * \param[in] path[] File path
+ * \param[in] mode   Mapping mode
+ * \return           Buffer
+ */
+extern pb_buffer_t
+pb_buffer_create_mmap(const char path[], pb_buffer_mode_t mode) {
+  assert(path);
+  int fd = mode == PB_BUFFER_WRITE
+    ? open(path, O_RDWR | O_CREAT, 0666)
+    : open(path, O_RDONLY);
+  return map_create(fd, mode);
+}
+
+/*!
+ * Create a buffer backed by an open file.
+ *
+ * This function is only for internal use, e.g. for mapping anonymous scratch
+ * files which were created and unlinked by the caller. The buffer takes
+ * ownership of the file descriptor. See the documentation of
+ * pb_buffer_create_mmap() for the semantics of the mapping modes.
+ *
+ * \param[in] fd   File descriptor
+ * \param[in] mode Mapping mode
+ * \return         Buffer
+ */
+extern pb_buffer_t
+pb_buffer_create_mmap_fd(int fd, pb_buffer_mode_t mode) {
+  return map_create(fd, mode);
+}
+
+/*!
+ * Create a buffer backed by a shared memory object.
+ *
+ * Shared memory objects are memory-mapped like files (see the documentation
+ * of pb_buffer_create_mmap() for the semantics of the mapping modes), but live
+ * in memory only. A journal that is written by one process in write mode can
+ * thus be mapped by another process in read mode and decoded without copying,
+ * as journals and cursors address the underlying data solely by offsets.
+ *
+ * \warning Shared memory objects persist until they are removed explicitly
+ * with shm_unlink(), even if no process has them mapped anymore.
+ *
+ * \param[in] name[] Shared memory object name, e.g. "/message"
+ * \param[in] mode   Mapping mode
+ * \return           Buffer
+ */
+extern pb_buffer_t
+pb_buffer_create_shm(const char name[], pb_buffer_mode_t mode) {
+  assert(name);
+  int fd = mode == PB_BUFFER_WRITE
+    ? shm_open(name, O_RDWR | O_CREAT, 0600)
+    : shm_open(name, O_RDONLY, 0);
+  return map_create(fd, mode);
+}
+
 /*!
  * Destroy a buffer.
  *
@@ -129,15 +486,147 @@ pb_buffer_create_zero_copy(uint8_t data[], size_t size) {
 extern void
 pb_buffer_destroy(pb_buffer_t *buffer) {
   assert(buffer);
+
+  /* Unmap file and close it, retaining all changes */
   if (buffer->allocator &&
+      buffer->allocator->proc.free == mmap_free) {
+    pb_mmap_t *map = buffer->allocator->data;
+    if (map->data)
+      munmap(map->data, map->capacity);
+    close(map->fd);
+    free(map);
+
+    /* Clear buffer */
+    buffer->allocator = NULL;
+    buffer->data      = NULL;
+    buffer->size      = 0;
+    buffer->capacity  = 0;
+  } else if (buffer->allocator &&
       buffer->allocator != &allocator_zero_copy) {
     if (buffer->data) {
-      pb_allocator_free(buffer->allocator, buffer->data);
-      buffer->data = NULL;
-      buffer->size = 0;
+      if (buffer->data != buffer->storage)
+        pb_allocator_free(buffer->allocator, buffer->data);
+      buffer->data     = NULL;
+      buffer->size     = 0;
+      buffer->capacity = 0;
     }
     buffer->allocator = NULL;
+    buffer->storage   = NULL;
+  }
+}
+
+/*!
+ * Reset a buffer, retaining its capacity.
+ *
+ * The buffer is emptied, but the allocated memory is kept, so the buffer can
+ * be filled again without allocating as long as its capacity suffices. This
+ * allows to reuse buffers across requests without any allocations. A buffer
+ * backed by a writable memory-mapped file is truncated instead.
+ *
+ * \param[in,out] buffer Buffer
+ */
+extern void
+pb_buffer_reset(pb_buffer_t *buffer) {
+  assert(buffer);
+  if (buffer->allocator &&
+      buffer->allocator->proc.free == mmap_free) {
+    if (buffer->data)
+      pb_allocator_free(buffer->allocator, buffer->data);
+    buffer->data     = NULL;
+    buffer->capacity = 0;
+  }
+  buffer->size = 0;
+}
+
+/*!
+ * Flush the changes of a buffer backed by a memory-mapped file to disk.
+ *
+ * For all other buffers, this is a no-op, as there's nothing to flush.
+ *
+ * \param[in,out] buffer Buffer
+ * \return               Error code
+ */
+extern pb_error_t
+pb_buffer_sync(pb_buffer_t *buffer) {
+  assert(buffer);
+  if (unlikely_(!pb_buffer_valid(buffer)))
+    return PB_ERROR_INVALID;
+
+  /* Synchronously write back pages of shared mapping */
+  if (buffer->allocator->proc.free == mmap_free) {
+    pb_mmap_t *map = buffer->allocator->data;
+    if (map->mode == PB_BUFFER_WRITE && map->data && buffer->size)
+      if (unlikely_(msync(map->data, buffer->size, MS_SYNC)))
+        return PB_ERROR_IO;                                /* LCOV_EXCL_LINE */
   }
+  return PB_ERROR_NONE;
+}
+
+/*!
+ * Resize the raw data of a buffer.
+ *
+ * As long as a buffer is backed by inline storage, the storage is used for as
+ * much data as it can hold. When the data outgrows it, the data is moved to
+ * memory obtained from the allocator. If allocation fails, the buffer is not
+ * altered, so shrinking may be attempted without checking the result.
+ *
+ * \param[in,out] buffer Buffer
+ * \param[in]     size   Raw data size
+ * \return               Error code
+ */
+extern pb_error_t
+pb_buffer_resize(pb_buffer_t *buffer, size_t size) {
+  assert(buffer && size);
+  assert(pb_buffer_valid(buffer));
+  uint8_t *data = NULL;
+
+  /* Keep data in inline storage or move it to allocated memory */
+  if (buffer->storage && buffer->data == buffer->storage) {
+    if (size <= buffer->capacity)
+      return PB_ERROR_NONE;
+    if (unlikely_(!(data = pb_allocator_allocate(buffer->allocator, size))))
+      return PB_ERROR_ALLOC;
+    memcpy(data, buffer->data, buffer->size);
+
+  /* Otherwise resize allocated memory */
+  } else if (unlikely_(!(data = pb_allocator_resize(buffer->allocator,
+      buffer->data, size)))) {
+    return PB_ERROR_ALLOC;
+  }
+
+  /* Update buffer */
+  buffer->data     = data;
+  buffer->capacity = size;
+  return PB_ERROR_NONE;
+}
+
+/*!
+ * Reserve capacity for additional raw data of a buffer.
+ *
+ * The capacity is at least doubled whenever the buffer needs to be resized,
+ * so appending data piece by piece takes amortized constant time. Growing the
+ * buffer within the reserved capacity cannot fail.
+ *
+ * \param[in,out] buffer Buffer
+ * \param[in]     size   Additional size
+ * \return               Error code
+ */
+extern pb_error_t
+pb_buffer_reserve(pb_buffer_t *buffer, size_t size) {
+  assert(buffer);
+  if (unlikely_(!pb_buffer_valid(buffer)))
+    return PB_ERROR_INVALID;
+  size_t capacity = pb_buffer_capacity(buffer);
+  if (pb_buffer_size(buffer) + size <= capacity)
+    return PB_ERROR_NONE;
+
+  /* Double capacity, unless more space is requested */
+  if (capacity * 2 < pb_buffer_size(buffer) + size) {
+    capacity = pb_buffer_size(buffer) + size;
+  } else {
+    capacity *= 2;
+  }
+  return pb_buffer_resize(buffer, capacity);
 }
 
 /*!
@@ -157,11 +646,14 @@ pb_buffer_grow(pb_buffer_t *buffer, size_t size) {
     if (unlikely_(buffer->allocator == &allocator_zero_copy))
       return NULL;
 
+    /* Grow buffer within capacity, if possible */
+    if (buffer->size + size <= buffer->capacity) {
+      buffer->size += size;
+      return &(buffer->data[buffer->size - size]);
+    }
+
     /* Grow buffer and adjust size */
-    uint8_t *data = pb_allocator_resize(buffer->allocator,
-      buffer->data, buffer->size + size);
-    if (data) {
-      buffer->data  = data;
+    if (likely_(!pb_buffer_resize(buffer, buffer->size + size))) {
       buffer->size += size;
 
       /* Return reserved space */
@@ -36,6 +36,23 @@
  * Interface
  * ------------------------------------------------------------------------- */
 
+PB_WARN_UNUSED_RESULT
+extern pb_buffer_t
+pb_buffer_create_mmap_fd(
+  int fd,                              /* File descriptor */
+  pb_buffer_mode_t mode);              /* Mapping mode */
+
+extern pb_error_t
+pb_buffer_resize(
+  pb_buffer_t *buffer,                 /* Buffer */
+  size_t size);                        /* Raw data size */
+
+PB_WARN_UNUSED_RESULT
+extern pb_error_t
+pb_buffer_reserve(
+  pb_buffer_t *buffer,                 /* Buffer */
+  size_t size);                        /* Additional size */
+
 PB_WARN_UNUSED_RESULT
 extern uint8_t *
 pb_buffer_grow(
@@ -62,7 +79,8 @@ pb_buffer_create_zero_copy_internal(uint8_t data[], size_t size) {
   pb_buffer_t buffer = {
     .allocator = &allocator_zero_copy,
     .data      = data,
-    .size      = size
+    .size      = size,
+    .capacity  = size
   };
   return buffer;
 }
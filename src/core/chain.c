@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "core/buffer.h"
+#include "core/chain.h"
+#include "core/common.h"
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create a chain of buffers.
+ *
+ * A chain represents a message which is split into several segments, e.g. a
+ * sequence of receive buffers handed over by the network layer, so it can be
+ * decoded without copying all segments into a single contiguous buffer.
+ *
+ * \warning A chain does not take ownership of the provided segments, so the
+ * caller must ensure that the segments are not freed during operations.
+ *
+ * \param[in] segments[] Segments
+ * \param[in] size       Segment count
+ * \return               Chain
+ */
+extern pb_chain_t
+pb_chain_create(const pb_buffer_t segments[], size_t size) {
+  assert(segments || !size);
+  pb_chain_t chain = {
+    .segments = segments,
+    .size     = size
+  };
+  return chain;
+}
+
+/*!
+ * Destroy a chain.
+ *
+ * \param[in,out] chain Chain
+ */
+extern void
+pb_chain_destroy(pb_chain_t *chain) {
+  assert(chain); /* Nothing to be done */
+}
+
+/*!
+ * Retrieve the total length of all segments of a chain.
+ *
+ * \param[in] chain Chain
+ * \return          Length
+ */
+extern size_t
+pb_chain_length(const pb_chain_t *chain) {
+  assert(chain);
+  size_t length = 0;
+  for (size_t s = 0; s < chain->size; s++)
+    length += pb_buffer_size(&(chain->segments[s]));
+  return length;
+}
+
+/*!
+ * Retrieve the internal error state of a chain.
+ *
+ * A chain is only valid if all of its segments are valid.
+ *
+ * \param[in] chain Chain
+ * \return          Error code
+ */
+extern pb_error_t
+pb_chain_error(const pb_chain_t *chain) {
+  assert(chain);
+  pb_error_t error = PB_ERROR_NONE;
+  for (size_t s = 0; !error && s < chain->size; s++)
+    error = pb_buffer_error(&(chain->segments[s]));
+  return error;
+}
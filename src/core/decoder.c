@@ -27,9 +27,11 @@
 #include <string.h>
 
 #include "core/buffer.h"
+#include "core/chain.h"
 #include "core/common.h"
 #include "core/decoder.h"
 #include "core/descriptor.h"
+#include "core/parser.h"
 #include "core/stream.h"
 
 /* ----------------------------------------------------------------------------
@@ -152,3 +154,45 @@ pb_decoder_decode(
   pb_stream_destroy(&stream);
   return error;
 }
+
+/*!
+ * Decode a chain of buffers using a handler.
+ *
+ * The segments are fed to a parser one after another, so tags and values are
+ * read directly from the segments, and strings and bytes are passed without
+ * copying, unless they cross a segment boundary. Nested messages are never
+ * copied, as the parser descends into them, so the handler is invoked as with
+ * pb_parser_feed(), reporting their fields between the events of entering and
+ * leaving them.
+ *
+ * \param[in]     descriptor Descriptor
+ * \param[in]     chain      Chain
+ * \param[in]     handler    Handler
+ * \param[in,out] user       User data
+ * \return                   Error code
+ */
+extern pb_error_t
+pb_decoder_decode_chain(
+    const pb_descriptor_t *descriptor, const pb_chain_t *chain,
+    pb_decoder_handler_f handler, void *user) {
+  assert(descriptor && chain && handler);
+  if (unlikely_(!pb_chain_valid(chain)))
+    return PB_ERROR_INVALID;
+  pb_error_t error = PB_ERROR_NONE;
+
+  /* Feed segments to parser */
+  pb_parser_t parser = pb_parser_create(descriptor);
+  for (size_t s = 0; s < pb_chain_size(chain); s++) {
+    const pb_buffer_t *segment = pb_chain_segment(chain, s);
+    error = pb_parser_feed(&parser, pb_buffer_data(segment),
+      pb_buffer_size(segment), handler, user);
+    if (error && error != PB_ERROR_PARTIAL)
+      break;
+  }
+  pb_parser_destroy(&parser);
+
+  /* If the chain ended within a field, it was truncated */
+  return error == PB_ERROR_PARTIAL
+    ? PB_ERROR_OFFSET
+    : error;
+}
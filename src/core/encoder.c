@@ -322,6 +322,51 @@ pb_encoder_create_with_allocator(
   return encoder;
 }
 
+/*!
+ * Create an encoder backed by inline storage.
+ *
+ * \param[in]     descriptor Descriptor
+ * \param[in,out] block[]    Inline storage
+ * \param[in]     size       Inline storage size
+ * \return                   Encoder
+ */
+extern pb_encoder_t
+pb_encoder_create_inline(
+    const pb_descriptor_t *descriptor, uint8_t block[], size_t size) {
+  return pb_encoder_create_inline_with_allocator(
+    &allocator_default, descriptor, block, size);
+}
+
+/*!
+ * Create an encoder backed by inline storage using a custom allocator.
+ *
+ * Values are encoded into the given block of memory until it is exhausted, at
+ * which point the encoded data is transparently moved to memory obtained from
+ * the allocator.
+ *
+ * \warning An encoder does not take ownership of the provided allocator or
+ * block of memory, so the caller must ensure that neither is freed during
+ * operations.
+ *
+ * \param[in,out] allocator  Allocator
+ * \param[in]     descriptor Descriptor
+ * \param[in,out] block[]    Inline storage
+ * \param[in]     size       Inline storage size
+ * \return                   Encoder
+ */
+extern pb_encoder_t
+pb_encoder_create_inline_with_allocator(
+    pb_allocator_t *allocator, const pb_descriptor_t *descriptor,
+    uint8_t block[], size_t size) {
+  assert(allocator && descriptor && block && size);
+  pb_encoder_t encoder = {
+    .descriptor = descriptor,
+    .buffer     = pb_buffer_create_inline_with_allocator(
+      allocator, block, size)
+  };
+  return encoder;
+}
+
 /*!
  * Destroy an encoder.
  *
@@ -334,6 +379,22 @@ pb_encoder_destroy(pb_encoder_t *encoder) {
     pb_buffer_destroy(&(encoder->buffer));
 }
 
+/*!
+ * Reset an encoder, retaining the capacity of its buffer.
+ *
+ * The encoded data is discarded, but the allocated memory is kept, so the
+ * encoder can be reused for the next message without allocating as long as
+ * its capacity suffices.
+ *
+ * \param[in,out] encoder Encoder
+ */
+extern void
+pb_encoder_reset(pb_encoder_t *encoder) {
+  assert(encoder);
+  if (pb_encoder_valid(encoder))
+    pb_buffer_reset(&(encoder->buffer));
+}
+
 /*!
  * Encode a value or set of values.
  *
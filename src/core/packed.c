@@ -0,0 +1,427 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+
+#include "core/common.h"
+#include "core/packed.h"
+#include "core/varint.h"
+
+/* ----------------------------------------------------------------------------
+ * Constants
+ * ------------------------------------------------------------------------- */
+
+/*! Number of variable-sized integers decoded at once */
+#define BLOCK_SIZE 64
+
+/*! Sign bit of a 64-bit integer */
+#define SIGN_64 0x8000000000000000ULL
+
+/* ----------------------------------------------------------------------------
+ * Internal functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Map the raw bits of a fixed-size 32-bit value to an ordered key.
+ *
+ * Keys compare as signed integers in the same order as the original values,
+ * so ranges of unsigned integers, signed integers and floats can be checked
+ * with the same signed comparison.
+ *
+ * \param[in] type Type
+ * \param[in] bits Raw bits
+ * \return         Ordered key
+ */
+static int32_t
+key_32(pb_type_t type, uint32_t bits) {
+  switch (type) {
+    case PB_TYPE_FIXED32:
+      return (int32_t)(bits ^ 0x80000000U);
+    case PB_TYPE_FLOAT:
+      return (int32_t)(bits ^ ((uint32_t)((int32_t)bits >> 31) >> 1));
+    default:
+      return (int32_t)bits;
+  }
+}
+
+/*!
+ * Map the raw bits of a fixed-size 64-bit value to an ordered key.
+ *
+ * \param[in] type Type
+ * \param[in] bits Raw bits
+ * \return         Ordered key
+ */
+static int64_t
+key_64(pb_type_t type, uint64_t bits) {
+  switch (type) {
+    case PB_TYPE_FIXED64:
+      return (int64_t)(bits ^ SIGN_64);
+    case PB_TYPE_DOUBLE:
+      return (int64_t)(bits ^ ((uint64_t)((int64_t)bits >> 63) >> 1));
+    default:
+      return (int64_t)bits;
+  }
+}
+
+/*!
+ * Map the raw value of a variable-sized integer to an ordered key.
+ *
+ * Keys compare as unsigned integers in the same order as the decoded values,
+ * which takes truncation, sign-extension and zig-zag encoding into account.
+ *
+ * \param[in] type Type
+ * \param[in] raw  Raw value
+ * \return         Ordered key
+ */
+static uint64_t
+key_varint(pb_type_t type, uint64_t raw) {
+  switch (type) {
+    case PB_TYPE_INT32:
+    case PB_TYPE_ENUM:
+      return (uint64_t)(int64_t)(int32_t)raw ^ SIGN_64;
+    case PB_TYPE_INT64:
+      return raw ^ SIGN_64;
+    case PB_TYPE_UINT32:
+      return (uint32_t)raw;
+    case PB_TYPE_SINT32:
+      return (uint64_t)(int64_t)(int32_t)(((uint32_t)raw >> 1) ^
+        -((uint32_t)raw & 1)) ^ SIGN_64;
+    case PB_TYPE_SINT64:
+      return ((raw >> 1) ^ -(raw & 1)) ^ SIGN_64;
+    case PB_TYPE_BOOL:
+      return (uint8_t)raw;
+    default:
+      return raw;
+  }
+}
+
+/*!
+ * Map a native value of a variable-sized integer type to an ordered key.
+ *
+ * \param[in] type  Type
+ * \param[in] value Pointer holding value
+ * \return          Ordered key
+ */
+static uint64_t
+key_native(pb_type_t type, const void *value) {
+  switch (type) {
+    case PB_TYPE_INT32:
+    case PB_TYPE_SINT32:
+    case PB_TYPE_ENUM:
+      return (uint64_t)(int64_t)*(const int32_t *)value ^ SIGN_64;
+    case PB_TYPE_INT64:
+    case PB_TYPE_SINT64:
+      return (uint64_t)*(const int64_t *)value ^ SIGN_64;
+    case PB_TYPE_UINT32:
+      return *(const uint32_t *)value;
+    case PB_TYPE_BOOL:
+      return *(const uint8_t *)value;
+    default:
+      return *(const uint64_t *)value;
+  }
+}
+
+/*!
+ * Find the first fixed-size 32-bit value within a range.
+ *
+ * If both bounds point to the same value, values are compared bitwise, which
+ * is the same comparison that is used for matching single values.
+ *
+ * \param[in]  type   Type
+ * \param[in]  data[] Source buffer
+ * \param[in]  size   Value count
+ * \param[in]  min    Pointer holding lower bound
+ * \param[in]  max    Pointer holding upper bound
+ * \return            Index of value or value count
+ */
+static size_t
+find_32(
+    pb_type_t type, const uint8_t data[], size_t size,
+    const void *min, const void *max) {
+  assert(data && min && max);
+  size_t v = 0;
+
+  /* Compare values bitwise */
+  if (min == max) {
+    uint32_t value; memcpy(&value, min, sizeof(uint32_t));
+
+#ifdef __SSE2__
+
+    /* Compare blocks of four values at once */
+    __m128i needle = _mm_set1_epi32((int32_t)value);
+    for (; v + 4 <= size; v += 4) {
+      __m128i temp = _mm_loadu_si128((const __m128i *)&(data[v << 2]));
+      int mask = _mm_movemask_epi8(_mm_cmpeq_epi32(temp, needle));
+      if (mask)
+        return v + (__builtin_ctz(mask) >> 2);
+    }
+
+#endif /* __SSE2__ */
+
+    /* Compare remaining values */
+    for (; v < size; ++v) {
+      uint32_t temp; memcpy(&temp, &(data[v << 2]), sizeof(uint32_t));
+      if (temp == value)
+        return v;
+    }
+
+  /* Compare values by order */
+  } else {
+    uint32_t bits[2];
+    memcpy(&(bits[0]), min, sizeof(uint32_t));
+    memcpy(&(bits[1]), max, sizeof(uint32_t));
+    int32_t lower = key_32(type, bits[0]),
+            upper = key_32(type, bits[1]);
+
+#ifdef __SSE2__
+
+    /* Prepare masks to map raw bits to ordered keys */
+    __m128i lo = _mm_set1_epi32(lower),
+            hi = _mm_set1_epi32(upper),
+            fm = _mm_set1_epi32(type == PB_TYPE_FLOAT   ? 0x7FFFFFFF : 0),
+            um = _mm_set1_epi32(type == PB_TYPE_FIXED32 ? INT32_MIN  : 0);
+
+    /* Compare blocks of four values at once */
+    for (; v + 4 <= size; v += 4) {
+      __m128i temp = _mm_loadu_si128((const __m128i *)&(data[v << 2]));
+      temp = _mm_xor_si128(temp,
+        _mm_and_si128(_mm_srai_epi32(temp, 31), fm));
+      temp = _mm_xor_si128(temp, um);
+      int mask = _mm_movemask_epi8(_mm_or_si128(
+        _mm_cmpgt_epi32(lo, temp), _mm_cmpgt_epi32(temp, hi))) ^ 0xFFFF;
+      if (mask)
+        return v + (__builtin_ctz(mask) >> 2);
+    }
+
+#endif /* __SSE2__ */
+
+    /* Compare remaining values */
+    for (; v < size; ++v) {
+      uint32_t temp; memcpy(&temp, &(data[v << 2]), sizeof(uint32_t));
+      int32_t key = key_32(type, temp);
+      if (key >= lower && key <= upper)
+        return v;
+    }
+  }
+  return size;
+}
+
+/*!
+ * Find the first fixed-size 64-bit value within a range.
+ *
+ * \param[in]  type   Type
+ * \param[in]  data[] Source buffer
+ * \param[in]  size   Value count
+ * \param[in]  min    Pointer holding lower bound
+ * \param[in]  max    Pointer holding upper bound
+ * \return            Index of value or value count
+ */
+static size_t
+find_64(
+    pb_type_t type, const uint8_t data[], size_t size,
+    const void *min, const void *max) {
+  assert(data && min && max);
+  size_t v = 0;
+
+  /* Compare values bitwise */
+  if (min == max) {
+    uint64_t value; memcpy(&value, min, sizeof(uint64_t));
+
+#ifdef __SSE2__
+
+    /* Compare blocks of two values at once, halves must both match */
+    __m128i needle = _mm_set1_epi64x((int64_t)value);
+    for (; v + 2 <= size; v += 2) {
+      __m128i temp = _mm_loadu_si128((const __m128i *)&(data[v << 3]));
+      int mask = _mm_movemask_epi8(_mm_cmpeq_epi32(temp, needle));
+      if ((mask & 0x00FF) == 0x00FF)
+        return v;
+      if ((mask & 0xFF00) == 0xFF00)
+        return v + 1;
+    }
+
+#endif /* __SSE2__ */
+
+    /* Compare remaining values */
+    for (; v < size; ++v) {
+      uint64_t temp; memcpy(&temp, &(data[v << 3]), sizeof(uint64_t));
+      if (temp == value)
+        return v;
+    }
+
+  /* Compare values by order, in blocks to allow for auto-vectorization */
+  } else {
+    uint64_t bits[2];
+    memcpy(&(bits[0]), min, sizeof(uint64_t));
+    memcpy(&(bits[1]), max, sizeof(uint64_t));
+    int64_t lower = key_64(type, bits[0]),
+            upper = key_64(type, bits[1]);
+    for (; v < size; v += BLOCK_SIZE) {
+      size_t n = size - v < BLOCK_SIZE ? size - v : BLOCK_SIZE;
+      uint64_t mask = 0;
+      for (size_t b = 0; b < n; ++b) {
+        uint64_t temp; memcpy(&temp, &(data[(v + b) << 3]), sizeof(uint64_t));
+        int64_t key = key_64(type, temp);
+        mask |= (uint64_t)(key >= lower && key <= upper) << b;
+      }
+      if (mask)
+        return v + __builtin_ctzll(mask);
+    }
+  }
+  return size;
+}
+
+/*!
+ * Find the first variable-sized integer within a range.
+ *
+ * Values are decoded in blocks and compared afterwards, so the comparison
+ * does not interfere with decoding.
+ *
+ * \param[in]  type   Type
+ * \param[in]  data[] Source buffer
+ * \param[in]  size   Source buffer size
+ * \param[in]  min    Pointer holding lower bound
+ * \param[in]  max    Pointer holding upper bound
+ * \param[out] offset Pointer receiving offset
+ * \param[out] skip   Pointer receiving value count
+ * \return            Test result
+ */
+static int
+find_varint(
+    pb_type_t type, const uint8_t data[], size_t size,
+    const void *min, const void *max, size_t *offset, size_t *skip) {
+  assert(data && min && max && offset && skip);
+  uint64_t lower = key_native(type, min),
+           upper = key_native(type, max);
+
+  /* Decode and compare blocks of values */
+  size_t start[BLOCK_SIZE], o = 0, v = 0;
+  uint64_t key[BLOCK_SIZE];
+  while (o < size) {
+    size_t n = 0;
+    while (n < BLOCK_SIZE && o < size) {
+      uint64_t raw; size_t length = 1;
+      if (likely_(data[o] < 0x80)) {
+        raw = data[o];
+      } else if (!(length = pb_varint_unpack_uint64(
+          &(data[o]), size - o, &raw))) {
+        break;
+      }
+      start[n] = o;
+      key[n++] = key_varint(type, raw);
+      o += length;
+    }
+
+    /* Compare decoded block of values */
+    uint64_t mask = 0;
+    for (size_t b = 0; b < n; ++b)
+      mask |= (uint64_t)(key[b] >= lower && key[b] <= upper) << b;
+    if (mask) {
+      size_t b = __builtin_ctzll(mask);
+      *offset = start[b];
+      *skip   = v + b;
+      return 1;
+    }
+
+    /* Stop at invalid variable-sized integer */
+    v += n;
+    if (n < BLOCK_SIZE && o < size)
+      break;
+  }
+
+  /* Return offset after last valid value */
+  *offset = o;
+  *skip   = v;
+  return 0;
+}
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Find the first value of a packed field within a range.
+ *
+ * Packed fixed-size values are scanned in blocks using SIMD instructions, if
+ * available, while variable-sized integers are decoded and compared in
+ * blocks. The bounds are inclusive and must point to values of the native
+ * type. If both bounds point to the same value, the value is searched for.
+ *
+ * If a value is found, the offset receives its start, and the value count the
+ * number of values preceding it. Otherwise, the offset receives the end of
+ * the last valid value, and the value count the number of valid values.
+ *
+ * \warning Only types that can be packed are supported, so the caller must
+ * ensure that the wiretype of the type is not length-prefixed.
+ *
+ * \param[in]  type   Type
+ * \param[in]  data[] Source buffer
+ * \param[in]  size   Source buffer size
+ * \param[in]  min    Pointer holding lower bound
+ * \param[in]  max    Pointer holding upper bound
+ * \param[out] offset Pointer receiving offset
+ * \param[out] skip   Pointer receiving value count
+ * \return            Test result
+ */
+extern int
+pb_packed_find(
+    pb_type_t type, const uint8_t data[], size_t size,
+    const void *min, const void *max, size_t *offset, size_t *skip) {
+  assert(data && min && max && offset && skip);
+  size_t count, found;
+  switch (type) {
+
+    /* Fixed-size 32-bit values */
+    case PB_TYPE_FIXED32:
+    case PB_TYPE_SFIXED32:
+    case PB_TYPE_FLOAT:
+      count = size >> 2;
+      found = find_32(type, data, count, min, max);
+      *offset = found << 2;
+      *skip   = found;
+      return found < count;
+
+    /* Fixed-size 64-bit values */
+    case PB_TYPE_FIXED64:
+    case PB_TYPE_SFIXED64:
+    case PB_TYPE_DOUBLE:
+      count = size >> 3;
+      found = find_64(type, data, count, min, max);
+      *offset = found << 3;
+      *skip   = found;
+      return found < count;
+
+    /* Variable-sized integers */
+    default:
+      assert(type != PB_TYPE_STRING &&
+             type != PB_TYPE_BYTES  &&
+             type != PB_TYPE_MESSAGE);
+      return find_varint(type, data, size, min, max, offset, skip);
+  }
+}
@@ -0,0 +1,598 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <alloca.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/allocator.h"
+#include "core/buffer.h"
+#include "core/common.h"
+#include "core/decoder.h"
+#include "core/descriptor.h"
+#include "core/parser.h"
+#include "core/stream.h"
+
+/* ----------------------------------------------------------------------------
+ * Constants
+ * ------------------------------------------------------------------------- */
+
+/* Maximum nesting depth of messages */
+#define DEPTH 100
+
+/* ----------------------------------------------------------------------------
+ * Internal functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve the frame of the innermost nested message, if any.
+ *
+ * \param[in] parser Parser
+ * \return           Frame
+ */
+static pb_parser_frame_t *
+frame(pb_parser_t *parser) {
+  assert(parser);
+  return pb_parser_depth(parser)
+    ? (pb_parser_frame_t *)pb_buffer_data_from(&(parser->frames),
+        pb_buffer_size(&(parser->frames)) - sizeof(pb_parser_frame_t))
+    : NULL;
+}
+
+/*!
+ * Retrieve the descriptor of the innermost message.
+ *
+ * \param[in] parser Parser
+ * \return           Descriptor
+ */
+static const pb_descriptor_t *
+descriptor(pb_parser_t *parser) {
+  assert(parser);
+  const pb_parser_frame_t *current = frame(parser);
+  return current
+    ? pb_field_descriptor_nested(current->field)
+    : parser->descriptor;
+}
+
+/*!
+ * Gather the bytes of a non-prefixed value from a fragment.
+ *
+ * If the value is contained in the fragment, it is read directly from there.
+ * Otherwise, the bytes are accumulated inside the parser, so values spanning
+ * fragments can be read once they are complete. The length of a variable-sized
+ * integer is determined by its terminating byte, fixed-sized values by the
+ * wiretype.
+ *
+ * \param[in,out] parser   Parser
+ * \param[in]     wiretype Wiretype
+ * \param[in,out] data     Pointer to fragment position
+ * \param[in]     end      Fragment end
+ * \param[out]    raw      Pointer receiving raw value
+ * \return                 Error code
+ */
+static pb_error_t
+gather(
+    pb_parser_t *parser, pb_wiretype_t wiretype,
+    const uint8_t **data, const uint8_t *end, const uint8_t **raw) {
+  assert(parser && data && *data < end && raw);
+  size_t left = end - *data;
+
+  /* Read value from fragment, if it's contained in it */
+  if (likely_(!parser->size)) {
+    size_t size = 0;
+    if (wiretype == PB_WIRETYPE_VARINT) {
+      while (size < left && (*data)[size] & 0x80)
+        if (unlikely_(++size == sizeof(parser->bytes)))
+          return PB_ERROR_VARINT;
+      size++;                          /* Terminating byte */
+    } else {
+      size = wiretype == PB_WIRETYPE_64BIT ? 8 : 4;
+    }
+    if (likely_(size <= left)) {
+      *raw          = *data;
+      *data        += size;
+      parser->size  = size;
+      return PB_ERROR_NONE;
+    }
+  }
+
+  /* Otherwise accumulate bytes of variable-sized integer */
+  *raw = parser->bytes;
+  if (wiretype == PB_WIRETYPE_VARINT) {
+    while (*data < end) {
+      uint8_t byte = *(*data)++;
+      parser->bytes[parser->size++] = byte;
+      if (!(byte & 0x80))
+        return PB_ERROR_NONE;
+      if (unlikely_(parser->size == sizeof(parser->bytes)))
+        return PB_ERROR_VARINT;
+    }
+
+  /* Fixed-sized values */
+  } else {
+    size_t length = wiretype == PB_WIRETYPE_64BIT ? 8 : 4,
+           chunk  = length - parser->size;
+    if (chunk > left)
+      chunk = left;
+    memcpy(&(parser->bytes[parser->size]), *data, chunk);
+    parser->size += chunk;
+    *data        += chunk;
+    if (parser->size == length)
+      return PB_ERROR_NONE;
+  }
+  return PB_ERROR_PARTIAL;
+}
+
+/*!
+ * Read a gathered value of given type and discard the gathered bytes.
+ *
+ * \param[in,out] parser Parser
+ * \param[in]     raw[]  Raw value
+ * \param[in]     type   Type
+ * \param[out]    value  Pointer receiving value
+ * \return               Error code
+ */
+static pb_error_t
+read_value(
+    pb_parser_t *parser, const uint8_t raw[], pb_type_t type, void *value) {
+  assert(parser && raw && value);
+  pb_buffer_t buffer = pb_buffer_create_zero_copy_internal(
+    (uint8_t *)raw, parser->size);
+
+  /* Read value and ensure that all bytes were consumed */
+  pb_stream_t stream = pb_stream_create(&buffer);
+  pb_error_t error = pb_stream_read(&stream, type, value);
+  if (!error && pb_stream_left(&stream))
+    error = PB_ERROR_VARINT;
+
+  /* Free all allocated memory */
+  pb_stream_destroy(&stream);
+  pb_buffer_destroy(&buffer);
+  parser->size = 0;
+  return error;
+}
+
+/*!
+ * Read a gathered value of the current field and invoke the handler.
+ *
+ * \param[in,out] parser  Parser
+ * \param[in]     raw[]   Raw value
+ * \param[in]     handler Handler
+ * \param[in,out] user    User data
+ * \return                Error code
+ */
+static pb_error_t
+emit_value(
+    pb_parser_t *parser, const uint8_t raw[],
+    pb_decoder_handler_f handler, void *user) {
+  assert(parser && parser->field && raw && handler);
+  const pb_field_descriptor_t *descriptor = parser->field;
+
+  /* Allocate temporary space for type-agnostic decoding */
+  void *value = alloca(pb_field_descriptor_type_size(descriptor));
+  pb_error_t error = read_value(parser, raw,
+    pb_field_descriptor_type(descriptor), value);
+  return likely_(!error)
+    ? handler(descriptor, value, user)
+    : error;
+}
+
+/*!
+ * Invoke the handler for a complete string or bytes value.
+ *
+ * \param[in,out] parser  Parser
+ * \param[in]     data[]  Raw data
+ * \param[in]     size    Raw data size
+ * \param[in]     handler Handler
+ * \param[in,out] user    User data
+ * \return                Error code
+ */
+static pb_error_t
+emit_data(
+    pb_parser_t *parser, const uint8_t data[], size_t size,
+    pb_decoder_handler_f handler, void *user) {
+  assert(parser && parser->field && data && handler);
+  pb_string_t string = pb_string_init((uint8_t *)data, size);
+  parser->state = PB_PARSER_STATE_TAG;
+  return handler(parser->field, &string, user);
+}
+
+/*!
+ * Enter the nested message of the current field.
+ *
+ * A frame holding the field and the offset of the end of the message is
+ * pushed, so the fields of the nested message are processed one by one, just
+ * like the fields of the message itself.
+ *
+ * \param[in,out] parser  Parser
+ * \param[in]     offset  Offset of the nested message
+ * \param[in]     handler Handler
+ * \param[in,out] user    User data
+ * \return                Error code
+ */
+static pb_error_t
+enter(
+    pb_parser_t *parser, size_t offset,
+    pb_decoder_handler_f handler, void *user) {
+  assert(parser && parser->field && handler);
+  const pb_parser_frame_t *outer = frame(parser);
+  if (unlikely_(outer && parser->remaining > outer->end - offset))
+    return PB_ERROR_OFFSET;
+  if (unlikely_(pb_parser_depth(parser) == DEPTH))
+    return PB_ERROR_INVALID;
+
+  /* Push frame for nested message */
+  if (unlikely_(pb_buffer_reserve(&(parser->frames),
+      sizeof(pb_parser_frame_t))))
+    return PB_ERROR_ALLOC;                                 /* LCOV_EXCL_LINE */
+  pb_parser_frame_t *inner = (pb_parser_frame_t *)pb_buffer_grow(
+    &(parser->frames), sizeof(pb_parser_frame_t));
+  inner->field = parser->field;
+  inner->end   = offset + parser->remaining;
+
+  /* Invoke handler with event */
+  pb_parser_event_t event = PB_PARSER_EVENT_ENTER;
+  parser->state = PB_PARSER_STATE_TAG;
+  return handler(parser->field, &event, user);
+}
+
+/*!
+ * Leave the innermost nested message after it was fully consumed.
+ *
+ * \param[in,out] parser  Parser
+ * \param[in]     handler Handler
+ * \param[in,out] user    User data
+ * \return                Error code
+ */
+static pb_error_t
+leave(pb_parser_t *parser, pb_decoder_handler_f handler, void *user) {
+  assert(parser && handler);
+  if (unlikely_(parser->state != PB_PARSER_STATE_TAG || parser->size))
+    return PB_ERROR_OFFSET;
+
+  /* Pop frame and invoke handler with event */
+  const pb_field_descriptor_t *field = frame(parser)->field;
+  parser->frames.size -= sizeof(pb_parser_frame_t);
+  pb_parser_event_t event = PB_PARSER_EVENT_LEAVE;
+  return handler(field, &event, user);
+}
+
+/*!
+ * Process the tag of the next field.
+ *
+ * Unknown fields are skipped. Values of known fields are read according to
+ * the field descriptor, except for non-length-prefixed fields which are
+ * encoded in packed encoding, exactly like pb_decoder_decode() does.
+ *
+ * \param[in,out] parser Parser
+ * \param[in]     raw[]  Raw tag
+ * \return               Error code
+ */
+static pb_error_t
+parse_tag(pb_parser_t *parser, const uint8_t raw[]) {
+  assert(parser && raw);
+  pb_tag_t tag;
+  pb_error_t error = read_value(parser, raw, PB_TYPE_UINT32, &tag);
+  if (unlikely_(error))
+    return error;
+
+  /* Extract wiretype and tag */
+  pb_wiretype_t wiretype = tag & 7;
+  tag >>= 3;
+
+  /* Check descriptor and skip field if unknown */
+  parser->field = pb_descriptor_field_by_tag(descriptor(parser), tag);
+  if (unlikely_(!parser->field)) {
+    switch (wiretype) {
+      case PB_WIRETYPE_VARINT:
+      case PB_WIRETYPE_64BIT:
+      case PB_WIRETYPE_32BIT:
+        parser->state = PB_PARSER_STATE_VALUE;
+        break;
+      case PB_WIRETYPE_LENGTH:
+        parser->state = PB_PARSER_STATE_LENGTH;
+        break;
+      default:
+        return PB_ERROR_INVALID;
+    }
+    parser->wiretype = wiretype;
+
+  /* Non-packed fields may also be encoded in packed encoding */
+  } else {
+    parser->wiretype = pb_field_descriptor_wiretype(parser->field);
+    parser->state    = parser->wiretype == PB_WIRETYPE_LENGTH ||
+                       wiretype        == PB_WIRETYPE_LENGTH
+      ? PB_PARSER_STATE_LENGTH
+      : PB_PARSER_STATE_VALUE;
+  }
+  return PB_ERROR_NONE;
+}
+
+/*!
+ * Process the length prefix of the current field.
+ *
+ * \param[in,out] parser Parser
+ * \param[in]     raw[]  Raw length prefix
+ * \return               Error code
+ */
+static pb_error_t
+parse_length(pb_parser_t *parser, const uint8_t raw[]) {
+  assert(parser && raw);
+  uint32_t length;
+  pb_error_t error = read_value(parser, raw, PB_TYPE_UINT32, &length);
+  if (unlikely_(error))
+    return error;
+
+  /* Determine how to process the value */
+  parser->remaining = length;
+  if (!parser->field) {
+    parser->state = PB_PARSER_STATE_SKIP;
+  } else if (parser->wiretype == PB_WIRETYPE_LENGTH) {
+    parser->state = PB_PARSER_STATE_DATA;
+  } else {
+    parser->state = PB_PARSER_STATE_PACKED;
+  }
+  return PB_ERROR_NONE;
+}
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create a parser.
+ *
+ * \param[in] descriptor Descriptor
+ * \return               Parser
+ */
+extern pb_parser_t
+pb_parser_create(const pb_descriptor_t *descriptor) {
+  return pb_parser_create_with_allocator(&allocator_default, descriptor);
+}
+
+/*!
+ * Create a parser using a custom allocator.
+ *
+ * \warning A parser does not take ownership of the provided allocator, so
+ * the caller must ensure that the allocator is not freed during operations.
+ *
+ * \param[in,out] allocator  Allocator
+ * \param[in]     descriptor Descriptor
+ * \return                   Parser
+ */
+extern pb_parser_t
+pb_parser_create_with_allocator(
+    pb_allocator_t *allocator, const pb_descriptor_t *descriptor) {
+  assert(allocator && descriptor);
+  pb_parser_t parser = {
+    .descriptor = descriptor,
+    .buffer     = pb_buffer_create_empty_with_allocator(allocator),
+    .frames     = pb_buffer_create_empty_with_allocator(allocator),
+    .state      = PB_PARSER_STATE_TAG
+  };
+  return parser;
+}
+
+/*!
+ * Destroy a parser.
+ *
+ * \param[in,out] parser Parser
+ */
+extern void
+pb_parser_destroy(pb_parser_t *parser) {
+  assert(parser);
+  if (pb_parser_valid(parser)) {
+    pb_buffer_destroy(&(parser->buffer));
+    pb_buffer_destroy(&(parser->frames));
+  }
+}
+
+/*!
+ * Reset a parser, retaining the capacity of its buffers.
+ *
+ * Any partial value and nested message is discarded, so the parser can be
+ * reused for the next message, or after an error, without allocating.
+ *
+ * \param[in,out] parser Parser
+ */
+extern void
+pb_parser_reset(pb_parser_t *parser) {
+  assert(parser);
+  if (pb_parser_valid(parser)) {
+    pb_buffer_reset(&(parser->buffer));
+    pb_buffer_reset(&(parser->frames));
+  }
+  parser->field     = NULL;
+  parser->state     = PB_PARSER_STATE_TAG;
+  parser->offset    = 0;
+  parser->remaining = 0;
+  parser->size      = 0;
+}
+
+/*!
+ * Feed a fragment of a message to a parser, invoking a handler for every
+ * field value that is completed.
+ *
+ * The handler is invoked like with pb_decoder_decode(), so the same handlers
+ * can be used with both, except for nested messages. All state is kept inside
+ * the parser, so a message may be split at arbitrary positions, e.g. as it
+ * arrives over a socket, without buffering it as a whole.
+ *
+ * Nested messages are never buffered. Instead, the parser descends into them,
+ * invoking the handler with the field descriptor of the nested message and a
+ * pointer to PB_PARSER_EVENT_ENTER, then for all fields of the nested message,
+ * and finally with a pointer to PB_PARSER_EVENT_LEAVE.
+ *
+ * Scalar values are gathered inside the parser, values of packed fields are
+ * delivered one by one and unknown fields are skipped, so none of them needs
+ * more than a few bytes of memory. Strings and bytes are passed directly from
+ * the fragment if they are contained in it, and are only copied to the
+ * parser's buffer as they arrive if they span fragments, so the buffer never
+ * holds more than the received part of a single value.
+ *
+ * If the fragment ends on a field boundary of the message, PB_ERROR_NONE is
+ * returned, and if it ends within a field or nested message, PB_ERROR_PARTIAL
+ * is returned to signal that more data is needed. If the message ends while
+ * more data is needed, it was truncated. After any other error, the parser
+ * must be reset.
+ *
+ * \param[in,out] parser  Parser
+ * \param[in]     data[]  Fragment
+ * \param[in]     size    Fragment size
+ * \param[in]     handler Handler
+ * \param[in,out] user    User data
+ * \return                Error code
+ */
+extern pb_error_t
+pb_parser_feed(
+    pb_parser_t *parser, const uint8_t data[], size_t size,
+    pb_decoder_handler_f handler, void *user) {
+  assert(parser && (data || !size) && handler);
+  if (unlikely_(!pb_parser_valid(parser)))
+    return PB_ERROR_INVALID;
+  pb_error_t error = PB_ERROR_NONE;
+
+  /* Process fragment until it is exhausted */
+  const uint8_t *end = data + size, *raw;
+  while (!error && data < end) {
+    const uint8_t *start = data, *limit = end;
+
+    /* Limit fragment to innermost nested message */
+    const pb_parser_frame_t *current = frame(parser);
+    if (current && current->end - parser->offset < (size_t)(end - data))
+      limit = data + (current->end - parser->offset);
+    switch (parser->state) {
+
+      /* Read tag */
+      case PB_PARSER_STATE_TAG:
+        if (!(error = gather(parser, PB_WIRETYPE_VARINT, &data, limit, &raw)))
+          error = parse_tag(parser, raw);
+        break;
+
+      /* Read non-prefixed value and skip it if field is unknown */
+      case PB_PARSER_STATE_VALUE:
+        if (!(error = gather(parser, parser->wiretype, &data, limit, &raw))) {
+          parser->state = PB_PARSER_STATE_TAG;
+          if (parser->field) {
+            error = emit_value(parser, raw, handler, user);
+          } else {
+            parser->size = 0;
+          }
+        }
+        break;
+
+      /* Read length prefix and enter nested message, if any */
+      case PB_PARSER_STATE_LENGTH:
+        if ((error = gather(parser, PB_WIRETYPE_VARINT, &data, limit, &raw)) ||
+            (error = parse_length(parser, raw)))
+          break;
+        if (parser->state == PB_PARSER_STATE_DATA &&
+            pb_field_descriptor_type(parser->field) == PB_TYPE_MESSAGE) {
+          error = enter(parser, parser->offset + (data - start),
+            handler, user);
+        } else if (!parser->remaining) {
+          if (parser->state == PB_PARSER_STATE_DATA) {
+            error = emit_data(parser, parser->bytes, 0, handler, user);
+          } else {
+            parser->state = PB_PARSER_STATE_TAG;
+          }
+        }
+        break;
+
+      /* Read string or bytes */
+      case PB_PARSER_STATE_DATA: {
+        size_t chunk = parser->remaining;
+        if (chunk <= (size_t)(limit - data) &&
+            pb_buffer_empty(&(parser->buffer))) {
+          error = emit_data(parser, data, chunk, handler, user);
+          data += chunk;
+          break;
+        }
+
+        /* Value spans fragments, so append the received part to the buffer */
+        if (chunk > (size_t)(limit - data))
+          chunk = limit - data;
+        if (unlikely_(pb_buffer_reserve(&(parser->buffer), chunk))) {
+          error = PB_ERROR_ALLOC;
+          break;
+        }
+        memcpy(pb_buffer_grow(&(parser->buffer), chunk), data, chunk);
+        parser->remaining -= chunk;
+        data              += chunk;
+
+        /* Invoke handler, if the value is complete */
+        if (!parser->remaining) {
+          error = emit_data(parser, pb_buffer_data(&(parser->buffer)),
+            pb_buffer_size(&(parser->buffer)), handler, user);
+          pb_buffer_reset(&(parser->buffer));
+        }
+        break;
+      }
+
+      /* Read values of packed field within its boundaries */
+      case PB_PARSER_STATE_PACKED: {
+        const uint8_t *bound = limit;
+        if (parser->remaining < (size_t)(limit - data))
+          bound = data + parser->remaining;
+        error = gather(parser, parser->wiretype, &data, bound, &raw);
+        parser->remaining -= data - start;
+
+        /* Ensure the value doesn't exceed the field */
+        if (error == PB_ERROR_PARTIAL && !parser->remaining) {
+          error = PB_ERROR_OFFSET;
+        } else if (!error) {
+          error = emit_value(parser, raw, handler, user);
+        }
+        if (!parser->remaining && !error)
+          parser->state = PB_PARSER_STATE_TAG;
+        break;
+      }
+
+      /* Skip length-prefixed value of unknown field */
+      case PB_PARSER_STATE_SKIP: {
+        size_t chunk = parser->remaining;
+        if (chunk > (size_t)(limit - data))
+          chunk = limit - data;
+        parser->remaining -= chunk;
+        data              += chunk;
+        if (!parser->remaining)
+          parser->state = PB_PARSER_STATE_TAG;
+        break;
+      }
+    }
+    parser->offset += data - start;
+
+    /* Leave nested messages that were fully consumed */
+    while ((!error || error == PB_ERROR_PARTIAL) &&
+        (current = frame(parser)) && current->end == parser->offset)
+      error = leave(parser, handler, user);
+  }
+
+  /* More data is needed, if the fragment ended within a field */
+  if (error == PB_ERROR_PARTIAL)
+    error = PB_ERROR_NONE;
+  if (!error && !pb_parser_done(parser))
+    error = PB_ERROR_PARTIAL;
+  return error;
+}
@@ -67,28 +67,21 @@ pb_buffer_write(
     if (unlikely_(buffer->allocator == &allocator_zero_copy))
       return PB_ERROR_ALLOC;
 
-    /* Buffer grows, so grow space and then move data */
+    /* Buffer grows, so grow space if necessary and then move data */
     if (delta > 0) {
-      uint8_t *new_data = pb_allocator_resize(buffer->allocator,
-        buffer->data, buffer->size + delta);
-      if (new_data) {
-        buffer->data = new_data;
-        if (end < buffer->size)
-          memmove(&(buffer->data[end + delta]), &(buffer->data[end]),
-            buffer->size - end);
-      } else {
-        return PB_ERROR_ALLOC;
-      }
+      if (buffer->size + delta > buffer->capacity)
+        if (unlikely_(pb_buffer_resize(buffer, buffer->size + delta)))
+          return PB_ERROR_ALLOC;
+      if (end < buffer->size)
+        memmove(&(buffer->data[end + delta]), &(buffer->data[end]),
+          buffer->size - end);
 
     /* Buffer shrinks, so move data and then shrink space */
     } else {
       if (end < buffer->size)
         memmove(&(buffer->data[end + delta]), &(buffer->data[end]),
           buffer->size - end);
-      uint8_t *new_data = pb_allocator_resize(buffer->allocator,
-        buffer->data, buffer->size + delta);
-      if (new_data)
-        buffer->data = new_data;
+      pb_buffer_resize(buffer, buffer->size + delta);
     }
 
     /* Update buffer size */
@@ -132,15 +125,13 @@ pb_buffer_clear(pb_buffer_t *buffer, size_t start, size_t end) {
       if (end < buffer->size)
         memmove(&(buffer->data[end + delta]), &(buffer->data[end]),
           buffer->size - end);
-      uint8_t *new_data = pb_allocator_resize(buffer->allocator,
-        buffer->data, buffer->size + delta);
-      if (new_data)
-        buffer->data = new_data;
+      pb_buffer_resize(buffer, buffer->size + delta);
 
-    /* Buffer is cleared completely, so free space */
-    } else {
+    /* Buffer is cleared completely, so free space if allocated */
+    } else if (buffer->data != buffer->storage) {
       pb_allocator_free(buffer->allocator, buffer->data);
-      buffer->data = NULL;
+      buffer->data     = NULL;
+      buffer->capacity = 0;
     }
 
     /* Update buffer size */
@@ -25,11 +25,13 @@
 #include <stdlib.h>
 
 #include "core/descriptor.h"
+#include "core/packed.h"
 #include "core/stream.h"
 #include "message/buffer.h"
 #include "message/common.h"
 #include "message/cursor.h"
 #include "message/field.h"
+#include "message/index.h"
 #include "message/journal.h"
 #include "message/message.h"
 #include "message/part.h"
@@ -179,6 +181,129 @@ next(pb_cursor_t *cursor) {
   return 0;
 }
 
+/*!
+ * Move a cursor forward to a value inside the current field or packed field.
+ *
+ * \param[in,out] cursor Cursor
+ * \param[in]     start  Start offset relative to current value
+ * \param[in]     skip   Number of values to skip
+ */
+static void
+move(pb_cursor_t *cursor, size_t start, size_t skip) {
+  assert(cursor);
+  pb_offset_t *offset = &(cursor->current.offset);
+  const uint8_t *data =
+    pb_journal_data_from(pb_cursor_journal(cursor), offset->start + start);
+
+  /* Determine length of value from wiretype */
+  size_t length = 1;
+  switch (pb_field_descriptor_wiretype(cursor->current.descriptor)) {
+    case PB_WIRETYPE_32BIT:
+      length = 4;
+      break;
+    case PB_WIRETYPE_64BIT:
+      length = 8;
+      break;
+    default:
+      while (data[length - 1] & 0x80)
+        length++;
+      break;
+  }
+
+  /* Adjust offsets and position */
+  offset->diff.origin -= start;
+  offset->start       += start;
+  offset->end          = offset->start + length;
+  cursor->pos         += skip;
+}
+
+/*!
+ * Search the current field of a cursor for a value within a range.
+ *
+ * If the cursor is located inside a packed field, the current and all
+ * following values of the packed field are searched at once. If no value is
+ * found, the cursor is moved to the last value of the packed field.
+ *
+ * \param[in,out] cursor Cursor
+ * \param[in]     min    Pointer holding lower bound
+ * \param[in]     max    Pointer holding upper bound
+ * \return               Test result
+ */
+static int
+find(pb_cursor_t *cursor, const void *min, const void *max) {
+  assert(cursor && min && max);
+  assert(pb_cursor_aligned(cursor));
+  const pb_field_descriptor_t *descriptor = cursor->current.descriptor;
+  const pb_offset_t *offset = &(cursor->current.offset),
+                    *packed = &(cursor->current.packed);
+
+  /* Search the current value or all following values of a packed field */
+  size_t end = packed->end && pb_field_descriptor_packed(descriptor)
+    ? packed->end
+    : offset->end;
+  const uint8_t *data =
+    pb_journal_data_from(pb_cursor_journal(cursor), offset->start);
+
+  /* Move cursor to the value found */
+  size_t start, skip;
+  if (pb_packed_find(pb_field_descriptor_type(descriptor), data,
+      end - offset->start, min, max, &start, &skip)) {
+    move(cursor, start, skip);
+    return 1;
+  }
+
+  /* Move cursor to the last valid value of a packed field */
+  if (skip > 1) {
+    switch (pb_field_descriptor_wiretype(descriptor)) {
+      case PB_WIRETYPE_32BIT:
+        start -= 4;
+        break;
+      case PB_WIRETYPE_64BIT:
+        start -= 8;
+        break;
+      default:
+        for (--start; data[start - 1] & 0x80; --start);
+        break;
+    }
+    move(cursor, start, skip - 1);
+  }
+  return 0;
+}
+
+/*!
+ * Seek a cursor from its current position to a field containing a value
+ * within a range.
+ *
+ * \param[in,out] cursor Cursor
+ * \param[in]     min    Pointer holding lower bound
+ * \param[in]     max    Pointer holding upper bound
+ * \return               Test result
+ */
+static int
+seek(pb_cursor_t *cursor, const void *min, const void *max) {
+  assert(cursor && min && max);
+  int result = 0;
+  if (pb_cursor_valid(cursor) && cursor->tag) {
+    const pb_field_descriptor_t *descriptor = cursor->current.descriptor;
+
+    /* Search raw values in blocks, skipping over packed fields */
+    if (pb_field_descriptor_wiretype(descriptor) != PB_WIRETYPE_LENGTH) {
+      while (!result && pb_cursor_next(cursor))
+        result = find(cursor, min, max);
+
+    /* Create field and seek for value */
+    } else if (pb_field_descriptor_type(descriptor) != PB_TYPE_MESSAGE &&
+               min == max) {
+      while (!result && pb_cursor_next(cursor)) {
+        pb_field_t field = pb_field_create_from_cursor(cursor);
+        result = pb_field_match(&field, min);
+        pb_field_destroy(&field);
+      }
+    }
+  }
+  return result;
+}
+
 /* ----------------------------------------------------------------------------
  * Interface
  * ------------------------------------------------------------------------- */
@@ -301,6 +426,38 @@ pb_cursor_create_nested(
   return cursor;
 }
 
+/*!
+ * Create a cursor for the occurrence of a field at a position of an index.
+ *
+ * The cursor is created from the span of the index containing the position.
+ * Inside packed fields of fixed-size values, the offsets are computed directly,
+ * otherwise the cursor is advanced from the start of the span. If the position
+ * is out of bounds, the cursor is invalid and reports the end of the message.
+ *
+ * \warning After creating a cursor, it is mandatory to check its validity
+ * with the macro pb_cursor_valid().
+ *
+ * \param[in,out] index Index
+ * \param[in]     pos   Position
+ * \return              Cursor
+ */
+extern pb_cursor_t
+pb_cursor_create_from_index(pb_index_t *index, size_t pos) {
+  assert(index);
+  pb_index_span_t *span;
+  pb_error_t error = pb_index_lookup(index, pos, &span);
+  if (likely_(!error) && !(error = pb_cursor_align(&(span->cursor)))) {
+    pb_cursor_t cursor = pb_cursor_copy(&(span->cursor));
+    pb_cursor_jump(&cursor, pos - span->pos);
+    return cursor;
+  }
+
+  /* Return invalid cursor carrying error */
+  pb_cursor_t cursor = pb_cursor_create_invalid();
+  cursor.error = error;
+  return cursor;
+}
+
 /*!
  * Destroy a cursor.
  *
@@ -358,6 +515,9 @@ pb_cursor_rewind(pb_cursor_t *cursor) {
 /*!
  * Seek a cursor from its current position to a field containing the value.
  *
+ * Values of packed fields are searched in blocks, so the cursor does not
+ * need to halt on every single value.
+ *
  * \warning The seek operation is not allowed on cursors created without tags,
  * as the cursor would assume the field type to match the value type.
  *
@@ -368,20 +528,56 @@ pb_cursor_rewind(pb_cursor_t *cursor) {
 extern int
 pb_cursor_seek(pb_cursor_t *cursor, const void *value) {
   assert(cursor && value);
-  int result = 0;
-  if (pb_cursor_valid(cursor) && cursor->tag) {
-    const pb_field_descriptor_t *descriptor = cursor->current.descriptor;
+  return seek(cursor, value, value);
+}
 
-    /* Create field and seek for value */
-    if (pb_field_descriptor_type(descriptor) != PB_TYPE_MESSAGE) {
-      while (!result && pb_cursor_next(cursor)) {
-        pb_field_t field = pb_field_create_from_cursor(cursor);
-        result = pb_field_match(&field, value);
-        pb_field_destroy(&field);
-      }
-    }
-  }
-  return result;
+/*!
+ * Seek a cursor from its current position to a field containing a value
+ * within a range.
+ *
+ * The bounds are inclusive and are compared by the order of the field's
+ * native type. Range search is only supported for fields of numeric types.
+ *
+ * \warning The seek operation is not allowed on cursors created without tags,
+ * as the cursor would assume the field type to match the value type.
+ *
+ * \param[in,out] cursor Cursor
+ * \param[in]     min    Pointer holding lower bound
+ * \param[in]     max    Pointer holding upper bound
+ * \return               Test result
+ */
+extern int
+pb_cursor_seek_range(
+    pb_cursor_t *cursor, const void *min, const void *max) {
+  assert(cursor && min && max);
+  return seek(cursor, min, max);
+}
+
+/*!
+ * Find the positions of all fields containing the value, starting from the
+ * current position of a cursor.
+ *
+ * At most the given number of positions is written. If the returned count
+ * equals that number, the cursor halts on the last field found, so the search
+ * can be continued with another call.
+ *
+ * \warning The find operation is not allowed on cursors created without tags,
+ * as the cursor would assume the field type to match the value type.
+ *
+ * \param[in,out] cursor Cursor
+ * \param[in]     value  Pointer holding value
+ * \param[out]    pos[]  Positions
+ * \param[in]     size   Maximum position count
+ * \return               Position count
+ */
+extern size_t
+pb_cursor_find(
+    pb_cursor_t *cursor, const void *value, size_t pos[], size_t size) {
+  assert(cursor && value && pos);
+  size_t found = 0;
+  while (found < size && seek(cursor, value, value))
+    pos[found++] = cursor->pos;
+  return found;
 }
 
 /*!
@@ -401,8 +597,18 @@ pb_cursor_match(pb_cursor_t *cursor, const void *value) {
   if (pb_cursor_valid(cursor)) {
     const pb_field_descriptor_t *descriptor = cursor->current.descriptor;
 
+    /* Compare raw value directly */
+    if (pb_field_descriptor_wiretype(descriptor) != PB_WIRETYPE_LENGTH) {
+      if (!pb_cursor_align(cursor)) {
+        const pb_offset_t *offset = &(cursor->current.offset);
+        size_t start, skip;
+        result = pb_packed_find(pb_field_descriptor_type(descriptor),
+          pb_journal_data_from(pb_cursor_journal(cursor), offset->start),
+            offset->end - offset->start, value, value, &start, &skip);
+      }
+
     /* Create field and compare value */
-    if (pb_field_descriptor_type(descriptor) != PB_TYPE_MESSAGE) {
+    } else if (pb_field_descriptor_type(descriptor) != PB_TYPE_MESSAGE) {
       pb_field_t field = pb_field_create_from_cursor(cursor);
       result = pb_field_match(&field, value);
       pb_field_destroy(&field);
@@ -563,3 +769,41 @@ pb_cursor_align(pb_cursor_t *cursor) {
   }
   return error;
 }
+
+/*!
+ * Move a cursor forward by a given number of occurrences.
+ *
+ * Inside a packed field of fixed-size values, the offsets of the following
+ * values are computed directly, so the cursor can jump over an arbitrary
+ * number of values at once. Otherwise, the cursor is advanced one by one.
+ *
+ * \param[in,out] cursor Cursor
+ * \param[in]     count  Occurrence count
+ * \return               Test result
+ */
+extern int
+pb_cursor_jump(pb_cursor_t *cursor, size_t count) {
+  assert(cursor);
+  int result = pb_cursor_valid(cursor);
+  while (result && count) {
+    pb_offset_t *offset = &(cursor->current.offset);
+
+    /* Jump over as many packed fixed-size values as possible */
+    size_t left = !pb_cursor_align(cursor) ? pb_cursor_left(cursor) : 0;
+    if (left > 1) {
+      size_t size = (offset->end - offset->start),
+             skip = left - 1 < count ? left - 1 : count;
+      offset->start       += skip * size;
+      offset->end         += skip * size;
+      offset->diff.origin -= skip * size;
+      cursor->pos         += skip;
+      count               -= skip;
+
+    /* Otherwise advance to next occurrence */
+    } else {
+      result = pb_cursor_next(cursor);
+      count--;
+    }
+  }
+  return result;
+}
@@ -46,6 +46,11 @@ extern pb_error_t
 pb_cursor_align(
   pb_cursor_t *cursor);                /* Cursor */
 
+extern int
+pb_cursor_jump(
+  pb_cursor_t *cursor,                 /* Cursor */
+  size_t count);                       /* Occurrence count */
+
 /* ----------------------------------------------------------------------------
  * Inline functions
  * ------------------------------------------------------------------------- */
@@ -158,4 +163,36 @@ pb_cursor_offset(const pb_cursor_t *cursor) {
   return &(cursor->current.offset);
 }
 
+/*!
+ * Retrieve the number of values left in a packed field of fixed-size values.
+ *
+ * The current value is included in the count. If the cursor is not located
+ * inside a packed field of fixed-size values, zero is returned.
+ *
+ * \param[in] cursor Cursor
+ * \return           Value count
+ */
+PB_INLINE size_t
+pb_cursor_left(const pb_cursor_t *cursor) {
+  assert(cursor);
+  assert(pb_cursor_aligned(cursor));
+  const pb_field_descriptor_t *descriptor = cursor->current.descriptor;
+  if (!cursor->current.packed.end || !pb_field_descriptor_packed(descriptor))
+    return 0;
+
+  /* Determine size of packed values from wiretype */
+  size_t size;
+  switch (pb_field_descriptor_wiretype(descriptor)) {
+    case PB_WIRETYPE_32BIT:
+      size = 4;
+      break;
+    case PB_WIRETYPE_64BIT:
+      size = 8;
+      break;
+    default:
+      return 0;
+  }
+  return (cursor->current.packed.end - cursor->current.offset.start) / size;
+}
+
 #endif /* PB_MESSAGE_CURSOR_H */
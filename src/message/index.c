@@ -0,0 +1,324 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "core/allocator.h"
+#include "core/descriptor.h"
+#include "message/common.h"
+#include "message/cursor.h"
+#include "message/index.h"
+#include "message/journal.h"
+#include "message/message.h"
+
+/* ----------------------------------------------------------------------------
+ * Constants
+ * ------------------------------------------------------------------------- */
+
+/*! Maximum number of occurrences covered by a sampled span */
+static const size_t span_size = 64;
+
+/* ----------------------------------------------------------------------------
+ * Internal functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Add a span starting at the current position of a cursor to an index.
+ *
+ * If allocation fails, the index's internal state is fully recoverable.
+ *
+ * \param[in,out] index  Index
+ * \param[in]     cursor Cursor
+ * \param[in]     pos    Position
+ * \return               Error code
+ */
+static pb_error_t
+push(pb_index_t *index, const pb_cursor_t *cursor, size_t pos) {
+  assert(index && cursor);
+  if (index->span.size == index->span.capacity) {
+    size_t capacity = index->span.capacity ? index->span.capacity << 1 : 8;
+    pb_index_span_t *data = pb_allocator_resize(index->allocator,
+      index->span.data, sizeof(pb_index_span_t) * capacity);
+    if (unlikely_(!data))
+      return PB_ERROR_ALLOC;
+    index->span.data     = data;
+    index->span.capacity = capacity;
+  }
+  index->span.data[index->span.size++] = (pb_index_span_t){
+    .cursor = pb_cursor_copy(cursor),
+    .pos    = pos,
+    .size   = 0
+  };
+  return PB_ERROR_NONE;
+}
+
+/*!
+ * Build the spans of an index, continuing after the last complete span.
+ *
+ * Packed fields of fixed-size values are covered by a single span, as the
+ * offsets of their values can be computed directly. All other occurrences are
+ * sampled, so that every span covers at most a constant number of them.
+ *
+ * \param[in,out] index Index
+ * \return              Error code
+ */
+static pb_error_t
+build(pb_index_t *index) {
+  assert(index);
+  pb_error_t error = PB_ERROR_NONE;
+
+  /* Resume from the start of the last span, as it may be incomplete */
+  pb_cursor_t cursor; size_t pos = 0;
+  if (index->span.size) {
+    const pb_index_span_t *span = &(index->span.data[--index->span.size]);
+    cursor = pb_cursor_copy(&(span->cursor));
+    pos    = span->pos;
+  } else {
+    cursor = pb_cursor_create(&(index->message), index->tag);
+  }
+
+  /* Walk all occurrences and sample spans */
+  size_t open = SIZE_MAX;
+  while (pb_cursor_valid(&cursor)) {
+    if (unlikely_(error = pb_cursor_align(&cursor)))
+      break;
+
+    /* Record start offset of first occurrence */
+    const pb_offset_t *offset = cursor.current.packed.end
+      ? &(cursor.current.packed)
+      : &(cursor.current.offset);
+    if (!pos)
+      index->extent.start = offset->start + offset->diff.tag;
+
+    /* Start a new span, if necessary */
+    size_t size = pb_cursor_left(&cursor);
+    if (size || open == SIZE_MAX || index->span.data[open].size == span_size) {
+      if (unlikely_(error = push(index, &cursor, pos)))
+        break;
+      open = size ? SIZE_MAX : index->span.size - 1;
+    }
+
+    /* Jump over packed fixed-size values or advance to next occurrence */
+    index->span.data[index->span.size - 1].size += size ? size : 1;
+    index->extent.end = cursor.current.packed.end
+      ? cursor.current.packed.end
+      : cursor.current.offset.end;
+    if (size) {
+      pos += size;
+      pb_cursor_jump(&cursor, size);
+    } else {
+      pos++;
+      pb_cursor_next(&cursor);
+    }
+  }
+
+  /* Check for errors other than reaching the end of the message */
+  if (!error && pb_cursor_error(&cursor) != PB_ERROR_EOM)
+    error = pb_cursor_error(&cursor);
+  pb_cursor_destroy(&cursor);
+
+  /* Update occurrence count or reset index */
+  index->size = error ? 0 : pos;
+  if (unlikely_(error))
+    index->span.size = 0;
+  return error;
+}
+
+/*!
+ * Ensure that an index is up-to-date with its underlying journal.
+ *
+ * Changes before the indexed occurrences only shift them, so the spans remain
+ * valid and are aligned lazily. Changes after the indexed occurrences may add
+ * new occurrences, so the index is rebuilt starting from the last span. All
+ * other changes require a full rebuild.
+ *
+ * \param[in,out] index Index
+ * \return              Error code
+ */
+static pb_error_t
+refresh(pb_index_t *index) {
+  assert(index);
+  pb_journal_t *journal = pb_index_journal(index);
+  if (likely_(index->version == pb_journal_version(journal)))
+    return PB_ERROR_NONE;
+
+  /* Determine impact of all changes since the last build */
+  int rebuild = index->version == SIZE_MAX || !index->size, resume = 0;
+  for (pb_version_t v = index->version;
+      !rebuild && v < pb_journal_version(journal); ++v) {
+    const pb_journal_entry_t *entry = &(journal->entry.data[v]);
+
+    /* Change happened before indexed occurrences: move */
+    if (entry->offset <= index->extent.start) {
+      index->extent.start += entry->delta;
+      index->extent.end   += entry->delta;
+
+    /* Change happened after indexed occurrences: resume */
+    } else if (entry->origin >= index->extent.end) {
+      resume |= entry->delta > 0;
+
+    /* Change happened within indexed occurrences: rebuild */
+    } else {
+      rebuild = 1;
+    }
+  }
+
+  /* Rebuild index from scratch or resume from last span */
+  if (rebuild)
+    index->span.size = 0;
+  pb_error_t error = rebuild || resume
+    ? build(index)
+    : PB_ERROR_NONE;
+  index->version = error
+    ? SIZE_MAX
+    : pb_journal_version(journal);
+  return error;
+}
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create an index over the occurrences of a repeated field in a message.
+ *
+ * The index is built lazily on first use and kept up-to-date with changes
+ * made to the underlying journal. Cursors for arbitrary positions can be
+ * created from an index with pb_cursor_create_from_index().
+ *
+ * \warning After creating an index, it is mandatory to check its validity
+ * with the macro pb_index_valid().
+ *
+ * \param[in,out] message Message
+ * \param[in]     tag     Tag
+ * \return                Index
+ */
+extern pb_index_t
+pb_index_create(pb_message_t *message, pb_tag_t tag) {
+  return pb_index_create_with_allocator(&allocator_default, message, tag);
+}
+
+/*!
+ * Create an index over the occurrences of a repeated field using a custom
+ * allocator.
+ *
+ * \warning An index does not take ownership of the provided allocator, so the
+ * caller must ensure that the allocator is not freed during operations.
+ *
+ * \param[in,out] allocator Allocator
+ * \param[in,out] message   Message
+ * \param[in]     tag       Tag
+ * \return                  Index
+ */
+extern pb_index_t
+pb_index_create_with_allocator(
+    pb_allocator_t *allocator, pb_message_t *message, pb_tag_t tag) {
+  assert(allocator && message && tag);
+  if (pb_message_valid(message)) {
+    const pb_field_descriptor_t *descriptor =
+      pb_descriptor_field_by_tag(pb_message_descriptor(message), tag);
+    if (descriptor &&
+        pb_field_descriptor_label(descriptor) == PB_LABEL_REPEATED) {
+      pb_index_t index = {
+        .allocator = allocator,
+        .message   = pb_message_copy(message),
+        .tag       = tag,
+        .version   = SIZE_MAX, /* = uninitialized */
+        .span      = {
+          .data     = NULL,
+          .size     = 0,
+          .capacity = 0
+        },
+        .size      = 0,
+        .error     = PB_ERROR_NONE
+      };
+      return index;
+    }
+  }
+  return pb_index_create_invalid();
+}
+
+/*!
+ * Destroy an index.
+ *
+ * \param[in,out] index Index
+ */
+extern void
+pb_index_destroy(pb_index_t *index) {
+  assert(index);
+  if (index->span.data)
+    pb_allocator_free(index->allocator, index->span.data);
+  pb_message_destroy(&(index->message));
+  index->span.data = NULL;
+  index->error     = PB_ERROR_INVALID;
+}
+
+/*!
+ * Retrieve the number of occurrences of the field covered by an index.
+ *
+ * \param[in,out] index Index
+ * \return              Occurrence count
+ */
+extern size_t
+pb_index_size(pb_index_t *index) {
+  assert(index);
+  return pb_index_valid(index) && !refresh(index)
+    ? index->size
+    : 0;
+}
+
+/*!
+ * Retrieve the span of an index containing the occurrence at a position.
+ *
+ * \param[in,out] index Index
+ * \param[in]     pos   Position
+ * \param[out]    span  Pointer receiving span
+ * \return              Error code
+ */
+extern pb_error_t
+pb_index_lookup(pb_index_t *index, size_t pos, pb_index_span_t **span) {
+  assert(index && span);
+  if (unlikely_(!pb_index_valid(index)))
+    return PB_ERROR_INVALID;
+
+  /* Ensure index is up-to-date and position is within bounds */
+  pb_error_t error = refresh(index);
+  if (unlikely_(error))
+    return error;
+  if (pos >= index->size)
+    return PB_ERROR_EOM;
+
+  /* Perform binary search for span containing position */
+  size_t l = 0, r = index->span.size;
+  while (r - l > 1) {
+    size_t m = l + ((r - l) >> 1);
+    if (index->span.data[m].pos <= pos) {
+      l = m;
+    } else {
+      r = m;
+    }
+  }
+  *span = &(index->span.data[l]);
+  return PB_ERROR_NONE;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef PB_MESSAGE_INDEX_H
+#define PB_MESSAGE_INDEX_H
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <protobluff/message/index.h>
+
+#include "message/common.h"
+#include "message/cursor.h"
+#include "message/message.h"
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_index_span_t {
+  pb_cursor_t cursor;                  /*!< Cursor at first occurrence */
+  size_t pos;                          /*!< Position of first occurrence */
+  size_t size;                         /*!< Occurrence count */
+} pb_index_span_t;
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+PB_WARN_UNUSED_RESULT
+extern pb_error_t
+pb_index_lookup(
+  pb_index_t *index,                   /* Index */
+  size_t pos,                          /* Position */
+  pb_index_span_t **span);             /* Pointer receiving span */
+
+/* ----------------------------------------------------------------------------
+ * Inline functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create an invalid index.
+ *
+ * \return Index
+ */
+PB_INLINE PB_WARN_UNUSED_RESULT
+pb_index_t
+pb_index_create_invalid(void) {
+  pb_index_t index = {
+    .message = pb_message_create_invalid(),
+    .error   = PB_ERROR_INVALID
+  };
+  return index;
+}
+
+/*!
+ * Retrieve the underlying journal of an index.
+ *
+ * \param[in] index Index
+ * \return          Journal
+ */
+PB_INLINE pb_journal_t *
+pb_index_journal(pb_index_t *index) {
+  assert(index);
+  return pb_message_journal(&(index->message));
+}
+
+#endif /* PB_MESSAGE_INDEX_H */
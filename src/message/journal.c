@@ -33,6 +33,23 @@
  * Internal functions
  * ------------------------------------------------------------------------- */
 
+/*!
+ * Retrieve the allocator used for the entries of a journal.
+ *
+ * Entries are allocated from the allocator of the journal, if it has one, as
+ * the allocator of a memory-mapped buffer can only manage the mapping itself.
+ *
+ * \param[in] journal Journal
+ * \return            Allocator
+ */
+static pb_allocator_t *
+allocator_from_journal(const pb_journal_t *journal) {
+  assert(journal);
+  return journal->allocator
+    ? journal->allocator
+    : pb_buffer_allocator(&(journal->buffer));
+}
+
 /*!
  * Add an entry to a journal.
  *
@@ -50,23 +67,41 @@ push(
   assert(journal && origin <= offset && delta);
   assert(pb_journal_valid(journal));
   pb_allocator_t *allocator = pb_buffer_allocator(&(journal->buffer));
-  if (unlikely_(allocator == &allocator_zero_copy))
-    return PB_ERROR_ALLOC;
-
-  /* Grow journal and append entry */
-  pb_journal_entry_t *data = pb_allocator_resize(allocator,
-    journal->entry.data, sizeof(pb_journal_entry_t)
-      * (journal->entry.size + 1));
-  if (data) {
-    journal->entry.data = data;
-    journal->entry.data[journal->entry.size++] = (pb_journal_entry_t){
-      .origin = origin,
-      .offset = offset,
-      .delta  = delta
-    };
-    return PB_ERROR_NONE;
+  if (unlikely_(allocator == &allocator_zero_copy)) {
+    if (!journal->allocator)
+      return PB_ERROR_ALLOC;
+
+    /* Promote copy-on-write journal by copying the underlying data */
+    pb_buffer_t buffer = pb_buffer_create_with_allocator(journal->allocator,
+      pb_buffer_data(&(journal->buffer)), pb_buffer_size(&(journal->buffer)));
+    if (unlikely_(!pb_buffer_valid(&buffer)))
+      return PB_ERROR_ALLOC;
+    journal->buffer = buffer;
   }
-  return PB_ERROR_ALLOC;
+
+  /* Grow entries geometrically, if capacity is exhausted */
+  if (journal->entry.size == journal->entry.capacity) {
+    size_t capacity = journal->entry.capacity
+      ? journal->entry.capacity * 2
+      : 8;
+    pb_journal_entry_t *data = pb_allocator_resize(
+      allocator_from_journal(journal),
+      journal->entry.data, sizeof(pb_journal_entry_t) * capacity);
+    if (unlikely_(!data))
+      return PB_ERROR_ALLOC;
+
+    /* Update entries */
+    journal->entry.data     = data;
+    journal->entry.capacity = capacity;
+  }
+
+  /* Append entry */
+  journal->entry.data[journal->entry.size++] = (pb_journal_entry_t){
+    .origin = origin,
+    .offset = offset,
+    .delta  = delta
+  };
+  return PB_ERROR_NONE;
 }
 
 /* LCOV_EXCL_START >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> */
@@ -121,11 +156,13 @@ pb_journal_create_with_allocator(
     pb_allocator_t *allocator, const uint8_t data[], size_t size) {
   assert(allocator && data && size);
   pb_journal_t journal = {
-    .buffer = pb_buffer_create_with_allocator(allocator, data, size),
-    .entry  = {
-      .data = NULL,
-      .size = 0
-    }
+    .buffer    = pb_buffer_create_with_allocator(allocator, data, size),
+    .entry     = {
+      .data     = NULL,
+      .size     = 0,
+      .capacity = 0
+    },
+    .allocator = NULL
   };
   return journal;
 }
@@ -153,11 +190,59 @@ extern pb_journal_t
 pb_journal_create_empty_with_allocator(pb_allocator_t *allocator) {
   assert(allocator);
   pb_journal_t journal = {
-    .buffer = pb_buffer_create_empty_with_allocator(allocator),
-    .entry  = {
-      .data = NULL,
-      .size = 0
-    }
+    .buffer    = pb_buffer_create_empty_with_allocator(allocator),
+    .entry     = {
+      .data     = NULL,
+      .size     = 0,
+      .capacity = 0
+    },
+    .allocator = NULL
+  };
+  return journal;
+}
+
+/*!
+ * Create an empty journal backed by inline storage.
+ *
+ * \param[in,out] block[] Inline storage
+ * \param[in]     size    Inline storage size
+ * \return                Journal
+ */
+extern pb_journal_t
+pb_journal_create_inline(uint8_t block[], size_t size) {
+  return pb_journal_create_inline_with_allocator(
+    &allocator_default, block, size);
+}
+
+/*!
+ * Create an empty journal backed by inline storage using a custom allocator.
+ *
+ * Messages that fit into the given block of memory are written without any
+ * allocations for the data. Larger messages are transparently moved to memory
+ * obtained from the allocator, which is also used for the journal entries.
+ *
+ * \warning A journal does not take ownership of the provided allocator or
+ * block of memory, so the caller must ensure that neither is freed during
+ * operations.
+ *
+ * \param[in,out] allocator Allocator
+ * \param[in,out] block[]   Inline storage
+ * \param[in]     size      Inline storage size
+ * \return                  Journal
+ */
+extern pb_journal_t
+pb_journal_create_inline_with_allocator(
+    pb_allocator_t *allocator, uint8_t block[], size_t size) {
+  assert(allocator && block && size);
+  pb_journal_t journal = {
+    .buffer    = pb_buffer_create_inline_with_allocator(
+      allocator, block, size),
+    .entry     = {
+      .data     = NULL,
+      .size     = 0,
+      .capacity = 0
+    },
+    .allocator = NULL
   };
   return journal;
 }
@@ -173,11 +258,112 @@ extern pb_journal_t
 pb_journal_create_zero_copy(uint8_t data[], size_t size) {
   assert(data && size);
   pb_journal_t journal = {
-    .buffer = pb_buffer_create_zero_copy(data, size),
-    .entry  = {
-      .data = NULL,
-      .size = 0
-    }
+    .buffer    = pb_buffer_create_zero_copy(data, size),
+    .entry     = {
+      .data     = NULL,
+      .size     = 0,
+      .capacity = 0
+    },
+    .allocator = NULL
+  };
+  return journal;
+}
+
+/*!
+ * Create a copy-on-write journal.
+ *
+ * \param[in,out] data[] Raw data
+ * \param[in]     size   Raw data size
+ * \return               Journal
+ */
+extern pb_journal_t
+pb_journal_create_copy_on_write(uint8_t data[], size_t size) {
+  return pb_journal_create_copy_on_write_with_allocator(
+    &allocator_default, data, size);
+}
+
+/*!
+ * Create a copy-on-write journal using a custom allocator.
+ *
+ * A copy-on-write journal starts out as a zero-copy journal, so reads and
+ * writes that don't change the size of the data operate on the provided data
+ * in place. The first write that grows or shrinks the data copies it into
+ * memory obtained from the allocator, which the journal owns from then on.
+ * This makes it cheap to wrap all incoming data, paying for the copy only if
+ * the message is actually altered.
+ *
+ * \warning A journal does not take ownership of the provided allocator, so the
+ * caller must ensure that the allocator is not freed during operations.
+ *
+ * \param[in,out] allocator Allocator
+ * \param[in,out] data[]    Raw data
+ * \param[in]     size      Raw data size
+ * \return                  Journal
+ */
+extern pb_journal_t
+pb_journal_create_copy_on_write_with_allocator(
+    pb_allocator_t *allocator, uint8_t data[], size_t size) {
+  assert(allocator && data && size);
+  pb_journal_t journal = {
+    .buffer    = pb_buffer_create_zero_copy(data, size),
+    .entry     = {
+      .data     = NULL,
+      .size     = 0,
+      .capacity = 0
+    },
+    .allocator = allocator
+  };
+  return journal;
+}
+
+/*!
+ * Create a journal backed by a memory-mapped file.
+ *
+ * Journal entries are kept in memory obtained from the system-default
+ * allocator, as only the data itself is mapped. See pb_buffer_create_mmap()
+ * for the semantics of the mapping modes.
+ *
+ * \param[in] path[] File path
+ * \param[in] mode   Mapping mode
+ * \return           Journal
+ */
+extern pb_journal_t
+pb_journal_create_mmap(const char path[], pb_buffer_mode_t mode) {
+  assert(path);
+  pb_journal_t journal = {
+    .buffer    = pb_buffer_create_mmap(path, mode),
+    .entry     = {
+      .data     = NULL,
+      .size     = 0,
+      .capacity = 0
+    },
+    .allocator = &allocator_default
+  };
+  return journal;
+}
+
+/*!
+ * Create a journal backed by a shared memory object.
+ *
+ * Journal entries are kept in memory obtained from the system-default
+ * allocator, as only the data itself is shared. See pb_buffer_create_shm()
+ * for the semantics of shared memory objects.
+ *
+ * \param[in] name[] Shared memory object name
+ * \param[in] mode   Mapping mode
+ * \return           Journal
+ */
+extern pb_journal_t
+pb_journal_create_shm(const char name[], pb_buffer_mode_t mode) {
+  assert(name);
+  pb_journal_t journal = {
+    .buffer    = pb_buffer_create_shm(name, mode),
+    .entry     = {
+      .data     = NULL,
+      .size     = 0,
+      .capacity = 0
+    },
+    .allocator = &allocator_default
   };
   return journal;
 }
@@ -192,17 +378,59 @@ pb_journal_destroy(pb_journal_t *journal) {
   assert(journal);
   if (pb_journal_valid(journal)) {
     if (journal->entry.data) {
-      pb_allocator_t *allocator = pb_buffer_allocator(&(journal->buffer));
-      pb_allocator_free(allocator, journal->entry.data);
+      pb_allocator_free(allocator_from_journal(journal), journal->entry.data);
 
       /* Clear entries */
-      journal->entry.data = NULL;
-      journal->entry.size = 0;
+      journal->entry.data     = NULL;
+      journal->entry.size     = 0;
+      journal->entry.capacity = 0;
     }
     pb_buffer_destroy(&(journal->buffer));
   }
 }
 
+/*!
+ * Reset a journal, retaining the capacity of its buffer and entries.
+ *
+ * The journal is emptied and its version is reset, but all allocated memory
+ * is kept, so the journal can be reused for the next message without
+ * allocating as long as its capacity suffices. A copy-on-write journal that
+ * was not yet promoted becomes an empty journal using its allocator.
+ *
+ * \warning All messages and parts that were created on the journal become
+ * invalid, as they refer to versions of the journal that no longer exist.
+ *
+ * \param[in,out] journal Journal
+ */
+extern void
+pb_journal_reset(pb_journal_t *journal) {
+  assert(journal);
+  if (pb_journal_valid(journal)) {
+    pb_allocator_t *allocator = pb_buffer_allocator(&(journal->buffer));
+    if (allocator == &allocator_zero_copy && journal->allocator) {
+      journal->buffer =
+        pb_buffer_create_empty_with_allocator(journal->allocator);
+    } else {
+      pb_buffer_reset(&(journal->buffer));
+    }
+    journal->entry.size = 0;
+  }
+}
+
+/*!
+ * Flush the changes of a journal backed by a memory-mapped file to disk.
+ *
+ * \param[in,out] journal Journal
+ * \return                Error code
+ */
+extern pb_error_t
+pb_journal_sync(pb_journal_t *journal) {
+  assert(journal);
+  if (unlikely_(!pb_journal_valid(journal)))
+    return PB_ERROR_INVALID;
+  return pb_buffer_sync(&(journal->buffer));
+}
+
 /*!
  * Write data to a journal.
  *
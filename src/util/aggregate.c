@@ -0,0 +1,533 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "core/allocator.h"
+#include "core/buffer.h"
+#include "core/common.h"
+#include "core/descriptor.h"
+#include "util/aggregate.h"
+#include "util/path.h"
+#include "util/record.h"
+
+/* ----------------------------------------------------------------------------
+ * Constants
+ * ------------------------------------------------------------------------- */
+
+/* Number of values folded at once */
+#define BATCH 256
+
+/* Number of messages claimed by a thread at once */
+#define CHUNK 256
+
+/* Number of independent accumulators */
+#define LANES 4
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_aggregate_source_t {
+  pthread_mutex_t mutex;               /*!< Mutex */
+  const pb_buffer_t *buffers;          /*!< Buffers, if any */
+  size_t size;                         /*!< Buffer count */
+  size_t offset;                       /*!< Offset of next buffer */
+  pb_record_reader_t *reader;          /*!< Record reader, if any */
+  pb_error_t error;                    /*!< First error */
+} pb_aggregate_source_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_aggregate_worker_t {
+  pb_aggregate_source_t *source;       /*!< Shared source */
+  pb_aggregate_t partial;              /*!< Partial result */
+  pb_buffer_t records[CHUNK];          /*!< Claimed records */
+  double values[BATCH];                /*!< Values to be folded */
+  size_t size;                         /*!< Value count */
+  pthread_t thread;                    /*!< Thread */
+  int started;                         /*!< Whether the thread was started */
+} pb_aggregate_worker_t;
+
+/* ----------------------------------------------------------------------------
+ * Internal functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Test whether a path ends in a numeric field.
+ *
+ * \param[in] path Path
+ * \return         Test result
+ */
+static int
+numeric(const pb_path_t *path) {
+  assert(path);
+  switch (pb_field_descriptor_type(
+      pb_path_segment(path, pb_path_size(path) - 1)->descriptor)) {
+    case PB_TYPE_STRING:
+    case PB_TYPE_BYTES:
+    case PB_TYPE_MESSAGE:
+      return 0;
+    default:
+      return 1;
+  }
+}
+
+/*!
+ * Fold a batch of values into an aggregate.
+ *
+ * Sums and extremes are computed in independent lanes, so there are no
+ * dependencies between consecutive iterations and the loop can be pipelined
+ * or vectorized. Values outside of the histogram's bounds are counted in the
+ * first or last bin, respectively.
+ *
+ * \param[in,out] aggregate Aggregate
+ * \param[in]     values[]  Values
+ * \param[in]     size      Value count
+ */
+static void
+fold(pb_aggregate_t *aggregate, const double values[], size_t size) {
+  assert(aggregate && (values || !size));
+  double sum[LANES], min[LANES], max[LANES];
+  for (size_t l = 0; l < LANES; l++) {
+    sum[l] = 0;
+    min[l] = aggregate->min;
+    max[l] = aggregate->max;
+  }
+
+  /* Compute sums and extremes */
+  for (size_t v = 0; v < size; v++) {
+    const size_t l = v % LANES;
+    sum[l] += values[v];
+    min[l]  = values[v] < min[l] ? values[v] : min[l];
+    max[l]  = values[v] > max[l] ? values[v] : max[l];
+  }
+  for (size_t l = 0; l < LANES; l++) {
+    aggregate->sum += sum[l];
+    aggregate->min  = min[l] < aggregate->min ? min[l] : aggregate->min;
+    aggregate->max  = max[l] > aggregate->max ? max[l] : aggregate->max;
+  }
+  aggregate->count += size;
+
+  /* Compute histogram, if any */
+  const size_t bins = aggregate->histogram.size;
+  if (bins) {
+    const double lower = aggregate->histogram.lower,
+                 scale = bins / (aggregate->histogram.upper - lower);
+    for (size_t v = 0; v < size; v++) {
+      const double offset = (values[v] - lower) * scale;
+      aggregate->histogram.data[offset > 0
+        ? offset < bins ? (size_t)offset : bins - 1
+        : 0]++;
+    }
+  }
+}
+
+/*!
+ * Merge a partial result into an aggregate.
+ *
+ * \param[in,out] aggregate Aggregate
+ * \param[in]     partial   Partial result
+ */
+static void
+merge(pb_aggregate_t *aggregate, const pb_aggregate_t *partial) {
+  assert(aggregate && partial);
+  aggregate->count += partial->count;
+  aggregate->sum   += partial->sum;
+  if (partial->min < aggregate->min)
+    aggregate->min = partial->min;
+  if (partial->max > aggregate->max)
+    aggregate->max = partial->max;
+  for (size_t b = 0; b < aggregate->histogram.size; b++)
+    aggregate->histogram.data[b] += partial->histogram.data[b];
+}
+
+/*!
+ * Record the first error of all threads, so the others stop early.
+ *
+ * \param[in,out] source Shared source
+ * \param[in]     error  Error code
+ */
+static void
+fail(pb_aggregate_source_t *source, pb_error_t error) {
+  assert(source && error);
+  pthread_mutex_lock(&(source->mutex));
+  if (!source->error)
+    source->error = error;
+  pthread_mutex_unlock(&(source->mutex));
+}
+
+/*!
+ * Claim the next chunk of messages from the shared source.
+ *
+ * Buffers are claimed by advancing an offset. Records are claimed by reading
+ * their length prefixes only, so the serial part of reading a file is small,
+ * and threads which finish early simply claim more chunks.
+ *
+ * \param[in,out] worker  Worker
+ * \param[out]    buffers Pointer receiving messages
+ * \return                Message count
+ */
+static size_t
+claim(pb_aggregate_worker_t *worker, const pb_buffer_t **buffers) {
+  assert(worker && buffers);
+  pb_aggregate_source_t *source = worker->source;
+  size_t size = 0;
+  pthread_mutex_lock(&(source->mutex));
+  if (!source->error) {
+
+    /* Read records from file */
+    if (source->reader) {
+      pb_error_t error = PB_ERROR_NONE;
+      while (size < CHUNK && !(error = pb_record_reader_next(
+          source->reader, &(worker->records[size]))))
+        size++;
+      if (error && error != PB_ERROR_EOM)
+        source->error = error;
+      *buffers = worker->records;
+
+    /* Advance offset of buffers */
+    } else {
+      size = source->size - source->offset;
+      if (size > CHUNK)
+        size = CHUNK;
+      *buffers = &(source->buffers[source->offset]);
+      source->offset += size;
+    }
+  }
+  pthread_mutex_unlock(&(source->mutex));
+  return size;
+}
+
+/*!
+ * Collect a value, folding values in batches.
+ *
+ * \param[in]     descriptor Field descriptor
+ * \param[in]     value      Pointer holding value
+ * \param[in,out] user       Worker
+ * \return                   Error code
+ */
+static pb_error_t
+handler(
+    const pb_field_descriptor_t *descriptor, const void *value, void *user) {
+  assert(descriptor && value && user);
+  pb_aggregate_worker_t *worker = user;
+  double number;
+  switch (pb_field_descriptor_type(descriptor)) {
+    case PB_TYPE_INT32:
+    case PB_TYPE_SINT32:
+    case PB_TYPE_SFIXED32:
+      number = *(const int32_t *)value;
+      break;
+    case PB_TYPE_INT64:
+    case PB_TYPE_SINT64:
+    case PB_TYPE_SFIXED64:
+      number = *(const int64_t *)value;
+      break;
+    case PB_TYPE_UINT32:
+    case PB_TYPE_FIXED32:
+      number = *(const uint32_t *)value;
+      break;
+    case PB_TYPE_UINT64:
+    case PB_TYPE_FIXED64:
+      number = *(const uint64_t *)value;
+      break;
+    case PB_TYPE_FLOAT:
+      number = *(const float *)value;
+      break;
+    case PB_TYPE_DOUBLE:
+      number = *(const double *)value;
+      break;
+    case PB_TYPE_BOOL:
+      number = *(const uint8_t *)value;
+      break;
+    case PB_TYPE_ENUM:
+      number = *(const pb_enum_t *)value;
+      break;
+    default:
+      return PB_ERROR_INVALID;                             /* LCOV_EXCL_LINE */
+  }
+
+  /* Buffer value and fold batch, if full */
+  worker->values[worker->size++] = number;
+  if (worker->size == BATCH) {
+    fold(&(worker->partial), worker->values, BATCH);
+    worker->size = 0;
+  }
+  return PB_ERROR_NONE;
+}
+
+/*!
+ * Aggregate chunks of messages until the shared source is exhausted.
+ *
+ * \param[in,out] data Worker
+ * \return             Nothing
+ */
+static void *
+run(void *data) {
+  assert(data);
+  pb_aggregate_worker_t *worker = data;
+  const pb_path_t *path = worker->partial.path;
+  pb_error_t error = PB_ERROR_NONE;
+
+  /* Evaluate path on claimed messages */
+  const pb_buffer_t *buffers;
+  for (size_t size; !error && (size = claim(worker, &buffers)); )
+    for (size_t b = 0; !error && b < size; b++)
+      error = pb_path_evaluate(path, &(buffers[b]), handler, worker);
+  if (unlikely_(error))
+    fail(worker->source, error);
+
+  /* Fold remaining values */
+  fold(&(worker->partial), worker->values, worker->size);
+  worker->size = 0;
+  return NULL;
+}
+
+/*!
+ * Aggregate all messages of a source using a number of threads.
+ *
+ * The calling thread takes part in the aggregation. If threads cannot be
+ * started, the remaining threads process all messages. The aggregate is only
+ * altered if all messages were aggregated successfully.
+ *
+ * \param[in,out] aggregate Aggregate
+ * \param[in,out] source    Shared source
+ * \param[in]     threads   Thread count, 0 for one per processor
+ * \return                  Error code
+ */
+static pb_error_t
+aggregate_source(
+    pb_aggregate_t *aggregate, pb_aggregate_source_t *source,
+    size_t threads) {
+  assert(aggregate && source);
+  if (!threads) {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = processors > 0 ? (size_t)processors : 1;
+  }
+
+  /* Allocate workers and histograms for partial results */
+  const size_t bins = aggregate->histogram.size;
+  pb_aggregate_worker_t *workers = pb_allocator_allocate(&allocator_default,
+    threads * sizeof(pb_aggregate_worker_t));
+  uint64_t *data = bins ? pb_allocator_allocate(&allocator_default,
+    threads * bins * sizeof(uint64_t)) : NULL;
+  if (unlikely_(!workers || (bins && !data))) {
+    if (workers)
+      pb_allocator_free(&allocator_default, workers);
+    return PB_ERROR_ALLOC;
+  }
+  if (bins)
+    memset(data, 0, threads * bins * sizeof(uint64_t));
+
+  /* Initialize workers with empty partial results */
+  for (size_t w = 0; w < threads; w++) {
+    workers[w].source                 = source;
+    workers[w].partial                = *aggregate;
+    workers[w].partial.histogram.data = bins ? &(data[w * bins]) : NULL;
+    workers[w].size                   = 0;
+    workers[w].started                = 0;
+    pb_aggregate_reset(&(workers[w].partial));
+  }
+
+  /* Start threads, take part in aggregation and wait for completion */
+  pthread_mutex_init(&(source->mutex), NULL);
+  for (size_t w = 1; w < threads; w++)
+    workers[w].started = !pthread_create(
+      &(workers[w].thread), NULL, run, &(workers[w]));
+  run(&(workers[0]));
+  for (size_t w = 1; w < threads; w++)
+    if (workers[w].started)
+      pthread_join(workers[w].thread, NULL);
+  pthread_mutex_destroy(&(source->mutex));
+
+  /* Merge partial results */
+  pb_error_t error = source->error;
+  if (!error)
+    for (size_t w = 0; w < threads; w++)
+      merge(aggregate, &(workers[w].partial));
+
+  /* Free all allocated memory */
+  if (data)
+    pb_allocator_free(&allocator_default, data);
+  pb_allocator_free(&allocator_default, workers);
+  return error;
+}
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create an aggregate for a numeric field.
+ *
+ * \warning An aggregate does not take ownership of the provided path, so the
+ * caller must ensure that the path is not freed during operations.
+ *
+ * \param[in] path Path
+ * \return         Aggregate
+ */
+extern pb_aggregate_t
+pb_aggregate_create(const pb_path_t *path) {
+  assert(path);
+  if (unlikely_(!pb_path_valid(path) || !numeric(path)))
+    return pb_aggregate_create_invalid(PB_ERROR_INVALID);
+  pb_aggregate_t aggregate = {
+    .path  = path,
+    .error = PB_ERROR_NONE
+  };
+  pb_aggregate_reset(&aggregate);
+  return aggregate;
+}
+
+/*!
+ * Create an aggregate for a numeric field with a histogram.
+ *
+ * The histogram divides the range between the lower and upper bound into
+ * bins of equal width. Values outside of the range are counted in the first
+ * or last bin, respectively.
+ *
+ * \warning An aggregate does not take ownership of the provided path, so the
+ * caller must ensure that the path is not freed during operations.
+ *
+ * \param[in] path  Path
+ * \param[in] lower Lower bound
+ * \param[in] upper Upper bound
+ * \param[in] size  Bin count
+ * \return          Aggregate
+ */
+extern pb_aggregate_t
+pb_aggregate_create_with_histogram(
+    const pb_path_t *path, double lower, double upper, size_t size) {
+  assert(path && lower < upper && size);
+  pb_aggregate_t aggregate = pb_aggregate_create(path);
+  if (unlikely_(!pb_aggregate_valid(&aggregate)))
+    return aggregate;
+
+  /* Allocate histogram */
+  uint64_t *data =
+    pb_allocator_allocate(&allocator_default, size * sizeof(uint64_t));
+  if (unlikely_(!data))
+    return pb_aggregate_create_invalid(PB_ERROR_ALLOC);
+  aggregate.histogram.lower = lower;
+  aggregate.histogram.upper = upper;
+  aggregate.histogram.data  = data;
+  aggregate.histogram.size  = size;
+  pb_aggregate_reset(&aggregate);
+  return aggregate;
+}
+
+/*!
+ * Destroy an aggregate.
+ *
+ * \param[in,out] aggregate Aggregate
+ */
+extern void
+pb_aggregate_destroy(pb_aggregate_t *aggregate) {
+  assert(aggregate);
+  if (pb_aggregate_valid(aggregate) && aggregate->histogram.data)
+    pb_allocator_free(&allocator_default, aggregate->histogram.data);
+  aggregate->histogram.data = NULL;
+  aggregate->histogram.size = 0;
+  aggregate->error          = PB_ERROR_INVALID;
+}
+
+/*!
+ * Aggregate the values of a field over a batch of buffers.
+ *
+ * The batch is partitioned into chunks, which are claimed and scanned by the
+ * given number of threads. Fields not on the path are skipped without being
+ * decoded, and no messages are built. The results are added to those of
+ * previous aggregations, unless an error occurs, in which case the aggregate
+ * is not altered.
+ *
+ * \param[in,out] aggregate Aggregate
+ * \param[in]     buffers[] Buffers
+ * \param[in]     size      Buffer count
+ * \param[in]     threads   Thread count, 0 for one per processor
+ * \return                  Error code
+ */
+extern pb_error_t
+pb_aggregate_buffers(
+    pb_aggregate_t *aggregate, const pb_buffer_t buffers[], size_t size,
+    size_t threads) {
+  assert(aggregate && (buffers || !size));
+  if (unlikely_(!pb_aggregate_valid(aggregate)))
+    return PB_ERROR_INVALID;
+  pb_aggregate_source_t source = {
+    .buffers = buffers,
+    .size    = size
+  };
+  return aggregate_source(aggregate, &source, threads);
+}
+
+/*!
+ * Aggregate the values of a field over a record file.
+ *
+ * The file is memory-mapped, and chunks of records are claimed and scanned by
+ * the given number of threads, exactly like a batch of buffers.
+ *
+ * \param[in,out] aggregate Aggregate
+ * \param[in]     path[]    Path of record file
+ * \param[in]     threads   Thread count, 0 for one per processor
+ * \return                  Error code
+ */
+extern pb_error_t
+pb_aggregate_file(pb_aggregate_t *aggregate, const char path[], size_t threads) {
+  assert(aggregate && path);
+  if (unlikely_(!pb_aggregate_valid(aggregate)))
+    return PB_ERROR_INVALID;
+  pb_record_reader_t reader = pb_record_reader_create(path);
+  if (unlikely_(!pb_record_reader_valid(&reader)))
+    return PB_ERROR_IO;
+
+  /* Aggregate records */
+  pb_aggregate_source_t source = {
+    .reader = &reader
+  };
+  pb_error_t error = aggregate_source(aggregate, &source, threads);
+  pb_record_reader_destroy(&reader);
+  return error;
+}
+
+/*!
+ * Reset the results of an aggregate.
+ *
+ * \param[in,out] aggregate Aggregate
+ */
+extern void
+pb_aggregate_reset(pb_aggregate_t *aggregate) {
+  assert(aggregate);
+  aggregate->count = 0;
+  aggregate->sum   = 0;
+  aggregate->min   =  INFINITY;
+  aggregate->max   = -INFINITY;
+  if (aggregate->histogram.size)
+    memset(aggregate->histogram.data, 0,
+      aggregate->histogram.size * sizeof(uint64_t));
+}
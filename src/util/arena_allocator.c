@@ -0,0 +1,573 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Enable anonymous mappings and hugepage advice, if available */
+#ifndef _GNU_SOURCE
+  #define _GNU_SOURCE
+#endif
+
+/* Detect available system calls */
+#ifdef HAVE_CONFIG_H
+  #include "config.h"
+#endif
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "core/allocator.h"
+#include "core/common.h"
+#include "util/arena_allocator.h"
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_arena_block_t {
+  struct pb_arena_block_t *next;       /*!< Next linked block */
+  size_t capacity;                     /*!< Capacity */
+  size_t size;                         /*!< Bytes in use */
+} pb_arena_block_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_arena_allocator_t {
+  pb_arena_block_t *head;              /*!< First block */
+  pb_arena_block_t *current;           /*!< Block allocations are made from */
+  uint8_t *last;                       /*!< Last allocated memory block */
+  size_t capacity;                     /*!< Minimum block capacity */
+  int embedded;                        /*!< Arena lives in initial block */
+  int huge;                            /*!< Blocks are backed by hugepages */
+} pb_arena_allocator_t;
+
+/* ----------------------------------------------------------------------------
+ * Constants
+ * ------------------------------------------------------------------------- */
+
+/* Alignment of all memory blocks */
+#define ALIGNMENT 16
+
+/* Size of a transparent hugepage */
+#define HUGEPAGE (2 * 1024 * 1024)
+
+/* ----------------------------------------------------------------------------
+ * Macros
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Round a size up to the next multiple of the alignment.
+ *
+ * \param[in] size Size
+ * \return         Aligned size
+ */
+#define align(size) \
+  (((size) + ALIGNMENT - 1) & ~((size_t)ALIGNMENT - 1))
+
+/* Size of the prefix storing the size of a memory block */
+#define PREFIX align(sizeof(size_t))
+
+/*!
+ * Round a size up to the next multiple of the hugepage size.
+ *
+ * \param[in] size Size
+ * \return         Aligned size
+ */
+#define align_huge(size) \
+  (((size) + HUGEPAGE - 1) & ~((size_t)HUGEPAGE - 1))
+
+/*!
+ * Retrieve the start of the usable data of a block.
+ *
+ * \param[in] block Block
+ * \return          Data
+ */
+#define data_from_block(block) \
+  (assert(block), (uint8_t *)(block) + align(sizeof(pb_arena_block_t)))
+
+/*!
+ * Retrieve the size stored in the prefix of a memory block.
+ *
+ * \param[in] memory Memory block
+ * \return           Size
+ */
+#define size_from_memory(memory) \
+  (*(size_t *)((uint8_t *)(memory) - PREFIX))
+
+/* ----------------------------------------------------------------------------
+ * Internal functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Map memory backed by hugepages.
+ *
+ * Explicit hugepages are tried first, which only succeeds if the system has
+ * reserved some. Otherwise, regular pages are mapped at a hugepage boundary
+ * and the kernel is advised to back them by transparent hugepages, which
+ * it does on a best-effort basis.
+ *
+ * \warning The size must be a multiple of the hugepage size. The lines
+ * excluded from code coverage depend on the configuration of the system.
+ *
+ * \param[in] size Bytes to be mapped
+ * \return         Mapped memory
+ */
+static void *
+map_huge(size_t size) {
+  assert(size && size == align_huge(size));
+  uint8_t *memory;
+#ifdef MAP_HUGETLB
+  memory = mmap(NULL, size, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (memory != MAP_FAILED)
+    return memory;                                         /* LCOV_EXCL_LINE */
+#endif /* MAP_HUGETLB */
+
+  /* Map with slack, so the memory can be aligned to a hugepage boundary */
+  memory = mmap(NULL, size + HUGEPAGE, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (unlikely_(memory == MAP_FAILED))
+    return NULL;                                           /* LCOV_EXCL_LINE */
+
+  /* Unmap slack before and after the aligned memory */
+  size_t offset = align_huge((uintptr_t)memory) - (uintptr_t)memory;
+  if (offset)
+    munmap(memory, offset);
+  munmap(memory + offset + size, HUGEPAGE - offset);
+  memory += offset;
+
+#if defined(HAVE_MADVISE) && defined(MADV_HUGEPAGE)
+  madvise(memory, size, MADV_HUGEPAGE);
+#endif /* HAVE_MADVISE && MADV_HUGEPAGE */
+  return memory;
+}
+
+/*!
+ * Allocate a block with a given capacity, including its header.
+ *
+ * \param[in]     arena    Arena
+ * \param[in,out] capacity Capacity, adjusted to the actual capacity
+ * \return                 Block
+ */
+static pb_arena_block_t *
+block_allocate(const pb_arena_allocator_t *arena, size_t *capacity) {
+  assert(arena && capacity);
+  size_t size = align(sizeof(pb_arena_block_t)) + *capacity;
+  if (!arena->huge)
+    return malloc(size);
+
+  /* Use all of the mapped memory */
+  size = align_huge(size);
+  *capacity = size - align(sizeof(pb_arena_block_t));
+  return map_huge(size);
+}
+
+/*!
+ * Free a block that was allocated with block_allocate().
+ *
+ * \param[in]     arena Arena
+ * \param[in,out] block Block
+ */
+static void
+block_free(const pb_arena_allocator_t *arena, pb_arena_block_t *block) {
+  assert(arena && block);
+  if (arena->huge) {
+    munmap(block, align(sizeof(pb_arena_block_t)) + block->capacity);
+  } else {
+    free(block);
+  }
+}
+
+/*!
+ * Advance to a block which is able to hold a given number of bytes.
+ *
+ * Blocks following the current one were retained by a reset and are reused
+ * if they are large enough. Otherwise, a new block is inserted.
+ *
+ * \warning The lines excluded from code coverage cannot be triggered within
+ * the tests, as we're not going to mock malloc.
+ *
+ * \param[in,out] arena Arena
+ * \param[in]     size  Bytes needed
+ * \return              Block
+ */
+static pb_arena_block_t *
+advance(pb_arena_allocator_t *arena, size_t size) {
+  assert(arena && size);
+  pb_arena_block_t *current = arena->current;
+  if (current->next && current->next->capacity >= size) {
+    current->next->size = 0;
+    return arena->current = current->next;
+  }
+
+  /* Allocate block large enough for the requested size */
+  size_t capacity = size > arena->capacity ? size : arena->capacity;
+  pb_arena_block_t *block = block_allocate(arena, &capacity);
+  if (unlikely_(!block))
+    return NULL;                                           /* LCOV_EXCL_LINE */
+
+  /* Link block after current block */
+  *block = (pb_arena_block_t){
+    .next     = current->next,
+    .capacity = capacity,
+    .size     = 0
+  };
+  current->next = block;
+  return arena->current = block;
+}
+
+/* ----------------------------------------------------------------------------
+ * Allocator callbacks
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Allocate a memory block of given size.
+ *
+ * Memory blocks are carved from large blocks by bumping a pointer, so an
+ * allocation is just an addition in the common case. Every memory block is
+ * prefixed with its size, so it can be copied when it must be moved.
+ *
+ * \param[in,out] data Internal allocator data
+ * \param[in]     size Bytes to be allocated
+ * \return             Memory block
+ */
+static void *
+allocator_allocate(void *data, size_t size) {
+  assert(size);
+  if (unlikely_(!data))
+    return NULL;
+
+  /* Advance to next block, if the current one is exhausted */
+  pb_arena_allocator_t *arena = data;
+  pb_arena_block_t *block = arena->current;
+  size_t needed = PREFIX + align(size);
+  if (unlikely_(block->size + needed > block->capacity))
+    if (unlikely_(!(block = advance(arena, needed))))
+      return NULL;                                         /* LCOV_EXCL_LINE */
+
+  /* Bump pointer and store size in prefix */
+  uint8_t *memory = data_from_block(block) + block->size + PREFIX;
+  size_from_memory(memory) = size;
+  block->size += needed;
+  return arena->last = memory;
+}
+
+/*!
+ * Change the size of a previously allocated memory block.
+ *
+ * If the memory block is the last one that was allocated, it is resized in
+ * place as long as the current block has enough space left, which is what
+ * happens when a buffer or journal grows. Shrinking always happens in place.
+ * Otherwise, a new memory block is allocated and the data is copied.
+ *
+ * \param[in,out] data  Internal allocator data
+ * \param[in,out] block Memory block to be resized
+ * \param[in]     size  Bytes to be allocated
+ * \return              Memory block
+ */
+static void *
+allocator_resize(void *data, void *block, size_t size) {
+  assert(size);
+  if (unlikely_(!data))
+    return NULL;
+
+  /* Allocate new block */
+  if (unlikely_(!block))
+    return allocator_allocate(data, size);
+
+  /* Resize last memory block in place, if possible */
+  pb_arena_allocator_t *arena = data;
+  pb_arena_block_t *current = arena->current;
+  if (block == arena->last) {
+    size_t offset = (uint8_t *)block - data_from_block(current);
+    if (offset + align(size) <= current->capacity) {
+      current->size = offset + align(size);
+      size_from_memory(block) = size;
+      return block;
+    }
+
+  /* Shrink other memory block in place */
+  } else if (size <= size_from_memory(block)) {
+    size_from_memory(block) = size;
+    return block;
+  }
+
+  /* Allocate new memory block and copy data */
+  size_t previous = size_from_memory(block);
+  void *memory = allocator_allocate(data, size);
+  if (likely_(memory != NULL)) {
+    memcpy(memory, block, previous < size ? previous : size);
+
+    /* Reclaim space of memory block, if it was the last in its block */
+    if (block == data_from_block(current) + current->size - align(previous))
+      current->size -= PREFIX + align(previous);
+  }
+  return memory;
+}
+
+/*!
+ * Free an allocated memory block.
+ *
+ * Only the space of the last allocated memory block is reclaimed immediately,
+ * all other space is reclaimed when the arena is reset or destroyed.
+ *
+ * \param[in,out] data  Internal allocator data
+ * \param[in,out] block Memory block to be freed
+ */
+static void
+allocator_free(void *data, void *block) {
+  assert(block);
+  if (unlikely_(!data))
+    return;
+
+  /* Rewind pointer if the memory block was the last one allocated */
+  pb_arena_allocator_t *arena = data;
+  if (block == arena->last) {
+    arena->current->size = (uint8_t *)block - PREFIX -
+      data_from_block(arena->current);
+    arena->last = NULL;
+  }
+}
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create an arena allocator.
+ *
+ * \return Arena allocator
+ */
+extern pb_allocator_t
+pb_arena_allocator_create(void) {
+  return pb_arena_allocator_create_with_capacity(65536);
+}
+
+/*!
+ * Create an arena allocator with a minimum block capacity.
+ *
+ * An arena allocator carves memory blocks from large blocks and frees them
+ * all at once, which is considerably faster than managing each memory block
+ * separately. It is best suited for objects which share the same lifetime,
+ * e.g. all journals and encoders used for processing a single request.
+ *
+ * \warning An arena allocator is not thread-safe.
+ *
+ * \param[in] capacity Capacity
+ * \return             Arena allocator
+ */
+extern pb_allocator_t
+pb_arena_allocator_create_with_capacity(size_t capacity) {
+  assert(capacity);
+  pb_allocator_t allocator = {
+    .proc = {
+      .allocate = allocator_allocate,
+      .resize   = allocator_resize,
+      .free     = allocator_free
+    },
+    .data = NULL
+  };
+
+  /* Allocate arena together with first block */
+  capacity = align(capacity);
+  pb_arena_allocator_t *arena = malloc(align(sizeof(pb_arena_allocator_t)) +
+    align(sizeof(pb_arena_block_t)) + capacity);
+  if (arena) {
+    pb_arena_block_t *head = (pb_arena_block_t *)
+      ((uint8_t *)arena + align(sizeof(pb_arena_allocator_t)));
+    *head = (pb_arena_block_t){
+      .next     = NULL,
+      .capacity = capacity,
+      .size     = 0
+    };
+    *arena = (pb_arena_allocator_t){
+      .head     = head,
+      .current  = head,
+      .last     = NULL,
+      .capacity = capacity,
+      .embedded = 0,
+      .huge     = 0
+    };
+    allocator.data = arena;
+  }
+  return allocator;
+}
+
+/*!
+ * Create an arena allocator backed by hugepages.
+ *
+ * All blocks are mapped at hugepage boundaries and span whole hugepages, so
+ * large buffers and journals are covered by few TLB entries, which speeds up
+ * scanning them considerably. Explicit hugepages are used if the system has
+ * reserved some, otherwise transparent hugepages are requested.
+ *
+ * \warning The capacity is rounded up, so that every block spans at least one
+ * hugepage. Thus, this allocator is only suited for very large messages.
+ *
+ * \param[in] capacity Capacity
+ * \return             Arena allocator
+ */
+extern pb_allocator_t
+pb_arena_allocator_create_with_hugepages(size_t capacity) {
+  assert(capacity);
+  pb_allocator_t allocator = {
+    .proc = {
+      .allocate = allocator_allocate,
+      .resize   = allocator_resize,
+      .free     = allocator_free
+    },
+    .data = NULL
+  };
+
+  /* Map arena together with first block, using all of the mapped memory */
+  size_t header = align(sizeof(pb_arena_allocator_t)) +
+                  align(sizeof(pb_arena_block_t)),
+         size   = align_huge(header + align(capacity));
+  pb_arena_allocator_t *arena = map_huge(size);
+  if (arena) {
+    pb_arena_block_t *head = (pb_arena_block_t *)
+      ((uint8_t *)arena + align(sizeof(pb_arena_allocator_t)));
+    *head = (pb_arena_block_t){
+      .next     = NULL,
+      .capacity = size - header,
+      .size     = 0
+    };
+    *arena = (pb_arena_allocator_t){
+      .head     = head,
+      .current  = head,
+      .last     = NULL,
+      .capacity = size - header,
+      .embedded = 0,
+      .huge     = 1
+    };
+    allocator.data = arena;
+  }
+  return allocator;
+}
+
+/*!
+ * Create an arena allocator using a caller-provided initial block.
+ *
+ * The arena and the first block are placed inside the provided memory, e.g.
+ * an array on the stack, so no allocations take place as long as it is large
+ * enough. Further blocks are allocated with the same capacity. If the given
+ * memory is too small to hold the arena itself, the allocator is invalid.
+ *
+ * \warning The arena allocator does not take ownership of the provided memory,
+ * so the caller must ensure that it outlives the allocator.
+ *
+ * \param[in,out] block Initial block
+ * \param[in]     size  Initial block size
+ * \return              Arena allocator
+ */
+extern pb_allocator_t
+pb_arena_allocator_create_with_block(void *block, size_t size) {
+  assert(block && size);
+  pb_allocator_t allocator = {
+    .proc = {
+      .allocate = allocator_allocate,
+      .resize   = allocator_resize,
+      .free     = allocator_free
+    },
+    .data = NULL
+  };
+
+  /* Align provided memory and ensure that arena and first block fit */
+  size_t offset = align((uintptr_t)block) - (uintptr_t)block,
+         header = align(sizeof(pb_arena_allocator_t)) +
+                  align(sizeof(pb_arena_block_t));
+  if (size < offset + header + ALIGNMENT)
+    return allocator;
+
+  /* Place arena together with first block into provided memory */
+  pb_arena_allocator_t *arena = (pb_arena_allocator_t *)
+    ((uint8_t *)block + offset);
+  pb_arena_block_t *head = (pb_arena_block_t *)
+    ((uint8_t *)arena + align(sizeof(pb_arena_allocator_t)));
+  *head = (pb_arena_block_t){
+    .next     = NULL,
+    .capacity = (size - offset - header) & ~((size_t)ALIGNMENT - 1),
+    .size     = 0
+  };
+  *arena = (pb_arena_allocator_t){
+    .head     = head,
+    .current  = head,
+    .last     = NULL,
+    .capacity = align(size),
+    .embedded = 1,
+    .huge     = 0
+  };
+  allocator.data = arena;
+  return allocator;
+}
+
+/*!
+ * Reset an arena allocator.
+ *
+ * All memory blocks are released at once, but the underlying blocks are
+ * retained for reuse, so the arena can serve the next request of the same
+ * magnitude without allocating again.
+ *
+ * \param[in,out] allocator Arena allocator
+ */
+extern void
+pb_arena_allocator_reset(pb_allocator_t *allocator) {
+  assert(allocator);
+  pb_arena_allocator_t *arena = allocator->data;
+  if (arena) {
+    arena->head->size = 0;
+    arena->current    = arena->head;
+    arena->last       = NULL;
+  }
+}
+
+/*!
+ * Destroy an arena allocator.
+ *
+ * The arena allocator will automatically free all memory blocks that are
+ * still allocated upon destruction.
+ *
+ * \param[in,out] allocator Arena allocator
+ */
+extern void
+pb_arena_allocator_destroy(pb_allocator_t *allocator) {
+  assert(allocator);
+  pb_arena_allocator_t *arena = allocator->data;
+  if (arena) {
+    pb_arena_block_t *block = arena->head->next;
+    while (block) {
+      pb_arena_block_t *next = block->next;
+      block_free(arena, block);
+      block = next;
+    }
+
+    /* Free arena together with first block */
+    if (arena->huge) {
+      munmap(arena, align(sizeof(pb_arena_allocator_t)) +
+        align(sizeof(pb_arena_block_t)) + arena->head->capacity);
+    } else if (!arena->embedded) {
+      free(arena);
+    }
+    allocator->data = NULL;
+  }
+}
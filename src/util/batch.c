@@ -0,0 +1,515 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "core/allocator.h"
+#include "core/buffer.h"
+#include "core/common.h"
+#include "core/decoder.h"
+#include "core/stream.h"
+#include "util/batch.h"
+#include "util/executor.h"
+#include "util/pool.h"
+#include "util/validator.h"
+
+/* ----------------------------------------------------------------------------
+ * Constants
+ * ------------------------------------------------------------------------- */
+
+/* Alignment of the state of every buffer */
+#define ALIGNMENT 16
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_batch_span_t {
+  size_t offset;                       /*!< Offset of element */
+  size_t size;                         /*!< Size of element */
+} pb_batch_span_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_batch_job_t {
+  pb_batch_t *batch;                   /*!< Batch */
+  const pb_buffer_t *buffers;          /*!< Buffers, or enclosing buffer */
+  const pb_batch_span_t *spans;        /*!< Spans of elements, if any */
+  int validate;                        /*!< Whether to validate only */
+  uint8_t *states;                     /*!< State of buffers, if any */
+  size_t stride;                       /*!< Distance between states */
+  struct {
+    pthread_mutex_t mutex;             /*!< Mutex */
+    uint8_t *done;                     /*!< Decoded buffers */
+    size_t next;                       /*!< Next buffer to complete */
+    size_t size;                       /*!< Buffer count */
+    pb_error_t error;                  /*!< First completion error */
+  } sequence;
+} pb_batch_job_t;
+
+/* ----------------------------------------------------------------------------
+ * Macros
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve the state of a buffer.
+ *
+ * \param[in] job   Job
+ * \param[in] index Buffer index
+ * \return          State
+ */
+#define state(job, index) \
+  ((job)->states ? (job)->states + (index) * (job)->stride : NULL)
+
+/* ----------------------------------------------------------------------------
+ * Internal functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Mark a buffer as decoded and complete all buffers which are due.
+ *
+ * Completion handlers are invoked while holding the lock of the sequence, so
+ * they are never executed concurrently and always in order of the buffers,
+ * regardless of the thread that decoded a buffer. The context is that of the
+ * calling thread, but refers to the index and state of the buffer, which was
+ * retained since it was decoded. After a completion handler failed, no further
+ * buffers are completed.
+ *
+ * \param[in,out] job     Job
+ * \param[in,out] context Context of calling thread
+ * \return                Error code
+ */
+static pb_error_t
+sequence(pb_batch_job_t *job, pb_batch_context_t *context) {
+  assert(job && context);
+  pthread_mutex_lock(&(job->sequence.mutex));
+  job->sequence.done[context->index] = 1;
+  while (!job->sequence.error && job->sequence.next < job->sequence.size &&
+      job->sequence.done[job->sequence.next]) {
+    context->index = job->sequence.next++;
+    context->state = state(job, context->index);
+    job->sequence.error = job->batch->complete(context);
+  }
+  pb_error_t error = job->sequence.error;
+  pthread_mutex_unlock(&(job->sequence.mutex));
+  return error;
+}
+
+/*!
+ * Decode a buffer of a batch.
+ *
+ * \param[in]     index  Buffer index
+ * \param[in]     thread Thread index
+ * \param[in,out] user   Job
+ * \return               Error code
+ */
+static pb_error_t
+task(size_t index, size_t thread, void *user) {
+  assert(user);
+  pb_batch_job_t *job = user;
+  pb_batch_t *batch = job->batch;
+  pb_batch_context_t *context = &(batch->context.data[thread]);
+
+  /* Retrieve pool of thread, as threads may differ between jobs */
+  if (unlikely_(!context->pool && !(context->pool = pb_pool_local())))
+    return PB_ERROR_ALLOC;                                 /* LCOV_EXCL_LINE */
+
+  /* Create buffer for element of repeated field, if given */
+  pb_buffer_t buffer = job->spans
+    ? pb_buffer_create_zero_copy_internal(
+        pb_buffer_data_from(job->buffers,
+          job->spans[index].offset), job->spans[index].size)
+    : job->buffers[index];
+
+  /* Decode or validate buffer */
+  pb_error_t error;
+  context->index = index;
+  context->state = state(job, index);
+  if (job->validate) {
+    pb_validator_t validator = pb_validator_create(batch->descriptor);
+    error = pb_validator_check(&validator, &buffer);
+    pb_validator_destroy(&validator);
+  } else {
+    pb_decoder_t decoder = pb_decoder_create(batch->descriptor, &buffer);
+    error = pb_decoder_decode(&decoder, batch->handler, context);
+    pb_decoder_destroy(&decoder);
+  }
+
+  /* Complete buffer, if requested */
+  if (!error && !job->validate && batch->complete)
+    error = batch->order == PB_BATCH_ORDER_INDEX
+      ? sequence(job, context)
+      : batch->complete(context);
+  return error;
+}
+
+/*!
+ * Decode or validate buffers or elements of a repeated field in parallel.
+ *
+ * \param[in,out] batch     Batch
+ * \param[in]     buffers[] Buffers, or enclosing buffer
+ * \param[in]     spans[]   Spans of elements, if any
+ * \param[in]     size      Buffer or element count
+ * \param[in]     validate  Whether to validate only
+ * \param[in,out] user      User data
+ * \return                  Error code
+ */
+static pb_error_t
+run(
+    pb_batch_t *batch, const pb_buffer_t buffers[],
+    const pb_batch_span_t spans[], size_t size, int validate, void *user) {
+  assert(batch && (buffers || !size));
+
+  /* Reset contexts */
+  for (size_t c = 0; c < batch->context.size; c++) {
+    batch->context.data[c].index = 0;
+    batch->context.data[c].pool  = NULL;
+    batch->context.data[c].state = NULL;
+    batch->context.data[c].user  = user;
+  }
+  pb_batch_job_t job = {
+    .batch    = batch,
+    .buffers  = buffers,
+    .spans    = spans,
+    .validate = validate,
+    .stride   = (batch->state + ALIGNMENT - 1) & ~((size_t)ALIGNMENT - 1),
+    .sequence = {
+      .size = size
+    }
+  };
+
+  /* Allocate zeroed state for every buffer, retained until completion */
+  pb_error_t error = PB_ERROR_NONE;
+  if (!validate && job.stride && size) {
+    if (unlikely_(size > SIZE_MAX / job.stride ||
+        !(job.states = pb_allocator_allocate(&allocator_default,
+          size * job.stride))))
+      return PB_ERROR_ALLOC;
+    memset(job.states, 0, size * job.stride);
+  }
+
+  /* Allocate sequence for completion in order */
+  const int ordered = !validate && batch->complete &&
+    batch->order == PB_BATCH_ORDER_INDEX;
+  if (ordered && size) {
+    if (unlikely_(!(job.sequence.done =
+        pb_allocator_allocate(&allocator_default, size)))) {
+      error = PB_ERROR_ALLOC;                              /* LCOV_EXCL_LINE */
+    } else {
+      memset(job.sequence.done, 0, size);
+      pthread_mutex_init(&(job.sequence.mutex), NULL);
+    }
+  }
+
+  /* Decode or validate buffers */
+  if (likely_(!error))
+    error = pb_executor_run(batch->executor, size, task, &job);
+
+  /* Free all allocated memory */
+  if (job.sequence.done) {
+    pthread_mutex_destroy(&(job.sequence.mutex));
+    pb_allocator_free(&allocator_default, job.sequence.done);
+  }
+  if (job.states)
+    pb_allocator_free(&allocator_default, job.states);
+  return error;
+}
+
+/*!
+ * Index the spans of all elements of a repeated field.
+ *
+ * Only the tags and lengths of the enclosing message are read, and all other
+ * fields are skipped without being decoded, so this pass is cheap compared to
+ * decoding the elements themselves.
+ *
+ * \param[in]     buffer Buffer
+ * \param[in]     tag    Tag of repeated field
+ * \param[in,out] spans  Spans of elements
+ * \return               Error code
+ */
+static pb_error_t
+scan(const pb_buffer_t *buffer, pb_tag_t tag, pb_buffer_t *spans) {
+  assert(buffer && spans);
+  pb_error_t error = PB_ERROR_NONE;
+  pb_stream_t stream = pb_stream_create(buffer);
+  while (!error && pb_stream_left(&stream)) {
+    uint32_t key;
+    if (unlikely_(error = pb_stream_read(&stream, PB_TYPE_UINT32, &key)))
+      break;
+
+    /* Ensure wiretype is known */
+    pb_wiretype_t wiretype = key & 7;
+    if (unlikely_(wiretype > PB_WIRETYPE_32BIT ||
+        !pb_stream_skip_jump[wiretype])) {
+      error = PB_ERROR_INVALID;
+
+    /* Skip fields other than the repeated field */
+    } else if (key >> 3 != tag || wiretype != PB_WIRETYPE_LENGTH) {
+      error = pb_stream_skip(&stream, wiretype);
+
+    /* Append span of element */
+    } else {
+      uint32_t length;
+      if (unlikely_(error = pb_stream_read(&stream, PB_TYPE_UINT32, &length)))
+        break;
+      pb_batch_span_t span = {
+        .offset = pb_stream_offset(&stream),
+        .size   = length
+      };
+      if (likely_(!(error = pb_stream_advance(&stream, length))) &&
+          likely_(!(error = pb_buffer_reserve(spans, sizeof(span)))))
+        memcpy(pb_buffer_grow(spans, sizeof(span)), &span, sizeof(span));
+    }
+  }
+  pb_stream_destroy(&stream);
+  return error;
+}
+
+/*!
+ * Decode or validate the elements of a repeated field in parallel.
+ *
+ * \param[in,out] batch    Batch
+ * \param[in]     buffer   Buffer
+ * \param[in]     tag      Tag of repeated field
+ * \param[in]     validate Whether to validate only
+ * \param[in,out] user     User data
+ * \return                 Error code
+ */
+static pb_error_t
+decode_field(
+    pb_batch_t *batch, const pb_buffer_t *buffer, pb_tag_t tag,
+    int validate, void *user) {
+  assert(batch && buffer);
+  if (unlikely_(!pb_batch_valid(batch) || !pb_buffer_valid(buffer)))
+    return PB_ERROR_INVALID;
+
+  /* Index spans of elements */
+  pb_buffer_t spans = pb_buffer_create_empty();
+  pb_error_t error = scan(buffer, tag, &spans);
+
+  /* Decode or validate elements */
+  if (likely_(!error))
+    error = run(batch, buffer,
+      (const pb_batch_span_t *)pb_buffer_data(&spans),
+      pb_buffer_size(&spans) / sizeof(pb_batch_span_t), validate, user);
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&spans);
+  return error;
+}
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create a batch for decoding buffers in parallel.
+ *
+ * \warning A batch does not take ownership of the provided executor and
+ * descriptor, so the caller must ensure that they are not freed during
+ * operations.
+ *
+ * \param[in,out] executor   Executor
+ * \param[in]     descriptor Descriptor
+ * \param[in]     handler    Handler
+ * \return                   Batch
+ */
+extern pb_batch_t
+pb_batch_create(
+    pb_executor_t *executor, const pb_descriptor_t *descriptor,
+    pb_decoder_handler_f handler) {
+  assert(executor && descriptor && handler);
+  return pb_batch_create_with_completion(
+    executor, descriptor, handler, NULL, PB_BATCH_ORDER_NONE);
+}
+
+/*!
+ * Create a batch for decoding buffers in parallel with a completion handler.
+ *
+ * The handler is invoked for every field of every buffer with a context as
+ * user data, which is owned by the decoding thread and identifies the thread
+ * and buffer. The completion handler is invoked once a buffer was decoded. If
+ * the order is PB_BATCH_ORDER_INDEX, completion handlers are invoked one at a
+ * time in order of the buffers, which allows to emit results deterministically
+ * while buffers are still being decoded by other threads.
+ *
+ * \warning A batch does not take ownership of the provided executor and
+ * descriptor, so the caller must ensure that they are not freed during
+ * operations.
+ *
+ * \param[in,out] executor   Executor
+ * \param[in]     descriptor Descriptor
+ * \param[in]     handler    Handler
+ * \param[in]     complete   Completion handler
+ * \param[in]     order      Completion order
+ * \return                   Batch
+ */
+extern pb_batch_t
+pb_batch_create_with_completion(
+    pb_executor_t *executor, const pb_descriptor_t *descriptor,
+    pb_decoder_handler_f handler, pb_batch_complete_f complete,
+    pb_batch_order_t order) {
+  assert(executor && descriptor && handler);
+  return pb_batch_create_with_state(
+    executor, descriptor, handler, complete, order, 0);
+}
+
+/*!
+ * Create a batch for decoding buffers in parallel with per-buffer state.
+ *
+ * Every buffer is given zeroed state of the given size, which is passed to
+ * the handler and completion handler through the context. As the state of a
+ * buffer is retained until it was completed, results can be accumulated in
+ * the handler and emitted in the completion handler, even if the buffer is
+ * completed in order by another thread than the one that decoded it.
+ *
+ * \warning A batch does not take ownership of the provided executor and
+ * descriptor, so the caller must ensure that they are not freed during
+ * operations.
+ *
+ * \param[in,out] executor   Executor
+ * \param[in]     descriptor Descriptor
+ * \param[in]     handler    Handler
+ * \param[in]     complete   Completion handler
+ * \param[in]     order      Completion order
+ * \param[in]     state      Size of state per buffer
+ * \return                   Batch
+ */
+extern pb_batch_t
+pb_batch_create_with_state(
+    pb_executor_t *executor, const pb_descriptor_t *descriptor,
+    pb_decoder_handler_f handler, pb_batch_complete_f complete,
+    pb_batch_order_t order, size_t state) {
+  assert(executor && descriptor && handler);
+  if (unlikely_(!pb_executor_valid(executor)))
+    return pb_batch_create_invalid();
+
+  /* Allocate one context per thread */
+  const size_t size = pb_executor_size(executor);
+  pb_batch_context_t *data = pb_allocator_allocate(&allocator_default,
+    size * sizeof(pb_batch_context_t));
+  if (unlikely_(!data))
+    return pb_batch_create_invalid();                      /* LCOV_EXCL_LINE */
+  for (size_t c = 0; c < size; c++) {
+    pb_batch_context_t context = {
+      .thread = c
+    };
+    data[c] = context;
+  }
+  pb_batch_t batch = {
+    .executor   = executor,
+    .descriptor = descriptor,
+    .handler    = handler,
+    .complete   = complete,
+    .order      = order,
+    .state      = state,
+    .context    = {
+      .data = data,
+      .size = size
+    }
+  };
+  return batch;
+}
+
+/*!
+ * Destroy a batch.
+ *
+ * \param[in,out] batch Batch
+ */
+extern void
+pb_batch_destroy(pb_batch_t *batch) {
+  assert(batch);
+  if (batch->context.data)
+    pb_allocator_free(&allocator_default, batch->context.data);
+}
+
+/*!
+ * Decode a batch of buffers in parallel.
+ *
+ * Each buffer is decoded as a whole by a single thread, but buffers are
+ * decoded concurrently, so the handlers must only share state that is
+ * partitioned by thread or buffer index. If a buffer cannot be decoded or a
+ * handler fails, no further buffers are decoded and the first error is
+ * returned. In ordered mode, the buffers completed up to that point always
+ * form a prefix of the batch.
+ *
+ * \param[in,out] batch     Batch
+ * \param[in]     buffers[] Buffers
+ * \param[in]     size      Buffer count
+ * \param[in,out] user      User data
+ * \return                  Error code
+ */
+extern pb_error_t
+pb_batch_decode(
+    pb_batch_t *batch, const pb_buffer_t buffers[], size_t size,
+    void *user) {
+  assert(batch && (buffers || !size));
+  if (unlikely_(!pb_batch_valid(batch)))
+    return PB_ERROR_INVALID;
+  return run(batch, buffers, NULL, size, 0, user);
+}
+
+/*!
+ * Decode the elements of a repeated submessage field in parallel.
+ *
+ * A single message with a huge repeated field is decoded in two passes. The
+ * first pass indexes the spans of all elements, skipping everything else. The
+ * second pass decodes the elements concurrently like a batch of buffers, so
+ * the batch must be created with the descriptor of the submessage, and the
+ * index of the context refers to the element. Other fields of the message are
+ * not decoded.
+ *
+ * \param[in,out] batch  Batch
+ * \param[in]     buffer Buffer
+ * \param[in]     tag    Tag of repeated field
+ * \param[in,out] user   User data
+ * \return               Error code
+ */
+extern pb_error_t
+pb_batch_decode_field(
+    pb_batch_t *batch, const pb_buffer_t *buffer, pb_tag_t tag, void *user) {
+  assert(batch && buffer);
+  return decode_field(batch, buffer, tag, 0, user);
+}
+
+/*!
+ * Validate the elements of a repeated submessage field in parallel.
+ *
+ * The elements are indexed like in pb_batch_decode_field() and validated
+ * concurrently with the descriptor of the batch. Neither the handler nor the
+ * completion handler of the batch are invoked.
+ *
+ * \param[in,out] batch  Batch
+ * \param[in]     buffer Buffer
+ * \param[in]     tag    Tag of repeated field
+ * \return               Error code
+ */
+extern pb_error_t
+pb_batch_check_field(
+    pb_batch_t *batch, const pb_buffer_t *buffer, pb_tag_t tag) {
+  assert(batch && buffer);
+  return decode_field(batch, buffer, tag, 1, NULL);
+}
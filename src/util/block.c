@@ -0,0 +1,410 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/buffer.h"
+#include "core/common.h"
+#include "core/varint.h"
+#include "util/block.h"
+#include "util/lz.h"
+#include "util/record.h"
+
+/* ----------------------------------------------------------------------------
+ * Constants
+ * ------------------------------------------------------------------------- */
+
+/* Default block size */
+#define BLOCK 65536
+
+/* Largest number of bytes for which checksum sums cannot overflow */
+#define CHECKSUM_SPAN 5552
+
+/* Modulus of checksum sums */
+#define CHECKSUM_BASE 65521
+
+/* Largest ratio of decompressed to compressed size of the codec */
+#define RATIO 255
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_block_header_t {
+  uint32_t size;                       /*!< Decompressed size */
+  uint32_t checksum;                   /*!< Checksum of decompressed data */
+} pb_block_header_t;
+
+/* ----------------------------------------------------------------------------
+ * Internal functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Compute the Adler-32 checksum of data.
+ *
+ * \param[in] data[] Raw data
+ * \param[in] size   Raw data size
+ * \return           Checksum
+ */
+static uint32_t
+checksum(const uint8_t data[], size_t size) {
+  assert(data || !size);
+  uint32_t a = 1, b = 0;
+  while (size) {
+    size_t span = size < CHECKSUM_SPAN ? size : CHECKSUM_SPAN;
+    for (size -= span; span; span--) {
+      a += *data++;
+      b += a;
+    }
+    a %= CHECKSUM_BASE;
+    b %= CHECKSUM_BASE;
+  }
+  return b << 16 | a;
+}
+
+/*!
+ * Ensure a buffer has at least the given size.
+ *
+ * \param[in,out] buffer Buffer
+ * \param[in]     size   Size
+ * \return               Error code
+ */
+static pb_error_t
+ensure(pb_buffer_t *buffer, size_t size) {
+  assert(buffer);
+  size_t current = pb_buffer_size(buffer);
+  if (current >= size)
+    return PB_ERROR_NONE;
+  return pb_buffer_grow(buffer, size - current)
+    ? PB_ERROR_NONE
+    : PB_ERROR_ALLOC;
+}
+
+/*!
+ * Load a block, decompressing it if necessary, and verify its checksum.
+ *
+ * A block that was stored uncompressed is used in place, so its records point
+ * directly into the mapping. The decompressed size in the header is checked
+ * against what the codec can produce from the compressed size before memory
+ * is allocated, so a corrupted header cannot cause a huge allocation.
+ *
+ * \param[in,out] reader Block reader
+ * \param[in]     block  Block
+ * \return               Error code
+ */
+static pb_error_t
+load(pb_block_reader_t *reader, const pb_buffer_t *block) {
+  assert(reader && block);
+  pb_block_header_t header;
+  size_t size = pb_buffer_size(block);
+  if (unlikely_(size < sizeof(header)))
+    return PB_ERROR_OFFSET;
+
+  /* Read header and use block in place, if it wasn't compressed */
+  const uint8_t *data = pb_buffer_data(block);
+  memcpy(&header, data, sizeof(header));
+  data += sizeof(header);
+  size -= sizeof(header);
+
+  /* Otherwise decompress block */
+  if (size != header.size) {
+    if (unlikely_(header.size / RATIO > size))
+      return PB_ERROR_INVALID;
+    pb_error_t error = ensure(&(reader->block), header.size);
+    if (unlikely_(error))
+      return error;
+    uint8_t *target = pb_buffer_data_from(&(reader->block), 0);
+    if (unlikely_(pb_lz_decompress(data, size, target, header.size)))
+      return PB_ERROR_INVALID;
+    data = target;
+  }
+
+  /* Verify checksum and start reading records of block */
+  if (unlikely_(checksum(data, header.size) != header.checksum))
+    return PB_ERROR_INVALID;
+  reader->data   = data;
+  reader->size   = header.size;
+  reader->offset = 0;
+  return PB_ERROR_NONE;
+}
+
+/*!
+ * Compress and write the pending block of a block writer.
+ *
+ * If the block cannot be compressed to less than its size, it's stored
+ * uncompressed, which is signalled by the stored size matching the size in
+ * the header, so incompressible data costs no time when reading.
+ *
+ * \param[in,out] writer Block writer
+ * \return               Error code
+ */
+static pb_error_t
+flush(pb_block_writer_t *writer) {
+  assert(writer);
+  size_t size = pb_buffer_size(&(writer->block));
+  if (!size)
+    return PB_ERROR_NONE;
+
+  /* Ensure space for header and uncompressed block */
+  pb_block_header_t header;
+  pb_error_t error = ensure(&(writer->compressed), sizeof(header) + size);
+  if (unlikely_(error))
+    return error;
+
+  /* Write header */
+  const uint8_t *data = pb_buffer_data(&(writer->block));
+  uint8_t *target = pb_buffer_data_from(&(writer->compressed), 0);
+  header.size     = size;
+  header.checksum = checksum(data, size);
+  memcpy(target, &header, sizeof(header));
+
+  /* Compress block, or store it if it's incompressible */
+  size_t stored = pb_lz_compress(data,
+    size, &(target[sizeof(header)]), size - 1);
+  if (!stored) {
+    memcpy(&(target[sizeof(header)]), data, size);
+    stored = size;
+  }
+
+  /* Write block as a record */
+  pb_buffer_t record =
+    pb_buffer_create_zero_copy_internal(target, sizeof(header) + stored);
+  if (!(error = pb_record_writer_write(&(writer->writer), &record, 1)))
+    pb_buffer_reset(&(writer->block));
+  pb_buffer_destroy(&record);
+  return error;
+}
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create a block reader for a file.
+ *
+ * \param[in] path[] Path
+ * \return           Block reader
+ */
+extern pb_block_reader_t
+pb_block_reader_create(const char path[]) {
+  assert(path);
+  pb_block_reader_t reader = {
+    .reader = pb_record_reader_create(path),
+    .block  = pb_buffer_create_empty(),
+    .data   = NULL,
+    .size   = 0,
+    .offset = 0
+  };
+  return reader;
+}
+
+/*!
+ * Destroy a block reader.
+ *
+ * \param[in,out] reader Block reader
+ */
+extern void
+pb_block_reader_destroy(pb_block_reader_t *reader) {
+  assert(reader);
+  pb_record_reader_destroy(&(reader->reader));
+  pb_buffer_destroy(&(reader->block));
+}
+
+/*!
+ * Read the next record of a file.
+ *
+ * Blocks are read and decompressed one at a time, and the record is returned
+ * as a zero-copy buffer which points into the current block, so it remains
+ * valid until the next block is read or the block reader is destroyed. If a
+ * block is corrupted, PB_ERROR_INVALID is returned and the block is skipped
+ * on the next call. If there are no more records, PB_ERROR_EOM is returned.
+ *
+ * \param[in,out] reader Block reader
+ * \param[out]    record Buffer receiving record
+ * \return               Error code
+ */
+extern pb_error_t
+pb_block_reader_next(pb_block_reader_t *reader, pb_buffer_t *record) {
+  assert(reader && record);
+  if (unlikely_(!pb_block_reader_valid(reader)))
+    return PB_ERROR_INVALID;
+
+  /* Load next block, if the current one was fully read */
+  pb_error_t error = PB_ERROR_NONE;
+  while (reader->offset == reader->size) {
+    pb_buffer_t block;
+    if ((error = pb_record_reader_next(&(reader->reader), &block)))
+      return error;
+    error = load(reader, &block);
+    pb_buffer_destroy(&block);
+    if (unlikely_(error))
+      return error;
+  }
+
+  /* Read length prefix and ensure the record is complete */
+  size_t left = reader->size - reader->offset;
+  const uint8_t *data = &(reader->data[reader->offset]);
+  uint32_t length;
+  size_t size = pb_varint_unpack_uint32(data, left, &length);
+  if (unlikely_(!size))
+    return PB_ERROR_VARINT;
+  if (unlikely_(left - size < length))
+    return PB_ERROR_OFFSET;
+
+  /* Return record and advance to next */
+  *record = pb_buffer_create_zero_copy_internal(
+    (uint8_t *)&(data[size]), length);
+  reader->offset += size + length;
+  return PB_ERROR_NONE;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/*!
+ * Create a block writer for a file with the default block size.
+ *
+ * \param[in] path[] Path
+ * \param[in] sync   Sync policy
+ * \return           Block writer
+ */
+extern pb_block_writer_t
+pb_block_writer_create(const char path[], pb_record_sync_t sync) {
+  assert(path);
+  return pb_block_writer_create_with_size(path, sync, BLOCK);
+}
+
+/*!
+ * Create a block writer for a file with a given block size.
+ *
+ * Records are grouped into blocks of at most the given size, unless a single
+ * record is larger, and every block is compressed and written as a record to
+ * the file. Larger blocks compress better, smaller blocks use less memory.
+ *
+ * \param[in] path[] Path
+ * \param[in] sync   Sync policy
+ * \param[in] size   Block size
+ * \return           Block writer
+ */
+extern pb_block_writer_t
+pb_block_writer_create_with_size(
+    const char path[], pb_record_sync_t sync, size_t size) {
+  assert(path && size && size <= UINT32_MAX);
+  pb_block_writer_t writer = {
+    .writer     = pb_record_writer_create(path, sync),
+    .block      = pb_buffer_create_empty(),
+    .compressed = pb_buffer_create_empty(),
+    .size       = size
+  };
+
+  /* Reserve space for pending block */
+  if (unlikely_(!pb_record_writer_valid(&(writer.writer)) ||
+      pb_buffer_resize(&(writer.block), size))) {
+    pb_block_writer_destroy(&writer);
+    return pb_block_writer_create_invalid();
+  }
+  return writer;
+}
+
+/*!
+ * Destroy a block writer.
+ *
+ * The pending block is written before the file is closed. To check whether
+ * this succeeded, the block writer should be flushed beforehand.
+ *
+ * \param[in,out] writer Block writer
+ */
+extern void
+pb_block_writer_destroy(pb_block_writer_t *writer) {
+  assert(writer);
+  if (pb_block_writer_valid(writer))
+    flush(writer);
+  pb_record_writer_destroy(&(writer->writer));
+  if (pb_buffer_valid(&(writer->block)))
+    pb_buffer_destroy(&(writer->block));
+  if (pb_buffer_valid(&(writer->compressed)))
+    pb_buffer_destroy(&(writer->compressed));
+}
+
+/*!
+ * Append a batch of records to the pending block of a block writer.
+ *
+ * Records are never split across blocks. When a record doesn't fit into the
+ * pending block anymore, the block is compressed and written first, so the
+ * sync policy applies to written blocks, not to pending records. Records must
+ * be smaller than 4 GB, as blocks store their size in 32 bits, otherwise
+ * PB_ERROR_OFFSET is returned.
+ *
+ * \param[in,out] writer    Block writer
+ * \param[in]     records[] Records
+ * \param[in]     size      Record count
+ * \return                  Error code
+ */
+extern pb_error_t
+pb_block_writer_write(
+    pb_block_writer_t *writer, const pb_buffer_t records[], size_t size) {
+  assert(writer && (records || !size));
+  if (unlikely_(!pb_block_writer_valid(writer)))
+    return PB_ERROR_INVALID;
+  pb_error_t error = PB_ERROR_NONE;
+  for (size_t r = 0; r < size; r++) {
+    if (unlikely_(pb_buffer_size(&(records[r])) > UINT32_MAX))
+      return PB_ERROR_OFFSET;
+
+    /* Ensure the block holding the record fits the header */
+    uint32_t length = pb_buffer_size(&(records[r]));
+    size_t needed = pb_varint_size_uint32(&length) + length,
+           pending = pb_buffer_size(&(writer->block));
+    if (unlikely_(needed > UINT32_MAX))
+      return PB_ERROR_OFFSET;
+
+    /* Write pending block, if the record doesn't fit */
+    if (pending && pending + needed > writer->size &&
+        unlikely_(error = flush(writer)))
+      return error;
+
+    /* Append record to pending block */
+    uint8_t *data = pb_buffer_grow(&(writer->block), needed);
+    if (unlikely_(!data))
+      return PB_ERROR_ALLOC;
+    data += pb_varint_pack_uint32(data, &length);
+    if (length)
+      memcpy(data, pb_buffer_data(&(records[r])), length);
+  }
+  return error;
+}
+
+/*!
+ * Compress and write the pending block of a block writer.
+ *
+ * \param[in,out] writer Block writer
+ * \return               Error code
+ */
+extern pb_error_t
+pb_block_writer_flush(pb_block_writer_t *writer) {
+  assert(writer);
+  if (unlikely_(!pb_block_writer_valid(writer)))
+    return PB_ERROR_INVALID;
+  return flush(writer);
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef PB_UTIL_BLOCK_H
+#define PB_UTIL_BLOCK_H
+
+#include <protobluff/util/block.h>
+
+#include "core/buffer.h"
+#include "core/common.h"
+#include "util/record.h"
+
+/* ----------------------------------------------------------------------------
+ * Inline functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create an invalid block writer.
+ *
+ * \return Block writer
+ */
+PB_INLINE PB_WARN_UNUSED_RESULT
+pb_block_writer_t
+pb_block_writer_create_invalid(void) {
+  pb_block_writer_t writer = {
+    .writer     = pb_record_writer_create_invalid(),
+    .block      = pb_buffer_create_invalid(),
+    .compressed = pb_buffer_create_invalid()
+  };
+  return writer;
+}
+
+#endif /* PB_UTIL_BLOCK_H */
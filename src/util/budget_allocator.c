@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "core/allocator.h"
+#include "core/common.h"
+#include "util/budget_allocator.h"
+
+/* ----------------------------------------------------------------------------
+ * Constants
+ * ------------------------------------------------------------------------- */
+
+/* Size of the header storing the size of a memory block */
+#define HEADER 16
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_budget_allocator_t {
+  pb_allocator_t *allocator;           /*!< Wrapped allocator */
+  size_t budget;                       /*!< Budget in bytes */
+  size_t current;                      /*!< Bytes currently allocated */
+  size_t peak;                         /*!< Peak bytes allocated */
+} pb_budget_allocator_t;
+
+/* ----------------------------------------------------------------------------
+ * Macros
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve the size stored in the header of a memory block.
+ *
+ * \param[in] memory Memory block
+ * \return           Size
+ */
+#define size_from_memory(memory) \
+  (*(size_t *)((uint8_t *)(memory) - HEADER))
+
+/* ----------------------------------------------------------------------------
+ * Internal functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Reserve bytes from the budget and update the peak.
+ *
+ * The reservation is made with a compare-and-swap loop, so concurrent callers
+ * can never exceed the budget together.
+ *
+ * \param[in,out] budget Budget allocator
+ * \param[in]     size   Bytes
+ * \return               Error code
+ */
+static pb_error_t
+reserve(pb_budget_allocator_t *budget, size_t size) {
+  assert(budget);
+  size_t current = __atomic_load_n(&(budget->current), __ATOMIC_RELAXED);
+  do {
+    if (unlikely_(size > budget->budget - current))
+      return PB_ERROR_ALLOC;
+  } while (!__atomic_compare_exchange_n(&(budget->current), &current,
+    current + size, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+  /* Update peak, if exceeded */
+  size_t peak = __atomic_load_n(&(budget->peak), __ATOMIC_RELAXED);
+  while (peak < current + size && !__atomic_compare_exchange_n(
+    &(budget->peak), &peak, current + size, 1,
+      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  return PB_ERROR_NONE;
+}
+
+/*!
+ * Release bytes to the budget.
+ *
+ * \param[in,out] budget Budget allocator
+ * \param[in]     size   Bytes
+ */
+static void
+release(pb_budget_allocator_t *budget, size_t size) {
+  assert(budget);
+  __atomic_sub_fetch(&(budget->current), size, __ATOMIC_RELAXED);
+}
+
+/* ----------------------------------------------------------------------------
+ * Allocator callbacks
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Allocate a memory block of given size.
+ *
+ * The size is reserved from the budget before the memory block is allocated
+ * from the wrapped allocator, so no memory is allocated beyond the budget.
+ *
+ * \param[in,out] data Internal allocator data
+ * \param[in]     size Bytes to be allocated
+ * \return             Memory block
+ */
+static void *
+allocator_allocate(void *data, size_t size) {
+  assert(size);
+  if (unlikely_(!data))
+    return NULL;
+
+  /* Reserve size from budget */
+  pb_budget_allocator_t *budget = data;
+  if (unlikely_(reserve(budget, size)))
+    return NULL;
+
+  /* Allocate memory block and store size in header */
+  uint8_t *memory = pb_allocator_allocate(budget->allocator, HEADER + size);
+  if (unlikely_(!memory)) {
+    release(budget, size);
+    return NULL;
+  }
+  memory += HEADER;
+  size_from_memory(memory) = size;
+  return memory;
+}
+
+/*!
+ * Change the size of a previously allocated memory block.
+ *
+ * Only the growth of the memory block is reserved from the budget. If the
+ * budget is exhausted, the memory block is left untouched, so buffers and
+ * journals can fully recover from the failure.
+ *
+ * \param[in,out] data  Internal allocator data
+ * \param[in,out] block Memory block to be resized
+ * \param[in]     size  Bytes to be allocated
+ * \return              Memory block
+ */
+static void *
+allocator_resize(void *data, void *block, size_t size) {
+  assert(size);
+  if (unlikely_(!data))
+    return NULL;
+
+  /* Allocate new block */
+  if (unlikely_(!block))
+    return allocator_allocate(data, size);
+
+  /* Reserve growth from budget */
+  pb_budget_allocator_t *budget = data;
+  size_t previous = size_from_memory(block);
+  if (size > previous && unlikely_(reserve(budget, size - previous)))
+    return NULL;
+
+  /* Resize memory block and update size in header */
+  uint8_t *memory = pb_allocator_resize(budget->allocator,
+    (uint8_t *)block - HEADER, HEADER + size);
+  if (unlikely_(!memory)) {
+    if (size > previous)
+      release(budget, size - previous);
+    return NULL;
+  }
+  memory += HEADER;
+  size_from_memory(memory) = size;
+
+  /* Release shrinkage to budget */
+  if (size < previous)
+    release(budget, previous - size);
+  return memory;
+}
+
+/*!
+ * Free an allocated memory block.
+ *
+ * \param[in,out] data  Internal allocator data
+ * \param[in,out] block Memory block to be freed
+ */
+static void
+allocator_free(void *data, void *block) {
+  assert(block);
+  if (unlikely_(!data))
+    return;
+
+  /* Release size to budget and free memory block */
+  pb_budget_allocator_t *budget = data;
+  release(budget, size_from_memory(block));
+  pb_allocator_free(budget->allocator, (uint8_t *)block - HEADER);
+}
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create a budget allocator wrapping the system-default allocator.
+ *
+ * \param[in] budget Budget in bytes
+ * \return           Budget allocator
+ */
+extern pb_allocator_t
+pb_budget_allocator_create(size_t budget) {
+  return pb_budget_allocator_create_with_allocator(&allocator_default, budget);
+}
+
+/*!
+ * Create a budget allocator wrapping an allocator.
+ *
+ * A budget allocator forwards all calls to the wrapped allocator, as long as
+ * the bytes currently allocated stay within the given budget. Allocations or
+ * resizes exceeding the budget fail like an out-of-memory condition, which is
+ * cleanly reported as PB_ERROR_ALLOC, so the memory a single untrusted message
+ * can make protobluff allocate is strictly bounded. The budget covers the
+ * bytes requested, not the small header every memory block is prefixed with.
+ *
+ * \warning The budget allocator does not take ownership of the wrapped
+ * allocator, so the caller must ensure that it outlives the budget allocator.
+ * The budget allocator is exactly as thread-safe as the wrapped allocator.
+ *
+ * \param[in,out] allocator Allocator
+ * \param[in]     budget    Budget in bytes
+ * \return                  Budget allocator
+ */
+extern pb_allocator_t
+pb_budget_allocator_create_with_allocator(
+    pb_allocator_t *allocator, size_t budget) {
+  assert(allocator);
+  pb_allocator_t result = {
+    .proc = {
+      .allocate = allocator_allocate,
+      .resize   = allocator_resize,
+      .free     = allocator_free
+    },
+    .data = NULL
+  };
+
+  /* Allocate budget allocator */
+  pb_budget_allocator_t *data = calloc(1, sizeof(pb_budget_allocator_t));
+  if (data) {
+    data->allocator = allocator;
+    data->budget    = budget;
+    result.data     = data;
+  }
+  return result;
+}
+
+/*!
+ * Destroy a budget allocator.
+ *
+ * \warning All memory blocks must be freed before the budget allocator is
+ * destroyed, as they were allocated from the wrapped allocator.
+ *
+ * \param[in,out] allocator Budget allocator
+ */
+extern void
+pb_budget_allocator_destroy(pb_allocator_t *allocator) {
+  assert(allocator);
+  if (allocator->data) {
+    free(allocator->data);
+    allocator->data = NULL;
+  }
+}
+
+/*!
+ * Retrieve the bytes currently allocated from a budget allocator.
+ *
+ * \param[in] allocator Budget allocator
+ * \return              Bytes currently allocated
+ */
+extern size_t
+pb_budget_allocator_current(const pb_allocator_t *allocator) {
+  assert(allocator);
+  pb_budget_allocator_t *data = allocator->data;
+  return data
+    ? __atomic_load_n(&(data->current), __ATOMIC_RELAXED)
+    : 0;
+}
+
+/*!
+ * Retrieve the high-water mark of a budget allocator.
+ *
+ * \param[in] allocator Budget allocator
+ * \return              Peak bytes allocated
+ */
+extern size_t
+pb_budget_allocator_peak(const pb_allocator_t *allocator) {
+  assert(allocator);
+  pb_budget_allocator_t *data = allocator->data;
+  return data
+    ? __atomic_load_n(&(data->peak), __ATOMIC_RELAXED)
+    : 0;
+}
+
+/*!
+ * Reset the high-water mark of a budget allocator.
+ *
+ * The high-water mark is set to the bytes currently allocated, so the peak of
+ * the next request can be determined when a budget allocator is reused.
+ *
+ * \param[in,out] allocator Budget allocator
+ */
+extern void
+pb_budget_allocator_reset(pb_allocator_t *allocator) {
+  assert(allocator);
+  pb_budget_allocator_t *data = allocator->data;
+  if (data)
+    __atomic_store_n(&(data->peak),
+      __atomic_load_n(&(data->current), __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+}
@@ -0,0 +1,501 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/allocator.h"
+#include "core/common.h"
+#include "util/cache_allocator.h"
+
+/* ----------------------------------------------------------------------------
+ * Constants
+ * ------------------------------------------------------------------------- */
+
+/* Capacity of the smallest size class */
+#define BASE 16
+
+/* Number of size classes, doubling in capacity up to 64 KiB */
+#define CLASSES 13
+
+/* Maximum number of memory blocks held by a bin of a thread cache */
+#define RETAIN 64
+
+/* Size of the header storing the capacity of a memory block */
+#define HEADER 16
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_cache_block_t {
+  struct pb_cache_block_t *next;       /*!< Next free memory block */
+} pb_cache_block_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_cache_bin_t {
+  pb_cache_block_t *head;              /*!< First free memory block */
+  size_t size;                         /*!< Free memory blocks */
+} pb_cache_bin_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_cache_t {
+  struct pb_cache_t *next;             /*!< Next registered cache */
+  struct pb_cache_allocator_t *cache;  /*!< Cache allocator */
+  int owned;                           /*!< Whether a thread owns the cache */
+  pb_cache_bin_t bin[CLASSES];         /*!< Bins of free memory blocks */
+} pb_cache_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_cache_allocator_t {
+  pthread_key_t key;                   /*!< Thread-local cache key */
+  pb_cache_t *caches;                  /*!< Registered caches */
+  pb_cache_block_t *depot[CLASSES];    /*!< Shared free memory blocks */
+} pb_cache_allocator_t;
+
+/* ----------------------------------------------------------------------------
+ * Macros
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve the capacity stored in the header of a memory block.
+ *
+ * \param[in] memory Memory block
+ * \return           Capacity
+ */
+#define capacity_from_memory(memory) \
+  (*(size_t *)((uint8_t *)(memory) - HEADER))
+
+/*!
+ * Retrieve the capacity of a size class.
+ *
+ * \param[in] class Size class
+ * \return          Capacity
+ */
+#define capacity_from_class(class) \
+  ((size_t)BASE << (class))
+
+/* ----------------------------------------------------------------------------
+ * Internal functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Determine the size class for a given number of bytes.
+ *
+ * \param[in] size Bytes
+ * \return         Size class
+ */
+static size_t
+class_from_size(size_t size) {
+  assert(size && size <= capacity_from_class(CLASSES - 1));
+  size_t class = 0;
+  while (capacity_from_class(class) < size)
+    class++;
+  return class;
+}
+
+/*!
+ * Push a chain of free memory blocks onto the depot of a size class.
+ *
+ * Pushing is lock-free and safe against concurrent pushes and takes, as the
+ * depot is only ever emptied as a whole, which rules out the ABA problem.
+ *
+ * \param[in,out] cache Cache allocator
+ * \param[in]     class Size class
+ * \param[in,out] head  First memory block of chain
+ * \param[in,out] tail  Last memory block of chain
+ */
+static void
+depot_push(
+    pb_cache_allocator_t *cache, size_t class,
+    pb_cache_block_t *head, pb_cache_block_t *tail) {
+  assert(cache && head && tail);
+  pb_cache_block_t *top = __atomic_load_n(
+    &(cache->depot[class]), __ATOMIC_RELAXED);
+  do {
+    tail->next = top;
+  } while (!__atomic_compare_exchange_n(&(cache->depot[class]), &top, head,
+    1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*!
+ * Take all free memory blocks from the depot of a size class.
+ *
+ * \param[in,out] cache Cache allocator
+ * \param[in]     class Size class
+ * \return              First memory block of chain
+ */
+static pb_cache_block_t *
+depot_take(pb_cache_allocator_t *cache, size_t class) {
+  assert(cache);
+  if (!__atomic_load_n(&(cache->depot[class]), __ATOMIC_RELAXED))
+    return NULL;
+  return __atomic_exchange_n(&(cache->depot[class]), NULL, __ATOMIC_ACQUIRE);
+}
+
+/*!
+ * Move a given number of memory blocks from a bin to the depot.
+ *
+ * \param[in,out] cache Cache allocator
+ * \param[in,out] bin   Bin
+ * \param[in]     class Size class
+ * \param[in]     size  Memory blocks to be moved
+ */
+static void
+bin_flush(
+    pb_cache_allocator_t *cache, pb_cache_bin_t *bin,
+    size_t class, size_t size) {
+  assert(cache && bin && size <= bin->size);
+  if (!size)
+    return;
+
+  /* Detach the given number of memory blocks from the bin */
+  pb_cache_block_t *head = bin->head, *tail = head;
+  for (size_t b = 1; b < size; b++)
+    tail = tail->next;
+  bin->head  = tail->next;
+  bin->size -= size;
+  depot_push(cache, class, head, tail);
+}
+
+/*!
+ * Release a thread cache when its thread exits.
+ *
+ * All memory blocks are moved to the depot, so other threads can reuse them,
+ * and the thread cache is marked as unowned, so the next thread can adopt it.
+ *
+ * \param[in,out] data Thread cache
+ */
+static void
+cache_release(void *data) {
+  assert(data);
+  pb_cache_t *local = data;
+  for (size_t c = 0; c < CLASSES; c++)
+    bin_flush(local->cache, &(local->bin[c]), c, local->bin[c].size);
+  __atomic_store_n(&(local->owned), 0, __ATOMIC_RELEASE);
+}
+
+/*!
+ * Retrieve the thread cache of the calling thread.
+ *
+ * On first use, the thread adopts a thread cache that was released by an
+ * exited thread or registers a new one. Registration is a lock-free push,
+ * and thread caches are never unregistered before the allocator is destroyed.
+ *
+ * \warning The lines excluded from code coverage cannot be triggered within
+ * the tests, as we're not going to mock malloc.
+ *
+ * \param[in,out] cache Cache allocator
+ * \return              Thread cache
+ */
+static pb_cache_t *
+cache_local(pb_cache_allocator_t *cache) {
+  assert(cache);
+  pb_cache_t *local = pthread_getspecific(cache->key);
+  if (likely_(local != NULL))
+    return local;
+
+  /* Adopt thread cache that is not owned by any thread */
+  for (local = __atomic_load_n(&(cache->caches), __ATOMIC_ACQUIRE);
+      local; local = local->next) {
+    int owned = 0;
+    if (__atomic_load_n(&(local->owned), __ATOMIC_RELAXED) == 0 &&
+        __atomic_compare_exchange_n(&(local->owned), &owned, 1,
+          0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      break;
+  }
+
+  /* Otherwise, register a new thread cache */
+  if (!local) {
+    if (unlikely_(!(local = calloc(1, sizeof(pb_cache_t)))))
+      return NULL;                                         /* LCOV_EXCL_LINE */
+    local->cache = cache;
+    local->owned = 1;
+    local->next  = __atomic_load_n(&(cache->caches), __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&(cache->caches), &(local->next),
+      local, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  }
+
+  /* Bind thread cache to calling thread */
+  if (unlikely_(pthread_setspecific(cache->key, local))) {
+    __atomic_store_n(&(local->owned), 0, __ATOMIC_RELEASE);/* LCOV_EXCL_LINE */
+    return NULL;                                           /* LCOV_EXCL_LINE */
+  }
+  return local;
+}
+
+/* ----------------------------------------------------------------------------
+ * Allocator callbacks
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Allocate a memory block of given size.
+ *
+ * Small memory blocks are rounded up to a size class and taken from the bin
+ * of the calling thread's cache without any synchronization. If the bin is
+ * empty, it is refilled from the depot with a single atomic exchange, before
+ * falling back to malloc. Large memory blocks are always allocated directly.
+ *
+ * \param[in,out] data Internal allocator data
+ * \param[in]     size Bytes to be allocated
+ * \return             Memory block
+ */
+static void *
+allocator_allocate(void *data, size_t size) {
+  assert(size);
+  if (unlikely_(!data))
+    return NULL;
+
+  /* Allocate large memory blocks directly */
+  pb_cache_allocator_t *cache = data;
+  size_t capacity = size;
+  if (likely_(size <= capacity_from_class(CLASSES - 1))) {
+    size_t class = class_from_size(size);
+    capacity = capacity_from_class(class);
+
+    /* Take memory block from bin of thread cache, refilling it if empty */
+    pb_cache_t *local = cache_local(cache);
+    if (likely_(local != NULL)) {
+      pb_cache_bin_t *bin = &(local->bin[class]);
+      if (unlikely_(!bin->head)) {
+        bin->head = depot_take(cache, class);
+        for (pb_cache_block_t *block = bin->head; block; block = block->next)
+          bin->size++;
+      }
+      if (likely_(bin->head != NULL)) {
+        pb_cache_block_t *block = bin->head;
+        bin->head = block->next;
+        bin->size--;
+        return block;
+      }
+    }
+  }
+
+  /* Allocate memory block and store capacity in header */
+  uint8_t *memory = malloc(HEADER + capacity);
+  if (unlikely_(!memory))
+    return NULL;                                           /* LCOV_EXCL_LINE */
+  memory += HEADER;
+  capacity_from_memory(memory) = capacity;
+  return memory;
+}
+
+/*!
+ * Free an allocated memory block.
+ *
+ * Small memory blocks are returned to the bin of the calling thread's cache,
+ * regardless of which thread allocated them. If the bin overflows, half of
+ * its memory blocks are moved to the depot, so they can migrate to threads
+ * that allocate more than they free. If the calling thread has no cache, the
+ * memory block is pushed to the depot directly.
+ *
+ * \param[in,out] data  Internal allocator data
+ * \param[in,out] block Memory block to be freed
+ */
+static void
+allocator_free(void *data, void *block) {
+  assert(block);
+  if (unlikely_(!data))
+    return;
+
+  /* Free large memory blocks directly */
+  pb_cache_allocator_t *cache = data;
+  size_t capacity = capacity_from_memory(block);
+  if (unlikely_(capacity > capacity_from_class(CLASSES - 1))) {
+    free((uint8_t *)block - HEADER);
+    return;
+  }
+
+  /* Return memory block to bin of thread cache, flushing it on overflow */
+  size_t class = class_from_size(capacity);
+  pb_cache_t *local = cache_local(cache);
+  if (likely_(local != NULL)) {
+    pb_cache_bin_t *bin = &(local->bin[class]);
+    ((pb_cache_block_t *)block)->next = bin->head;
+    bin->head = block;
+    if (unlikely_(++bin->size > RETAIN))
+      bin_flush(cache, bin, class, RETAIN / 2);
+
+  /* Otherwise, push memory block to depot */
+  } else {
+    depot_push(cache, class, block, block);                /* LCOV_EXCL_LINE */
+  }
+}
+
+/*!
+ * Change the size of a previously allocated memory block.
+ *
+ * If the new size still fits the size class of the memory block, it is kept
+ * in place. Large memory blocks are reallocated. Otherwise, a new memory block
+ * is allocated from the appropriate size class and the data is copied.
+ *
+ * \param[in,out] data  Internal allocator data
+ * \param[in,out] block Memory block to be resized
+ * \param[in]     size  Bytes to be allocated
+ * \return              Memory block
+ */
+static void *
+allocator_resize(void *data, void *block, size_t size) {
+  assert(size);
+  if (unlikely_(!data))
+    return NULL;
+
+  /* Allocate new memory block */
+  if (unlikely_(!block))
+    return allocator_allocate(data, size);
+
+  /* Keep memory block in place, if it fits its size class */
+  size_t capacity = capacity_from_memory(block);
+  if (capacity <= capacity_from_class(CLASSES - 1)) {
+    if (size <= capacity)
+      return block;
+
+  /* Reallocate large memory block, if it stays large */
+  } else if (size > capacity_from_class(CLASSES - 1)) {
+    uint8_t *memory = realloc((uint8_t *)block - HEADER, HEADER + size);
+    if (unlikely_(!memory))
+      return NULL;                                         /* LCOV_EXCL_LINE */
+    memory += HEADER;
+    capacity_from_memory(memory) = size;
+    return memory;
+  }
+
+  /* Allocate new memory block and copy data */
+  void *memory = allocator_allocate(data, size);
+  if (likely_(memory != NULL)) {
+    memcpy(memory, block, capacity < size ? capacity : size);
+    allocator_free(data, block);
+  }
+  return memory;
+}
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create a cache allocator.
+ *
+ * A cache allocator serves small memory blocks from size classes that are
+ * cached per thread, so allocating and freeing memory blocks does not require
+ * any synchronization in the common case. Memory blocks freed by another
+ * thread than the one that allocated them are collected in the cache of the
+ * freeing thread and migrate back through a lock-free depot that is shared
+ * among all threads. This makes it well suited for multi-threaded servers
+ * that decode and encode messages on many cores.
+ *
+ * \warning Every cache allocator occupies a thread-specific data key, of which
+ * only a limited number is available per process, so cache allocators should
+ * be long-lived and shared among threads, not created per request.
+ *
+ * \return Cache allocator
+ */
+extern pb_allocator_t
+pb_cache_allocator_create(void) {
+  pb_allocator_t allocator = {
+    .proc = {
+      .allocate = allocator_allocate,
+      .resize   = allocator_resize,
+      .free     = allocator_free
+    },
+    .data = NULL
+  };
+
+  /* Allocate cache allocator and thread-specific data key */
+  pb_cache_allocator_t *cache = calloc(1, sizeof(pb_cache_allocator_t));
+  if (cache) {
+    if (likely_(!pthread_key_create(&(cache->key), cache_release))) {
+      allocator.data = cache;
+    } else {
+      free(cache);                                         /* LCOV_EXCL_LINE */
+    }
+  }
+  return allocator;
+}
+
+/*!
+ * Move all memory blocks cached by the calling thread to the depot.
+ *
+ * This is useful before a thread becomes idle for a longer period of time,
+ * as the memory blocks it cached can then be reused by other threads.
+ *
+ * \param[in,out] allocator Cache allocator
+ */
+extern void
+pb_cache_allocator_flush(pb_allocator_t *allocator) {
+  assert(allocator);
+  pb_cache_allocator_t *cache = allocator->data;
+  if (cache) {
+    pb_cache_t *local = pthread_getspecific(cache->key);
+    if (local)
+      for (size_t c = 0; c < CLASSES; c++)
+        bin_flush(cache, &(local->bin[c]), c, local->bin[c].size);
+  }
+}
+
+/*!
+ * Destroy a cache allocator.
+ *
+ * All cached memory blocks and thread caches are freed upon destruction.
+ *
+ * \warning The cache allocator must not be used by any other thread during
+ * or after destruction, and all memory blocks must have been freed, as large
+ * memory blocks are not tracked.
+ *
+ * \param[in,out] allocator Cache allocator
+ */
+extern void
+pb_cache_allocator_destroy(pb_allocator_t *allocator) {
+  assert(allocator);
+  pb_cache_allocator_t *cache = allocator->data;
+  if (cache) {
+    pthread_key_delete(cache->key);
+
+    /* Move memory blocks of all thread caches to depot and free caches */
+    pb_cache_t *local = cache->caches;
+    while (local) {
+      pb_cache_t *next = local->next;
+      for (size_t c = 0; c < CLASSES; c++)
+        bin_flush(cache, &(local->bin[c]), c, local->bin[c].size);
+      free(local);
+      local = next;
+    }
+
+    /* Free memory blocks in depot */
+    for (size_t c = 0; c < CLASSES; c++) {
+      pb_cache_block_t *block = cache->depot[c];
+      while (block) {
+        pb_cache_block_t *next = block->next;
+        free((uint8_t *)block - HEADER);
+        block = next;
+      }
+    }
+    free(cache);
+    allocator->data = NULL;
+  }
+}
@@ -32,11 +32,41 @@
  * Type definitions
  * ------------------------------------------------------------------------- */
 
-typedef struct pb_chunk_allocator_t {
-  struct pb_chunk_allocator_t *next;   /*!< Next linked chunk */
+typedef struct pb_chunk_t {
+  struct pb_chunk_t *prev;             /*!< Previous linked chunk */
+  struct pb_chunk_t *next;             /*!< Next linked chunk */
   size_t capacity;                     /*!< Capacity */
+} pb_chunk_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_chunk_allocator_t {
+  pb_chunk_t list;                     /*!< Sentinel of allocated chunks */
+  struct {
+    pb_chunk_t *head;                  /*!< Free chunks */
+    size_t size;                       /*!< Free chunk count */
+  } free[16];                          /*!< Free chunks by size class */
+  size_t capacity;                     /*!< Minimum capacity */
 } pb_chunk_allocator_t;
 
+/* ----------------------------------------------------------------------------
+ * Constants
+ * ------------------------------------------------------------------------- */
+
+/* Number of size classes for which freed chunks are recycled */
+#define CLASSES (sizeof(((pb_chunk_allocator_t *)0)->free) / \
+  sizeof(((pb_chunk_allocator_t *)0)->free[0]))
+
+/* Maximum number of free chunks retained per size class */
+#define RETAIN 64
+
+/* Alignment of all memory blocks, as guaranteed by malloc */
+#define ALIGNMENT 16
+
+/* Size of a chunk header, padded to preserve the alignment of the block */
+#define HEADER \
+  ((sizeof(pb_chunk_t) + ALIGNMENT - 1) & ~((size_t)ALIGNMENT - 1))
+
 /* ----------------------------------------------------------------------------
  * Macros
  * ------------------------------------------------------------------------- */
@@ -48,8 +78,7 @@ typedef struct pb_chunk_allocator_t {
  * \return          Memory block
  */
 #define block_from_chunk(chunk) \
-  (assert(chunk), (void *)((uint8_t *)(chunk) + \
-    sizeof(pb_chunk_allocator_t)))
+  (assert(chunk), (void *)((uint8_t *)(chunk) + HEADER))
 
 /*!
  * Retrieve the allocated chunk for a memory block.
@@ -58,8 +87,38 @@ typedef struct pb_chunk_allocator_t {
  * \return          Allocated chunk
  */
 #define chunk_from_block(block) \
-  (assert(block), (void *)((uint8_t *)(block) - \
-    sizeof(pb_chunk_allocator_t)))
+  (assert(block), (pb_chunk_t *)((uint8_t *)(block) - HEADER))
+
+/* ----------------------------------------------------------------------------
+ * Internal functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Link a chunk at the end of the list of allocated chunks.
+ *
+ * \param[in,out] base  Chunk allocator
+ * \param[in,out] chunk Chunk
+ */
+static void
+attach(pb_chunk_allocator_t *base, pb_chunk_t *chunk) {
+  assert(base && chunk);
+  chunk->prev = base->list.prev;
+  chunk->next = &(base->list);
+  chunk->prev->next = chunk;
+  chunk->next->prev = chunk;
+}
+
+/*!
+ * Unlink a chunk from the list of allocated chunks.
+ *
+ * \param[in,out] chunk Chunk
+ */
+static void
+detach(pb_chunk_t *chunk) {
+  assert(chunk);
+  chunk->prev->next = chunk->next;
+  chunk->next->prev = chunk->prev;
+}
 
 /* ----------------------------------------------------------------------------
  * Allocator callbacks
@@ -71,12 +130,13 @@ typedef struct pb_chunk_allocator_t {
  * Memory blocks are stored in pre-allocated chunks to account for later growth
  * by allocating more space than is needed upfront. If the block grows inside
  * the corresponding chunk's capacity, the same block is returned. Otherwise,
- * the chunk is doubled in size to make room for more growth.
+ * the chunk is grown to the next multiple of the minimum capacity.
  *
- * Chunks are managed through a linked list. New chunks are always appended to
- * the end of the list. If a chunk is freed, it is removed from the list and
- * its predecessor and successor are linked. The first chunk does not store
- * any data, it just holds the initial capacity and the head of the list.
+ * Allocated chunks are managed through a circular doubly-linked list with the
+ * allocator itself acting as the sentinel, so chunks can be appended and
+ * removed in constant time. Freed chunks of the smaller size classes, i.e.
+ * multiples of the minimum capacity, are retained in free lists and recycled
+ * by later allocations of the same size class.
  *
  * \warning The lines excluded from code coverage cannot be triggered within
  * the tests, as we're not going to mock malloc. Nope. No chance.
@@ -91,31 +151,27 @@ allocator_allocate(void *data, size_t size) {
   if (unlikely_(!data))
     return NULL;
 
-  /* Search to end of chunk list */
+  /* Calculate necessary capacity and size class */
   pb_chunk_allocator_t *base = data;
-  pb_chunk_allocator_t *head = data;
-  while (head->next)
-    head = head->next;
-
-  /* Calculate necessary capacity */
-  size_t capacity = base->capacity * (size / base->capacity + 1);
-
-  /* Allocate chunk and link in predecessor */
-  pb_chunk_allocator_t *chunk = malloc(
-    sizeof(pb_chunk_allocator_t) + capacity);
-  if (chunk) {
-    *chunk = (pb_chunk_allocator_t){
-      .next     = NULL,
-      .capacity = capacity
-    };
-    head->next = chunk;
-
-    /* Return freshly allocated block */
-    return block_from_chunk(head->next);
+  size_t index    = size / base->capacity,
+         capacity = base->capacity * (index + 1);
+
+  /* Recycle free chunk of the same size class, or allocate chunk */
+  pb_chunk_t *chunk;
+  if (index < CLASSES && base->free[index].head) {
+    chunk = base->free[index].head;
+    base->free[index].head = chunk->next;
+    base->free[index].size--;
+  } else {
+    chunk = malloc(HEADER + capacity);
+    if (unlikely_(!chunk))
+      return NULL;                                         /* LCOV_EXCL_LINE */
+    chunk->capacity = capacity;
   }
 
-  /* It's not for you, mate */
-  return NULL;                                             /* LCOV_EXCL_LINE */
+  /* Link chunk and return block */
+  attach(base, chunk);
+  return block_from_chunk(chunk);
 }
 
 /*!
@@ -135,35 +191,28 @@ allocator_resize(void *data, void *block, size_t size) {
   if (unlikely_(!data))
     return NULL;
 
-  /* Change size of given memory block */
-  if (likely_(block != NULL)) {
-    pb_chunk_allocator_t *current = chunk_from_block(block);
-
-    /* Check if chunk's capacity is exhausted */
-    if (unlikely_(size > current->capacity)) {
-      pb_chunk_allocator_t *base = data;
-      pb_chunk_allocator_t *head = data;
-      while (head->next && head->next != current)
-        head = head->next;
-
-      /* Calculate new capacity */
-      size_t capacity = base->capacity * (size / base->capacity + 1);
-
-      /* Grow chunk and link in predecessor */
-      pb_chunk_allocator_t *chunk = realloc(head->next,
-        sizeof(pb_chunk_allocator_t) + capacity);
-      if (chunk) {
-        head->next = chunk;
-        head->next->capacity = capacity;
-
-        /* Return resized block */
-        return block_from_chunk(head->next);
-      }
-    }                                                      /* LCOV_EXCL_LINE */
-
   /* Allocate new block */
-  } else {
+  if (unlikely_(!block))
     return allocator_allocate(data, size);
+
+  /* Check if chunk's capacity is exhausted */
+  pb_chunk_t *current = chunk_from_block(block);
+  if (unlikely_(size > current->capacity)) {
+    pb_chunk_allocator_t *base = data;
+
+    /* Calculate new capacity */
+    size_t capacity = base->capacity * (size / base->capacity + 1);
+
+    /* Grow chunk and link in neighbours */
+    pb_chunk_t *chunk = realloc(current, HEADER + capacity);
+    if (unlikely_(!chunk))
+      return NULL;                                         /* LCOV_EXCL_LINE */
+    chunk->capacity   = capacity;
+    chunk->prev->next = chunk;
+    chunk->next->prev = chunk;
+
+    /* Return resized block */
+    return block_from_chunk(chunk);
   }
 
   /* Nothing to be done */
@@ -182,15 +231,20 @@ allocator_free(void *data, void *block) {
   if (unlikely_(!data))
     return;
 
-  /* Search current chunk in chunk list */
-  pb_chunk_allocator_t *head    = data;
-  pb_chunk_allocator_t *current = chunk_from_block(block);
-  while (head->next && head->next != current)
-    head = head->next;
+  /* Unlink chunk from list */
+  pb_chunk_allocator_t *base = data;
+  pb_chunk_t *chunk = chunk_from_block(block);
+  detach(chunk);
 
-  /* Link predecessor and successor and free current chunk */
-  head->next = current->next;
-  free(current);
+  /* Retain chunk in free list of its size class, or free it */
+  size_t index = chunk->capacity / base->capacity - 1;
+  if (index < CLASSES && base->free[index].size < RETAIN) {
+    chunk->next = base->free[index].head;
+    base->free[index].head = chunk;
+    base->free[index].size++;
+  } else {
+    free(chunk);
+  }
 }
 
 /* ----------------------------------------------------------------------------
@@ -224,13 +278,12 @@ pb_chunk_allocator_create_with_capacity(size_t capacity) {
     },
     .data = NULL
   };
-  pb_chunk_allocator_t *base = malloc(sizeof(pb_chunk_allocator_t));
+  pb_chunk_allocator_t *base = calloc(1, sizeof(pb_chunk_allocator_t));
   if (base) {
-    *base = (pb_chunk_allocator_t){
-      .next     = NULL,
-      .capacity = capacity
-    };
-    allocator.data = base;
+    base->list.prev = &(base->list);
+    base->list.next = &(base->list);
+    base->capacity  = capacity;
+    allocator.data  = base;
   }
   return allocator;
 }
@@ -248,11 +301,21 @@ pb_chunk_allocator_destroy(pb_allocator_t *allocator) {
   assert(allocator);
   pb_chunk_allocator_t *base = allocator->data;
   if (base) {
-    pb_chunk_allocator_t *head;
-    while ((head = base->next) && base->next) {
-      base->next = base->next->next;
-      free(head);
+    pb_chunk_t *chunk = base->list.next;
+    while (chunk != &(base->list)) {
+      pb_chunk_t *next = chunk->next;
+      free(chunk);
+      chunk = next;
+    }
+
+    /* Free chunks retained in free lists */
+    for (size_t c = 0; c < CLASSES; ++c) {
+      while ((chunk = base->free[c].head)) {
+        base->free[c].head = chunk->next;
+        free(chunk);
+      }
     }
     free(base);
+    allocator->data = NULL;
   }
 }
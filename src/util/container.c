@@ -0,0 +1,528 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Enable truncation of files */
+#ifndef _GNU_SOURCE
+  #define _GNU_SOURCE
+#endif
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "core/buffer.h"
+#include "core/common.h"
+#include "core/descriptor.h"
+#include "core/varint.h"
+#include "util/container.h"
+#include "util/path.h"
+#include "util/record.h"
+
+/* ----------------------------------------------------------------------------
+ * Constants
+ * ------------------------------------------------------------------------- */
+
+/* Magic number identifying a container */
+static const uint8_t
+magic[8] = { 'p', 'b', 'c', 'o', 'n', 't', 0, 1 };
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_container_footer_t {
+  uint64_t records;                    /*!< Size of records */
+  uint64_t size;                       /*!< Record count */
+  uint64_t index;                      /*!< Offset of record offsets */
+  uint64_t keys;                       /*!< Offset of key samples */
+  uint64_t samples;                    /*!< Key sample count */
+  uint64_t interval;                   /*!< Key sampling interval */
+  uint8_t magic[8];                    /*!< Magic number */
+} pb_container_footer_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_container_key_t {
+  uint64_t value;                      /*!< Key */
+  int present;                         /*!< Key presence */
+} pb_container_key_t;
+
+/* ----------------------------------------------------------------------------
+ * Path callback
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Field handler that extracts a key.
+ *
+ * Only unsigned integer fields can be used as keys, so their natural order is
+ * retained. If a key occurs several times, the last occurrence is used.
+ *
+ * \param[in]     descriptor Field descriptor
+ * \param[in]     value      Pointer holding value
+ * \param[in,out] user       User data
+ * \return                   Error code
+ */
+static pb_error_t
+handler(
+    const pb_field_descriptor_t *descriptor, const void *value, void *user) {
+  assert(descriptor && value && user);
+  pb_container_key_t *key = user;
+  switch (pb_field_descriptor_type(descriptor)) {
+    case PB_TYPE_UINT32:
+    case PB_TYPE_FIXED32:
+      key->value = *(const uint32_t *)value;
+      break;
+    case PB_TYPE_UINT64:
+    case PB_TYPE_FIXED64:
+      key->value = *(const uint64_t *)value;
+      break;
+    default:
+      return PB_ERROR_INVALID;
+  }
+  key->present = 1;
+  return PB_ERROR_NONE;
+}
+
+/* ----------------------------------------------------------------------------
+ * Internal functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Extract the key of a record.
+ *
+ * \param[in]  key    Key path
+ * \param[in]  record Record
+ * \param[out] value  Pointer receiving key
+ * \return            Error code
+ */
+static pb_error_t
+extract(const pb_path_t *key, const pb_buffer_t *record, uint64_t *value) {
+  assert(key && record && value);
+  pb_container_key_t temp = {};
+  pb_error_t error = pb_path_evaluate(key, record, handler, &temp);
+  if (!error && !temp.present)
+    error = PB_ERROR_ABSENT;
+  if (!error)
+    *value = temp.value;
+  return error;
+}
+
+/*!
+ * Check the consistency of a footer with the size of its file.
+ *
+ * Every offset and count is bounded by the size of the data preceding the
+ * footer before it is used in any subtraction or multiplication, so crafted
+ * footers cannot wrap around and point outside of the mapping.
+ *
+ * \param[in] footer Footer
+ * \param[in] size   File size
+ * \return           Test result
+ */
+static int
+check(const pb_container_footer_t *footer, size_t size) {
+  assert(footer && size >= sizeof(*footer));
+  const uint64_t limit = size - sizeof(*footer);
+  if (memcmp(footer->magic, magic, sizeof(magic)))
+    return 0;
+
+  /* Check record offsets, which directly follow the records */
+  if (footer->index > limit || footer->index % 8 ||
+      footer->records > footer->index ||
+      footer->size > (limit - footer->index) / 8 ||
+      footer->keys != footer->index + footer->size * 8)
+    return 0;
+
+  /* Check key samples, which directly precede the footer */
+  if (footer->samples > (limit - footer->keys) / 8 ||
+      footer->keys + footer->samples * 8 != limit)
+    return 0;
+  if (!footer->samples)
+    return 1;
+  return footer->interval && footer->samples ==
+    footer->size / footer->interval + !!(footer->size % footer->interval);
+}
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create a container reader for a file.
+ *
+ * The file is memory-mapped and the index in its footer is used in place, so
+ * opening a container takes constant time regardless of its size.
+ *
+ * \param[in] path[] Path
+ * \return           Container reader
+ */
+extern pb_container_reader_t
+pb_container_reader_create(const char path[]) {
+  assert(path);
+  pb_buffer_t buffer = pb_buffer_create_mmap(path, PB_BUFFER_READ);
+  if (unlikely_(!pb_buffer_valid(&buffer)))
+    return pb_container_reader_create_invalid(PB_ERROR_IO);
+
+  /* Read and check footer */
+  pb_container_footer_t footer;
+  size_t size = pb_buffer_size(&buffer);
+  if (size >= sizeof(footer))
+    memcpy(&footer, pb_buffer_data_from(&buffer,
+      size - sizeof(footer)), sizeof(footer));
+  if (unlikely_(size < sizeof(footer) || !check(&footer, size))) {
+    pb_buffer_destroy(&buffer);
+    return pb_container_reader_create_invalid(PB_ERROR_INVALID);
+  }
+
+  /* Use index and key samples in place */
+  const uint8_t *data = pb_buffer_data(&buffer);
+  pb_container_reader_t reader = {
+    .buffer   = buffer,
+    .index    = (const uint64_t *)&(data[footer.index]),
+    .keys     = (const uint64_t *)&(data[footer.keys]),
+    .records  = footer.records,
+    .size     = footer.size,
+    .samples  = footer.samples,
+    .interval = footer.interval,
+    .error    = PB_ERROR_NONE
+  };
+  return reader;
+}
+
+/*!
+ * Destroy a container reader.
+ *
+ * \param[in,out] reader Container reader
+ */
+extern void
+pb_container_reader_destroy(pb_container_reader_t *reader) {
+  assert(reader);
+  if (pb_container_reader_valid(reader))
+    pb_buffer_destroy(&(reader->buffer));
+}
+
+/*!
+ * Retrieve the record with the given number in constant time.
+ *
+ * The record is returned as a zero-copy buffer which points into the mapping
+ * and remains valid until the container reader is destroyed.
+ *
+ * \param[in]  reader   Container reader
+ * \param[in]  position Record number
+ * \param[out] record   Buffer receiving record
+ * \return              Error code
+ */
+extern pb_error_t
+pb_container_reader_get(
+    const pb_container_reader_t *reader, size_t position,
+    pb_buffer_t *record) {
+  assert(reader && record);
+  if (unlikely_(!pb_container_reader_valid(reader)))
+    return PB_ERROR_INVALID;
+  if (unlikely_(position >= reader->size))
+    return PB_ERROR_OFFSET;
+
+  /* Determine boundaries of record */
+  size_t offset = reader->index[position], end = position + 1 < reader->size
+    ? reader->index[position + 1]
+    : reader->records;
+  if (unlikely_(offset >= end || end > reader->records))
+    return PB_ERROR_OFFSET;
+
+  /* Read length prefix and ensure it matches the boundaries */
+  uint8_t *data = pb_buffer_data_from(&(reader->buffer), offset);
+  uint32_t length;
+  size_t size = pb_varint_unpack_uint32(data, end - offset, &length);
+  if (unlikely_(!size))
+    return PB_ERROR_VARINT;
+  if (unlikely_(size + length != end - offset))
+    return PB_ERROR_OFFSET;
+
+  /* Return record */
+  *record = pb_buffer_create_zero_copy_internal(&(data[size]), length);
+  return PB_ERROR_NONE;
+}
+
+/*!
+ * Seek to the first record with a key not less than the given key.
+ *
+ * The key samples are searched with a binary search, and only the records
+ * between two samples are decoded to determine the exact position, so the
+ * records must be sorted by their keys, and the key path must match the one
+ * used for writing. If all keys are less than the given key, PB_ERROR_ABSENT
+ * is returned.
+ *
+ * \param[in]  reader   Container reader
+ * \param[in]  key      Key path
+ * \param[in]  value    Key
+ * \param[out] position Pointer receiving record number
+ * \return              Error code
+ */
+extern pb_error_t
+pb_container_reader_seek(
+    const pb_container_reader_t *reader, const pb_path_t *key,
+    uint64_t value, size_t *position) {
+  assert(reader && key && position);
+  if (unlikely_(!pb_container_reader_valid(reader) ||
+      !pb_path_valid(key) || !reader->samples))
+    return PB_ERROR_INVALID;
+
+  /* Search first key sample not less than the given key */
+  size_t lower = 0, upper = reader->samples;
+  while (lower < upper) {
+    size_t middle = lower + (upper - lower) / 2;
+    if (reader->keys[middle] < value) {
+      lower = middle + 1;
+    } else {
+      upper = middle;
+    }
+  }
+
+  /* Search records between the previous and the found key sample */
+  size_t begin = lower ? (lower - 1) * reader->interval + 1 : 0,
+         end   = lower < reader->samples
+           ? lower * reader->interval
+           : reader->size;
+  pb_error_t error = PB_ERROR_NONE;
+  for (; !error && begin < end; begin++) {
+    pb_buffer_t record; uint64_t current;
+    if (!(error = pb_container_reader_get(reader, begin, &record))) {
+      error = extract(key, &record, &current);
+      pb_buffer_destroy(&record);
+      if (!error && current >= value)
+        break;
+    }
+  }
+
+  /* Return position, if any */
+  if (!error) {
+    if (begin < reader->size) {
+      *position = begin;
+    } else {
+      error = PB_ERROR_ABSENT;
+    }
+  }
+  return error;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/*!
+ * Create a container writer for a file.
+ *
+ * \param[in] path[] Path
+ * \return           Container writer
+ */
+extern pb_container_writer_t
+pb_container_writer_create(const char path[]) {
+  assert(path);
+  pb_container_writer_t writer = pb_container_writer_create_invalid();
+
+  /* Create an empty file */
+  pb_record_writer_t temp = pb_record_writer_create(path, PB_RECORD_SYNC_NONE);
+  if (unlikely_(!pb_record_writer_valid(&temp) ||
+      ftruncate(temp.fd, 0))) {
+    pb_record_writer_destroy(&temp);
+    return writer;
+  }
+
+  /* Record offsets are kept in a scratch file to bound memory usage */
+  char *scratch = malloc(strlen(path) + sizeof(".XXXXXX"));
+  pb_buffer_t index = pb_buffer_create_invalid();
+  if (scratch) {
+    int fd = mkstemp(strcat(strcpy(scratch, path), ".XXXXXX"));
+
+    /* The mapping keeps the unlinked scratch file alive until destroyed */
+    if (fd >= 0) {
+      unlink(scratch);
+      index = pb_buffer_create_mmap_fd(fd, PB_BUFFER_WRITE);
+    }
+    free(scratch);
+  }
+  if (unlikely_(!pb_buffer_valid(&index))) {
+    pb_record_writer_destroy(&temp);
+    return writer;
+  }
+
+  /* Initialize writer */
+  writer.writer = temp;
+  writer.index  = index;
+  writer.keys   = pb_buffer_create_empty();
+  return writer;
+}
+
+/*!
+ * Create a container writer for a file with key samples.
+ *
+ * Every n-th record's key is extracted with the given path and sampled in the
+ * footer, so the container can be searched by key. The key must be an
+ * unsigned integer field, and records must be written in ascending order of
+ * their keys.
+ *
+ * \warning A container writer does not take ownership of the provided path,
+ * so the caller must ensure that the path is not freed during operations.
+ *
+ * \param[in] path[]   Path
+ * \param[in] key      Key path
+ * \param[in] interval Key sampling interval
+ * \return             Container writer
+ */
+extern pb_container_writer_t
+pb_container_writer_create_with_keys(
+    const char path[], const pb_path_t *key, size_t interval) {
+  assert(path && key && interval);
+  if (unlikely_(!pb_path_valid(key)))
+    return pb_container_writer_create_invalid();
+  pb_container_writer_t writer = pb_container_writer_create(path);
+  writer.key      = key;
+  writer.interval = interval;
+  return writer;
+}
+
+/*!
+ * Destroy a container writer.
+ *
+ * If the container writer wasn't finished, the file is not a valid container.
+ *
+ * \param[in,out] writer Container writer
+ */
+extern void
+pb_container_writer_destroy(pb_container_writer_t *writer) {
+  assert(writer);
+  pb_record_writer_destroy(&(writer->writer));
+  if (pb_buffer_valid(&(writer->index)))
+    pb_buffer_destroy(&(writer->index));
+  if (pb_buffer_valid(&(writer->keys)))
+    pb_buffer_destroy(&(writer->keys));
+}
+
+/*!
+ * Append a batch of records to a container.
+ *
+ * The offsets of the records, and the keys of sampled records, are appended
+ * to the index incrementally. Keys are extracted before any record is written,
+ * so if a key is missing, nothing is written. If writing fails, the container
+ * writer is invalidated, as the file cannot be finished consistently.
+ *
+ * \param[in,out] writer    Container writer
+ * \param[in]     records[] Records
+ * \param[in]     size      Record count
+ * \return                  Error code
+ */
+extern pb_error_t
+pb_container_writer_write(
+    pb_container_writer_t *writer, const pb_buffer_t records[], size_t size) {
+  assert(writer && (records || !size));
+  if (unlikely_(!pb_container_writer_valid(writer)))
+    return PB_ERROR_INVALID;
+  if (unlikely_(!size))
+    return PB_ERROR_NONE;
+
+  /* Determine number of sampled records */
+  size_t samples = 0;
+  if (writer->key)
+    samples = (writer->size + size    + writer->interval - 1) / writer->interval
+            - (writer->size           + writer->interval - 1) / writer->interval;
+
+  /* Reserve space for record offsets and key samples */
+  if (unlikely_(pb_buffer_reserve(&(writer->index), size * 8) ||
+                pb_buffer_reserve(&(writer->keys), samples * 8)))
+    return PB_ERROR_ALLOC;
+
+  /* Extract keys of sampled records into reserved space */
+  pb_error_t error = PB_ERROR_NONE;
+  if (samples) {
+    uint64_t *keys = (uint64_t *)pb_buffer_data_from(
+      &(writer->keys), pb_buffer_size(&(writer->keys)));
+    for (size_t r = 0, k = 0; !error && r < size; r++)
+      if (!((writer->size + r) % writer->interval))
+        error = extract(writer->key, &(records[r]), &(keys[k++]));
+    if (unlikely_(error))
+      return error;
+  }
+
+  /* Write records */
+  if (unlikely_(error = pb_record_writer_write(
+      &(writer->writer), records, size))) {
+    if (error != PB_ERROR_INVALID)
+      pb_record_writer_destroy(&(writer->writer));
+    return error;
+  }
+
+  /* Append record offsets and key samples within reserved space */
+  uint64_t *index = (uint64_t *)pb_buffer_grow(&(writer->index), size * 8);
+  if (unlikely_(!index || (samples &&
+      !pb_buffer_grow(&(writer->keys), samples * 8))))
+    return PB_ERROR_ALLOC;
+  for (size_t r = 0; r < size; r++) {
+    uint32_t length = pb_buffer_size(&(records[r]));
+    index[r] = writer->offset;
+    writer->offset += pb_varint_size_uint32(&length) + length;
+  }
+  writer->size += size;
+  return PB_ERROR_NONE;
+}
+
+/*!
+ * Finish a container by writing the index and footer and syncing it to disk.
+ *
+ * Afterwards, no more records can be written.
+ *
+ * \param[in,out] writer Container writer
+ * \return               Error code
+ */
+extern pb_error_t
+pb_container_writer_finish(pb_container_writer_t *writer) {
+  assert(writer);
+  if (unlikely_(!pb_container_writer_valid(writer)))
+    return PB_ERROR_INVALID;
+
+  /* Pad records, so the index is aligned */
+  const uint8_t padding[8] = {};
+  size_t pad = (8 - writer->offset % 8) % 8;
+
+  /* Assemble footer */
+  pb_container_footer_t footer = {
+    .records  = writer->offset,
+    .size     = writer->size,
+    .index    = writer->offset + pad,
+    .keys     = writer->offset + pad + pb_buffer_size(&(writer->index)),
+    .samples  = pb_buffer_size(&(writer->keys)) / 8,
+    .interval = writer->interval
+  };
+  memcpy(footer.magic, magic, sizeof(magic));
+
+  /* Write index and footer, sync and close file */
+  pb_record_writer_t *temp = &(writer->writer);
+  pb_error_t error = PB_ERROR_NONE;
+  if (!(error = pb_record_writer_write_raw(temp, padding, pad)) &&
+      !(error = pb_record_writer_write_raw(temp,
+        pb_buffer_data(&(writer->index)), pb_buffer_size(&(writer->index)))) &&
+      !(error = pb_record_writer_write_raw(temp,
+        pb_buffer_data(&(writer->keys)), pb_buffer_size(&(writer->keys)))) &&
+      !(error = pb_record_writer_write_raw(temp,
+        (const uint8_t *)&footer, sizeof(footer))))
+    error = pb_record_writer_sync(temp);
+  pb_record_writer_destroy(temp);
+  return error;
+}
@@ -0,0 +1,355 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <unistd.h>
+
+#include "core/allocator.h"
+#include "core/common.h"
+#include "util/executor.h"
+
+/* ----------------------------------------------------------------------------
+ * Constants
+ * ------------------------------------------------------------------------- */
+
+/* Size of a cache line */
+#define CACHELINE 64
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_executor_queue_t {
+  pthread_mutex_t mutex;               /*!< Mutex */
+  size_t begin;                        /*!< First unclaimed task */
+  size_t end;                          /*!< End of unclaimed tasks */
+  char padding[CACHELINE];             /*!< Padding against false sharing */
+} pb_executor_queue_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_executor_worker_t {
+  struct pb_executor_state_t *state;   /*!< Shared state */
+  size_t index;                        /*!< Thread index */
+  pthread_t thread;                    /*!< Thread */
+} pb_executor_worker_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_executor_state_t {
+  pthread_mutex_t mutex;               /*!< Mutex */
+  pthread_cond_t start;                /*!< Condition for start of job */
+  pthread_cond_t done;                 /*!< Condition for end of job */
+  size_t generation;                   /*!< Job generation */
+  size_t active;                       /*!< Threads working on job */
+  int stop;                            /*!< Whether threads should exit */
+  struct {
+    pb_executor_task_f task;           /*!< Task */
+    void *user;                        /*!< User data */
+    pb_error_t error;                  /*!< First error */
+  } job;
+  pb_executor_queue_t *queues;         /*!< Queues, one per thread */
+  pb_executor_worker_t *workers;       /*!< Workers, one per thread */
+  size_t size;                         /*!< Thread count */
+} pb_executor_state_t;
+
+/* ----------------------------------------------------------------------------
+ * Internal functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Steal tasks from the queue of another thread.
+ *
+ * The upper half of the first non-empty queue is moved to the queue of the
+ * thief, so large ranges are split in logarithmically many steps, while the
+ * owner keeps working on the lower end of its range undisturbed.
+ *
+ * \param[in,out] state  Shared state
+ * \param[in]     thread Thread index
+ * \param[out]    index  Pointer receiving task index
+ * \return               Test result
+ */
+static int
+steal(pb_executor_state_t *state, size_t thread, size_t *index) {
+  assert(state && index);
+  for (size_t v = 1; v < state->size; v++) {
+    pb_executor_queue_t *victim = &(state->queues[(thread + v) % state->size]);
+    pthread_mutex_lock(&(victim->mutex));
+    if (victim->begin < victim->end) {
+      const size_t end = victim->end;
+      victim->end -= (end - victim->begin + 1) / 2;
+      *index = victim->end;
+      pthread_mutex_unlock(&(victim->mutex));
+
+      /* Move remaining stolen tasks to own queue */
+      pb_executor_queue_t *queue = &(state->queues[thread]);
+      pthread_mutex_lock(&(queue->mutex));
+      queue->begin = *index + 1;
+      queue->end   = end;
+      pthread_mutex_unlock(&(queue->mutex));
+      return 1;
+    }
+    pthread_mutex_unlock(&(victim->mutex));
+  }
+  return 0;
+}
+
+/*!
+ * Claim the next task, stealing from other threads if the own queue is empty.
+ *
+ * \param[in,out] state  Shared state
+ * \param[in]     thread Thread index
+ * \param[out]    index  Pointer receiving task index
+ * \return               Test result
+ */
+static int
+claim(pb_executor_state_t *state, size_t thread, size_t *index) {
+  assert(state && index);
+  pb_executor_queue_t *queue = &(state->queues[thread]);
+  pthread_mutex_lock(&(queue->mutex));
+  if (queue->begin < queue->end) {
+    *index = queue->begin++;
+    pthread_mutex_unlock(&(queue->mutex));
+    return 1;
+  }
+  pthread_mutex_unlock(&(queue->mutex));
+  return steal(state, thread, index);
+}
+
+/*!
+ * Execute tasks until all queues are empty or a task failed.
+ *
+ * Queues only shrink during a job, so once a thread finds all queues empty,
+ * all remaining tasks are already being executed by other threads.
+ *
+ * \param[in,out] state  Shared state
+ * \param[in]     thread Thread index
+ */
+static void
+work(pb_executor_state_t *state, size_t thread) {
+  assert(state);
+  size_t index;
+  while (!__atomic_load_n(&(state->job.error), __ATOMIC_RELAXED) &&
+      claim(state, thread, &index)) {
+    pb_error_t error = state->job.task(index, thread, state->job.user);
+    if (unlikely_(error)) {
+      pb_error_t expected = PB_ERROR_NONE;
+      __atomic_compare_exchange_n(&(state->job.error), &expected, error,
+        0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+/*!
+ * Wait for jobs and take part in them until the executor is destroyed.
+ *
+ * \param[in,out] data Worker
+ * \return             Nothing
+ */
+static void *
+main_(void *data) {
+  assert(data);
+  pb_executor_worker_t *worker = data;
+  pb_executor_state_t *state = worker->state;
+  size_t generation = 0;
+
+  /* Wait for next job or termination */
+  pthread_mutex_lock(&(state->mutex));
+  for (;;) {
+    while (!state->stop && state->generation == generation)
+      pthread_cond_wait(&(state->start), &(state->mutex));
+    if (state->stop)
+      break;
+    generation = state->generation;
+    pthread_mutex_unlock(&(state->mutex));
+
+    /* Take part in job and signal completion, if last */
+    work(state, worker->index);
+    pthread_mutex_lock(&(state->mutex));
+    if (!--state->active)
+      pthread_cond_signal(&(state->done));
+  }
+  pthread_mutex_unlock(&(state->mutex));
+  return NULL;
+}
+
+/*!
+ * Stop and join the first threads of an executor and free its state.
+ *
+ * \param[in,out] state Shared state
+ * \param[in]     size  Number of running threads, including the caller
+ */
+static void
+state_destroy(pb_executor_state_t *state, size_t size) {
+  assert(state);
+  pthread_mutex_lock(&(state->mutex));
+  state->stop = 1;
+  pthread_cond_broadcast(&(state->start));
+  pthread_mutex_unlock(&(state->mutex));
+  for (size_t w = 1; w < size; w++)
+    pthread_join(state->workers[w].thread, NULL);
+
+  /* Free all allocated memory */
+  for (size_t q = 0; q < state->size; q++)
+    pthread_mutex_destroy(&(state->queues[q].mutex));
+  pthread_cond_destroy(&(state->done));
+  pthread_cond_destroy(&(state->start));
+  pthread_mutex_destroy(&(state->mutex));
+  pb_allocator_free(&allocator_default, state->workers);
+  pb_allocator_free(&allocator_default, state->queues);
+  pb_allocator_free(&allocator_default, state);
+}
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create an executor.
+ *
+ * An executor is a pool of threads which is created once and executes a
+ * number of independent tasks per job. The tasks of a job are distributed
+ * evenly across the queues of all threads up front. When a thread runs out of
+ * tasks, it steals half of the remaining tasks of another thread, so uneven
+ * workloads are balanced without contention in the common case.
+ *
+ * \param[in] size Thread count, 0 for one per online processor
+ * \return         Executor
+ */
+extern pb_executor_t
+pb_executor_create(size_t size) {
+  if (!size) {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    size = processors > 0 ? (size_t)processors : 1;
+  }
+
+  /* Allocate state, queues and workers */
+  pb_executor_state_t *state =
+    pb_allocator_allocate(&allocator_default, sizeof(pb_executor_state_t));
+  if (unlikely_(!state))
+    return pb_executor_create_invalid();
+  state->queues = pb_allocator_allocate(&allocator_default,
+    size * sizeof(pb_executor_queue_t));
+  state->workers = pb_allocator_allocate(&allocator_default,
+    size * sizeof(pb_executor_worker_t));
+  if (unlikely_(!state->queues || !state->workers)) {
+    if (state->workers)
+      pb_allocator_free(&allocator_default, state->workers);
+    if (state->queues)
+      pb_allocator_free(&allocator_default, state->queues);
+    pb_allocator_free(&allocator_default, state);
+    return pb_executor_create_invalid();
+  }
+
+  /* Initialize state */
+  pthread_mutex_init(&(state->mutex), NULL);
+  pthread_cond_init(&(state->start), NULL);
+  pthread_cond_init(&(state->done), NULL);
+  state->generation = 0;
+  state->active     = 0;
+  state->stop       = 0;
+  state->size       = size;
+  for (size_t q = 0; q < size; q++) {
+    pthread_mutex_init(&(state->queues[q].mutex), NULL);
+    state->queues[q].begin = 0;
+    state->queues[q].end   = 0;
+  }
+
+  /* Start threads, except for the first one, which is the caller's */
+  for (size_t w = 0; w < size; w++) {
+    state->workers[w].state = state;
+    state->workers[w].index = w;
+    if (w && unlikely_(pthread_create(&(state->workers[w].thread),
+        NULL, main_, &(state->workers[w])))) {
+      state_destroy(state, w);
+      return pb_executor_create_invalid();
+    }
+  }
+  pb_executor_t executor = {
+    .state = state,
+    .size  = size
+  };
+  return executor;
+}
+
+/*!
+ * Destroy an executor.
+ *
+ * \param[in,out] executor Executor
+ */
+extern void
+pb_executor_destroy(pb_executor_t *executor) {
+  assert(executor);
+  if (executor->state)
+    state_destroy(executor->state, executor->size);
+}
+
+/*!
+ * Execute a number of tasks using all threads of an executor.
+ *
+ * The calling thread takes part in executing the tasks and returns when all
+ * tasks were executed. Every task is executed exactly once by an arbitrary
+ * thread, which is identified by its index. If a task fails, no further tasks
+ * are started and the first error is returned.
+ *
+ * \warning An executor is not thread-safe and must not be used to run jobs
+ * from within its own tasks.
+ *
+ * \param[in,out] executor Executor
+ * \param[in]     size     Task count
+ * \param[in]     task     Task
+ * \param[in,out] user     User data
+ * \return                 Error code
+ */
+extern pb_error_t
+pb_executor_run(
+    pb_executor_t *executor, size_t size, pb_executor_task_f task,
+    void *user) {
+  assert(executor && task);
+  if (unlikely_(!pb_executor_valid(executor)))
+    return PB_ERROR_INVALID;
+  pb_executor_state_t *state = executor->state;
+
+  /* Distribute tasks evenly across queues */
+  for (size_t q = 0; q < state->size; q++) {
+    state->queues[q].begin = size *  q      / state->size;
+    state->queues[q].end   = size * (q + 1) / state->size;
+  }
+  state->job.task  = task;
+  state->job.user  = user;
+  state->job.error = PB_ERROR_NONE;
+
+  /* Start job, take part in it and wait for completion */
+  pthread_mutex_lock(&(state->mutex));
+  state->generation++;
+  state->active = state->size - 1;
+  pthread_cond_broadcast(&(state->start));
+  pthread_mutex_unlock(&(state->mutex));
+  work(state, 0);
+  pthread_mutex_lock(&(state->mutex));
+  while (state->active)
+    pthread_cond_wait(&(state->done), &(state->mutex));
+  pthread_mutex_unlock(&(state->mutex));
+  return state->job.error;
+}
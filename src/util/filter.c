@@ -0,0 +1,871 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <alloca.h>
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/allocator.h"
+#include "core/buffer.h"
+#include "core/common.h"
+#include "core/descriptor.h"
+#include "core/stream.h"
+#include "util/filter.h"
+#include "util/path.h"
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_filter_compiler_t {
+  pb_filter_t *filter;                 /*!< Filter */
+  const char *input;                   /*!< Current position */
+  struct {
+    size_t leaf;                       /*!< Predicate capacity */
+    size_t program;                    /*!< Instruction capacity */
+  } capacity;
+  size_t depth;                        /*!< Current stack depth */
+} pb_filter_compiler_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_filter_state_t {
+  const pb_filter_t *filter;           /*!< Filter */
+  uint8_t *truth;                      /*!< Truth values of predicates */
+  uint8_t *last;                       /*!< Results of last occurrences */
+  uint8_t *stack;                      /*!< Evaluation stack */
+  size_t *active;                      /*!< Active predicates */
+  int done;                            /*!< Result is determined */
+} pb_filter_state_t;
+
+/* ----------------------------------------------------------------------------
+ * Constants
+ * ------------------------------------------------------------------------- */
+
+/* Truth values of three-valued logic */
+#define FALSE_   0                     /*!< False */
+#define TRUE_    1                     /*!< True */
+#define UNKNOWN_ 2                     /*!< Not yet determined */
+
+/* Characters allowed in field paths */
+#define PATH_CHARS \
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_."
+
+/* ----------------------------------------------------------------------------
+ * Internal functions: compilation
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Skip whitespace and test whether the input continues with a token.
+ *
+ * \param[in,out] compiler Compiler
+ * \param[in]     token[]  Token
+ * \return                 Test result
+ */
+static int
+accept(pb_filter_compiler_t *compiler, const char token[]) {
+  assert(compiler && token);
+  while (isspace((unsigned char)*compiler->input))
+    compiler->input++;
+  size_t size = strlen(token);
+  if (strncmp(compiler->input, token, size))
+    return 0;
+
+  /* Keywords must not be followed by further identifier characters */
+  if (isalpha((unsigned char)token[0]) &&
+      compiler->input[size] && strchr(PATH_CHARS, compiler->input[size]))
+    return 0;
+  compiler->input += size;
+  return 1;
+}
+
+/*!
+ * Append an instruction to the program.
+ *
+ * \param[in,out] compiler Compiler
+ * \param[in]     code     Instruction code
+ * \param[in]     arg      Predicate or jump target
+ * \return                 Error code
+ */
+static pb_error_t
+emit(pb_filter_compiler_t *compiler, pb_filter_code_t code, size_t arg) {
+  assert(compiler);
+  pb_filter_t *filter = compiler->filter;
+  if (filter->program.size == compiler->capacity.program) {
+    size_t capacity = compiler->capacity.program
+      ? compiler->capacity.program << 1
+      : 16;
+    pb_filter_op_t *data = pb_allocator_resize(&allocator_default,
+      filter->program.data, sizeof(pb_filter_op_t) * capacity);
+    if (unlikely_(!data))
+      return PB_ERROR_ALLOC;
+    filter->program.data      = data;
+    compiler->capacity.program = capacity;
+  }
+  filter->program.data[filter->program.size++] = (pb_filter_op_t){
+    .code = code,
+    .arg  = arg
+  };
+
+  /* Track stack depth needed for evaluation */
+  if (code == PB_FILTER_CODE_LEAF) {
+    if (++compiler->depth > filter->depth)
+      filter->depth = compiler->depth;
+  } else if (code == PB_FILTER_CODE_AND || code == PB_FILTER_CODE_OR) {
+    compiler->depth--;
+  }
+  return PB_ERROR_NONE;
+}
+
+/*!
+ * Parse a literal matching the type of a predicate's field.
+ *
+ * \param[in,out] compiler Compiler
+ * \param[in]     type     Type
+ * \param[in,out] leaf     Predicate
+ * \return                 Error code
+ */
+static pb_error_t
+parse_literal(
+    pb_filter_compiler_t *compiler, pb_type_t type, pb_filter_leaf_t *leaf) {
+  assert(compiler && leaf);
+  accept(compiler, "");
+  const char *input = compiler->input;
+  char *end = (char *)input;
+  errno = 0;
+  switch (type) {
+
+    /* Parse signed integer */
+    case PB_TYPE_INT32:
+    case PB_TYPE_INT64:
+    case PB_TYPE_SINT32:
+    case PB_TYPE_SINT64:
+    case PB_TYPE_SFIXED32:
+    case PB_TYPE_SFIXED64:
+    case PB_TYPE_ENUM:
+      leaf->value.integer = strtoll(input, &end, 10);
+      break;
+
+    /* Parse unsigned integer */
+    case PB_TYPE_UINT32:
+    case PB_TYPE_UINT64:
+    case PB_TYPE_FIXED32:
+    case PB_TYPE_FIXED64:
+      if (isdigit((unsigned char)*input))
+        leaf->value.natural = strtoull(input, &end, 10);
+      break;
+
+    /* Parse boolean */
+    case PB_TYPE_BOOL:
+      if (accept(compiler, "true")) {
+        leaf->value.natural = 1;
+      } else if (accept(compiler, "false")) {
+        leaf->value.natural = 0;
+      } else {
+        return PB_ERROR_INVALID;
+      }
+      return PB_ERROR_NONE;
+
+    /* Parse floating-point number */
+    case PB_TYPE_FLOAT:
+    case PB_TYPE_DOUBLE:
+      leaf->value.real = strtod(input, &end);
+      break;
+
+    /* Parse quoted string, resolving escaped quotes and backslashes */
+    case PB_TYPE_STRING:
+    case PB_TYPE_BYTES: {
+      if (*input != '"')
+        return PB_ERROR_INVALID;
+      uint8_t *data = pb_allocator_allocate(&allocator_default,
+        strlen(input) + 1);
+      if (unlikely_(!data))
+        return PB_ERROR_ALLOC;
+      size_t size = 0;
+      for (end = (char *)input + 1; *end && *end != '"'; end++) {
+        if (*end == '\\' && end[1])
+          end++;
+        data[size++] = (uint8_t)*end;
+      }
+      leaf->value.string = pb_string_init(data, size);
+      if (*(end++) != '"')
+        return PB_ERROR_INVALID;
+      break;
+    }
+
+    /* Messages can only be tested for presence */
+    default:
+      return PB_ERROR_INVALID;
+  }
+
+  /* Ensure that the literal was parsed completely */
+  if (end == input || errno == ERANGE)
+    return PB_ERROR_INVALID;
+  compiler->input = end;
+  return PB_ERROR_NONE;
+}
+
+/*!
+ * Parse a predicate, which is a field path optionally followed by a
+ * comparison operator and a literal.
+ *
+ * \param[in,out] compiler Compiler
+ * \return                 Error code
+ */
+static pb_error_t
+parse_leaf(pb_filter_compiler_t *compiler) {
+  assert(compiler);
+  pb_filter_t *filter = compiler->filter;
+  if (filter->leaf.size == compiler->capacity.leaf) {
+    size_t capacity = compiler->capacity.leaf
+      ? compiler->capacity.leaf << 1
+      : 8;
+    pb_filter_leaf_t *data = pb_allocator_resize(&allocator_default,
+      filter->leaf.data, sizeof(pb_filter_leaf_t) * capacity);
+    if (unlikely_(!data))
+      return PB_ERROR_ALLOC;
+    filter->leaf.data      = data;
+    compiler->capacity.leaf = capacity;
+  }
+
+  /* Extract field path */
+  accept(compiler, "");
+  size_t size = strspn(compiler->input, PATH_CHARS);
+  if (!size)
+    return PB_ERROR_INVALID;
+  char *name = alloca(size + 1);
+  memcpy(name, compiler->input, size);
+  name[size] = '\0';
+  compiler->input += size;
+
+  /* Resolve field path and register predicate */
+  pb_filter_leaf_t *leaf = &(filter->leaf.data[filter->leaf.size]);
+  memset(leaf, 0, sizeof(pb_filter_leaf_t));
+  leaf->path = pb_path_create(filter->descriptor, name);
+  if (!pb_path_valid(&(leaf->path)))
+    return pb_path_error(&(leaf->path));
+  filter->leaf.size++;
+
+  /* Repeated fields are only allowed at the end of the path */
+  const size_t levels = pb_path_size(&(leaf->path));
+  for (size_t l = 0; l < levels - 1; ++l)
+    if (pb_field_descriptor_label(
+          pb_path_segment(&(leaf->path), l)->descriptor) == PB_LABEL_REPEATED)
+      return PB_ERROR_INVALID;
+  const pb_field_descriptor_t *descriptor =
+    pb_path_segment(&(leaf->path), levels - 1)->descriptor;
+
+  /* Parse comparison operator, two-character operators first */
+  if (accept(compiler, "==")) {
+    leaf->operator = PB_FILTER_OPERATOR_EQ;
+  } else if (accept(compiler, "!=")) {
+    leaf->operator = PB_FILTER_OPERATOR_NE;
+  } else if (accept(compiler, "<=")) {
+    leaf->operator = PB_FILTER_OPERATOR_LE;
+  } else if (accept(compiler, ">=")) {
+    leaf->operator = PB_FILTER_OPERATOR_GE;
+  } else if (accept(compiler, "<")) {
+    leaf->operator = PB_FILTER_OPERATOR_LT;
+  } else if (accept(compiler, ">")) {
+    leaf->operator = PB_FILTER_OPERATOR_GT;
+  } else if (accept(compiler, "contains")) {
+    if (pb_field_descriptor_label(descriptor) != PB_LABEL_REPEATED)
+      return PB_ERROR_INVALID;
+    leaf->operator = PB_FILTER_OPERATOR_EQ;
+  } else {
+    leaf->operator = PB_FILTER_OPERATOR_PRESENT;
+  }
+
+  /* Parse literal, if any, and push predicate */
+  pb_error_t error = PB_ERROR_NONE;
+  if (leaf->operator != PB_FILTER_OPERATOR_PRESENT)
+    error = parse_literal(compiler, pb_field_descriptor_type(descriptor), leaf);
+  return error
+    ? error
+    : emit(compiler, PB_FILTER_CODE_LEAF, filter->leaf.size - 1);
+}
+
+/* Forward declaration for recursive descent */
+static pb_error_t
+parse_or(pb_filter_compiler_t *compiler);
+
+/*!
+ * Parse a negation, a parenthesized expression or a predicate.
+ *
+ * \param[in,out] compiler Compiler
+ * \return                 Error code
+ */
+static pb_error_t
+parse_unary(pb_filter_compiler_t *compiler) {
+  assert(compiler);
+  pb_error_t error = PB_ERROR_NONE;
+  if (accept(compiler, "!")) {
+    if (!(error = parse_unary(compiler)))
+      error = emit(compiler, PB_FILTER_CODE_NOT, 0);
+  } else if (accept(compiler, "(")) {
+    if (!(error = parse_or(compiler)) && !accept(compiler, ")"))
+      error = PB_ERROR_INVALID;
+  } else {
+    error = parse_leaf(compiler);
+  }
+  return error;
+}
+
+/*!
+ * Parse a binary expression, short-circuiting the right operand.
+ *
+ * The left operand is followed by a conditional jump past the right operand
+ * and the combining instruction, so evaluation never touches the right
+ * operand if the result is already determined by the left one.
+ *
+ * \param[in,out] compiler Compiler
+ * \param[in]     token[]  Operator token
+ * \param[in]     jump     Jump instruction code
+ * \param[in]     code     Combining instruction code
+ * \param[in]     operand  Operand parser
+ * \return                 Error code
+ */
+static pb_error_t
+parse_binary(
+    pb_filter_compiler_t *compiler, const char token[],
+    pb_filter_code_t jump, pb_filter_code_t code,
+    pb_error_t (*operand)(pb_filter_compiler_t *)) {
+  assert(compiler && token && operand);
+  pb_error_t error = operand(compiler);
+  while (!error && accept(compiler, token)) {
+    size_t target = compiler->filter->program.size;
+    if (!(error = emit(compiler, jump, 0)) &&
+        !(error = operand(compiler)) &&
+        !(error = emit(compiler, code, 0)))
+      compiler->filter->program.data[target].arg =
+        compiler->filter->program.size;
+  }
+  return error;
+}
+
+/*!
+ * Parse a conjunction.
+ *
+ * \param[in,out] compiler Compiler
+ * \return                 Error code
+ */
+static pb_error_t
+parse_and(pb_filter_compiler_t *compiler) {
+  assert(compiler);
+  return parse_binary(compiler, "&&",
+    PB_FILTER_CODE_JUMP_FALSE, PB_FILTER_CODE_AND, parse_unary);
+}
+
+/*!
+ * Parse a disjunction.
+ *
+ * \param[in,out] compiler Compiler
+ * \return                 Error code
+ */
+static pb_error_t
+parse_or(pb_filter_compiler_t *compiler) {
+  assert(compiler);
+  return parse_binary(compiler, "||",
+    PB_FILTER_CODE_JUMP_TRUE, PB_FILTER_CODE_OR, parse_and);
+}
+
+/* ----------------------------------------------------------------------------
+ * Internal functions: evaluation
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Compare a value against the literal of a predicate.
+ *
+ * \param[in] leaf  Predicate
+ * \param[in] type  Type
+ * \param[in] value Pointer holding value
+ * \return          Comparison result, 2 if unordered
+ */
+static int
+compare(const pb_filter_leaf_t *leaf, pb_type_t type, const void *value) {
+  assert(leaf && value);
+  switch (type) {
+
+    /* Compare signed integers */
+    case PB_TYPE_INT32:
+    case PB_TYPE_SINT32:
+    case PB_TYPE_SFIXED32:
+    case PB_TYPE_ENUM: {
+      int64_t x = *(const int32_t *)value;
+      return (x > leaf->value.integer) - (x < leaf->value.integer);
+    }
+    case PB_TYPE_INT64:
+    case PB_TYPE_SINT64:
+    case PB_TYPE_SFIXED64: {
+      int64_t x = *(const int64_t *)value;
+      return (x > leaf->value.integer) - (x < leaf->value.integer);
+    }
+
+    /* Compare unsigned integers */
+    case PB_TYPE_UINT32:
+    case PB_TYPE_FIXED32: {
+      uint64_t x = *(const uint32_t *)value;
+      return (x > leaf->value.natural) - (x < leaf->value.natural);
+    }
+    case PB_TYPE_UINT64:
+    case PB_TYPE_FIXED64: {
+      uint64_t x = *(const uint64_t *)value;
+      return (x > leaf->value.natural) - (x < leaf->value.natural);
+    }
+    case PB_TYPE_BOOL: {
+      uint64_t x = *(const uint8_t *)value;
+      return (x > leaf->value.natural) - (x < leaf->value.natural);
+    }
+
+    /* Compare floating-point numbers, which may be unordered */
+    case PB_TYPE_FLOAT:
+    case PB_TYPE_DOUBLE: {
+      double x = type == PB_TYPE_FLOAT
+        ? *(const float  *)value
+        : *(const double *)value;
+      if (x != x || leaf->value.real != leaf->value.real)
+        return 2;
+      return (x > leaf->value.real) - (x < leaf->value.real);
+    }
+
+    /* Compare strings lexicographically */
+    default: {
+      const pb_string_t *x = value, *y = &(leaf->value.string);
+      size_t size = pb_string_size(x) < pb_string_size(y)
+        ? pb_string_size(x)
+        : pb_string_size(y);
+      int result = size
+        ? memcmp(pb_string_data(x), pb_string_data(y), size)
+        : 0;
+      if (!result)
+        return (pb_string_size(x) > pb_string_size(y)) -
+               (pb_string_size(x) < pb_string_size(y));
+      return (result > 0) - (result < 0);
+    }
+  }
+}
+
+/*!
+ * Test whether a value satisfies a predicate.
+ *
+ * \param[in] leaf  Predicate
+ * \param[in] type  Type
+ * \param[in] value Pointer holding value
+ * \return          Test result
+ */
+static int
+test(const pb_filter_leaf_t *leaf, pb_type_t type, const void *value) {
+  assert(leaf && value);
+  int result = compare(leaf, type, value);
+  switch (leaf->operator) {
+    case PB_FILTER_OPERATOR_EQ:
+      return result == 0;
+    case PB_FILTER_OPERATOR_NE:
+      return result != 0;
+    case PB_FILTER_OPERATOR_LT:
+      return result == -1;
+    case PB_FILTER_OPERATOR_LE:
+      return result == -1 || result == 0;
+    case PB_FILTER_OPERATOR_GT:
+      return result == 1;
+    case PB_FILTER_OPERATOR_GE:
+      return result == 1 || result == 0;
+    default:
+      return 1;                                            /* LCOV_EXCL_LINE */
+  }
+}
+
+/*!
+ * Run the program on the current truth values of all predicates.
+ *
+ * Evaluation uses three-valued logic, so the result may be determined before
+ * all predicates are known, e.g. if one operand of a disjunction is true.
+ *
+ * \param[in,out] state State
+ * \return              Truth value
+ */
+static uint8_t
+run(pb_filter_state_t *state) {
+  assert(state);
+  const pb_filter_t *filter = state->filter;
+  uint8_t *top = state->stack - 1;
+  for (size_t pc = 0; pc < filter->program.size; ++pc) {
+    const pb_filter_op_t *op = &(filter->program.data[pc]);
+    switch (op->code) {
+      case PB_FILTER_CODE_LEAF:
+        *(++top) = state->truth[op->arg];
+        break;
+      case PB_FILTER_CODE_NOT:
+        if (*top != UNKNOWN_)
+          *top = !*top;
+        break;
+      case PB_FILTER_CODE_AND:
+        top--;
+        if (top[0] == FALSE_ || top[1] == FALSE_)
+          top[0] = FALSE_;
+        else if (top[0] == UNKNOWN_ || top[1] == UNKNOWN_)
+          top[0] = UNKNOWN_;
+        break;
+      case PB_FILTER_CODE_OR:
+        top--;
+        if (top[0] == TRUE_ || top[1] == TRUE_)
+          top[0] = TRUE_;
+        else if (top[0] == UNKNOWN_ || top[1] == UNKNOWN_)
+          top[0] = UNKNOWN_;
+        break;
+      case PB_FILTER_CODE_JUMP_FALSE:
+        if (*top == FALSE_)
+          pc = op->arg - 1;
+        break;
+      case PB_FILTER_CODE_JUMP_TRUE:
+        if (*top == TRUE_)
+          pc = op->arg - 1;
+        break;
+    }
+  }
+  return *top;
+}
+
+/*!
+ * Scan a buffer at a given level, updating the truth values of all active
+ * predicates in a single pass.
+ *
+ * Fields not referenced by any active predicate are skipped without being
+ * decoded. Predicates on repeated fields or testing for presence can only
+ * become true, so whenever one of them does, the program is run to check
+ * whether the result is already determined, which ends the scan early.
+ *
+ * \param[in,out] state  State
+ * \param[in]     level  Level
+ * \param[in]     active Active predicates
+ * \param[in]     size   Active predicate count
+ * \param[in]     buffer Buffer
+ * \return               Error code
+ */
+static pb_error_t
+scan(
+    pb_filter_state_t *state, size_t level,
+    const size_t active[], size_t size, const pb_buffer_t *buffer) {
+  assert(state && active && size && buffer);
+  const pb_filter_t *filter = state->filter;
+  pb_error_t error = PB_ERROR_NONE;
+
+  /* Allocate space for predicates matching a field and type-agnostic value */
+  size_t *matched = alloca(sizeof(size_t) * size);
+  pb_string_t value;
+
+  /* Iterate tag-value pairs until the result is determined */
+  pb_stream_t stream = pb_stream_create(buffer);
+  while (!error && !state->done && pb_stream_left(&stream)) {
+    pb_tag_t tag;
+    if (unlikely_(error = pb_stream_read(&stream, PB_TYPE_UINT32, &tag)))
+      break;
+
+    /* Extract wiretype and tag */
+    pb_wiretype_t wiretype = tag & 7;
+    tag >>= 3;
+
+    /* Collect undetermined predicates that reference the field */
+    const pb_field_descriptor_t *descriptor = NULL;
+    size_t count = 0;
+    int changed = 0;
+    for (size_t a = 0; a < size; ++a) {
+      const pb_filter_leaf_t *leaf = &(filter->leaf.data[active[a]]);
+      const pb_path_segment_t *segment = pb_path_segment(&(leaf->path), level);
+      if (pb_field_descriptor_tag(segment->descriptor) != tag ||
+          state->truth[active[a]] == TRUE_)
+        continue;
+
+      /* Presence is determined without decoding the value */
+      if (level == pb_path_size(&(leaf->path)) - 1 &&
+          leaf->operator == PB_FILTER_OPERATOR_PRESENT) {
+        state->truth[active[a]] = TRUE_;
+        changed = 1;
+      } else {
+        descriptor = segment->descriptor;
+        matched[count++] = active[a];
+      }
+    }
+
+    /* Skip field if no predicate needs its value */
+    if (!count) {
+      error = pb_stream_skip(&stream, wiretype);
+
+    /* Evaluate submessage on the same underlying data */
+    } else if (pb_field_descriptor_type(descriptor) == PB_TYPE_MESSAGE) {
+      if (unlikely_(error = pb_stream_read(&stream, PB_TYPE_MESSAGE, &value)))
+        break;
+      pb_buffer_t subbuffer = pb_buffer_create_zero_copy_internal(
+        pb_string_data(&value), pb_string_size(&value));
+      error = scan(state, level + 1, matched, count, &subbuffer);
+      pb_buffer_destroy(&subbuffer);
+
+    /* Test values of field, which may be in packed encoding */
+    } else {
+      pb_type_t type = pb_field_descriptor_type(descriptor);
+      size_t end = 0;
+      if (wiretype != pb_field_descriptor_wiretype(descriptor) &&
+          wiretype == PB_WIRETYPE_LENGTH) {
+        uint32_t length;
+        if (unlikely_(error = pb_stream_read(&stream, PB_TYPE_UINT32, &length)))
+          break;
+        end = pb_stream_offset(&stream) + length;
+        if (end > pb_buffer_size(buffer))
+          error = PB_ERROR_OFFSET;
+      }
+      do {
+        if (error || (error = pb_stream_read(&stream, type, &value)))
+          break;
+        for (size_t m = 0; m < count; ++m) {
+          const pb_filter_leaf_t *leaf = &(filter->leaf.data[matched[m]]);
+          int result = test(leaf, type, &value);
+
+          /* Repeated fields match if any value matches */
+          if (pb_field_descriptor_label(descriptor) == PB_LABEL_REPEATED) {
+            if (result && state->truth[matched[m]] != TRUE_) {
+              state->truth[matched[m]] = TRUE_;
+              changed = 1;
+            }
+
+          /* Non-repeated fields are determined by the last occurrence */
+          } else {
+            state->last[matched[m]] = result ? TRUE_ : FALSE_;
+          }
+        }
+      } while (pb_stream_offset(&stream) < end);
+    }
+
+    /* Check whether the result is already determined */
+    if (changed && run(state) != UNKNOWN_)
+      state->done = 1;
+  }
+  pb_stream_destroy(&stream);
+  return error;
+}
+
+/*!
+ * Test whether a buffer matches a filter, using pre-allocated state.
+ *
+ * \param[in,out] state  State
+ * \param[in]     buffer Buffer
+ * \param[out]    match  Match
+ * \return               Error code
+ */
+static pb_error_t
+evaluate(pb_filter_state_t *state, const pb_buffer_t *buffer, int *match) {
+  assert(state && buffer && match);
+  const pb_filter_t *filter = state->filter;
+  if (unlikely_(!pb_buffer_valid(buffer)))
+    return PB_ERROR_INVALID;
+
+  /* Reset state */
+  memset(state->truth, UNKNOWN_, filter->leaf.size);
+  memset(state->last,  FALSE_,   filter->leaf.size);
+  state->done = 0;
+
+  /* Scan buffer and resolve predicates that depend on the last occurrence */
+  pb_error_t error = scan(state, 0, state->active, filter->leaf.size, buffer);
+  if (!error) {
+    for (size_t l = 0; l < filter->leaf.size; ++l)
+      if (state->truth[l] == UNKNOWN_)
+        state->truth[l] = state->last[l];
+    *match = run(state) == TRUE_;
+  }
+  return error;
+}
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create a filter from an expression.
+ *
+ * An expression consists of predicates combined with the operators !, && and
+ * ||, which may be grouped using parentheses. A predicate is a field path, as
+ * accepted by pb_path_create() but without index selectors, followed by one
+ * of the comparison operators ==, !=, <, <=, > or >= and a literal, e.g.
+ * "status == 3 && latency > 100". A path without an operator tests whether
+ * the field is present. Literals are integers, floating-point numbers, true
+ * and false, or strings in double quotes, depending on the field's type.
+ *
+ * Predicates on repeated fields are true if any value satisfies them, which
+ * is what the synonym "contains" for == expresses. Only the last field of a
+ * path may be repeated. Predicates on absent fields are false.
+ *
+ * The expression is compiled against the descriptor into a program once, so
+ * the filter should be cached and reused.
+ *
+ * \warning After creating a filter, it is mandatory to check its validity
+ * with the macro pb_filter_valid().
+ *
+ * \param[in] descriptor   Descriptor
+ * \param[in] expression[] Expression
+ * \return                 Filter
+ */
+extern pb_filter_t
+pb_filter_create(const pb_descriptor_t *descriptor, const char expression[]) {
+  assert(descriptor && expression);
+  pb_filter_t filter = {
+    .descriptor = descriptor,
+    .leaf       = {
+      .data = NULL,
+      .size = 0
+    },
+    .program    = {
+      .data = NULL,
+      .size = 0
+    },
+    .depth      = 0,
+    .error      = PB_ERROR_NONE
+  };
+
+  /* Compile expression and ensure that it was consumed completely */
+  pb_filter_compiler_t compiler = {
+    .filter = &filter,
+    .input  = expression
+  };
+  pb_error_t error = parse_or(&compiler);
+  if (!error && accept(&compiler, "") && *compiler.input)
+    error = PB_ERROR_INVALID;
+  if (unlikely_(error)) {
+    pb_filter_destroy(&filter);
+    filter = pb_filter_create_invalid();
+    filter.error = error;
+  }
+  return filter;
+}
+
+/*!
+ * Destroy a filter.
+ *
+ * \param[in,out] filter Filter
+ */
+extern void
+pb_filter_destroy(pb_filter_t *filter) {
+  assert(filter);
+  for (size_t l = 0; l < filter->leaf.size; ++l) {
+    pb_filter_leaf_t *leaf = &(filter->leaf.data[l]);
+    if (leaf->operator != PB_FILTER_OPERATOR_PRESENT && pb_path_valid(
+          &(leaf->path))) {
+      pb_type_t type = pb_field_descriptor_type(pb_path_segment(&(leaf->path),
+        pb_path_size(&(leaf->path)) - 1)->descriptor);
+      if ((type == PB_TYPE_STRING || type == PB_TYPE_BYTES) &&
+          leaf->value.string.data)
+        pb_allocator_free(&allocator_default, leaf->value.string.data);
+    }
+    pb_path_destroy(&(leaf->path));
+  }
+  if (filter->leaf.data)
+    pb_allocator_free(&allocator_default, filter->leaf.data);
+  if (filter->program.data)
+    pb_allocator_free(&allocator_default, filter->program.data);
+  filter->leaf.data    = NULL;
+  filter->leaf.size    = 0;
+  filter->program.data = NULL;
+  filter->program.size = 0;
+  filter->error        = PB_ERROR_INVALID;
+}
+
+/*!
+ * Test whether a buffer matches a filter.
+ *
+ * The buffer is scanned at most once, directly on the wire format, and the
+ * scan ends as soon as the result is determined.
+ *
+ * \param[in]  filter Filter
+ * \param[in]  buffer Buffer
+ * \param[out] match  Match
+ * \return            Error code
+ */
+extern pb_error_t
+pb_filter_match(
+    const pb_filter_t *filter, const pb_buffer_t *buffer, int *match) {
+  assert(filter && buffer && match);
+  if (unlikely_(!pb_filter_valid(filter)))
+    return PB_ERROR_INVALID;
+
+  /* Allocate state on the stack */
+  pb_filter_state_t state = {
+    .filter = filter,
+    .truth  = alloca(filter->leaf.size),
+    .last   = alloca(filter->leaf.size),
+    .stack  = alloca(filter->depth),
+    .active = alloca(sizeof(size_t) * filter->leaf.size)
+  };
+  for (size_t l = 0; l < filter->leaf.size; ++l)
+    state.active[l] = l;
+  return evaluate(&state, buffer, match);
+}
+
+/*!
+ * Test a batch of buffers against a filter, generating a selection bitmap.
+ *
+ * The bitmap must hold at least one bit per buffer, and bit n is set if the
+ * n-th buffer matches the filter, see pb_filter_selected(). Buffers which
+ * cannot be scanned are not selected, but do not abort the batch, so the
+ * error of the first such buffer is returned after all have been tested.
+ *
+ * \param[in]  filter      Filter
+ * \param[in]  buffers[]   Buffers
+ * \param[in]  size        Buffer count
+ * \param[out] selection[] Selection bitmap
+ * \return                 Error code
+ */
+extern pb_error_t
+pb_filter_select(
+    const pb_filter_t *filter, const pb_buffer_t buffers[], size_t size,
+    uint8_t selection[]) {
+  assert(filter && buffers && selection);
+  if (unlikely_(!pb_filter_valid(filter)))
+    return PB_ERROR_INVALID;
+  memset(selection, 0, (size + 7) >> 3);
+
+  /* Allocate state on the stack once for all buffers */
+  pb_filter_state_t state = {
+    .filter = filter,
+    .truth  = alloca(filter->leaf.size),
+    .last   = alloca(filter->leaf.size),
+    .stack  = alloca(filter->depth),
+    .active = alloca(sizeof(size_t) * filter->leaf.size)
+  };
+  for (size_t l = 0; l < filter->leaf.size; ++l)
+    state.active[l] = l;
+
+  /* Test buffers and set bits for matches */
+  pb_error_t result = PB_ERROR_NONE;
+  for (size_t b = 0; b < size; ++b) {
+    int selected = 0;
+    pb_error_t error = evaluate(&state, &buffers[b], &selected);
+    if (unlikely_(error)) {
+      if (!result)
+        result = error;
+    } else if (selected) {
+      selection[b >> 3] |= 1 << (b & 7);
+    }
+  }
+  return result;
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef PB_UTIL_FILTER_H
+#define PB_UTIL_FILTER_H
+
+#include <stdint.h>
+
+#include <protobluff/util/filter.h>
+
+#include "core/common.h"
+#include "core/descriptor.h"
+#include "util/path.h"
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef enum pb_filter_code_t {
+  PB_FILTER_CODE_LEAF,                 /*!< Push predicate */
+  PB_FILTER_CODE_NOT,                  /*!< Negate top */
+  PB_FILTER_CODE_AND,                  /*!< Conjunction of top two */
+  PB_FILTER_CODE_OR,                   /*!< Disjunction of top two */
+  PB_FILTER_CODE_JUMP_FALSE,           /*!< Jump if top is false */
+  PB_FILTER_CODE_JUMP_TRUE             /*!< Jump if top is true */
+} pb_filter_code_t;
+
+typedef enum pb_filter_operator_t {
+  PB_FILTER_OPERATOR_PRESENT,          /*!< Field is present */
+  PB_FILTER_OPERATOR_EQ,               /*!< Equal */
+  PB_FILTER_OPERATOR_NE,               /*!< Not equal */
+  PB_FILTER_OPERATOR_LT,               /*!< Less than */
+  PB_FILTER_OPERATOR_LE,               /*!< Less than or equal */
+  PB_FILTER_OPERATOR_GT,               /*!< Greater than */
+  PB_FILTER_OPERATOR_GE                /*!< Greater than or equal */
+} pb_filter_operator_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_filter_op_t {
+  pb_filter_code_t code;               /*!< Instruction code */
+  size_t arg;                          /*!< Predicate or jump target */
+} pb_filter_op_t;
+
+typedef struct pb_filter_leaf_t {
+  pb_path_t path;                      /*!< Field path */
+  pb_filter_operator_t operator;       /*!< Comparison operator */
+  union {
+    int64_t integer;                   /*!< Signed integer literal */
+    uint64_t natural;                  /*!< Unsigned integer literal */
+    double real;                       /*!< Floating-point literal */
+    pb_string_t string;                /*!< String literal */
+  } value;                             /*!< Literal */
+} pb_filter_leaf_t;
+
+/* ----------------------------------------------------------------------------
+ * Inline functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create an invalid filter.
+ *
+ * \return Filter
+ */
+PB_INLINE PB_WARN_UNUSED_RESULT
+pb_filter_t
+pb_filter_create_invalid(void) {
+  pb_filter_t filter = {
+    .error = PB_ERROR_INVALID
+  };
+  return filter;
+}
+
+#endif /* PB_UTIL_FILTER_H */
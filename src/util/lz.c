@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/common.h"
+#include "util/lz.h"
+
+/* ----------------------------------------------------------------------------
+ * Constants
+ * ------------------------------------------------------------------------- */
+
+/* Minimum match length */
+#define MATCH 4
+
+/* Maximum match offset */
+#define WINDOW 65535
+
+/* Number of bits used for hashing */
+#define HASH 12
+
+/* ----------------------------------------------------------------------------
+ * Internal functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Read four bytes of unaligned data.
+ *
+ * \param[in] data[] Source buffer
+ * \return           Value
+ */
+static inline uint32_t
+read32(const uint8_t data[]) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+/*!
+ * Hash four bytes of data for match lookup.
+ *
+ * \param[in] value Value
+ * \return          Hash
+ */
+static inline uint32_t
+hash(uint32_t value) {
+  return (value * 2654435761U) >> (32 - HASH);
+}
+
+/*!
+ * Determine the number of bytes needed to extend a length beyond a nibble.
+ *
+ * \param[in] length Length
+ * \return           Bytes
+ */
+static inline size_t
+length_size(size_t length) {
+  return length >= 15 ? (length - 15) / 255 + 1 : 0;
+}
+
+/*!
+ * Write the bytes extending a length beyond a nibble.
+ *
+ * \param[out] target[] Target buffer
+ * \param[in]  length   Length
+ * \return              Target buffer after length
+ */
+static inline uint8_t *
+length_pack(uint8_t target[], size_t length) {
+  if (length >= 15) {
+    for (length -= 15; length >= 255; length -= 255)
+      *target++ = 255;
+    *target++ = length;
+  }
+  return target;
+}
+
+/*!
+ * Read the bytes extending a length beyond a nibble.
+ *
+ * \param[in,out] source Pointer to source buffer
+ * \param[in]     end    End of source buffer
+ * \param[in,out] length Pointer holding length
+ * \return               Error code
+ */
+static inline pb_error_t
+length_unpack(const uint8_t **source, const uint8_t *end, size_t *length) {
+  if (*length == 15) {
+    uint8_t byte;
+    do {
+      if (unlikely_(*source == end))
+        return PB_ERROR_INVALID;
+      *length += (byte = *(*source)++);
+    } while (byte == 255);
+  }
+  return PB_ERROR_NONE;
+}
+
+/*!
+ * Write a sequence of literals, optionally followed by a match.
+ *
+ * Every sequence starts with a token holding the literal length in the upper
+ * and the match length in the lower nibble, both extended by additional bytes
+ * if they don't fit. A match is encoded as a two-byte little-endian offset.
+ * The last sequence consists of literals only.
+ *
+ * \param[out] target[]   Target buffer
+ * \param[in]  end        End of target buffer
+ * \param[in]  literals[] Literals
+ * \param[in]  size       Literal count
+ * \param[in]  offset     Match offset
+ * \param[in]  length     Match length, 0 for the last sequence
+ * \return                Target buffer after sequence, NULL if it's full
+ */
+static uint8_t *
+sequence(
+    uint8_t target[], const uint8_t *end, const uint8_t literals[],
+    size_t size, size_t offset, size_t length) {
+  size_t needed = 1 + length_size(size) + size;
+  if (length)
+    needed += 2 + length_size(length - MATCH);
+  if (unlikely_((size_t)(end - target) < needed))
+    return NULL;
+
+  /* Write token and literals */
+  size_t nibble = length ? length - MATCH : 0;
+  *target++ = (size < 15 ? size : 15) << 4 | (nibble < 15 ? nibble : 15);
+  target = length_pack(target, size);
+  memcpy(target, literals, size);
+  target += size;
+
+  /* Write match */
+  if (length) {
+    *target++ = offset & 0xFF;
+    *target++ = offset >> 8;
+    target = length_pack(target, nibble);
+  }
+  return target;
+}
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Compress data with a fast codec from the LZ77 family.
+ *
+ * Matches are found through a small hash table of recent positions, and the
+ * search skips ahead faster the longer no match was found, so incompressible
+ * data is passed quickly. If the compressed data doesn't fit into the target
+ * buffer, compression is aborted, so a capacity smaller than the source
+ * buffer can be used to give up on incompressible data early.
+ *
+ * \param[in]  source[] Source buffer
+ * \param[in]  size     Source buffer size
+ * \param[out] target[] Target buffer
+ * \param[in]  capacity Target buffer capacity
+ * \return              Compressed size, 0 if it doesn't fit
+ */
+extern size_t
+pb_lz_compress(
+    const uint8_t source[], size_t size, uint8_t target[], size_t capacity) {
+  assert((source || !size) && (target || !capacity));
+  uint32_t table[1 << HASH] = {};
+  const uint8_t *current = source, *anchor = source, *end = source + size;
+  uint8_t *output = target, *limit = target + capacity;
+
+  /* Search matches until there are not enough bytes left */
+  size_t misses = 0;
+  while (size >= MATCH && current <= end - MATCH) {
+    uint32_t value = read32(current), *entry = &(table[hash(value)]);
+    const uint8_t *match = source + *entry;
+    *entry = current - source;
+
+    /* Skip ahead faster if there was no match for some time */
+    if (match >= current || current - match > WINDOW ||
+        read32(match) != value) {
+      current += 1 + (misses++ >> 6);
+      continue;
+    }
+
+    /* Extend match and emit sequence */
+    size_t length = MATCH;
+    while (current + length < end && match[length] == current[length])
+      length++;
+    if (unlikely_(!(output = sequence(output, limit,
+        anchor, current - anchor, current - match, length))))
+      return 0;
+    current += length;
+    anchor   = current;
+    misses   = 0;
+  }
+
+  /* Emit remaining literals */
+  if (unlikely_(!(output = sequence(output, limit,
+      anchor, end - anchor, 0, 0))))
+    return 0;
+  return output - target;
+}
+
+/*!
+ * Decompress data compressed with the fast codec.
+ *
+ * The decompressed data must exactly fill the target buffer, so the size of
+ * the original data must be known, and the data must end with a sequence of
+ * literals, so truncated data is detected. All offsets and lengths are checked, so
+ * corrupted data can never read or write out of bounds.
+ *
+ * \param[in]  source[] Source buffer
+ * \param[in]  size     Source buffer size
+ * \param[out] target[] Target buffer
+ * \param[in]  capacity Target buffer capacity
+ * \return              Error code
+ */
+extern pb_error_t
+pb_lz_decompress(
+    const uint8_t source[], size_t size, uint8_t target[], size_t capacity) {
+  assert((source || !size) && (target || !capacity));
+  const uint8_t *current = source, *end = source + size;
+  uint8_t *output = target, *limit = target + capacity;
+  while (current < end) {
+    uint8_t token = *current++;
+
+    /* Copy literals */
+    size_t length = token >> 4;
+    if (unlikely_(length_unpack(&current, end, &length) ||
+        length > (size_t)(end - current) ||
+        length > (size_t)(limit - output)))
+      return PB_ERROR_INVALID;
+    memcpy(output, current, length);
+    current += length;
+    output  += length;
+
+    /* The last sequence consists of literals only */
+    if (current == end)
+      return output == limit
+        ? PB_ERROR_NONE
+        : PB_ERROR_INVALID;
+
+    /* Read match offset and length */
+    if (unlikely_(end - current < 2))
+      return PB_ERROR_INVALID;
+    size_t offset = current[0] | current[1] << 8;
+    current += 2;
+    length = token & 15;
+    if (unlikely_(length_unpack(&current, end, &length)))
+      return PB_ERROR_INVALID;
+    length += MATCH;
+    if (unlikely_(!offset || offset > (size_t)(output - target) ||
+        length > (size_t)(limit - output)))
+      return PB_ERROR_INVALID;
+
+    /* Copy match, which may overlap with its own output */
+    const uint8_t *match = output - offset;
+    if (offset >= length) {
+      memcpy(output, match, length);
+      output += length;
+    } else {
+      while (length--)
+        *output++ = *match++;
+    }
+  }
+  return PB_ERROR_INVALID;
+}
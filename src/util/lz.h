@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef PB_UTIL_LZ_H
+#define PB_UTIL_LZ_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "core/common.h"
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+PB_WARN_UNUSED_RESULT
+extern size_t
+pb_lz_compress(
+  const uint8_t source[],              /* Source buffer */
+  size_t size,                         /* Source buffer size */
+  uint8_t target[],                    /* Target buffer */
+  size_t capacity);                    /* Target buffer capacity */
+
+PB_WARN_UNUSED_RESULT
+extern pb_error_t
+pb_lz_decompress(
+  const uint8_t source[],              /* Source buffer */
+  size_t size,                         /* Source buffer size */
+  uint8_t target[],                    /* Target buffer */
+  size_t capacity);                    /* Target buffer capacity */
+
+#endif /* PB_UTIL_LZ_H */
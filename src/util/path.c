@@ -0,0 +1,439 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <alloca.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/allocator.h"
+#include "core/buffer.h"
+#include "core/common.h"
+#include "core/decoder.h"
+#include "core/descriptor.h"
+#include "core/stream.h"
+#include "util/descriptor.h"
+#include "util/path.h"
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_path_context_t {
+  const pb_path_t *path;               /*!< Path */
+  pb_decoder_handler_f handler;        /*!< Handler */
+  void *user;                          /*!< User data */
+} pb_path_context_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_path_slot_t {
+  const pb_field_descriptor_t
+    *descriptor;                       /*!< Field descriptor, if set */
+  union {
+    pb_string_t string;                /*!< String value */
+    uint64_t integer;                  /*!< Integer value */
+    double real;                       /*!< Floating-point value */
+  } value;                             /*!< Value */
+} pb_path_slot_t;
+
+/* ----------------------------------------------------------------------------
+ * Internal functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Invoke the handler for a matching value.
+ *
+ * \param[in]     context    Context
+ * \param[in]     descriptor Field descriptor
+ * \param[in]     value      Pointer holding value
+ * \return                   Error code
+ */
+static pb_error_t
+emit(
+    const pb_path_context_t *context,
+    const pb_field_descriptor_t *descriptor, const void *value) {
+  assert(context && descriptor && value);
+  if (pb_field_descriptor_type(descriptor) != PB_TYPE_MESSAGE)
+    return context->handler(descriptor, value, context->user);
+
+  /* Create decoder for nested message and invoke handler */
+  pb_buffer_t buffer = pb_buffer_create_zero_copy_internal(
+    pb_string_data(value), pb_string_size(value));
+  pb_decoder_t decoder = pb_decoder_create(
+    pb_field_descriptor_nested(descriptor), &buffer);
+  pb_error_t error = context->handler(descriptor, &decoder, context->user);
+
+  /* Free all allocated memory */
+  pb_decoder_destroy(&decoder);
+  pb_buffer_destroy(&buffer);
+  return error;
+}
+
+/*!
+ * Deliver a matching value, deferring values of non-repeated fields.
+ *
+ * Only the last occurrence of a non-repeated field is visible, so the value
+ * is kept in the slot of the enclosing message until it is fully evaluated.
+ * Submessages are delivered for every occurrence, as they are merged.
+ *
+ * \param[in]     context    Context
+ * \param[in]     descriptor Field descriptor
+ * \param[in]     value      Pointer holding value
+ * \param[in,out] slot       Slot
+ * \return                   Error code
+ */
+static pb_error_t
+deliver(
+    const pb_path_context_t *context,
+    const pb_field_descriptor_t *descriptor, const void *value,
+    pb_path_slot_t *slot) {
+  assert(context && descriptor && value && slot);
+  if (pb_field_descriptor_label(descriptor) == PB_LABEL_REPEATED ||
+      pb_field_descriptor_type(descriptor)  == PB_TYPE_MESSAGE)
+    return emit(context, descriptor, value);
+
+  /* Defer value of non-repeated field */
+  slot->descriptor = descriptor;
+  memcpy(&(slot->value), value, pb_field_descriptor_type_size(descriptor));
+  return PB_ERROR_NONE;
+}
+
+/*!
+ * Deliver the deferred value of a slot, if any.
+ *
+ * \param[in]     context Context
+ * \param[in,out] slot    Slot
+ * \return                Error code
+ */
+static pb_error_t
+flush(const pb_path_context_t *context, pb_path_slot_t *slot) {
+  assert(context && slot);
+  if (!slot->descriptor)
+    return PB_ERROR_NONE;
+  pb_error_t error = emit(context, slot->descriptor, &(slot->value));
+  slot->descriptor = NULL;
+  return error;
+}
+
+/*!
+ * Evaluate a path from a given level on a buffer.
+ *
+ * All fields not matching the path segment at the given level are skipped
+ * without decoding. Matching submessages are evaluated recursively on the
+ * same underlying data, so the buffer is walked exactly once.
+ *
+ * \param[in]     context Context
+ * \param[in]     level   Level
+ * \param[in]     buffer  Buffer
+ * \param[in,out] slot    Slot
+ * \return                Error code
+ */
+static pb_error_t
+evaluate(
+    const pb_path_context_t *context, size_t level,
+    const pb_buffer_t *buffer, pb_path_slot_t *slot) {
+  assert(context && buffer && slot);
+  const pb_path_segment_t *segment = pb_path_segment(context->path, level);
+  const pb_field_descriptor_t *descriptor = segment->descriptor;
+  const int leaf = level == pb_path_size(context->path) - 1;
+  pb_error_t error = PB_ERROR_NONE;
+
+  /* Allocate temporary space for type-agnostic decoding */
+  pb_type_t type = pb_field_descriptor_type(descriptor);
+  void *value = alloca(pb_field_descriptor_type_size(descriptor));
+
+  /* Iterate tag-value pairs until the selected occurrence is processed */
+  pb_stream_t stream = pb_stream_create(buffer);
+  for (size_t count = 0; !error && pb_stream_left(&stream); ) {
+    if (segment->index != SIZE_MAX && count > segment->index)
+      break;
+
+    /* Read tag from stream */
+    pb_tag_t tag;
+    if (unlikely_(error = pb_stream_read(&stream, PB_TYPE_UINT32, &tag)))
+      break;
+
+    /* Extract wiretype and tag */
+    pb_wiretype_t wiretype = tag & 7;
+    tag >>= 3;
+
+    /* Skip field if it does not match the path segment */
+    if (tag != pb_field_descriptor_tag(descriptor)) {
+      error = pb_stream_skip(&stream, wiretype);
+      continue;
+    }
+
+    /* Non-packed fields may also be encoded in packed encoding */
+    if (wiretype != pb_field_descriptor_wiretype(descriptor) &&
+        wiretype == PB_WIRETYPE_LENGTH) {
+      uint32_t length;
+      if (unlikely_(error = pb_stream_read(&stream, PB_TYPE_UINT32, &length)))
+        break;
+
+      /* Ensure we're within the stream's boundaries */
+      size_t offset = pb_stream_offset(&stream);
+      if (offset + length > pb_buffer_size(buffer))
+        error = PB_ERROR_OFFSET;
+
+      /* Iterate values of packed field */
+      while (!error && pb_stream_offset(&stream) < offset + length) {
+        if (unlikely_(error = pb_stream_read(&stream, type, value)))
+          break;
+        if (segment->index == SIZE_MAX || segment->index == count)
+          error = deliver(context, descriptor, value, slot);
+        count++;
+      }
+
+    /* Read value of given type from stream */
+    } else {
+      if (unlikely_(error = pb_stream_read(&stream, type, value)))
+        break;
+      if (segment->index != SIZE_MAX && segment->index != count++)
+        continue;
+
+      /* Deliver value if at the end of the path */
+      if (leaf) {
+        error = deliver(context, descriptor, value, slot);
+
+      /* Otherwise evaluate submessage on the same underlying data */
+      } else {
+        pb_buffer_t subbuffer = pb_buffer_create_zero_copy_internal(
+          pb_string_data(value), pb_string_size(value));
+
+        /* Every occurrence of a repeated submessage is a distinct scope */
+        if (pb_field_descriptor_label(descriptor) == PB_LABEL_REPEATED) {
+          pb_path_slot_t scope = {};
+          if (!(error = evaluate(context, level + 1, &subbuffer, &scope)))
+            error = flush(context, &scope);
+        } else {
+          error = evaluate(context, level + 1, &subbuffer, slot);
+        }
+        pb_buffer_destroy(&subbuffer);
+      }
+    }
+  }
+  pb_stream_destroy(&stream);
+  return error;
+}
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create a path from a string of field names.
+ *
+ * Field names are separated by dots. Repeated fields may be followed by an
+ * index in brackets to select a specific occurrence, or by a wildcard, which
+ * selects all occurrences and is the default, e.g. "a.b[*].c" or "a.b[2].c".
+ * All fields but the last must be submessages.
+ *
+ * A path is resolved against the descriptor once and can then be evaluated on
+ * an arbitrary number of buffers, so it should be cached and reused.
+ *
+ * \warning After creating a path, it is mandatory to check its validity
+ * with the macro pb_path_valid().
+ *
+ * \param[in] descriptor Descriptor
+ * \param[in] path[]     Path
+ * \return               Path
+ */
+extern pb_path_t
+pb_path_create(const pb_descriptor_t *descriptor, const char path[]) {
+  assert(descriptor && path);
+  pb_path_t result = {
+    .descriptor = descriptor,
+    .segment    = {
+      .data = NULL,
+      .size = 1
+    },
+    .error      = PB_ERROR_NONE
+  };
+
+  /* Copy path to tokenize it in place and count segments */
+  size_t length = strlen(path);
+  char *name = alloca(length + 1);
+  memcpy(name, path, length + 1);
+  for (size_t c = 0; c < length; ++c)
+    if (name[c] == '.')
+      result.segment.size++;
+
+  /* Allocate segments */
+  pb_path_segment_t *data = pb_allocator_allocate(&allocator_default,
+    sizeof(pb_path_segment_t) * result.segment.size);
+  if (unlikely_(!data)) {
+    result = pb_path_create_invalid();
+    result.error = PB_ERROR_ALLOC;
+    return result;
+  }
+
+  /* Resolve segments level by level */
+  for (size_t s = 0; s < result.segment.size; ++s) {
+    size_t size = strcspn(name, ".[");
+    char   next = name[size];
+    name[size] = '\0';
+
+    /* Resolve field and ensure that it is nested in a submessage */
+    const pb_field_descriptor_t *field = descriptor && size
+      ? pb_descriptor_field_by_name(descriptor, name)
+      : NULL;
+    if (!field)
+      break;
+    data[s].descriptor = field;
+    data[s].index      = SIZE_MAX;
+    descriptor         = pb_field_descriptor_nested(field);
+    name              += size + 1;
+
+    /* Parse occurrence index or wildcard of repeated field */
+    if (next == '[') {
+      if (pb_field_descriptor_label(field) != PB_LABEL_REPEATED)
+        break;
+      if (name[0] == '*' && name[1] == ']') {
+        name += 2;
+      } else if (name[0] >= '0' && name[0] <= '9') {
+        char *end;
+        data[s].index = strtoull(name, &end, 10);
+        if (*end != ']')
+          break;
+        name = end + 1;
+      } else {
+        break;
+      }
+      next = *(name++);
+    }
+
+    /* Ensure that the path continues or ends correctly */
+    if (next != (s < result.segment.size - 1 ? '.' : '\0'))
+      break;
+
+    /* Path was resolved successfully */
+    if (s == result.segment.size - 1) {
+      result.segment.data = data;
+      return result;
+    }
+  }
+
+  /* Path could not be resolved */
+  pb_allocator_free(&allocator_default, data);
+  return pb_path_create_invalid();
+}
+
+/*!
+ * Create a path from a branch of tags.
+ *
+ * All occurrences of repeated fields are selected.
+ *
+ * \warning After creating a path, it is mandatory to check its validity
+ * with the macro pb_path_valid().
+ *
+ * \param[in] descriptor Descriptor
+ * \param[in] tags[]     Tags
+ * \param[in] size       Tag count
+ * \return               Path
+ */
+extern pb_path_t
+pb_path_create_from_tags(
+    const pb_descriptor_t *descriptor, const pb_tag_t tags[], size_t size) {
+  assert(descriptor && tags && size);
+  pb_path_t path = {
+    .descriptor = descriptor,
+    .segment    = {
+      .data = pb_allocator_allocate(&allocator_default,
+        sizeof(pb_path_segment_t) * size),
+      .size = size
+    },
+    .error      = PB_ERROR_NONE
+  };
+  if (unlikely_(!path.segment.data)) {
+    path = pb_path_create_invalid();
+    path.error = PB_ERROR_ALLOC;
+    return path;
+  }
+
+  /* Resolve segments level by level */
+  for (size_t s = 0; s < size; ++s) {
+    const pb_field_descriptor_t *field = descriptor
+      ? pb_descriptor_field_by_tag(descriptor, tags[s])
+      : NULL;
+    if (!field) {
+      pb_path_destroy(&path);
+      return pb_path_create_invalid();
+    }
+    path.segment.data[s].descriptor = field;
+    path.segment.data[s].index      = SIZE_MAX;
+    descriptor = pb_field_descriptor_nested(field);
+  }
+  return path;
+}
+
+/*!
+ * Destroy a path.
+ *
+ * \param[in,out] path Path
+ */
+extern void
+pb_path_destroy(pb_path_t *path) {
+  assert(path);
+  if (path->segment.data)
+    pb_allocator_free(&allocator_default, path->segment.data);
+  path->segment.data = NULL;
+  path->segment.size = 0;
+  path->error        = PB_ERROR_INVALID;
+}
+
+/*!
+ * Evaluate a path on a buffer using a handler.
+ *
+ * The handler is invoked for every value matching the path, in the order of
+ * appearance. For non-repeated fields, only the last occurrence within the
+ * enclosing message is reported, as demanded by the Protocol Buffers
+ * specification. Values of submessages are passed to the handler as decoders,
+ * exactly like pb_decoder_decode() does.
+ *
+ * \param[in]     path    Path
+ * \param[in]     buffer  Buffer
+ * \param[in]     handler Handler
+ * \param[in,out] user    User data
+ * \return                Error code
+ */
+extern pb_error_t
+pb_path_evaluate(
+    const pb_path_t *path, const pb_buffer_t *buffer,
+    pb_decoder_handler_f handler, void *user) {
+  assert(path && buffer && handler);
+  if (unlikely_(!pb_path_valid(path) || !pb_buffer_valid(buffer)))
+    return PB_ERROR_INVALID;
+
+  /* Evaluate path on buffer */
+  pb_path_context_t context = {
+    .path    = path,
+    .handler = handler,
+    .user    = user
+  };
+  pb_path_slot_t slot = {};
+  pb_error_t error = evaluate(&context, 0, buffer, &slot);
+  return error
+    ? error
+    : flush(&context, &slot);
+}
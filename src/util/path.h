@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef PB_UTIL_PATH_H
+#define PB_UTIL_PATH_H
+
+#include <stdint.h>
+
+#include <protobluff/util/path.h>
+
+#include "core/common.h"
+#include "core/descriptor.h"
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_path_segment_t {
+  const pb_field_descriptor_t
+    *descriptor;                       /*!< Field descriptor */
+  size_t index;                        /*!< Occurrence index */
+} pb_path_segment_t;
+
+/* ----------------------------------------------------------------------------
+ * Inline functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create an invalid path.
+ *
+ * \return Path
+ */
+PB_INLINE PB_WARN_UNUSED_RESULT
+pb_path_t
+pb_path_create_invalid(void) {
+  pb_path_t path = {
+    .error = PB_ERROR_INVALID
+  };
+  return path;
+}
+
+/*!
+ * Retrieve the segment of a path at a given level.
+ *
+ * \param[in] path  Path
+ * \param[in] level Level
+ * \return          Path segment
+ */
+PB_INLINE const pb_path_segment_t *
+pb_path_segment(const pb_path_t *path, size_t level) {
+  assert(path && level < path->segment.size);
+  return &(path->segment.data[level]);
+}
+
+#endif /* PB_UTIL_PATH_H */
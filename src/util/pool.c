@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "core/allocator.h"
+#include "core/buffer.h"
+#include "core/common.h"
+#include "core/descriptor.h"
+#include "core/encoder.h"
+#include "message/journal.h"
+#include "util/pool.h"
+
+/* ----------------------------------------------------------------------------
+ * Constants
+ * ------------------------------------------------------------------------- */
+
+/* Maximum number of recycled journals and encoders each */
+#define RETAIN 16
+
+/* ----------------------------------------------------------------------------
+ * Variables
+ * ------------------------------------------------------------------------- */
+
+/*! Key for thread-local pools */
+static pthread_key_t
+key;
+
+/*! Whether the key for thread-local pools was created */
+static int
+key_created = 0;
+
+/*! Guard for creation of key for thread-local pools */
+static pthread_once_t
+key_once = PTHREAD_ONCE_INIT;
+
+/* ----------------------------------------------------------------------------
+ * Internal functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Destroy a thread-local pool when its thread exits.
+ *
+ * \param[in,out] data Thread-local pool
+ */
+static void
+local_destroy(void *data) {
+  assert(data);
+  pb_pool_destroy(data);
+  free(data);
+}
+
+/*!
+ * Create the key for thread-local pools.
+ */
+static void
+local_create_key(void) {
+  key_created = !pthread_key_create(&key, local_destroy);
+}
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create a pool.
+ *
+ * \return Pool
+ */
+extern pb_pool_t
+pb_pool_create(void) {
+  return pb_pool_create_with_allocator(&allocator_default);
+}
+
+/*!
+ * Create a pool using a custom allocator.
+ *
+ * A pool hands out journals and encoders and takes them back when they are no
+ * longer needed, resetting them while retaining their capacity. In steady
+ * state, processing messages doesn't require any allocations, as recycled
+ * journals and encoders already have enough capacity for typical messages.
+ *
+ * \warning A pool is not thread-safe, so every thread should use its own pool,
+ * e.g. the one returned by pb_pool_local(). A pool does not take ownership of
+ * the provided allocator, so the caller must ensure that the allocator is not
+ * freed during operations.
+ *
+ * \param[in,out] allocator Allocator
+ * \return                  Pool
+ */
+extern pb_pool_t
+pb_pool_create_with_allocator(pb_allocator_t *allocator) {
+  assert(allocator);
+  pb_journal_t *data = pb_allocator_allocate(allocator,
+    RETAIN * (sizeof(pb_journal_t) + sizeof(pb_encoder_t)));
+  if (data) {
+    pb_pool_t pool = {
+      .allocator = allocator,
+      .journal   = {
+        .data = data,
+        .size = 0
+      },
+      .encoder   = {
+        .data = (pb_encoder_t *)(data + RETAIN),
+        .size = 0
+      }
+    };
+    return pool;
+  }
+  return pb_pool_create_invalid();
+}
+
+/*!
+ * Destroy a pool.
+ *
+ * All recycled journals and encoders are destroyed.
+ *
+ * \param[in,out] pool Pool
+ */
+extern void
+pb_pool_destroy(pb_pool_t *pool) {
+  assert(pool);
+  if (pb_pool_valid(pool)) {
+    while (pool->journal.size)
+      pb_journal_destroy(&(pool->journal.data[--pool->journal.size]));
+    while (pool->encoder.size)
+      pb_encoder_destroy(&(pool->encoder.data[--pool->encoder.size]));
+
+    /* Free storage for recycled journals and encoders */
+    pb_allocator_free(pool->allocator, pool->journal.data);
+    pool->journal.data = NULL;
+    pool->encoder.data = NULL;
+  }
+}
+
+/*!
+ * Retrieve the pool of the calling thread.
+ *
+ * The pool is created on first use with the system-default allocator and
+ * destroyed automatically when the thread exits.
+ *
+ * \warning The lines excluded from code coverage cannot be triggered within
+ * the tests, as we're not going to mock malloc.
+ *
+ * \return Pool
+ */
+extern pb_pool_t *
+pb_pool_local(void) {
+  if (unlikely_(pthread_once(&key_once, local_create_key) || !key_created))
+    return NULL;                                           /* LCOV_EXCL_LINE */
+
+  /* Create pool for calling thread, if not done before */
+  pb_pool_t *pool = pthread_getspecific(key);
+  if (unlikely_(!pool)) {
+    if (unlikely_(!(pool = malloc(sizeof(pb_pool_t)))))
+      return NULL;                                         /* LCOV_EXCL_LINE */
+    *pool = pb_pool_create();
+    if (unlikely_(!pb_pool_valid(pool) || pthread_setspecific(key, pool))) {
+      pb_pool_destroy(pool);                               /* LCOV_EXCL_LINE */
+      free(pool);                                          /* LCOV_EXCL_LINE */
+      return NULL;                                         /* LCOV_EXCL_LINE */
+    }
+  }
+  return pool;
+}
+
+/*!
+ * Acquire an empty journal from a pool.
+ *
+ * \param[in,out] pool Pool
+ * \return             Journal
+ */
+extern pb_journal_t
+pb_pool_acquire_journal(pb_pool_t *pool) {
+  assert(pool);
+  if (unlikely_(!pb_pool_valid(pool)))
+    return pb_journal_create_invalid();
+
+  /* Hand out recycled journal or create a new one */
+  return pool->journal.size
+    ? pool->journal.data[--pool->journal.size]
+    : pb_journal_create_empty_with_allocator(pool->allocator);
+}
+
+/*!
+ * Release a journal to a pool.
+ *
+ * The journal is reset and recycled, unless the pool is full or the journal
+ * doesn't exclusively use the allocator of the pool, e.g. because it is a
+ * zero-copy journal or backed by inline storage, in which case it is
+ * destroyed. Either way, the journal must not be used anymore after it was
+ * released.
+ *
+ * \param[in,out] pool    Pool
+ * \param[in,out] journal Journal
+ */
+extern void
+pb_pool_release_journal(pb_pool_t *pool, pb_journal_t *journal) {
+  assert(pool && journal);
+  if (pb_pool_valid(pool) && pb_journal_valid(journal) &&
+      pool->journal.size < RETAIN && !journal->allocator &&
+      !pb_journal_buffer(journal)->storage &&
+      pb_buffer_allocator(pb_journal_buffer(journal)) == pool->allocator) {
+    pb_journal_reset(journal);
+    pool->journal.data[pool->journal.size++] = *journal;
+  } else {
+    pb_journal_destroy(journal);
+  }
+  *journal = pb_journal_create_invalid();
+}
+
+/*!
+ * Acquire an empty encoder for a descriptor from a pool.
+ *
+ * \param[in,out] pool       Pool
+ * \param[in]     descriptor Descriptor
+ * \return                   Encoder
+ */
+extern pb_encoder_t
+pb_pool_acquire_encoder(pb_pool_t *pool, const pb_descriptor_t *descriptor) {
+  assert(pool && descriptor);
+  if (unlikely_(!pb_pool_valid(pool)))
+    return pb_encoder_create_invalid();
+
+  /* Hand out recycled encoder or create a new one */
+  if (pool->encoder.size) {
+    pb_encoder_t encoder = pool->encoder.data[--pool->encoder.size];
+    encoder.descriptor = descriptor;
+    return encoder;
+  }
+  return pb_encoder_create_with_allocator(pool->allocator, descriptor);
+}
+
+/*!
+ * Release an encoder to a pool.
+ *
+ * The encoder is reset and recycled, unless the pool is full or the encoder
+ * doesn't exclusively use the allocator of the pool, e.g. because it is backed
+ * by inline storage, in which case it is destroyed. Either way, the encoder
+ * must not be used anymore after it was released.
+ *
+ * \param[in,out] pool    Pool
+ * \param[in,out] encoder Encoder
+ */
+extern void
+pb_pool_release_encoder(pb_pool_t *pool, pb_encoder_t *encoder) {
+  assert(pool && encoder);
+  if (pb_pool_valid(pool) && pb_encoder_valid(encoder) &&
+      pool->encoder.size < RETAIN && !pb_encoder_buffer(encoder)->storage &&
+      pb_buffer_allocator(pb_encoder_buffer(encoder)) == pool->allocator) {
+    pb_encoder_reset(encoder);
+    pool->encoder.data[pool->encoder.size++] = *encoder;
+  } else {
+    pb_encoder_destroy(encoder);
+  }
+  *encoder = pb_encoder_create_invalid();
+}
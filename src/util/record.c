@@ -0,0 +1,343 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Enable readahead advice, if available */
+#ifndef _GNU_SOURCE
+  #define _GNU_SOURCE
+#endif
+
+/* Detect available system calls */
+#ifdef HAVE_CONFIG_H
+  #include "config.h"
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "core/buffer.h"
+#include "core/common.h"
+#include "core/varint.h"
+#include "util/record.h"
+
+/* ----------------------------------------------------------------------------
+ * Constants
+ * ------------------------------------------------------------------------- */
+
+/* Bytes to advise for readahead at once */
+#define READAHEAD (1 << 20)
+
+/* Records to write with a single system call */
+#define BATCH 64
+
+/* ----------------------------------------------------------------------------
+ * Internal functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Advise the system to read ahead of the current offset of a record reader.
+ *
+ * The file is advised in windows, and the next window is requested as soon as
+ * the reader enters the second half of the current one, so pages should be
+ * available by the time they're decoded.
+ *
+ * \param[in,out] reader Record reader
+ */
+static void
+advise(pb_record_reader_t *reader) {
+  assert(reader);
+  size_t size = pb_buffer_size(&(reader->buffer));
+  if (reader->advised >= size ||
+      reader->offset + READAHEAD / 2 < reader->advised)
+    return;
+
+  /* Advise next window, the mapping and all windows are page-aligned */
+  size_t length = size - reader->advised;
+  if (length > READAHEAD)
+    length = READAHEAD;
+#if defined(HAVE_MADVISE) && defined(MADV_WILLNEED)
+  madvise(pb_buffer_data_from(&(reader->buffer), reader->advised),
+    length, MADV_WILLNEED);
+#endif /* HAVE_MADVISE && MADV_WILLNEED */
+  reader->advised += length;
+}
+
+/*!
+ * Flush the data written to a file to disk.
+ *
+ * \param[in] fd File descriptor
+ * \return       Error code
+ */
+static pb_error_t
+sync_file(int fd) {
+#ifdef HAVE_FDATASYNC
+  int result = fdatasync(fd);
+#else
+  int result = fsync(fd);
+#endif /* HAVE_FDATASYNC */
+  return likely_(!result)
+    ? PB_ERROR_NONE
+    : PB_ERROR_IO;                                         /* LCOV_EXCL_LINE */
+}
+
+/*!
+ * Write vectors to a file, resuming after partial writes and interrupts.
+ *
+ * \warning The lines excluded from code coverage cannot be triggered within
+ * the tests, as we're not going to mock the operating system.
+ *
+ * \param[in]     fd    File descriptor
+ * \param[in,out] iov[] Vectors
+ * \param[in]     size  Vector count
+ * \return              Error code
+ */
+static pb_error_t
+write_vectors(int fd, struct iovec iov[], size_t size) {
+  assert(iov && size);
+  while (size) {
+    ssize_t written = writev(fd, iov, size);
+    if (unlikely_(written < 0)) {
+      if (errno == EINTR)                                  /* LCOV_EXCL_LINE */
+        continue;                                          /* LCOV_EXCL_LINE */
+      return PB_ERROR_IO;
+    }
+
+    /* Skip written vectors and adjust partially written vector */
+    while (size && (size_t)written >= iov->iov_len) {
+      written -= iov->iov_len;
+      iov++; size--;
+    }
+    if (size) {
+      iov->iov_base  = (uint8_t *)iov->iov_base + written;
+      iov->iov_len  -= written;
+    }
+  }
+  return PB_ERROR_NONE;
+}
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create a record reader for a file.
+ *
+ * A record file is a sequence of records, each of which is prefixed with its
+ * length encoded as a variable-sized integer. The file is memory-mapped, so
+ * records can be read without copying.
+ *
+ * \param[in] path[] Path
+ * \return           Record reader
+ */
+extern pb_record_reader_t
+pb_record_reader_create(const char path[]) {
+  assert(path);
+  pb_record_reader_t reader = {
+    .buffer  = pb_buffer_create_mmap(path, PB_BUFFER_READ),
+    .offset  = 0,
+    .advised = 0
+  };
+  return reader;
+}
+
+/*!
+ * Destroy a record reader.
+ *
+ * \param[in,out] reader Record reader
+ */
+extern void
+pb_record_reader_destroy(pb_record_reader_t *reader) {
+  assert(reader);
+  if (pb_record_reader_valid(reader))
+    pb_buffer_destroy(&(reader->buffer));
+}
+
+/*!
+ * Read the next record of a file.
+ *
+ * The record is returned as a zero-copy buffer which points into the mapping
+ * and remains valid until the record reader is destroyed. If there are no
+ * more records, PB_ERROR_EOM is returned.
+ *
+ * \param[in,out] reader Record reader
+ * \param[out]    record Buffer receiving record
+ * \return               Error code
+ */
+extern pb_error_t
+pb_record_reader_next(pb_record_reader_t *reader, pb_buffer_t *record) {
+  assert(reader && record);
+  if (unlikely_(!pb_record_reader_valid(reader)))
+    return PB_ERROR_INVALID;
+  size_t left = pb_buffer_size(&(reader->buffer)) - reader->offset;
+  if (!left)
+    return PB_ERROR_EOM;
+
+  /* Read length prefix and ensure the record is complete */
+  uint8_t *data = pb_buffer_data_from(&(reader->buffer), reader->offset);
+  uint32_t length;
+  size_t size = pb_varint_unpack_uint32(data, left, &length);
+  if (unlikely_(!size))
+    return PB_ERROR_VARINT;
+  if (unlikely_(left - size < length))
+    return PB_ERROR_OFFSET;
+  advise(reader);
+
+  /* Return record and advance to next */
+  *record = pb_buffer_create_zero_copy_internal(&(data[size]), length);
+  reader->offset += size + length;
+  return PB_ERROR_NONE;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/*!
+ * Create a record writer for a file.
+ *
+ * Records are appended to the file, which is created if it doesn't exist. The
+ * sync policy determines when written records are flushed to disk.
+ *
+ * \param[in] path[] Path
+ * \param[in] sync   Sync policy
+ * \return           Record writer
+ */
+extern pb_record_writer_t
+pb_record_writer_create(const char path[], pb_record_sync_t sync) {
+  assert(path);
+  int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0666);
+  if (unlikely_(fd < 0))
+    return pb_record_writer_create_invalid();
+  pb_record_writer_t writer = {
+    .fd   = fd,
+    .sync = sync
+  };
+  return writer;
+}
+
+/*!
+ * Destroy a record writer.
+ *
+ * \param[in,out] writer Record writer
+ */
+extern void
+pb_record_writer_destroy(pb_record_writer_t *writer) {
+  assert(writer);
+  if (pb_record_writer_valid(writer)) {
+    if (writer->sync == PB_RECORD_SYNC_CLOSE)
+      sync_file(writer->fd);
+    close(writer->fd);
+    writer->fd = -1;
+  }
+}
+
+/*!
+ * Append a batch of records to a file.
+ *
+ * All records are written with as few system calls as possible, as length
+ * prefixes and records are gathered into vectors without copying. Appending
+ * many small records at once is therefore much faster than appending them
+ * one by one.
+ *
+ * \param[in,out] writer    Record writer
+ * \param[in]     records[] Records
+ * \param[in]     size      Record count
+ * \return                  Error code
+ */
+extern pb_error_t
+pb_record_writer_write(
+    pb_record_writer_t *writer, const pb_buffer_t records[], size_t size) {
+  assert(writer && (records || !size));
+  if (unlikely_(!pb_record_writer_valid(writer)))
+    return PB_ERROR_INVALID;
+  for (size_t r = 0; r < size; r++)
+    if (unlikely_(!pb_buffer_valid(&(records[r])) ||
+        pb_buffer_size(&(records[r])) > UINT32_MAX))
+      return PB_ERROR_INVALID;
+  pb_error_t error = PB_ERROR_NONE;
+
+  /* Gather length prefixes and records of each batch into vectors */
+  for (size_t r = 0; !error && r < size; r += BATCH) {
+    struct iovec iov[2 * BATCH];
+    uint8_t prefix[BATCH][5];
+    size_t vectors = 0;
+    for (size_t b = 0; b < BATCH && r + b < size; b++) {
+      const pb_buffer_t *record = &(records[r + b]);
+      uint32_t length = pb_buffer_size(record);
+      iov[vectors].iov_base   = prefix[b];
+      iov[vectors++].iov_len  = pb_varint_pack_uint32(prefix[b], &length);
+      if (length) {
+        iov[vectors].iov_base  = (void *)pb_buffer_data(record);
+        iov[vectors++].iov_len = length;
+      }
+    }
+    error = write_vectors(writer->fd, iov, vectors);
+  }
+
+  /* Sync file according to policy */
+  if (!error && writer->sync == PB_RECORD_SYNC_WRITE)
+    error = pb_record_writer_sync(writer);
+  return error;
+}
+
+/*!
+ * Append raw data without a length prefix to a file.
+ *
+ * This is only used internally by formats which add their own framing on top
+ * of records, e.g. a trailing index.
+ *
+ * \param[in,out] writer Record writer
+ * \param[in]     data[] Raw data
+ * \param[in]     size   Raw data size
+ * \return               Error code
+ */
+extern pb_error_t
+pb_record_writer_write_raw(
+    pb_record_writer_t *writer, const uint8_t data[], size_t size) {
+  assert(writer && (data || !size));
+  if (unlikely_(!pb_record_writer_valid(writer)))
+    return PB_ERROR_INVALID;
+  if (!size)
+    return PB_ERROR_NONE;
+  struct iovec iov = {
+    .iov_base = (void *)data,
+    .iov_len  = size
+  };
+  return write_vectors(writer->fd, &iov, 1);
+}
+
+/*!
+ * Flush all records written to a file to disk.
+ *
+ * \param[in,out] writer Record writer
+ * \return               Error code
+ */
+extern pb_error_t
+pb_record_writer_sync(pb_record_writer_t *writer) {
+  assert(writer);
+  if (unlikely_(!pb_record_writer_valid(writer)))
+    return PB_ERROR_INVALID;
+  return sync_file(writer->fd);
+}
@@ -0,0 +1,349 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Enable POSIX shared memory */
+#ifndef _GNU_SOURCE
+  #define _GNU_SOURCE
+#endif
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "core/buffer.h"
+#include "core/common.h"
+#include "util/ring.h"
+
+/* ----------------------------------------------------------------------------
+ * Constants
+ * ------------------------------------------------------------------------- */
+
+/* Size of a cache line */
+#define CACHELINE 64
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_ring_header_t {
+  size_t slots;                        /*!< Slot count */
+  size_t size;                         /*!< Slot size */
+  uint8_t pad1[CACHELINE - 2 * sizeof(size_t)];
+  size_t head;                         /*!< Messages pushed */
+  uint8_t pad2[CACHELINE - sizeof(size_t)];
+  size_t tail;                         /*!< Messages popped */
+  uint8_t pad3[CACHELINE - sizeof(size_t)];
+} pb_ring_header_t;
+
+/* ----------------------------------------------------------------------------
+ * Macros
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Round a size up to the next multiple of the cache line size.
+ *
+ * \param[in] size Size
+ * \return         Aligned size
+ */
+#define align(size) \
+  (((size) + CACHELINE - 1) & ~((size_t)CACHELINE - 1))
+
+/*!
+ * Compute the distance between two slots.
+ *
+ * Every slot starts with the length of the message it holds, followed by the
+ * message itself, and is aligned to a cache line.
+ *
+ * \param[in] size Slot size
+ * \return         Slot stride
+ */
+#define stride(size) \
+  align(sizeof(size_t) + (size))
+
+/* ----------------------------------------------------------------------------
+ * Internal functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve the slot for a given message sequence number.
+ *
+ * \param[in] header   Ring header
+ * \param[in] sequence Message sequence number
+ * \return             Slot
+ */
+static uint8_t *
+slot(pb_ring_header_t *header, size_t sequence) {
+  assert(header);
+  return (uint8_t *)header + sizeof(pb_ring_header_t) +
+    (sequence % header->slots) * stride(header->size);
+}
+
+/*!
+ * Compute the size of a ring with the given slot count and slot size.
+ *
+ * \param[in] slots Slot count
+ * \param[in] size  Slot size
+ * \return          Ring size, or 0 if it overflows
+ */
+static size_t
+total(size_t slots, size_t size) {
+  if (unlikely_(!slots || size > SIZE_MAX - sizeof(size_t) - CACHELINE))
+    return 0;
+  if (unlikely_(slots > (SIZE_MAX - sizeof(pb_ring_header_t)) /
+      stride(size)))
+    return 0;
+  return sizeof(pb_ring_header_t) + slots * stride(size);
+}
+
+/*!
+ * Map a shared memory object of given size.
+ *
+ * The file descriptor is closed in any case, as the mapping stays valid.
+ *
+ * \param[in] fd   File descriptor
+ * \param[in] size Shared memory object size
+ * \return         Ring
+ */
+static pb_ring_t
+map(int fd, size_t size) {
+  assert(fd >= 0 && size);
+  void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (unlikely_(data == MAP_FAILED))
+    return pb_ring_create_invalid();                       /* LCOV_EXCL_LINE */
+
+  /* Return ring */
+  pb_ring_t ring = {
+    .data = data,
+    .size = size
+  };
+  return ring;
+}
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create a ring in a shared memory object.
+ *
+ * A ring is a fixed number of slots of fixed size in shared memory, through
+ * which a single producer process passes messages to a single consumer process
+ * without any system calls. The producer copies each message into a slot once,
+ * and the consumer decodes it right from the slot, so compared to a pipe, one
+ * copy and all context switches are saved.
+ *
+ * The producer creates the ring and the consumer opens it. An existing ring of
+ * the same name is never replaced, as processes which still map it would fault
+ * when it is resized, so it must be removed with shm_unlink() beforehand. Sequence numbers are published with release and
+ * consumed with acquire semantics, so the ring is lock-free.
+ *
+ * \warning A ring is only safe for a single producer and a single consumer.
+ * The shared memory object persists until it is removed with shm_unlink().
+ *
+ * \param[in] name[] Shared memory object name, e.g. "/messages"
+ * \param[in] slots  Slot count
+ * \param[in] size   Slot size
+ * \return           Ring
+ */
+extern pb_ring_t
+pb_ring_create(const char name[], size_t slots, size_t size) {
+  assert(name && slots && size);
+  size_t length = total(slots, size);
+  if (unlikely_(!length || length > (size_t)PTRDIFF_MAX))
+    return pb_ring_create_invalid();
+
+  /* Create shared memory object, failing if it already exists */
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (unlikely_(fd < 0))
+    return pb_ring_create_invalid();
+
+  /* Size shared memory object */
+  if (unlikely_(ftruncate(fd, (off_t)length))) {
+    close(fd);                                             /* LCOV_EXCL_LINE */
+    shm_unlink(name);                                      /* LCOV_EXCL_LINE */
+    return pb_ring_create_invalid();                       /* LCOV_EXCL_LINE */
+  }
+
+  /* Map shared memory object and initialize header */
+  pb_ring_t ring = map(fd, length);
+  if (unlikely_(!pb_ring_valid(&ring))) {
+    shm_unlink(name);                                      /* LCOV_EXCL_LINE */
+  } else {
+    pb_ring_header_t *header = ring.data;
+    header->size = size;
+    header->head = 0;
+    header->tail = 0;
+    __atomic_store_n(&(header->slots), slots, __ATOMIC_RELEASE);
+  }
+  return ring;
+}
+
+/*!
+ * Open a ring in a shared memory object created by another process.
+ *
+ * \warning If the ring is opened before it was fully created, it is invalid,
+ * so opening should be retried.
+ *
+ * \param[in] name[] Shared memory object name
+ * \return           Ring
+ */
+extern pb_ring_t
+pb_ring_open(const char name[]) {
+  assert(name);
+  struct stat info;
+  int fd = shm_open(name, O_RDWR, 0);
+  if (unlikely_(fd < 0))
+    return pb_ring_create_invalid();
+
+  /* Ensure that the shared memory object was sized */
+  if (unlikely_(fstat(fd, &info) ||
+      (size_t)info.st_size < sizeof(pb_ring_header_t))) {
+    close(fd);
+    return pb_ring_create_invalid();
+  }
+
+  /* Map shared memory object and validate header */
+  pb_ring_t ring = map(fd, (size_t)info.st_size);
+  if (pb_ring_valid(&ring)) {
+    pb_ring_header_t *header = ring.data;
+    size_t slots = __atomic_load_n(&(header->slots), __ATOMIC_ACQUIRE);
+    if (unlikely_(ring.size != total(slots, header->size)))
+      pb_ring_destroy(&ring);
+  }
+  return ring;
+}
+
+/*!
+ * Destroy a ring.
+ *
+ * The shared memory object is unmapped, but not removed.
+ *
+ * \param[in,out] ring Ring
+ */
+extern void
+pb_ring_destroy(pb_ring_t *ring) {
+  assert(ring);
+  if (pb_ring_valid(ring)) {
+    munmap(ring->data, ring->size);
+    ring->data = NULL;
+    ring->size = 0;
+  }
+}
+
+/*!
+ * Push a message to a ring.
+ *
+ * This function may only be called by the producer. If all slots are taken,
+ * PB_ERROR_ALLOC is returned, so pushing can be retried once the consumer has
+ * popped a message. Messages larger than the slot size are rejected.
+ *
+ * \param[in,out] ring   Ring
+ * \param[in]     buffer Buffer
+ * \return               Error code
+ */
+extern pb_error_t
+pb_ring_push(pb_ring_t *ring, const pb_buffer_t *buffer) {
+  assert(ring && buffer);
+  if (unlikely_(!pb_ring_valid(ring) || !pb_buffer_valid(buffer)))
+    return PB_ERROR_INVALID;
+
+  /* Check message size and free slots */
+  pb_ring_header_t *header = ring->data;
+  if (unlikely_(pb_buffer_size(buffer) > header->size))
+    return PB_ERROR_INVALID;
+  size_t head = __atomic_load_n(&(header->head), __ATOMIC_RELAXED),
+         tail = __atomic_load_n(&(header->tail), __ATOMIC_ACQUIRE);
+  if (unlikely_(head - tail == header->slots))
+    return PB_ERROR_ALLOC;
+
+  /* Copy message into slot and publish it */
+  uint8_t *data = slot(header, head);
+  *(size_t *)data = pb_buffer_size(buffer);
+  if (!pb_buffer_empty(buffer))
+    memcpy(data + sizeof(size_t), pb_buffer_data(buffer),
+      pb_buffer_size(buffer));
+  __atomic_store_n(&(header->head), head + 1, __ATOMIC_RELEASE);
+  return PB_ERROR_NONE;
+}
+
+/*!
+ * Retrieve the oldest message of a ring without copying it.
+ *
+ * This function may only be called by the consumer. The returned zero-copy
+ * buffer points into the slot of the message, so it may only be used until
+ * the message is popped. If the ring is empty, PB_ERROR_ABSENT is returned.
+ * If the length stored in the slot exceeds the slot size, PB_ERROR_INVALID is
+ * returned, so a corrupted ring is never read out of bounds.
+ *
+ * \param[in,out] ring   Ring
+ * \param[out]    buffer Buffer
+ * \return               Error code
+ */
+extern pb_error_t
+pb_ring_peek(pb_ring_t *ring, pb_buffer_t *buffer) {
+  assert(ring && buffer);
+  if (unlikely_(!pb_ring_valid(ring)))
+    return PB_ERROR_INVALID;
+
+  /* Check for published messages */
+  pb_ring_header_t *header = ring->data;
+  size_t tail = __atomic_load_n(&(header->tail), __ATOMIC_RELAXED),
+         head = __atomic_load_n(&(header->head), __ATOMIC_ACQUIRE);
+  if (tail == head)
+    return PB_ERROR_ABSENT;
+
+  /* Read length once, as the slot may be altered by the other process */
+  uint8_t *data = slot(header, tail);
+  size_t size = __atomic_load_n((size_t *)data, __ATOMIC_RELAXED);
+  if (unlikely_(size > header->size))
+    return PB_ERROR_INVALID;
+
+  /* Return zero-copy buffer for message */
+  *buffer = pb_buffer_create_zero_copy_internal(data + sizeof(size_t), size);
+  return PB_ERROR_NONE;
+}
+
+/*!
+ * Remove the oldest message from a ring.
+ *
+ * This function may only be called by the consumer, after the message was
+ * processed, as its slot is handed back to the producer.
+ *
+ * \param[in,out] ring Ring
+ */
+extern void
+pb_ring_pop(pb_ring_t *ring) {
+  assert(ring);
+  if (pb_ring_valid(ring)) {
+    pb_ring_header_t *header = ring->data;
+    size_t tail = __atomic_load_n(&(header->tail), __ATOMIC_RELAXED),
+           head = __atomic_load_n(&(header->head), __ATOMIC_ACQUIRE);
+    if (tail != head)
+      __atomic_store_n(&(header->tail), tail + 1, __ATOMIC_RELEASE);
+  }
+}
@@ -0,0 +1,442 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/allocator.h"
+#include "core/common.h"
+#include "util/stats_allocator.h"
+
+/* ----------------------------------------------------------------------------
+ * Constants
+ * ------------------------------------------------------------------------- */
+
+/* Number of call sites that can be sampled */
+#define SITES 64
+
+/* Size of the header storing the size of a memory block */
+#define HEADER 16
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_stats_allocator_t {
+  pb_allocator_t *allocator;           /*!< Wrapped allocator */
+  size_t period;                       /*!< Sampling period */
+  size_t calls;                        /*!< Calls eligible for sampling */
+  pb_allocator_stats_t stats;          /*!< Statistics */
+  pb_allocator_site_t sites[SITES];    /*!< Sampled call sites */
+} pb_stats_allocator_t;
+
+/* ----------------------------------------------------------------------------
+ * Macros
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve the size stored in the header of a memory block.
+ *
+ * \param[in] memory Memory block
+ * \return           Size
+ */
+#define size_from_memory(memory) \
+  (*(size_t *)((uint8_t *)(memory) - HEADER))
+
+/*!
+ * Retrieve the address the current function will return to.
+ *
+ * As the allocator interface is inlined, this is usually the address of the
+ * function which requested the memory block.
+ *
+ * \return Call site address
+ */
+#ifdef __GNUC__
+  #define call_site() __builtin_return_address(0)
+#else
+  #define call_site() NULL
+#endif
+
+/*!
+ * Atomically add a value to a counter.
+ *
+ * \param[in,out] counter Counter
+ * \param[in]     value   Value
+ * \return                Updated counter
+ */
+#define counter_add(counter, value) \
+  __atomic_add_fetch(&(counter), (value), __ATOMIC_RELAXED)
+
+/*!
+ * Atomically subtract a value from a counter.
+ *
+ * \param[in,out] counter Counter
+ * \param[in]     value   Value
+ * \return                Updated counter
+ */
+#define counter_sub(counter, value) \
+  __atomic_sub_fetch(&(counter), (value), __ATOMIC_RELAXED)
+
+/*!
+ * Atomically read a counter.
+ *
+ * \param[in] counter Counter
+ * \return            Counter value
+ */
+#define counter_load(counter) \
+  __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+
+/* ----------------------------------------------------------------------------
+ * Internal functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Account for memory blocks that became live and update the peak.
+ *
+ * \param[in,out] stats Statistics
+ * \param[in]     size  Bytes
+ */
+static void
+grow(pb_allocator_stats_t *stats, size_t size) {
+  assert(stats);
+  size_t current = counter_add(stats->current, size),
+         peak    = counter_load(stats->peak);
+  while (peak < current && !__atomic_compare_exchange_n(&(stats->peak),
+    &peak, current, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/*!
+ * Sample a call site, if the sampling period has elapsed.
+ *
+ * Call sites are kept in an open-addressing table, so recording a sample is
+ * lock-free. If the table is full, samples from new call sites are dropped.
+ *
+ * \param[in,out] stats   Stats allocator
+ * \param[in]     address Call site address
+ * \param[in]     size    Bytes requested
+ */
+static void
+sample(pb_stats_allocator_t *stats, const void *address, size_t size) {
+  assert(stats);
+  if (likely_(!stats->period ||
+      counter_add(stats->calls, 1) % stats->period))
+    return;
+
+  /* Find or claim slot for call site */
+  size_t slot = ((uintptr_t)address >> 4) % SITES;
+  for (size_t s = 0; s < SITES; s++, slot = (slot + 1) % SITES) {
+    pb_allocator_site_t *site = &(stats->sites[slot]);
+    const void *current = __atomic_load_n(&(site->address), __ATOMIC_RELAXED);
+    if (current == address || (!current &&
+        (__atomic_compare_exchange_n(&(site->address), &current, address,
+          0, __ATOMIC_RELAXED, __ATOMIC_RELAXED) || current == address))) {
+      counter_add(site->count, 1);
+      counter_add(site->bytes, size);
+      return;
+    }
+  }
+}
+
+/* ----------------------------------------------------------------------------
+ * Allocator callbacks
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Allocate a memory block of given size.
+ *
+ * The memory block is allocated from the wrapped allocator and prefixed with
+ * its size, so the number of live bytes can be tracked when it is freed.
+ *
+ * \param[in,out] data Internal allocator data
+ * \param[in]     size Bytes to be allocated
+ * \return             Memory block
+ */
+static void *
+allocator_allocate(void *data, size_t size) {
+  assert(size);
+  if (unlikely_(!data))
+    return NULL;
+
+  /* Count call and sample call site */
+  pb_stats_allocator_t *stats = data;
+  counter_add(stats->stats.allocations, 1);
+  counter_add(stats->stats.requested, size);
+  sample(stats, call_site(), size);
+
+  /* Allocate memory block and store size in header */
+  uint8_t *memory = pb_allocator_allocate(stats->allocator, HEADER + size);
+  if (unlikely_(!memory))
+    return NULL;
+  memory += HEADER;
+  size_from_memory(memory) = size;
+  grow(&(stats->stats), size);
+  return memory;
+}
+
+/*!
+ * Change the size of a previously allocated memory block.
+ *
+ * If the wrapped allocator moved the memory block, the bytes that were kept
+ * are accounted for as moved, as they must have been copied.
+ *
+ * \param[in,out] data  Internal allocator data
+ * \param[in,out] block Memory block to be resized
+ * \param[in]     size  Bytes to be allocated
+ * \return              Memory block
+ */
+static void *
+allocator_resize(void *data, void *block, size_t size) {
+  assert(size);
+  if (unlikely_(!data))
+    return NULL;
+
+  /* Count call and sample call site */
+  pb_stats_allocator_t *stats = data;
+  counter_add(stats->stats.resizes, 1);
+  counter_add(stats->stats.requested, size);
+  sample(stats, call_site(), size);
+
+  /* Allocate or resize memory block */
+  size_t previous = block ? size_from_memory(block) : 0;
+  uint8_t *memory = block
+    ? pb_allocator_resize(stats->allocator,
+        (uint8_t *)block - HEADER, HEADER + size)
+    : pb_allocator_allocate(stats->allocator, HEADER + size);
+  if (unlikely_(!memory))
+    return NULL;
+
+  /* Update size in header and account for moved and live bytes */
+  memory += HEADER;
+  size_from_memory(memory) = size;
+  if (block && memory != block)
+    counter_add(stats->stats.moved, previous < size ? previous : size);
+  if (size > previous) {
+    grow(&(stats->stats), size - previous);
+  } else {
+    counter_sub(stats->stats.current, previous - size);
+  }
+  return memory;
+}
+
+/*!
+ * Free an allocated memory block.
+ *
+ * \param[in,out] data  Internal allocator data
+ * \param[in,out] block Memory block to be freed
+ */
+static void
+allocator_free(void *data, void *block) {
+  assert(block);
+  if (unlikely_(!data))
+    return;
+
+  /* Count call and free memory block */
+  pb_stats_allocator_t *stats = data;
+  counter_add(stats->stats.frees, 1);
+  counter_sub(stats->stats.current, size_from_memory(block));
+  pb_allocator_free(stats->allocator, (uint8_t *)block - HEADER);
+}
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create a stats allocator wrapping the system-default allocator.
+ *
+ * \return Stats allocator
+ */
+extern pb_allocator_t
+pb_stats_allocator_create(void) {
+  return pb_stats_allocator_create_with_sampling(&allocator_default, 0);
+}
+
+/*!
+ * Create a stats allocator wrapping an allocator.
+ *
+ * \param[in,out] allocator Allocator
+ * \return                  Stats allocator
+ */
+extern pb_allocator_t
+pb_stats_allocator_create_with_allocator(pb_allocator_t *allocator) {
+  assert(allocator);
+  return pb_stats_allocator_create_with_sampling(allocator, 0);
+}
+
+/*!
+ * Create a stats allocator wrapping an allocator and sampling call sites.
+ *
+ * A stats allocator forwards all calls to the wrapped allocator and counts
+ * calls, requested, moved and live bytes, so memory usage and allocator cost
+ * can be attributed to different kinds of messages or requests. Every memory
+ * block is prefixed with a small header storing its size.
+ *
+ * If a sampling period is given, every n-th call to allocate or resize is
+ * attributed to the address it was issued from, which can be resolved to a
+ * function with tools like addr2line. A period of zero disables sampling.
+ *
+ * \warning The stats allocator does not take ownership of the wrapped
+ * allocator, so the caller must ensure that it outlives the stats allocator.
+ * The stats allocator is exactly as thread-safe as the wrapped allocator.
+ *
+ * \param[in,out] allocator Allocator
+ * \param[in]     period    Sampling period
+ * \return                  Stats allocator
+ */
+extern pb_allocator_t
+pb_stats_allocator_create_with_sampling(
+    pb_allocator_t *allocator, size_t period) {
+  assert(allocator);
+  pb_allocator_t stats = {
+    .proc = {
+      .allocate = allocator_allocate,
+      .resize   = allocator_resize,
+      .free     = allocator_free
+    },
+    .data = NULL
+  };
+
+  /* Allocate stats allocator */
+  pb_stats_allocator_t *data = calloc(1, sizeof(pb_stats_allocator_t));
+  if (data) {
+    data->allocator = allocator;
+    data->period    = period;
+    stats.data      = data;
+  }
+  return stats;
+}
+
+/*!
+ * Destroy a stats allocator.
+ *
+ * \warning All memory blocks must be freed before the stats allocator is
+ * destroyed, as they were allocated from the wrapped allocator.
+ *
+ * \param[in,out] allocator Stats allocator
+ */
+extern void
+pb_stats_allocator_destroy(pb_allocator_t *allocator) {
+  assert(allocator);
+  if (allocator->data) {
+    free(allocator->data);
+    allocator->data = NULL;
+  }
+}
+
+/*!
+ * Retrieve the statistics of a stats allocator.
+ *
+ * Counters are updated independently, so the statistics do not necessarily
+ * form a consistent snapshot while other threads are using the allocator.
+ *
+ * \param[in]  allocator Stats allocator
+ * \param[out] stats     Statistics
+ */
+extern void
+pb_stats_allocator_query(
+    const pb_allocator_t *allocator, pb_allocator_stats_t *stats) {
+  assert(allocator && stats);
+  pb_stats_allocator_t *data = allocator->data;
+  if (data) {
+    *stats = (pb_allocator_stats_t){
+      .allocations = counter_load(data->stats.allocations),
+      .resizes     = counter_load(data->stats.resizes),
+      .frees       = counter_load(data->stats.frees),
+      .requested   = counter_load(data->stats.requested),
+      .moved       = counter_load(data->stats.moved),
+      .current     = counter_load(data->stats.current),
+      .peak        = counter_load(data->stats.peak)
+    };
+  } else {
+    *stats = (pb_allocator_stats_t){};
+  }
+}
+
+/*!
+ * Retrieve the sampled call sites of a stats allocator.
+ *
+ * Call sites are ordered by the number of sampled bytes, so the largest
+ * consumers come first. At most the given number of call sites is written.
+ *
+ * \param[in]  allocator Stats allocator
+ * \param[out] sites[]   Call sites
+ * \param[in]  size      Call site count
+ * \return               Call sites written
+ */
+extern size_t
+pb_stats_allocator_sites(
+    const pb_allocator_t *allocator, pb_allocator_site_t sites[],
+    size_t size) {
+  assert(allocator && (sites || !size));
+  pb_stats_allocator_t *data = allocator->data;
+  if (!data)
+    return 0;
+
+  /* Insert call sites ordered by sampled bytes */
+  size_t written = 0;
+  for (size_t s = 0; s < SITES; s++) {
+    pb_allocator_site_t site = {
+      .address = __atomic_load_n(&(data->sites[s].address), __ATOMIC_RELAXED),
+      .count   = counter_load(data->sites[s].count),
+      .bytes   = counter_load(data->sites[s].bytes)
+    };
+    if (!site.count)
+      continue;
+
+    /* Shift call sites with fewer sampled bytes, dropping the last one */
+    size_t w = written < size ? written++ : size;
+    for (; w > 0 && sites[w - 1].bytes < site.bytes; w--)
+      if (w < size)
+        sites[w] = sites[w - 1];
+    if (w < size)
+      sites[w] = site;
+  }
+  return written;
+}
+
+/*!
+ * Reset the statistics of a stats allocator.
+ *
+ * All counters and sampled call sites are cleared, except for the number of
+ * bytes currently allocated, which also becomes the new peak. This allows to
+ * measure the statistics of a single request or batch of messages.
+ *
+ * \param[in,out] allocator Stats allocator
+ */
+extern void
+pb_stats_allocator_reset(pb_allocator_t *allocator) {
+  assert(allocator);
+  pb_stats_allocator_t *data = allocator->data;
+  if (data) {
+    pb_allocator_stats_t *stats = &(data->stats);
+    __atomic_store_n(&(stats->allocations), 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&(stats->resizes),     0, __ATOMIC_RELAXED);
+    __atomic_store_n(&(stats->frees),       0, __ATOMIC_RELAXED);
+    __atomic_store_n(&(stats->requested),   0, __ATOMIC_RELAXED);
+    __atomic_store_n(&(stats->moved),       0, __ATOMIC_RELAXED);
+    __atomic_store_n(&(stats->peak),
+      counter_load(stats->current), __ATOMIC_RELAXED);
+    memset(data->sites, 0, sizeof(data->sites));
+  }
+}
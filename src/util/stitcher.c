@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "core/allocator.h"
+#include "core/buffer.h"
+#include "core/common.h"
+#include "core/descriptor.h"
+#include "core/encoder.h"
+#include "util/executor.h"
+#include "util/stitcher.h"
+
+/* ----------------------------------------------------------------------------
+ * Constants
+ * ------------------------------------------------------------------------- */
+
+/* Number of chunks per thread, so threads can steal from each other */
+#define CHUNKS 4
+
+/* Minimum number of values per chunk */
+#define VALUES 64
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_stitcher_job_t {
+  pb_stitcher_t *stitcher;             /*!< Stitcher */
+  const pb_descriptor_t *descriptor;   /*!< Descriptor */
+  pb_tag_t tag;                        /*!< Tag */
+  const uint8_t *values;               /*!< Values */
+  size_t stride;                       /*!< Size of a value */
+  size_t size;                         /*!< Value count */
+  size_t chunks;                       /*!< Chunk count */
+} pb_stitcher_job_t;
+
+/* ----------------------------------------------------------------------------
+ * Internal functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Encode a chunk of values into the encoder of the chunk.
+ *
+ * \param[in]     index  Chunk index
+ * \param[in]     thread Thread index
+ * \param[in,out] user   Job
+ * \return               Error code
+ */
+static pb_error_t
+task(size_t index, size_t thread, void *user) {
+  assert(user);
+  pb_stitcher_job_t *job = user;
+  const size_t begin = job->size *  index      / job->chunks,
+               end   = job->size * (index + 1) / job->chunks;
+
+  /* Encode values, retaining the capacity of previous runs */
+  pb_encoder_t *encoder = &(job->stitcher->chunk.data[index]);
+  pb_encoder_reset(encoder);
+  encoder->descriptor = job->descriptor;
+  return pb_encoder_encode(encoder, job->tag,
+    &(job->values[begin * job->stride]), end - begin);
+}
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create a stitcher for encoding repeated fields in parallel.
+ *
+ * \warning A stitcher does not take ownership of the provided executor, so the
+ * caller must ensure that the executor is not freed during operations.
+ *
+ * \param[in,out] executor Executor
+ * \return                 Stitcher
+ */
+extern pb_stitcher_t
+pb_stitcher_create(pb_executor_t *executor) {
+  assert(executor);
+  if (unlikely_(!pb_executor_valid(executor)))
+    return pb_stitcher_create_invalid();
+
+  /* Allocate encoders for chunks and segments for chunks and head */
+  const size_t size = pb_executor_size(executor) * CHUNKS;
+  pb_encoder_t *data = pb_allocator_allocate(&allocator_default,
+    size * sizeof(pb_encoder_t));
+  pb_buffer_t *segments = pb_allocator_allocate(&allocator_default,
+    (size + 1) * sizeof(pb_buffer_t));
+  if (unlikely_(!data || !segments)) {
+    if (segments)
+      pb_allocator_free(&allocator_default, segments);     /* LCOV_EXCL_LINE */
+    if (data)
+      pb_allocator_free(&allocator_default, data);         /* LCOV_EXCL_LINE */
+    return pb_stitcher_create_invalid();                   /* LCOV_EXCL_LINE */
+  }
+  for (size_t c = 0; c < size; c++) {
+    pb_encoder_t encoder = {
+      .buffer = pb_buffer_create_empty()
+    };
+    data[c] = encoder;
+  }
+  pb_stitcher_t stitcher = {
+    .executor = executor,
+    .chunk    = {
+      .data = data,
+      .size = size
+    },
+    .segment  = {
+      .data = segments,
+      .size = 0
+    }
+  };
+  return stitcher;
+}
+
+/*!
+ * Destroy a stitcher.
+ *
+ * \param[in,out] stitcher Stitcher
+ */
+extern void
+pb_stitcher_destroy(pb_stitcher_t *stitcher) {
+  assert(stitcher);
+  if (pb_stitcher_valid(stitcher)) {
+    for (size_t c = 0; c < stitcher->chunk.size; c++)
+      pb_encoder_destroy(&(stitcher->chunk.data[c]));
+    pb_allocator_free(&allocator_default, stitcher->segment.data);
+    pb_allocator_free(&allocator_default, stitcher->chunk.data);
+  }
+}
+
+/*!
+ * Encode the values of a repeated field in parallel.
+ *
+ * The values are split into contiguous chunks which are encoded concurrently
+ * with pb_encoder_encode() into separate buffers, which are retained across
+ * calls. The result is not written to the encoder, but can be appended to it
+ * with pb_stitcher_stitch() or retrieved as a chain of segments with
+ * pb_stitcher_chain(), which starts with the data of the encoder.
+ *
+ * Packed fields are encoded as one packed run per chunk, which is equivalent
+ * to a single run according to the specification.
+ *
+ * \param[in,out] stitcher Stitcher
+ * \param[in]     encoder  Encoder
+ * \param[in]     tag      Tag
+ * \param[in]     values   Pointer holding values
+ * \param[in]     size     Value count
+ * \return                 Error code
+ */
+extern pb_error_t
+pb_stitcher_encode(
+    pb_stitcher_t *stitcher, const pb_encoder_t *encoder, pb_tag_t tag,
+    const void *values, size_t size) {
+  assert(stitcher && encoder && tag && (values || !size));
+  if (unlikely_(!pb_stitcher_valid(stitcher) || !pb_encoder_valid(encoder)))
+    return PB_ERROR_INVALID;
+  stitcher->segment.size = 0;
+
+  /* Ensure field is repeated */
+  const pb_field_descriptor_t *descriptor =
+    pb_descriptor_field_by_tag(pb_encoder_descriptor(encoder), tag);
+  if (unlikely_(!descriptor ||
+      pb_field_descriptor_label(descriptor) != PB_LABEL_REPEATED))
+    return PB_ERROR_INVALID;
+
+  /* Split values into chunks of a minimum size */
+  size_t chunks = (size + VALUES - 1) / VALUES;
+  if (chunks > stitcher->chunk.size)
+    chunks = stitcher->chunk.size;
+  pb_stitcher_job_t job = {
+    .stitcher   = stitcher,
+    .descriptor = pb_encoder_descriptor(encoder),
+    .tag        = tag,
+    .values     = values,
+    .stride     = pb_field_descriptor_type(descriptor) != PB_TYPE_MESSAGE
+      ? pb_field_descriptor_type_size(descriptor)
+      : sizeof(pb_encoder_t),
+    .size       = size,
+    .chunks     = chunks
+  };
+
+  /* Encode chunks */
+  pb_error_t error = pb_executor_run(stitcher->executor, chunks, task, &job);
+  if (unlikely_(error))
+    return error;
+
+  /* Create segments for data of encoder and chunks */
+  const pb_buffer_t *buffer = pb_encoder_buffer(encoder);
+  stitcher->segment.data[0] = pb_buffer_create_zero_copy_internal(
+    buffer->data, pb_buffer_size(buffer));
+  for (size_t c = 0; c < chunks; c++) {
+    buffer = pb_encoder_buffer(&(stitcher->chunk.data[c]));
+    stitcher->segment.data[c + 1] = pb_buffer_create_zero_copy_internal(
+      buffer->data, pb_buffer_size(buffer));
+  }
+  stitcher->segment.size = chunks + 1;
+  return PB_ERROR_NONE;
+}
+
+/*!
+ * Append the encoded chunks to an encoder with a single gathered copy.
+ *
+ * The encoder is grown once by the total size of all chunks, so the encoded
+ * values are copied exactly once. The chain of the stitcher is invalidated.
+ *
+ * \param[in,out] stitcher Stitcher
+ * \param[in,out] encoder  Encoder
+ * \return                 Error code
+ */
+extern pb_error_t
+pb_stitcher_stitch(pb_stitcher_t *stitcher, pb_encoder_t *encoder) {
+  assert(stitcher && encoder);
+  if (unlikely_(!pb_stitcher_valid(stitcher) || !pb_encoder_valid(encoder)))
+    return PB_ERROR_INVALID;
+
+  /* Compute total size of chunks */
+  size_t size = 0;
+  for (size_t s = 1; s < stitcher->segment.size; s++)
+    size += pb_buffer_size(&(stitcher->segment.data[s]));
+
+  /* Grow encoder and copy chunks */
+  if (size) {
+    uint8_t *data = pb_buffer_grow(&(encoder->buffer), size);
+    if (unlikely_(!data))
+      return PB_ERROR_ALLOC;                               /* LCOV_EXCL_LINE */
+    for (size_t s = 1; s < stitcher->segment.size; s++) {
+      const pb_buffer_t *segment = &(stitcher->segment.data[s]);
+      memcpy(data, pb_buffer_data(segment), pb_buffer_size(segment));
+      data += pb_buffer_size(segment);
+    }
+  }
+  stitcher->segment.size = 0;
+  return PB_ERROR_NONE;
+}
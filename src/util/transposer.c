@@ -0,0 +1,479 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <alloca.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/allocator.h"
+#include "core/buffer.h"
+#include "core/common.h"
+#include "core/descriptor.h"
+#include "core/stream.h"
+#include "util/path.h"
+#include "util/transposer.h"
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef union pb_transposer_value_t {
+  pb_string_t string;                  /*!< String value */
+  uint64_t integer;                    /*!< Integer value */
+  double real;                         /*!< Floating-point value */
+} pb_transposer_value_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_transposer_slot_t {
+  int present;                         /*!< Value presence */
+  pb_transposer_value_t value;         /*!< Value */
+} pb_transposer_slot_t;
+
+/* ----------------------------------------------------------------------------
+ * Internal functions
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve the field descriptor at the end of a column's path.
+ *
+ * \param[in] column Column
+ * \return           Field descriptor
+ */
+static const pb_field_descriptor_t *
+leaf(const pb_transposer_column_t *column) {
+  assert(column);
+  return pb_path_segment(column->path,
+    pb_path_size(column->path) - 1)->descriptor;
+}
+
+/*!
+ * Test whether a column holds strings or bytes.
+ *
+ * \param[in] column Column
+ * \return           Test result
+ */
+static int
+variable(const pb_transposer_column_t *column) {
+  assert(column);
+  pb_type_t type = pb_field_descriptor_type(leaf(column));
+  return type == PB_TYPE_STRING || type == PB_TYPE_BYTES;
+}
+
+/*!
+ * Test whether a path selects at most a single value of a message.
+ *
+ * This holds if every repeated field on the path is followed by an index, as
+ * a wildcard, which is the default, selects all occurrences.
+ *
+ * \param[in] path Path
+ * \return         Test result
+ */
+static int
+single(const pb_path_t *path) {
+  assert(path);
+  for (size_t s = 0; s < pb_path_size(path); s++) {
+    const pb_path_segment_t *segment = pb_path_segment(path, s);
+    if (pb_field_descriptor_label(segment->descriptor) == PB_LABEL_REPEATED &&
+        segment->index == SIZE_MAX)
+      return 0;
+  }
+  return 1;
+}
+
+/*!
+ * Append an offset to a column of strings or bytes.
+ *
+ * \param[in,out] column Column
+ * \return               Error code
+ */
+static pb_error_t
+append_offset(pb_transposer_column_t *column) {
+  assert(column);
+  uint32_t offset = pb_buffer_size(&(column->values));
+  uint8_t *data = pb_buffer_grow(&(column->offsets), sizeof(offset));
+  if (unlikely_(!data))
+    return PB_ERROR_ALLOC;
+  memcpy(data, &offset, sizeof(offset));
+  return PB_ERROR_NONE;
+}
+
+/*!
+ * Scan a message once, capturing the values of all columns at a given level.
+ *
+ * Only columns whose paths matched up to the given level are active. Fields
+ * matching none of them are skipped without decoding, and submessages are
+ * scanned recursively for the subset of columns descending into them, so the
+ * message is walked exactly once regardless of the number of columns. Paths
+ * select single occurrences of repeated fields, so a path only matches several
+ * values if a non-repeated field occurs more than once, and the last one wins.
+ *
+ * \param[in]     transposer Transposer
+ * \param[in]     level      Level
+ * \param[in]     buffer     Buffer
+ * \param[in]     active[]   Active columns
+ * \param[in]     size       Active column count
+ * \param[in,out] slots[]    Slots
+ * \return                   Error code
+ */
+static pb_error_t
+scan(
+    const pb_transposer_t *transposer, size_t level,
+    const pb_buffer_t *buffer, const size_t active[], size_t size,
+    pb_transposer_slot_t slots[]) {
+  assert(transposer && buffer && active && size && slots);
+  pb_error_t error = PB_ERROR_NONE;
+
+  /* Allocate temporary space for occurrence counts and descending columns */
+  size_t *counts = alloca(size * sizeof(size_t)),
+         *next   = alloca(size * sizeof(size_t));
+  memset(counts, 0, size * sizeof(size_t));
+
+  /* Iterate tag-value pairs */
+  pb_stream_t stream = pb_stream_create(buffer);
+  while (!error && pb_stream_left(&stream)) {
+    pb_tag_t tag;
+    if (unlikely_(error = pb_stream_read(&stream, PB_TYPE_UINT32, &tag)))
+      break;
+
+    /* Extract wiretype and tag */
+    pb_wiretype_t wiretype = tag & 7;
+    tag >>= 3;
+
+    /* Find the field descriptor of an active column matching the tag */
+    const pb_field_descriptor_t *descriptor = NULL;
+    for (size_t a = 0; !descriptor && a < size; a++) {
+      const pb_path_segment_t *segment = pb_path_segment(
+        transposer->column.data[active[a]].path, level);
+      if (pb_field_descriptor_tag(segment->descriptor) == tag)
+        descriptor = segment->descriptor;
+    }
+
+    /* Skip field if it does not match any column */
+    if (!descriptor) {
+      error = pb_stream_skip(&stream, wiretype);
+      continue;
+    }
+
+    /* Non-packed fields may also be encoded in packed encoding */
+    pb_type_t type = pb_field_descriptor_type(descriptor);
+    size_t end = 0;
+    const int packed = wiretype != pb_field_descriptor_wiretype(descriptor) &&
+                       wiretype == PB_WIRETYPE_LENGTH;
+    if (packed) {
+      uint32_t length;
+      if (unlikely_(error = pb_stream_read(&stream, PB_TYPE_UINT32, &length)))
+        break;
+
+      /* Ensure we're within the stream's boundaries */
+      end = pb_stream_offset(&stream) + length;
+      if (end > pb_buffer_size(buffer))
+        error = PB_ERROR_OFFSET;
+    }
+
+    /* Iterate values, which are more than one only for packed fields */
+    for (int first = 1; !error && (packed
+        ? pb_stream_offset(&stream) < end
+        : first); first = 0) {
+      pb_transposer_value_t value;
+      if (unlikely_(error = pb_stream_read(&stream, type, &value)))
+        break;
+
+      /* Capture value for leaves, collect columns descending otherwise */
+      size_t descend = 0;
+      for (size_t a = 0; a < size; a++) {
+        const pb_transposer_column_t *column =
+          &(transposer->column.data[active[a]]);
+        const pb_path_segment_t *segment =
+          pb_path_segment(column->path, level);
+        if (pb_field_descriptor_tag(segment->descriptor) != tag ||
+            (segment->index != SIZE_MAX && segment->index != counts[a]++))
+          continue;
+        if (level == pb_path_size(column->path) - 1) {
+          slots[active[a]].present = 1;
+          memcpy(&(slots[active[a]].value), &value,
+            pb_field_descriptor_type_size(descriptor));
+        } else {
+          next[descend++] = active[a];
+        }
+      }
+
+      /* Scan submessage on the same underlying data */
+      if (descend) {
+        pb_buffer_t subbuffer = pb_buffer_create_zero_copy_internal(
+          pb_string_data(&(value.string)), pb_string_size(&(value.string)));
+        error = scan(transposer, level + 1, &subbuffer, next, descend, slots);
+        pb_buffer_destroy(&subbuffer);
+      }
+    }
+  }
+  pb_stream_destroy(&stream);
+  return error;
+}
+
+/*!
+ * Append a row with the captured values to all columns.
+ *
+ * Space is reserved in all columns before anything is appended, so the row is
+ * either appended entirely or not at all.
+ *
+ * \param[in,out] transposer Transposer
+ * \param[in]     slots[]    Slots
+ * \return                   Error code
+ */
+static pb_error_t
+append(pb_transposer_t *transposer, const pb_transposer_slot_t slots[]) {
+  assert(transposer && slots);
+  const size_t row = transposer->size;
+  pb_error_t error = PB_ERROR_NONE;
+
+  /* Reserve space for the row in all columns */
+  for (size_t c = 0; !error && c < transposer->column.size; c++) {
+    pb_transposer_column_t *column = &(transposer->column.data[c]);
+    if (variable(column)) {
+      size_t length = slots[c].present
+        ? pb_string_size(&(slots[c].value.string))
+        : 0;
+      if (pb_buffer_size(&(column->values)) + length > UINT32_MAX)
+        error = PB_ERROR_OFFSET;
+      if (!error && !(error = pb_buffer_reserve(&(column->values), length)))
+        error = pb_buffer_reserve(&(column->offsets), sizeof(uint32_t));
+    } else {
+      error = pb_buffer_reserve(&(column->values),
+        pb_field_descriptor_type_size(leaf(column)));
+    }
+    if (!error && !(row % 8))
+      error = pb_buffer_reserve(&(column->validity), 1);
+  }
+  if (unlikely_(error))
+    return error;
+
+  /* Append row within reserved space, which cannot fail */
+  for (size_t c = 0; c < transposer->column.size; c++) {
+    pb_transposer_column_t *column = &(transposer->column.data[c]);
+    if (!(row % 8))
+      *pb_buffer_grow(&(column->validity), 1) = 0;
+    if (slots[c].present)
+      *pb_buffer_data_from(&(column->validity), row / 8) |= 1 << row % 8;
+
+    /* Append string or bytes and offset */
+    if (variable(column)) {
+      const pb_string_t *string = &(slots[c].value.string);
+      if (slots[c].present && pb_string_size(string))
+        memcpy(pb_buffer_grow(&(column->values), pb_string_size(string)),
+          pb_string_data(string), pb_string_size(string));
+      error = append_offset(column);
+
+    /* Append value of fixed size, or zero if absent */
+    } else {
+      size_t size = pb_field_descriptor_type_size(leaf(column));
+      uint8_t *data = pb_buffer_grow(&(column->values), size);
+      if (slots[c].present) {
+        memcpy(data, &(slots[c].value), size);
+      } else {
+        memset(data, 0, size);
+      }
+    }
+  }
+  transposer->size++;
+  return error;
+}
+
+/* ----------------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create a transposer for a set of paths.
+ *
+ * \warning A transposer does not take ownership of the provided paths, so the
+ * caller must ensure that the paths are not freed during operations.
+ *
+ * \param[in] descriptor Descriptor
+ * \param[in] paths[]    Paths
+ * \param[in] size       Path count
+ * \return               Transposer
+ */
+extern pb_transposer_t
+pb_transposer_create(
+    const pb_descriptor_t *descriptor, const pb_path_t paths[], size_t size) {
+  return pb_transposer_create_with_allocator(
+    &allocator_default, descriptor, paths, size);
+}
+
+/*!
+ * Create a transposer for a set of paths using a custom allocator.
+ *
+ * A transposer turns a batch of messages into columns, one per path, with a
+ * row per message, in a layout similar to Apache Arrow: every column holds a
+ * validity bitmap and an array of values, and columns of strings and bytes
+ * additionally hold offsets into their values. All paths must be created for
+ * the given descriptor and must end in a field which is not a submessage. As
+ * every column holds one value per row, all repeated fields on a path must be
+ * followed by an index, e.g. "items[0].price", or PB_ERROR_INVALID is set.
+ *
+ * \warning A transposer does not take ownership of the provided allocator and
+ * paths, so the caller must ensure that they are not freed during operations.
+ *
+ * \param[in,out] allocator  Allocator
+ * \param[in]     descriptor Descriptor
+ * \param[in]     paths[]    Paths
+ * \param[in]     size       Path count
+ * \return                   Transposer
+ */
+extern pb_transposer_t
+pb_transposer_create_with_allocator(
+    pb_allocator_t *allocator, const pb_descriptor_t *descriptor,
+    const pb_path_t paths[], size_t size) {
+  assert(allocator && descriptor && paths && size);
+  for (size_t p = 0; p < size; p++)
+    if (unlikely_(!pb_path_valid(&(paths[p])) ||
+        pb_path_descriptor(&(paths[p])) != descriptor ||
+        !single(&(paths[p])) ||
+        pb_field_descriptor_type(pb_path_segment(&(paths[p]),
+          pb_path_size(&(paths[p])) - 1)->descriptor) == PB_TYPE_MESSAGE))
+      return pb_transposer_create_invalid(PB_ERROR_INVALID);
+
+  /* Allocate columns */
+  pb_transposer_column_t *columns =
+    pb_allocator_allocate(allocator, size * sizeof(pb_transposer_column_t));
+  if (unlikely_(!columns))
+    return pb_transposer_create_invalid(PB_ERROR_ALLOC);
+
+  /* Initialize transposer and columns */
+  pb_transposer_t transposer = {
+    .allocator  = allocator,
+    .descriptor = descriptor,
+    .column     = {
+      .data = columns,
+      .size = size
+    },
+    .size       = 0,
+    .error      = PB_ERROR_NONE
+  };
+  for (size_t c = 0; c < size; c++) {
+    pb_transposer_column_t column = {
+      .path     = &(paths[c]),
+      .values   = pb_buffer_create_empty_with_allocator(allocator),
+      .offsets  = pb_buffer_create_empty_with_allocator(allocator),
+      .validity = pb_buffer_create_empty_with_allocator(allocator)
+    };
+    columns[c] = column;
+  }
+
+  /* Columns of strings and bytes start with an offset of zero */
+  for (size_t c = 0; c < size; c++) {
+    if (variable(&(columns[c])) &&
+        unlikely_(append_offset(&(columns[c])))) {
+      pb_transposer_destroy(&transposer);                  /* LCOV_EXCL_LINE */
+      return pb_transposer_create_invalid(PB_ERROR_ALLOC); /* LCOV_EXCL_LINE */
+    }
+  }
+  return transposer;
+}
+
+/*!
+ * Destroy a transposer.
+ *
+ * \param[in,out] transposer Transposer
+ */
+extern void
+pb_transposer_destroy(pb_transposer_t *transposer) {
+  assert(transposer);
+  if (pb_transposer_valid(transposer)) {
+    for (size_t c = 0; c < transposer->column.size; c++) {
+      pb_transposer_column_t *column = &(transposer->column.data[c]);
+      pb_buffer_destroy(&(column->values));
+      pb_buffer_destroy(&(column->offsets));
+      pb_buffer_destroy(&(column->validity));
+    }
+    pb_allocator_free(transposer->allocator, transposer->column.data);
+    transposer->column.data = NULL;
+    transposer->column.size = 0;
+    transposer->error       = PB_ERROR_INVALID;
+  }
+}
+
+/*!
+ * Append a batch of messages to a transposer, one row per message.
+ *
+ * Every message is scanned exactly once for all paths. If a message cannot be
+ * decoded, no row is appended for it, and the error is returned, but the rows
+ * of all preceding messages remain.
+ *
+ * \param[in,out] transposer Transposer
+ * \param[in]     messages[] Messages
+ * \param[in]     size       Message count
+ * \return                   Error code
+ */
+extern pb_error_t
+pb_transposer_append(
+    pb_transposer_t *transposer, const pb_buffer_t messages[], size_t size) {
+  assert(transposer && (messages || !size));
+  if (unlikely_(!pb_transposer_valid(transposer)))
+    return PB_ERROR_INVALID;
+
+  /* Allocate temporary space for active columns and slots */
+  const size_t columns = transposer->column.size;
+  size_t *active = alloca(columns * sizeof(size_t));
+  pb_transposer_slot_t *slots = alloca(columns * sizeof(pb_transposer_slot_t));
+  for (size_t c = 0; c < columns; c++)
+    active[c] = c;
+
+  /* Scan messages and append rows */
+  pb_error_t error = PB_ERROR_NONE;
+  for (size_t m = 0; !error && m < size; m++) {
+    memset(slots, 0, columns * sizeof(pb_transposer_slot_t));
+    if (unlikely_(!pb_buffer_valid(&(messages[m])))) {
+      error = PB_ERROR_INVALID;
+    } else if (!(error = scan(transposer, 0,
+        &(messages[m]), active, columns, slots))) {
+      error = append(transposer, slots);
+    }
+  }
+  return error;
+}
+
+/*!
+ * Reset a transposer, retaining the capacity of its columns.
+ *
+ * \param[in,out] transposer Transposer
+ */
+extern void
+pb_transposer_reset(pb_transposer_t *transposer) {
+  assert(transposer);
+  if (unlikely_(!pb_transposer_valid(transposer)))
+    return;
+  for (size_t c = 0; c < transposer->column.size; c++) {
+    pb_transposer_column_t *column = &(transposer->column.data[c]);
+    pb_buffer_reset(&(column->values));
+    pb_buffer_reset(&(column->offsets));
+    pb_buffer_reset(&(column->validity));
+
+    /* The leading offset was allocated on creation, so its capacity is kept */
+    if (variable(column))
+      append_offset(column);
+  }
+  transposer->size = 0;
+}
@@ -24,12 +24,39 @@
 #include <assert.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "core/buffer.h"
+#include "core/chain.h"
 #include "core/common.h"
 #include "core/decoder.h"
 #include "core/descriptor.h"
+#include "core/parser.h"
 #include "util/validator.h"
 
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct pb_validator_tags_t {
+  pb_tag_t *data;                      /*!< Tags */
+  size_t size;                         /*!< Tag count */
+} pb_validator_tags_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_validator_scope_t {
+  size_t offset;                       /*!< Offset of tags */
+  size_t size;                         /*!< Tag count */
+} pb_validator_scope_t;
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct pb_validator_stack_t {
+  pb_buffer_t scopes;                  /*!< Scopes of nested messages */
+  pb_buffer_t tags;                    /*!< Tags of all scopes */
+} pb_validator_stack_t;
+
 /* ----------------------------------------------------------------------------
  * Forward declarations
  * ------------------------------------------------------------------------- */
@@ -38,19 +65,37 @@ static pb_error_t
 check(
   const pb_decoder_t *decoder);        /* Decoder */
 
-/* ----------------------------------------------------------------------------
- * Type definitions
- * ------------------------------------------------------------------------- */
+static pb_error_t
+push(
+  pb_validator_stack_t *stack,         /* Stack */
+  const pb_descriptor_t *descriptor);  /* Descriptor */
 
-typedef struct pb_validator_tags_t {
-  pb_tag_t *data;                      /*!< Tags */
-  size_t size;                         /*!< Tag count */
-} pb_validator_tags_t;
+static pb_error_t
+pop(
+  pb_validator_stack_t *stack,         /* Stack */
+  const pb_descriptor_t *descriptor);  /* Descriptor */
 
 /* ----------------------------------------------------------------------------
  * Decoder callback
  * ------------------------------------------------------------------------- */
 
+/*!
+ * Count the occurrence of a field.
+ *
+ * \param[in,out] tags       Field occurrences
+ * \param[in]     descriptor Field descriptor
+ */
+static void
+count(pb_validator_tags_t *tags, const pb_field_descriptor_t *descriptor) {
+  assert(tags && descriptor);
+  int miss = 1;
+  for (size_t t = 0; miss && t < tags->size; ++t)
+    if (tags->data[t] == pb_field_descriptor_tag(descriptor))
+      miss = 0;
+  if (miss)
+    tags->data[tags->size++] = pb_field_descriptor_tag(descriptor);
+}
+
 /*!
  * Field handler that counts occurrences.
  *
@@ -62,15 +107,7 @@ static pb_error_t
 handler(
     const pb_field_descriptor_t *descriptor, const void *value, void *user) {
   assert(descriptor && value && user);
-  pb_validator_tags_t *tags = user;
-
-  /* Count field occurrence */
-  int miss = 1;
-  for (size_t t = 0; miss && t < tags->size; ++t)
-    if (tags->data[t] == pb_field_descriptor_tag(descriptor))
-      miss = 0;
-  if (miss)
-    tags->data[tags->size++] = pb_field_descriptor_tag(descriptor);
+  count(user, descriptor);
 
   /* In case of submessage, perform recursive check */
   return pb_field_descriptor_type(descriptor) == PB_TYPE_MESSAGE
@@ -78,10 +115,126 @@ handler(
     : PB_ERROR_NONE;
 }
 
+/*!
+ * Field handler that counts occurrences within the scope of the innermost
+ * nested message, as reported by a parser.
+ *
+ * \param[in]     descriptor Field descriptor
+ * \param[in]     value      Pointer holding value
+ * \param[in,out] user       User data
+ */
+static pb_error_t
+handler_scope(
+    const pb_field_descriptor_t *descriptor, const void *value, void *user) {
+  assert(descriptor && value && user);
+  pb_validator_stack_t *stack = user;
+
+  /* Check nested message when leaving it */
+  int message = pb_field_descriptor_type(descriptor) == PB_TYPE_MESSAGE;
+  if (message && *(const pb_parser_event_t *)value == PB_PARSER_EVENT_LEAVE)
+    return pop(stack, pb_field_descriptor_nested(descriptor));
+
+  /* Count field occurrence in innermost scope */
+  pb_validator_scope_t *scope = (pb_validator_scope_t *)pb_buffer_data_from(
+    &(stack->scopes), pb_buffer_size(&(stack->scopes)) - sizeof(*scope));
+  pb_validator_tags_t tags = {
+    .data = (pb_tag_t *)pb_buffer_data_from(&(stack->tags), scope->offset),
+    .size = scope->size
+  };
+  count(&tags, descriptor);
+  scope->size = tags.size;
+
+  /* Open scope when entering nested message */
+  return message
+    ? push(stack, pb_field_descriptor_nested(descriptor))
+    : PB_ERROR_NONE;
+}
+
 /* ----------------------------------------------------------------------------
  * Internal functions
  * ------------------------------------------------------------------------- */
 
+/*!
+ * Check for absent required fields after counting field occurrences.
+ *
+ * \param[in] descriptor Descriptor
+ * \param[in] tags       Field occurrences
+ * \return               Error code
+ */
+static pb_error_t
+check_required(
+    const pb_descriptor_t *descriptor, const pb_validator_tags_t *tags) {
+  assert(descriptor && tags);
+  pb_error_t error = PB_ERROR_NONE;
+  pb_descriptor_iter_t it = pb_descriptor_iter_create(descriptor);
+  if (pb_descriptor_iter_begin(&it)) {
+    do {
+      const pb_field_descriptor_t *field = pb_descriptor_iter_current(&it);
+      if (pb_field_descriptor_label(field) == PB_LABEL_REQUIRED) {
+        int miss = 1;
+        for (size_t t = 0; miss && t < tags->size; ++t)
+          if (tags->data[t] == pb_field_descriptor_tag(field))
+            miss = 0;
+        if (miss)
+          error = PB_ERROR_ABSENT;
+      }
+    } while (!error && pb_descriptor_iter_next(&it));
+  }
+  pb_descriptor_iter_destroy(&it);
+  return error;
+}
+
+/*!
+ * Open a scope for counting the field occurrences of a message.
+ *
+ * \param[in,out] stack      Stack
+ * \param[in]     descriptor Descriptor
+ * \return                   Error code
+ */
+static pb_error_t
+push(pb_validator_stack_t *stack, const pb_descriptor_t *descriptor) {
+  assert(stack && descriptor);
+  size_t size = sizeof(pb_tag_t) * pb_descriptor_size(descriptor);
+  pb_validator_scope_t scope = {
+    .offset = pb_buffer_size(&(stack->tags)),
+    .size   = 0
+  };
+
+  /* Allocate space for tags, which are only written when counted */
+  if (unlikely_(pb_buffer_reserve(&(stack->scopes), sizeof(scope)) ||
+      pb_buffer_reserve(&(stack->tags), size) ||
+      (size && !pb_buffer_grow(&(stack->tags), size))))
+    return PB_ERROR_ALLOC;                                 /* LCOV_EXCL_LINE */
+  memcpy(pb_buffer_grow(&(stack->scopes), sizeof(scope)),
+    &scope, sizeof(scope));
+  return PB_ERROR_NONE;
+}
+
+/*!
+ * Close the innermost scope and check for absent required fields.
+ *
+ * \param[in,out] stack      Stack
+ * \param[in]     descriptor Descriptor
+ * \return                   Error code
+ */
+static pb_error_t
+pop(pb_validator_stack_t *stack, const pb_descriptor_t *descriptor) {
+  assert(stack && descriptor);
+  const pb_validator_scope_t *scope = (const pb_validator_scope_t *)
+    pb_buffer_data_from(&(stack->scopes),
+      pb_buffer_size(&(stack->scopes)) - sizeof(*scope));
+  pb_validator_tags_t tags = {
+    .data = (pb_tag_t *)pb_buffer_data_from(&(stack->tags), scope->offset),
+    .size = scope->size
+  };
+
+  /* Discard scope after checking required fields */
+  pb_error_t error = check_required(descriptor, &tags);
+  stack->tags.size    = scope->offset;
+  stack->scopes.size -= sizeof(*scope);
+  return error;
+}
+
 /*!
  * Decode a buffer and count field occurrences.
  *
@@ -104,25 +257,8 @@ check(const pb_decoder_t *decoder) {
   pb_error_t error = pb_decoder_decode(decoder, handler, &tags);
 
   /* Check for absent required fields */
-  if (likely_(!error)) {
-    pb_descriptor_iter_t it =
-      pb_descriptor_iter_create(decoder->descriptor);
-    if (pb_descriptor_iter_begin(&it)) {
-      do {
-        const pb_field_descriptor_t *descriptor =
-          pb_descriptor_iter_current(&it);
-        if (pb_field_descriptor_label(descriptor) == PB_LABEL_REQUIRED) {
-          int miss = 1;
-          for (size_t t = 0; miss && t < tags.size; ++t)
-            if (tags.data[t] == pb_field_descriptor_tag(descriptor))
-              miss = 0;
-          if (miss)
-            error = PB_ERROR_ABSENT;
-        }
-      } while (!error && pb_descriptor_iter_next(&it));
-    }
-    pb_descriptor_iter_destroy(&it);
-  }
+  if (likely_(!error))
+    error = check_required(pb_decoder_descriptor(decoder), &tags);
   return error;
 }
 
@@ -151,3 +287,40 @@ pb_validator_check(
   pb_decoder_destroy(&decoder);
   return error;
 }
+
+/*!
+ * Validate a chain of buffers.
+ *
+ * The chain is decoded with pb_decoder_decode_chain(), so the segments don't
+ * need to be copied into a single contiguous buffer. Nested messages are not
+ * decoded separately, but reported field by field, so the occurrences are
+ * counted in a stack of scopes, one for every enclosing message.
+ *
+ * \param[in] validator Validator
+ * \param[in] chain     Chain
+ * \return              Error code
+ */
+extern pb_error_t
+pb_validator_check_chain(
+    const pb_validator_t *validator, const pb_chain_t *chain) {
+  assert(validator && chain);
+  if (unlikely_(!pb_chain_valid(chain)))
+    return PB_ERROR_INVALID;
+
+  /* Initialize stack of occurrence counters */
+  pb_validator_stack_t stack = {
+    .scopes = pb_buffer_create_empty(),
+    .tags   = pb_buffer_create_empty()
+  };
+
+  /* Count occurrences and check for absent required fields */
+  pb_error_t error = push(&stack, validator->descriptor);
+  if (likely_(!error) && !(error = pb_decoder_decode_chain(
+      validator->descriptor, chain, handler_scope, &stack)))
+    error = pop(&stack, validator->descriptor);
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&(stack.scopes));
+  pb_buffer_destroy(&(stack.tags));
+  return error;
+}
@@ -23,8 +23,10 @@
 #include <assert.h>
 #include <check.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include "core/allocator.h"
 #include "core/buffer.h"
@@ -61,6 +63,47 @@ allocator_resize_fail(void *data, void *block, size_t size) {
   return NULL;
 }
 
+/* ----------------------------------------------------------------------------
+ * Files
+ * ------------------------------------------------------------------------- */
+
+/* File used for memory mapping */
+#define FILE_MMAP "buffer.mmap"
+
+/* Shared memory object used for memory mapping */
+#define SHM_NAME "/protobluff-buffer.shm"
+
+/*!
+ * Write data to a file, replacing its contents.
+ *
+ * \param[in] data[] Raw data
+ * \param[in] size   Raw data size
+ */
+static void
+file_write(const uint8_t data[], size_t size) {
+  FILE *file = fopen(FILE_MMAP, "wb");
+  assert(file);
+  if (size)
+    fwrite(data, 1, size, file);
+  fclose(file);
+}
+
+/*!
+ * Read the contents of a file.
+ *
+ * \param[out] data[] Raw data
+ * \param[in]  size   Raw data size
+ * \return            Bytes read
+ */
+static size_t
+file_read(uint8_t data[], size_t size) {
+  FILE *file = fopen(FILE_MMAP, "rb");
+  assert(file);
+  size_t read = fread(data, 1, size, file);
+  fclose(file);
+  return read;
+}
+
 /* ----------------------------------------------------------------------------
  * Tests
  * ------------------------------------------------------------------------- */
@@ -113,6 +156,31 @@ START_TEST(test_create_empty) {
 } END_TEST
 
 
+/*
+ * Create an empty buffer backed by inline storage.
+ */
+START_TEST(test_create_inline) {
+  uint8_t block[16];
+
+  /* Create buffer */
+  pb_buffer_t buffer = pb_buffer_create_inline(block, sizeof(block));
+
+  /* Assert buffer validity and error */
+  fail_unless(pb_buffer_valid(&buffer));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_buffer_error(&buffer));
+
+  /* Assert buffer size and capacity */
+  fail_unless(pb_buffer_empty(&buffer));
+  ck_assert_uint_eq(0, pb_buffer_size(&buffer));
+  ck_assert_uint_eq(16, pb_buffer_capacity(&buffer));
+
+  /* Assert inline storage */
+  ck_assert_ptr_eq(block, pb_buffer_data(&buffer));
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
 /*
  * Create a zero-copy buffer.
  */
@@ -139,6 +207,167 @@ START_TEST(test_create_zero_copy) {
   pb_buffer_destroy(&buffer);
 } END_TEST
 
+/*
+ * Create a buffer backed by a memory-mapped file.
+ */
+START_TEST(test_create_mmap) {
+  const uint8_t data[] = "SOME DATA";
+  const size_t  size   = 9;
+
+  /* Create buffer */
+  file_write(data, size);
+  pb_buffer_t buffer = pb_buffer_create_mmap(FILE_MMAP, PB_BUFFER_READ);
+
+  /* Assert buffer validity and error */
+  fail_unless(pb_buffer_valid(&buffer));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_buffer_error(&buffer));
+
+  /* Assert buffer size and contents */
+  ck_assert_uint_eq(size, pb_buffer_size(&buffer));
+  fail_if(memcmp(data, pb_buffer_data(&buffer), size));
+
+  /* Assert buffer can't grow */
+  ck_assert_ptr_eq(NULL, pb_buffer_grow(&buffer, 1));
+  ck_assert_uint_eq(size, pb_buffer_size(&buffer));
+
+  /* Assert changes are private */
+  memcpy(pb_buffer_data_from(&buffer, 0), "MORE", 4);
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_buffer_sync(&buffer));
+  uint8_t file[16];
+  ck_assert_uint_eq(size, file_read(file, sizeof(file)));
+  fail_if(memcmp(data, file, size));
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&buffer);
+  remove(FILE_MMAP);
+} END_TEST
+
+/*
+ * Create a writable buffer backed by a memory-mapped file.
+ */
+START_TEST(test_create_mmap_write) {
+  const uint8_t data[] = "SOME DATA";
+  const size_t  size   = 9;
+
+  /* Create buffer */
+  file_write(data, size);
+  pb_buffer_t buffer = pb_buffer_create_mmap(FILE_MMAP, PB_BUFFER_WRITE);
+
+  /* Assert buffer validity and error */
+  fail_unless(pb_buffer_valid(&buffer));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_buffer_error(&buffer));
+  ck_assert_uint_eq(size, pb_buffer_size(&buffer));
+
+  /* Grow buffer beyond a page and write to it */
+  uint8_t *space = pb_buffer_grow(&buffer, 10000);
+  ck_assert_ptr_ne(NULL, space);
+  memset(space, 'X', 10000);
+  memcpy(pb_buffer_data_from(&buffer, 0), "MORE", 4);
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_buffer_sync(&buffer));
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&buffer);
+
+  /* Assert changes were written to file */
+  uint8_t file[size + 10001];
+  ck_assert_uint_eq(size + 10000, file_read(file, sizeof(file)));
+  fail_if(memcmp("MORE DATA", file, size));
+  ck_assert_uint_eq('X', file[size + 9999]);
+  remove(FILE_MMAP);
+} END_TEST
+
+/*
+ * Create a writable buffer backed by an empty memory-mapped file.
+ */
+START_TEST(test_create_mmap_empty) {
+  remove(FILE_MMAP);
+  pb_buffer_t buffer = pb_buffer_create_mmap(FILE_MMAP, PB_BUFFER_WRITE);
+
+  /* Assert buffer validity and error */
+  fail_unless(pb_buffer_valid(&buffer));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_buffer_error(&buffer));
+
+  /* Assert empty buffer */
+  fail_unless(pb_buffer_empty(&buffer));
+  ck_assert_ptr_eq(NULL, pb_buffer_data(&buffer));
+
+  /* Grow buffer and write to it */
+  uint8_t *space = pb_buffer_grow(&buffer, 9);
+  ck_assert_ptr_ne(NULL, space);
+  memcpy(space, "SOME DATA", 9);
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&buffer);
+
+  /* Assert file was created */
+  uint8_t file[16];
+  ck_assert_uint_eq(9, file_read(file, sizeof(file)));
+  fail_if(memcmp("SOME DATA", file, 9));
+  remove(FILE_MMAP);
+} END_TEST
+
+/*
+ * Create a buffer backed by a file that doesn't exist.
+ */
+START_TEST(test_create_mmap_invalid) {
+  remove(FILE_MMAP);
+  pb_buffer_t buffer = pb_buffer_create_mmap(FILE_MMAP, PB_BUFFER_READ);
+
+  /* Assert buffer validity and error */
+  fail_if(pb_buffer_valid(&buffer));
+  ck_assert_uint_eq(PB_ERROR_ALLOC, pb_buffer_error(&buffer));
+  ck_assert_uint_eq(PB_ERROR_INVALID, pb_buffer_sync(&buffer));
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
+/*
+ * Create a buffer backed by a shared memory object and map it again.
+ */
+START_TEST(test_create_shm) {
+  const uint8_t data[] = "SOME DATA";
+  const size_t  size   = 9;
+
+  /* Create buffer in write mode */
+  pb_buffer_t buffer = pb_buffer_create_shm(SHM_NAME, PB_BUFFER_WRITE);
+  fail_unless(pb_buffer_valid(&buffer));
+  fail_unless(pb_buffer_empty(&buffer));
+
+  /* Grow buffer and write to it */
+  uint8_t *space = pb_buffer_grow(&buffer, size);
+  ck_assert_ptr_ne(NULL, space);
+  memcpy(space, data, size);
+
+  /* Map shared memory object again in read mode */
+  pb_buffer_t shared = pb_buffer_create_shm(SHM_NAME, PB_BUFFER_READ);
+  fail_unless(pb_buffer_valid(&shared));
+  ck_assert_uint_eq(size, pb_buffer_size(&shared));
+  fail_if(memcmp(data, pb_buffer_data(&shared), size));
+
+  /* Assert that the read mapping cannot grow */
+  ck_assert_ptr_eq(NULL, pb_buffer_grow(&shared, 1));
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&shared);
+  pb_buffer_destroy(&buffer);
+  shm_unlink(SHM_NAME);
+} END_TEST
+
+/*
+ * Create a buffer backed by a shared memory object that does not exist.
+ */
+START_TEST(test_create_shm_invalid) {
+  pb_buffer_t buffer = pb_buffer_create_shm(SHM_NAME, PB_BUFFER_READ);
+
+  /* Assert buffer validity and error */
+  fail_if(pb_buffer_valid(&buffer));
+  ck_assert_uint_eq(PB_ERROR_ALLOC, pb_buffer_error(&buffer));
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
 /*
  * Create an invalid buffer.
  */
@@ -195,6 +424,78 @@ START_TEST(test_create_invalid_allocate) {
   pb_buffer_destroy(&buffer);
 } END_TEST
 
+/*
+ * Reset a buffer, retaining its capacity.
+ */
+START_TEST(test_reset) {
+  const uint8_t data[] = "SOME DATA";
+  const size_t  size   = 9;
+
+  /* Create buffer */
+  pb_buffer_t buffer = pb_buffer_create(data, size);
+  const uint8_t *location = pb_buffer_data(&buffer);
+
+  /* Reset buffer and assert retained capacity */
+  pb_buffer_reset(&buffer);
+  fail_unless(pb_buffer_empty(&buffer));
+  ck_assert_uint_eq(size, pb_buffer_capacity(&buffer));
+
+  /* Grow buffer within capacity and assert same location */
+  ck_assert_ptr_eq(location, pb_buffer_grow(&buffer, 4));
+  ck_assert_ptr_eq(location + 4, pb_buffer_grow(&buffer, 5));
+  ck_assert_uint_eq(size, pb_buffer_size(&buffer));
+
+  /* Grow buffer beyond capacity */
+  ck_assert_ptr_ne(NULL, pb_buffer_grow(&buffer, 1));
+  ck_assert_uint_eq(size + 1, pb_buffer_capacity(&buffer));
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
+/*
+ * Reset a writable buffer backed by a memory-mapped file.
+ */
+START_TEST(test_reset_mmap) {
+  const uint8_t data[] = "SOME DATA";
+  const size_t  size   = 9;
+
+  /* Create buffer and reset it */
+  file_write(data, size);
+  pb_buffer_t buffer = pb_buffer_create_mmap(FILE_MMAP, PB_BUFFER_WRITE);
+  pb_buffer_reset(&buffer);
+
+  /* Assert empty buffer and truncated file */
+  fail_unless(pb_buffer_empty(&buffer));
+  uint8_t file[16];
+  ck_assert_uint_eq(0, file_read(file, sizeof(file)));
+
+  /* Grow buffer and assert file grows */
+  ck_assert_ptr_ne(NULL, pb_buffer_grow(&buffer, 4));
+  ck_assert_uint_eq(4, file_read(file, sizeof(file)));
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&buffer);
+  remove(FILE_MMAP);
+} END_TEST
+
+/*
+ * Flush the changes of a buffer that is not backed by a file.
+ */
+START_TEST(test_sync) {
+  const uint8_t data[] = "SOME DATA";
+  const size_t  size   = 9;
+
+  /* Create buffer */
+  pb_buffer_t buffer = pb_buffer_create(data, size);
+
+  /* Assert nothing to flush */
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_buffer_sync(&buffer));
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
 /*
  * Grow a buffer and return a pointer to the newly allocated space.
  */
@@ -243,6 +544,66 @@ START_TEST(test_grow_empty) {
   pb_buffer_destroy(&buffer);
 } END_TEST
 
+/*
+ * Grow a buffer backed by inline storage beyond its capacity.
+ */
+START_TEST(test_grow_inline) {
+  uint8_t block[16];
+
+  /* Create buffer */
+  pb_buffer_t buffer = pb_buffer_create_inline(block, sizeof(block));
+
+  /* Grow buffer within inline storage */
+  uint8_t *new_data = pb_buffer_grow(&buffer, 9);
+  ck_assert_ptr_eq(block, new_data);
+  memcpy(new_data, "SOME DATA", 9);
+  ck_assert_ptr_eq(block + 9, pb_buffer_grow(&buffer, 7));
+
+  /* Grow buffer beyond inline storage and assert moved data */
+  new_data = pb_buffer_grow(&buffer, 1);
+  ck_assert_ptr_ne(NULL, new_data);
+  ck_assert_ptr_ne(block, pb_buffer_data(&buffer));
+  fail_if(memcmp("SOME DATA", pb_buffer_data(&buffer), 9));
+
+  /* Assert buffer size and capacity */
+  ck_assert_uint_eq(17, pb_buffer_size(&buffer));
+  ck_assert_uint_eq(17, pb_buffer_capacity(&buffer));
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
+/*
+ * Grow a buffer backed by inline storage for which allocation fails.
+ */
+START_TEST(test_grow_inline_invalid_allocate) {
+  uint8_t block[16];
+
+  /* Patch allocator */
+  pb_allocator_t allocator = {
+    .proc = {
+      .allocate = allocator_allocate_fail,
+      .resize   = allocator_default.proc.resize,
+      .free     = allocator_default.proc.free
+    }
+  };
+
+  /* Create buffer and fill inline storage */
+  pb_buffer_t buffer =
+    pb_buffer_create_inline_with_allocator(&allocator, block, sizeof(block));
+  ck_assert_ptr_eq(block, pb_buffer_grow(&buffer, 16));
+
+  /* Grow buffer beyond inline storage */
+  ck_assert_ptr_eq(NULL, pb_buffer_grow(&buffer, 1));
+
+  /* Assert unaltered buffer */
+  ck_assert_ptr_eq(block, pb_buffer_data(&buffer));
+  ck_assert_uint_eq(16, pb_buffer_size(&buffer));
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
 /*
  * Grow a zero-copy buffer and expect a NULL pointer.
  */
@@ -363,6 +724,46 @@ START_TEST(test_grow_invalid_resize) {
   pb_buffer_destroy(&buffer);
 } END_TEST
 
+/*
+ * Reserve capacity for additional data and grow a buffer within it.
+ */
+START_TEST(test_reserve) {
+  pb_buffer_t buffer = pb_buffer_create_empty();
+
+  /* Reserve capacity and assert buffer size */
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_buffer_reserve(&buffer, 16));
+  ck_assert_uint_eq(16, pb_buffer_capacity(&buffer));
+  fail_unless(pb_buffer_empty(&buffer));
+
+  /* Grow buffer within reserved capacity */
+  ck_assert_ptr_ne(NULL, pb_buffer_grow(&buffer, 16));
+  ck_assert_uint_eq(16, pb_buffer_capacity(&buffer));
+
+  /* Reserve capacity beyond and assert doubling */
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_buffer_reserve(&buffer, 1));
+  ck_assert_uint_eq(32, pb_buffer_capacity(&buffer));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_buffer_reserve(&buffer, 64));
+  ck_assert_uint_eq(80, pb_buffer_capacity(&buffer));
+  ck_assert_uint_eq(16, pb_buffer_size(&buffer));
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
+/*
+ * Reserve capacity for an invalid buffer.
+ */
+START_TEST(test_reserve_invalid) {
+  pb_buffer_t buffer = pb_buffer_create_invalid();
+
+  /* Assert buffer validity and error */
+  fail_if(pb_buffer_valid(&buffer));
+  ck_assert_uint_eq(PB_ERROR_INVALID, pb_buffer_reserve(&buffer, 16));
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
 /*
  * Retrieve the raw data of a buffer.
  */
@@ -447,21 +848,47 @@ main(void) {
   tcase = tcase_create("create");
   tcase_add_test(tcase, test_create);
   tcase_add_test(tcase, test_create_empty);
+  tcase_add_test(tcase, test_create_inline);
   tcase_add_test(tcase, test_create_zero_copy);
+  tcase_add_test(tcase, test_create_mmap);
+  tcase_add_test(tcase, test_create_mmap_write);
+  tcase_add_test(tcase, test_create_mmap_empty);
+  tcase_add_test(tcase, test_create_mmap_invalid);
+  tcase_add_test(tcase, test_create_shm);
+  tcase_add_test(tcase, test_create_shm_invalid);
   tcase_add_test(tcase, test_create_invalid);
   tcase_add_test(tcase, test_create_invalid_allocate);
   suite_add_tcase(suite, tcase);
 
+  /* Add tests to test case "reset" */
+  tcase = tcase_create("reset");
+  tcase_add_test(tcase, test_reset);
+  tcase_add_test(tcase, test_reset_mmap);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "sync" */
+  tcase = tcase_create("sync");
+  tcase_add_test(tcase, test_sync);
+  suite_add_tcase(suite, tcase);
+
   /* Add tests to test case "grow" */
   tcase = tcase_create("grow");
   tcase_add_test(tcase, test_grow);
   tcase_add_test(tcase, test_grow_empty);
+  tcase_add_test(tcase, test_grow_inline);
+  tcase_add_test(tcase, test_grow_inline_invalid_allocate);
   tcase_add_test(tcase, test_grow_zero_copy);
   tcase_add_test(tcase, test_grow_invalid);
   tcase_add_test(tcase, test_grow_invalid_allocate);
   tcase_add_test(tcase, test_grow_invalid_resize);
   suite_add_tcase(suite, tcase);
 
+  /* Add tests to test case "reserve" */
+  tcase = tcase_create("reserve");
+  tcase_add_test(tcase, test_reserve);
+  tcase_add_test(tcase, test_reserve_invalid);
+  suite_add_tcase(suite, tcase);
+
   /* Add tests to test case "data" */
   tcase = tcase_create("data");
   tcase_add_test(tcase, test_data);
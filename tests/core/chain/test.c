@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "core/buffer.h"
+#include "core/chain.h"
+#include "core/common.h"
+
+/* ----------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a chain of buffers.
+ */
+START_TEST(test_create) {
+  uint8_t data[] = { 8, 127, 16, 127, 24, 127 };
+
+  /* Create segments and chain */
+  pb_buffer_t segments[] = {
+    pb_buffer_create_zero_copy(data, 2),
+    pb_buffer_create_zero_copy(data + 2, 4)
+  };
+  pb_chain_t chain = pb_chain_create(segments, 2);
+
+  /* Assert chain validity and error */
+  fail_unless(pb_chain_valid(&chain));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_chain_error(&chain));
+
+  /* Assert chain segments, size and length */
+  ck_assert_uint_eq(2, pb_chain_size(&chain));
+  ck_assert_uint_eq(6, pb_chain_length(&chain));
+  fail_unless(pb_chain_segment(&chain, 1) == &(segments[1]));
+
+  /* Free all allocated memory */
+  pb_chain_destroy(&chain);
+  pb_buffer_destroy(&(segments[0]));
+  pb_buffer_destroy(&(segments[1]));
+} END_TEST
+
+/*
+ * Create an empty chain of buffers.
+ */
+START_TEST(test_create_empty) {
+  pb_chain_t chain = pb_chain_create(NULL, 0);
+
+  /* Assert chain validity and error */
+  fail_unless(pb_chain_valid(&chain));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_chain_error(&chain));
+
+  /* Assert chain size and length */
+  ck_assert_uint_eq(0, pb_chain_size(&chain));
+  ck_assert_uint_eq(0, pb_chain_length(&chain));
+
+  /* Free all allocated memory */
+  pb_chain_destroy(&chain);
+} END_TEST
+
+/*
+ * Create a chain of buffers with an invalid segment.
+ */
+START_TEST(test_create_invalid) {
+  uint8_t data[] = { 8, 127 };
+
+  /* Create segments and chain */
+  pb_buffer_t segments[] = {
+    pb_buffer_create_zero_copy(data, 2),
+    pb_buffer_create_invalid()
+  };
+  pb_chain_t chain = pb_chain_create(segments, 2);
+
+  /* Assert chain validity and error */
+  fail_if(pb_chain_valid(&chain));
+  ck_assert_uint_eq(PB_ERROR_ALLOC, pb_chain_error(&chain));
+
+  /* Free all allocated memory */
+  pb_chain_destroy(&chain);
+  pb_buffer_destroy(&(segments[0]));
+  pb_buffer_destroy(&(segments[1]));
+} END_TEST
+
+/* ----------------------------------------------------------------------------
+ * Program
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a test suite for all registered test cases and run it.
+ *
+ * Tests must be run sequentially (in no-fork mode) or code coverage
+ * cannot be determined properly.
+ */
+int
+main(void) {
+  void *suite = suite_create("protobluff/core/chain"),
+       *tcase = NULL;
+
+  /* Add tests to test case "create" */
+  tcase = tcase_create("create");
+  tcase_add_test(tcase, test_create);
+  tcase_add_test(tcase, test_create_empty);
+  tcase_add_test(tcase, test_create_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Create a test suite runner in no-fork mode */
+  void *runner = srunner_create(suite);
+  srunner_set_fork_status(runner, CK_NOFORK);
+
+  /* Execute test suite runner */
+  srunner_run_all(runner, CK_NORMAL);
+  int failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+
+  /* Exit with status code */
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -29,6 +29,7 @@
 #include <protobluff/descriptor.h>
 
 #include "core/buffer.h"
+#include "core/chain.h"
 #include "core/common.h"
 #include "core/decoder.h"
 #include "core/descriptor.h"
@@ -53,6 +54,27 @@ handler(
   return PB_ERROR_NONE;
 }
 
+/*!
+ * Field handler that asserts that strings are read from the given buffer.
+ *
+ * \param[in]     descriptor Field descriptor
+ * \param[in]     value      Pointer holding value
+ * \param[in,out] user       User data
+ */
+static pb_error_t
+handler_zero_copy(
+    const pb_field_descriptor_t *descriptor, const void *value, void *user) {
+  assert(descriptor && value && user);
+  const pb_buffer_t *buffer = user;
+  if (pb_field_descriptor_type(descriptor) == PB_TYPE_STRING) {
+    const uint8_t *data = pb_string_data(value);
+    fail_unless(data >= pb_buffer_data(buffer) &&
+      data + pb_string_size(value) <=
+        pb_buffer_data(buffer) + pb_buffer_size(buffer));
+  }
+  return PB_ERROR_NONE;
+}
+
 /* ----------------------------------------------------------------------------
  * Descriptors
  * ------------------------------------------------------------------------- */
@@ -358,6 +380,124 @@ START_TEST(test_decode_invalid_packed) {
   pb_buffer_destroy(&buffer);
 } END_TEST
 
+/*
+ * Decode a chain of buffers using a handler.
+ */
+START_TEST(test_decode_chain) {
+  const uint8_t data[] = {
+    98, 2, 8, 127, 8, 172, 2, 66, 3, 97, 98, 99, 50, 4, 0, 0, 128, 63 };
+
+  /* Create segments and chain */
+  pb_buffer_t segments[] = {
+    pb_buffer_create_zero_copy((uint8_t *)data, 1),
+    pb_buffer_create_zero_copy((uint8_t *)data + 1, 5),
+    pb_buffer_create_empty(),
+    pb_buffer_create_zero_copy((uint8_t *)data + 6, 6),
+    pb_buffer_create_zero_copy((uint8_t *)data + 12, 6)
+  };
+  pb_chain_t chain = pb_chain_create(segments, 5);
+
+  /* Decode using the handler */
+  pb_tag_t tags[12] = {};
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_decoder_decode_chain(&descriptor, &chain, handler, tags));
+
+  /* Assert expected occurences, including entering and leaving F12 */
+  ck_assert_uint_eq(2, tags[0]);
+  ck_assert_uint_eq(1, tags[5]);
+  ck_assert_uint_eq(1, tags[7]);
+  ck_assert_uint_eq(2, tags[11]);
+
+  /* Free all allocated memory */
+  pb_chain_destroy(&chain);
+  for (size_t s = 0; s < 5; s++)
+    pb_buffer_destroy(&(segments[s]));
+} END_TEST
+
+/*
+ * Decode a chain of buffers with a nested message spanning segments.
+ */
+START_TEST(test_decode_chain_message) {
+  const uint8_t data[] = {
+    98, 17, 66, 3, 97, 98, 99, 66, 4, 100, 101, 102, 103, 8, 127,
+    66, 2, 104, 105 };
+
+  /* Create segments and chain */
+  pb_buffer_t segments[] = {
+    pb_buffer_create_zero_copy((uint8_t *)data, 7),
+    pb_buffer_create_zero_copy((uint8_t *)data + 7, 6),
+    pb_buffer_create_zero_copy((uint8_t *)data + 13, 2),
+    pb_buffer_create_zero_copy((uint8_t *)data + 15, 4)
+  };
+  pb_chain_t chain = pb_chain_create(segments, 4);
+
+  /* Decode using the handler */
+  pb_tag_t tags[12] = {};
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_decoder_decode_chain(&descriptor, &chain, handler, tags));
+
+  /* Assert expected occurences */
+  ck_assert_uint_eq(1, tags[0]);
+  ck_assert_uint_eq(3, tags[7]);
+  ck_assert_uint_eq(2, tags[11]);
+
+  /* Assert strings are read from the segments without copying */
+  pb_buffer_t buffer = pb_buffer_create_zero_copy(
+    (uint8_t *)data, sizeof(data));
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_decoder_decode_chain(&descriptor, &chain, handler_zero_copy, &buffer));
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&buffer);
+  pb_chain_destroy(&chain);
+  for (size_t s = 0; s < 4; s++)
+    pb_buffer_destroy(&(segments[s]));
+} END_TEST
+
+/*
+ * Decode a truncated chain of buffers using a handler.
+ */
+START_TEST(test_decode_chain_truncated) {
+  const uint8_t data[] = { 8, 127, 66, 3, 97, 98 };
+
+  /* Create segments and chain */
+  pb_buffer_t segments[] = {
+    pb_buffer_create_zero_copy((uint8_t *)data, 3),
+    pb_buffer_create_zero_copy((uint8_t *)data + 3, 3)
+  };
+  pb_chain_t chain = pb_chain_create(segments, 2);
+
+  /* Decode using the handler */
+  pb_tag_t tags[12] = {};
+  ck_assert_uint_eq(PB_ERROR_OFFSET,
+    pb_decoder_decode_chain(&descriptor, &chain, handler, tags));
+
+  /* Assert expected occurences */
+  ck_assert_uint_eq(1, tags[0]);
+  ck_assert_uint_eq(0, tags[7]);
+
+  /* Free all allocated memory */
+  pb_chain_destroy(&chain);
+  for (size_t s = 0; s < 2; s++)
+    pb_buffer_destroy(&(segments[s]));
+} END_TEST
+
+/*
+ * Decode an invalid chain of buffers using a handler.
+ */
+START_TEST(test_decode_chain_invalid) {
+  pb_buffer_t buffer = pb_buffer_create_invalid();
+  pb_chain_t  chain  = pb_chain_create(&buffer, 1);
+
+  /* Decode using the handler */
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_decoder_decode_chain(&descriptor, &chain, handler, NULL));
+
+  /* Free all allocated memory */
+  pb_chain_destroy(&chain);
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
 /* ----------------------------------------------------------------------------
  * Program
  * ------------------------------------------------------------------------- */
@@ -392,6 +532,14 @@ main(void) {
   tcase_add_test(tcase, test_decode_invalid_packed);
   suite_add_tcase(suite, tcase);
 
+  /* Add tests to test case "decode_chain" */
+  tcase = tcase_create("decode_chain");
+  tcase_add_test(tcase, test_decode_chain);
+  tcase_add_test(tcase, test_decode_chain_message);
+  tcase_add_test(tcase, test_decode_chain_truncated);
+  tcase_add_test(tcase, test_decode_chain_invalid);
+  suite_add_tcase(suite, tcase);
+
   /* Create a test suite runner in no-fork mode */
   void *runner = srunner_create(suite);
   srunner_set_fork_status(runner, CK_NOFORK);
@@ -133,6 +133,39 @@ START_TEST(test_create) {
   pb_encoder_destroy(&encoder);
 } END_TEST
 
+/*
+ * Create an encoder backed by inline storage.
+ */
+START_TEST(test_create_inline) {
+  uint8_t block[16];
+
+  /* Create encoder backed by inline storage */
+  pb_encoder_t encoder =
+    pb_encoder_create_inline(&descriptor, block, sizeof(block));
+  const pb_buffer_t *buffer = pb_encoder_buffer(&encoder);
+
+  /* Assert encoder validity and error */
+  fail_unless(pb_encoder_valid(&encoder));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_encoder_error(&encoder));
+
+  /* Encode value into inline storage */
+  pb_string_t value = pb_string_init_from_chars("SOME DATA");
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_encoder_encode(&encoder, 8, &value, 1));
+  ck_assert_uint_eq(11, pb_buffer_size(buffer));
+  ck_assert_ptr_eq(block, pb_buffer_data(buffer));
+
+  /* Encode value beyond inline storage and assert moved data */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_encoder_encode(&encoder, 8, &value, 1));
+  ck_assert_uint_eq(22, pb_buffer_size(buffer));
+  ck_assert_ptr_ne(block, pb_buffer_data(buffer));
+  fail_if(memcmp(pb_buffer_data(buffer), pb_buffer_data(buffer) + 11, 11));
+
+  /* Free all allocated memory */
+  pb_encoder_destroy(&encoder);
+} END_TEST
+
 /*
  * Create an invalid encoder.
  */
@@ -805,6 +838,34 @@ START_TEST(test_encode_32bit_invalid_resize) {
   pb_encoder_destroy(&encoder);
 } END_TEST
 
+/*
+ * Reset an encoder, retaining the capacity of its buffer.
+ */
+START_TEST(test_reset) {
+  pb_encoder_t encoder = pb_encoder_create(&descriptor);
+  const pb_buffer_t *buffer = pb_encoder_buffer(&encoder);
+
+  /* Encode a value */
+  pb_string_t value = pb_string_init_from_chars("SOME DATA");
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_encoder_encode(&encoder, 8, &value, 1));
+  const uint8_t *data = pb_buffer_data(buffer);
+
+  /* Reset encoder and assert retained capacity */
+  pb_encoder_reset(&encoder);
+  fail_unless(pb_buffer_empty(buffer));
+  ck_assert_uint_eq(11, pb_buffer_capacity(buffer));
+
+  /* Encode value again and assert same location */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_encoder_encode(&encoder, 8, &value, 1));
+  ck_assert_uint_eq(11, pb_buffer_size(buffer));
+  ck_assert_ptr_eq(data, pb_buffer_data(buffer));
+
+  /* Free all allocated memory */
+  pb_encoder_destroy(&encoder);
+} END_TEST
+
 /* ----------------------------------------------------------------------------
  * Program
  * ------------------------------------------------------------------------- */
@@ -823,6 +884,7 @@ main(void) {
   /* Add tests to test case "create" */
   tcase = tcase_create("create");
   tcase_add_test(tcase, test_create);
+  tcase_add_test(tcase, test_create_inline);
   tcase_add_test(tcase, test_create_invalid);
   tcase_add_test(tcase, test_create_invalid_allocate);
   suite_add_tcase(suite, tcase);
@@ -854,6 +916,11 @@ main(void) {
   tcase_add_test(tcase, test_encode_32bit_invalid_resize);
   suite_add_tcase(suite, tcase);
 
+  /* Add tests to test case "reset" */
+  tcase = tcase_create("reset");
+  tcase_add_test(tcase, test_reset);
+  suite_add_tcase(suite, tcase);
+
   /* Create a test suite runner in no-fork mode */
   void *runner = srunner_create(suite);
   srunner_set_fork_status(runner, CK_NOFORK);
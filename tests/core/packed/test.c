@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/common.h"
+#include "core/packed.h"
+
+/* ----------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Find an unsigned fixed-size 32-bit value.
+ */
+START_TEST(test_find_fixed32) {
+  uint32_t data[37];
+  for (size_t v = 0; v < 37; ++v)
+    data[v] = v * 1000;
+
+  /* Find all values, including those after the last full block */
+  size_t offset, skip;
+  for (size_t v = 0; v < 37; ++v) {
+    uint32_t value = v * 1000;
+    fail_unless(pb_packed_find(PB_TYPE_FIXED32, (const uint8_t *)data,
+      sizeof(data), &value, &value, &offset, &skip));
+    ck_assert_uint_eq(v * 4, offset);
+    ck_assert_uint_eq(v, skip);
+  }
+
+  /* Find absent value */
+  uint32_t value = 1;
+  fail_if(pb_packed_find(PB_TYPE_FIXED32, (const uint8_t *)data,
+    sizeof(data), &value, &value, &offset, &skip));
+  ck_assert_uint_eq(sizeof(data), offset);
+  ck_assert_uint_eq(37, skip);
+} END_TEST
+
+/*
+ * Find an unsigned fixed-size 32-bit value within a range.
+ */
+START_TEST(test_find_fixed32_range) {
+  uint32_t data[] = { 1, 2, 3, 4, 5, 6, 7, 0x80000000, 9 };
+
+  /* Find value within range */
+  size_t offset, skip;
+  uint32_t min = 6, max = 0x80000000;
+  fail_unless(pb_packed_find(PB_TYPE_FIXED32, (const uint8_t *)data,
+    sizeof(data), &min, &max, &offset, &skip));
+  ck_assert_uint_eq(5, skip);
+
+  /* Find value within range of large unsigned values */
+  min = 0x7FFFFFFF;
+  fail_unless(pb_packed_find(PB_TYPE_FIXED32, (const uint8_t *)data,
+    sizeof(data), &min, &max, &offset, &skip));
+  ck_assert_uint_eq(28, offset);
+  ck_assert_uint_eq(7, skip);
+
+  /* Find value within empty range */
+  min = 10, max = 9;
+  fail_if(pb_packed_find(PB_TYPE_FIXED32, (const uint8_t *)data,
+    sizeof(data), &min, &max, &offset, &skip));
+  ck_assert_uint_eq(9, skip);
+} END_TEST
+
+/*
+ * Find a signed fixed-size 32-bit value within a range.
+ */
+START_TEST(test_find_sfixed32_range) {
+  int32_t data[] = { 5, 4, 3, 2, 1, 0, -1, -2, -3 };
+
+  /* Find negative value within range */
+  size_t offset, skip;
+  int32_t min = -10, max = -1;
+  fail_unless(pb_packed_find(PB_TYPE_SFIXED32, (const uint8_t *)data,
+    sizeof(data), &min, &max, &offset, &skip));
+  ck_assert_uint_eq(24, offset);
+  ck_assert_uint_eq(6, skip);
+} END_TEST
+
+/*
+ * Find a float within a range.
+ */
+START_TEST(test_find_float_range) {
+  float data[] = { 1.5, -2.5, 100.0, -0.5, 0.25, 3.0, -100.0 };
+
+  /* Find negative value within range */
+  size_t offset, skip;
+  float min = -1.0, max = 0.0;
+  fail_unless(pb_packed_find(PB_TYPE_FLOAT, (const uint8_t *)data,
+    sizeof(data), &min, &max, &offset, &skip));
+  ck_assert_uint_eq(3, skip);
+
+  /* Find value within range after the last full block */
+  min = -1000.0, max = -50.0;
+  fail_unless(pb_packed_find(PB_TYPE_FLOAT, (const uint8_t *)data,
+    sizeof(data), &min, &max, &offset, &skip));
+  ck_assert_uint_eq(6, skip);
+} END_TEST
+
+/*
+ * Find a fixed-size 64-bit value.
+ */
+START_TEST(test_find_fixed64) {
+  uint64_t data[] = { 1, 2, 3, 0x100000001ULL, 1ULL << 32, 6, 7 };
+
+  /* Find value only matching in both halves */
+  size_t offset, skip;
+  uint64_t value = 1ULL << 32;
+  fail_unless(pb_packed_find(PB_TYPE_FIXED64, (const uint8_t *)data,
+    sizeof(data), &value, &value, &offset, &skip));
+  ck_assert_uint_eq(32, offset);
+  ck_assert_uint_eq(4, skip);
+
+  /* Find value after the last full block */
+  value = 7;
+  fail_unless(pb_packed_find(PB_TYPE_FIXED64, (const uint8_t *)data,
+    sizeof(data), &value, &value, &offset, &skip));
+  ck_assert_uint_eq(6, skip);
+
+  /* Find absent value */
+  value = 8;
+  fail_if(pb_packed_find(PB_TYPE_FIXED64, (const uint8_t *)data,
+    sizeof(data), &value, &value, &offset, &skip));
+  ck_assert_uint_eq(7, skip);
+} END_TEST
+
+/*
+ * Find a double within a range.
+ */
+START_TEST(test_find_double_range) {
+  double data[100];
+  for (size_t v = 0; v < 100; ++v)
+    data[v] = 50.0 - v;
+
+  /* Find negative value within range */
+  size_t offset, skip;
+  double min = -30.5, max = -29.5;
+  fail_unless(pb_packed_find(PB_TYPE_DOUBLE, (const uint8_t *)data,
+    sizeof(data), &min, &max, &offset, &skip));
+  ck_assert_uint_eq(80 * 8, offset);
+  ck_assert_uint_eq(80, skip);
+} END_TEST
+
+/*
+ * Find a variable-sized integer.
+ */
+START_TEST(test_find_varint) {
+  uint8_t data[200];
+  for (size_t v = 0; v < 100; ++v) {
+    data[v * 2]     = 0x80 | (v & 0x7F);
+    data[v * 2 + 1] = 1;
+  }
+
+  /* Find value in second block */
+  size_t offset, skip;
+  uint32_t value = 128 + 90;
+  fail_unless(pb_packed_find(PB_TYPE_UINT32, data, 200,
+    &value, &value, &offset, &skip));
+  ck_assert_uint_eq(180, offset);
+  ck_assert_uint_eq(90, skip);
+
+  /* Find absent value */
+  value = 1;
+  fail_if(pb_packed_find(PB_TYPE_UINT32, data, 200,
+    &value, &value, &offset, &skip));
+  ck_assert_uint_eq(200, offset);
+  ck_assert_uint_eq(100, skip);
+} END_TEST
+
+/*
+ * Find a signed variable-sized integer within a range.
+ */
+START_TEST(test_find_varint_range) {
+  const uint8_t data[] = { 1, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                0xFF, 0xFF, 0xFF, 0xFF, 0x01, 2 };
+
+  /* Find negative value within range */
+  size_t offset, skip;
+  int32_t min = -5, max = 0;
+  fail_unless(pb_packed_find(PB_TYPE_INT32, data, 12,
+    &min, &max, &offset, &skip));
+  ck_assert_uint_eq(1, offset);
+  ck_assert_uint_eq(1, skip);
+} END_TEST
+
+/*
+ * Find a zig-zag encoded variable-sized integer within a range.
+ */
+START_TEST(test_find_varint_zigzag_range) {
+  const uint8_t data[] = { 2, 4, 3, 5 };
+
+  /* Find negative value within range */
+  size_t offset, skip;
+  int64_t min = -3, max = -1;
+  fail_unless(pb_packed_find(PB_TYPE_SINT64, data, 4,
+    &min, &max, &offset, &skip));
+  ck_assert_uint_eq(2, offset);
+  ck_assert_uint_eq(2, skip);
+} END_TEST
+
+/*
+ * Find a variable-sized integer in an invalid buffer.
+ */
+START_TEST(test_find_varint_invalid) {
+  const uint8_t data[] = { 1, 2, 0x83, 0x84 };
+
+  /* Find absent value */
+  size_t offset, skip;
+  uint32_t value = 4;
+  fail_if(pb_packed_find(PB_TYPE_UINT32, data, 4,
+    &value, &value, &offset, &skip));
+  ck_assert_uint_eq(2, offset);
+  ck_assert_uint_eq(2, skip);
+} END_TEST
+
+/* ----------------------------------------------------------------------------
+ * Program
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a test suite for all registered test cases and run it.
+ *
+ * Tests must be run sequentially (in no-fork mode) or code coverage
+ * cannot be determined properly.
+ */
+int
+main(void) {
+  void *suite = suite_create("protobluff/core/packed"),
+       *tcase = NULL;
+
+  /* Add tests to test case "find" */
+  tcase = tcase_create("find");
+  tcase_add_test(tcase, test_find_fixed32);
+  tcase_add_test(tcase, test_find_fixed32_range);
+  tcase_add_test(tcase, test_find_sfixed32_range);
+  tcase_add_test(tcase, test_find_float_range);
+  tcase_add_test(tcase, test_find_fixed64);
+  tcase_add_test(tcase, test_find_double_range);
+  tcase_add_test(tcase, test_find_varint);
+  tcase_add_test(tcase, test_find_varint_range);
+  tcase_add_test(tcase, test_find_varint_zigzag_range);
+  tcase_add_test(tcase, test_find_varint_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Create a test suite runner in no-fork mode */
+  void *runner = srunner_create(suite);
+  srunner_set_fork_status(runner, CK_NOFORK);
+
+  /* Execute test suite runner */
+  srunner_run_all(runner, CK_NORMAL);
+  int failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+
+  /* Exit with status code */
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
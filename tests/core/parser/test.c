@@ -0,0 +1,635 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <assert.h>
+#include <check.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <protobluff/descriptor.h>
+
+#include "core/buffer.h"
+#include "core/common.h"
+#include "core/decoder.h"
+#include "core/descriptor.h"
+#include "core/parser.h"
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+/* Trace of handler invocations */
+typedef struct trace_t {
+  uint8_t data[256];                   /*!< Tags and raw values */
+  size_t size;                         /*!< Size */
+} trace_t;
+
+/* ----------------------------------------------------------------------------
+ * Decoder callback
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Field handler that traces tags and values.
+ *
+ * \param[in]     descriptor Field descriptor
+ * \param[in]     value      Pointer holding value
+ * \param[in,out] user       User data
+ */
+static pb_error_t
+handler(
+    const pb_field_descriptor_t *descriptor, const void *value, void *user) {
+  assert(descriptor && value && user);
+  trace_t *trace = user;
+  trace->data[trace->size++] = pb_field_descriptor_tag(descriptor);
+
+  /* Extract raw value according to type */
+  const uint8_t *data; size_t size;
+  uint8_t event;
+  switch (pb_field_descriptor_type(descriptor)) {
+    case PB_TYPE_MESSAGE:
+      event = *(const pb_parser_event_t *)value;
+      data  = &event;
+      size  = 1;
+      break;
+    case PB_TYPE_STRING:
+    case PB_TYPE_BYTES:
+      data = pb_string_data(value);
+      size = pb_string_size(value);
+      break;
+    default:
+      data = value;
+      size = pb_field_descriptor_type_size(descriptor);
+      break;
+  }
+
+  /* Append size and raw value to trace */
+  assert(trace->size + 1 + size <= sizeof(trace->data));
+  trace->data[trace->size++] = size;
+  if (size)
+    memcpy(&(trace->data[trace->size]), data, size);
+  trace->size += size;
+  return PB_ERROR_NONE;
+}
+
+/*!
+ * Field handler that ignores all values.
+ *
+ * \param[in]     descriptor Field descriptor
+ * \param[in]     value      Pointer holding value
+ * \param[in,out] user       User data
+ */
+static pb_error_t
+handler_ignore(
+    const pb_field_descriptor_t *descriptor, const void *value, void *user) {
+  assert(descriptor && value);
+  return PB_ERROR_NONE;
+}
+
+/*!
+ * Field handler that traces nested messages like a parser, by decoding them
+ * recursively between the events of entering and leaving them.
+ *
+ * \param[in]     descriptor Field descriptor
+ * \param[in]     value      Pointer holding value
+ * \param[in,out] user       User data
+ */
+static pb_error_t
+handler_decoder(
+    const pb_field_descriptor_t *descriptor, const void *value, void *user) {
+  assert(descriptor && value && user);
+  if (pb_field_descriptor_type(descriptor) != PB_TYPE_MESSAGE)
+    return handler(descriptor, value, user);
+
+  /* Decode nested message between events */
+  pb_parser_event_t enter = PB_PARSER_EVENT_ENTER,
+                    leave = PB_PARSER_EVENT_LEAVE;
+  pb_error_t error = handler(descriptor, &enter, user);
+  if (!error && !(error = pb_decoder_decode(value, handler_decoder, user)))
+    error = handler(descriptor, &leave, user);
+  return error;
+}
+
+/* ----------------------------------------------------------------------------
+ * Descriptors
+ * ------------------------------------------------------------------------- */
+
+/* Enum descriptor */
+static pb_enum_descriptor_t
+enum_descriptor = { {
+  (const pb_enum_value_descriptor_t []){
+    {  0, "V00" },
+    {  1, "V01" },
+    {  2, "V02" }
+  }, 3 } };
+
+/* Descriptor */
+static pb_descriptor_t
+descriptor = { {
+  (const pb_field_descriptor_t []){
+    {  1, "F01", UINT32,  OPTIONAL },
+    {  2, "F02", UINT64,  OPTIONAL },
+    {  3, "F03", SINT32,  OPTIONAL },
+    {  4, "F04", SINT64,  OPTIONAL },
+    {  5, "F05", BOOL,    OPTIONAL },
+    {  6, "F06", FLOAT,   REPEATED, NULL, NULL, PACKED },
+    {  7, "F07", DOUBLE,  OPTIONAL },
+    {  8, "F08", STRING,  OPTIONAL },
+    {  9, "F09", BYTES,   OPTIONAL },
+    { 10, "F10", ENUM,    OPTIONAL, &enum_descriptor },
+    { 11, "F11", MESSAGE, OPTIONAL, &descriptor },
+    { 12, "F12", MESSAGE, REPEATED, &descriptor }
+  }, 12 } };
+
+/* ----------------------------------------------------------------------------
+ * Fixtures
+ * ------------------------------------------------------------------------- */
+
+/* Message with all wiretypes, packed, nested and unknown fields */
+static const uint8_t
+message[] = {
+  8, 172, 2,                           /* F01 */
+  16, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 1,             /* F02 */
+  32, 1,                               /* F04 */
+  57, 0, 0, 0, 0, 0, 0, 240, 63,       /* F07 */
+  66, 5, 104, 101, 108, 108, 111,      /* F08 */
+  66, 0,                               /* F08 */
+  50, 8, 0, 0, 128, 63, 0, 0, 0, 64,   /* F06 */
+  104, 1,                              /* Unknown varint */
+  114, 3, 1, 2, 3,                     /* Unknown length-prefixed */
+  125, 1, 2, 3, 4,                     /* Unknown 32-bit */
+  90, 4, 8, 127, 66, 0,                /* F11 */
+  80, 2                                /* F10 */
+};
+
+/* ----------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a parser.
+ */
+START_TEST(test_create) {
+  pb_parser_t parser = pb_parser_create(&descriptor);
+
+  /* Assert parser validity and error */
+  fail_unless(pb_parser_valid(&parser));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_parser_error(&parser));
+
+  /* Assert parser descriptor and state */
+  fail_unless(pb_parser_descriptor(&parser) == &descriptor);
+  fail_unless(pb_parser_done(&parser));
+
+  /* Free all allocated memory */
+  pb_parser_destroy(&parser);
+} END_TEST
+
+/*
+ * Feed a message in a single fragment.
+ */
+START_TEST(test_feed) {
+  pb_parser_t parser = pb_parser_create(&descriptor);
+
+  /* Assert parser validity and error */
+  fail_unless(pb_parser_valid(&parser));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_parser_error(&parser));
+
+  /* Feed message using the handler */
+  trace_t trace = {};
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_parser_feed(&parser, message, sizeof(message), handler, &trace));
+  fail_unless(pb_parser_done(&parser));
+
+  /* Decode message using the handler */
+  trace_t expect = {};
+  pb_buffer_t  buffer  = pb_buffer_create(message, sizeof(message));
+  pb_decoder_t decoder = pb_decoder_create(&descriptor, &buffer);
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_decoder_decode(&decoder, handler_decoder, &expect));
+
+  /* Assert same handler invocations */
+  ck_assert_uint_eq(expect.size, trace.size);
+  fail_if(memcmp(expect.data, trace.data, trace.size));
+
+  /* Free all allocated memory */
+  pb_decoder_destroy(&decoder);
+  pb_buffer_destroy(&buffer);
+  pb_parser_destroy(&parser);
+} END_TEST
+
+/*
+ * Feed a message in fragments of all possible sizes.
+ */
+START_TEST(test_feed_fragments) {
+  trace_t expect = {};
+  pb_buffer_t  buffer  = pb_buffer_create(message, sizeof(message));
+  pb_decoder_t decoder = pb_decoder_create(&descriptor, &buffer);
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_decoder_decode(&decoder, handler_decoder, &expect));
+
+  /* Feed message in fragments of given size */
+  for (size_t f = 1; f < sizeof(message); f++) {
+    pb_parser_t parser = pb_parser_create(&descriptor);
+    trace_t trace = {};
+    pb_error_t error = PB_ERROR_NONE;
+    for (size_t o = 0; o < sizeof(message); o += f) {
+      size_t size = o + f > sizeof(message) ? sizeof(message) - o : f;
+
+      /* Copy fragment, so values may not be referenced after feeding */
+      uint8_t *data = malloc(size);
+      memcpy(data, &(message[o]), size);
+      error = pb_parser_feed(&parser, data, size, handler, &trace);
+      free(data);
+      fail_unless(error == PB_ERROR_NONE || error == PB_ERROR_PARTIAL);
+    }
+    ck_assert_uint_eq(PB_ERROR_NONE, error);
+
+    /* Assert same handler invocations */
+    ck_assert_uint_eq(expect.size, trace.size);
+    fail_if(memcmp(expect.data, trace.data, trace.size));
+
+    /* Free all allocated memory */
+    pb_parser_destroy(&parser);
+  }
+
+  /* Free all allocated memory */
+  pb_decoder_destroy(&decoder);
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
+/*
+ * Feed a message with a nested message spanning fragments.
+ */
+START_TEST(test_feed_message) {
+  const uint8_t data[] = { 98, 2, 8, 127, 8, 127 };
+  const size_t  size   = 6;
+
+  /* Create parser */
+  pb_parser_t parser = pb_parser_create(&descriptor);
+
+  /* Feed message in two fragments */
+  trace_t trace = {};
+  ck_assert_uint_eq(PB_ERROR_PARTIAL,
+    pb_parser_feed(&parser, data, 3, handler, &trace));
+  fail_if(pb_parser_done(&parser));
+  ck_assert_uint_eq(1, pb_parser_depth(&parser));
+  ck_assert_uint_eq(3, trace.size);
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_parser_feed(&parser, &(data[3]), size - 3, handler, &trace));
+  fail_unless(pb_parser_done(&parser));
+
+  /* Assert handler invocations */
+  const uint8_t expect[] = {
+    12, 1, PB_PARSER_EVENT_ENTER, 1, 4, 127, 0, 0, 0,
+    12, 1, PB_PARSER_EVENT_LEAVE, 1, 4, 127, 0, 0, 0 };
+  ck_assert_uint_eq(sizeof(expect), trace.size);
+  fail_if(memcmp(expect, trace.data, trace.size));
+
+  /* Free all allocated memory */
+  pb_parser_destroy(&parser);
+} END_TEST
+
+/*
+ * Feed a large nested message in fragments.
+ */
+START_TEST(test_feed_message_large) {
+  uint8_t data[2 + 60] = { 90, 60 };
+  for (size_t f = 0; f < 30; f++) {
+    data[2 + f * 2]     = 8;
+    data[2 + f * 2 + 1] = f;
+  }
+
+  /* Create parser */
+  pb_parser_t parser = pb_parser_create(&descriptor);
+
+  /* Feed message in fragments and assert nothing is buffered */
+  trace_t trace = {};
+  for (size_t o = 0; o < sizeof(data); o += 7) {
+    size_t size = o + 7 > sizeof(data) ? sizeof(data) - o : 7;
+    pb_error_t error =
+      pb_parser_feed(&parser, &(data[o]), size, handler, &trace);
+    ck_assert_uint_eq(o + size < sizeof(data)
+      ? PB_ERROR_PARTIAL
+      : PB_ERROR_NONE, error);
+    ck_assert_uint_eq(0, pb_buffer_capacity(&(parser.buffer)));
+
+    /* Assert fields are processed before the nested message is complete */
+    ck_assert_uint_eq(3 + (o + size - 2) / 2 * 6 +
+      (o + size == sizeof(data)) * 3, trace.size);
+  }
+  fail_unless(pb_parser_done(&parser));
+
+  /* Free all allocated memory */
+  pb_parser_destroy(&parser);
+} END_TEST
+
+/*
+ * Feed a string spanning fragments.
+ */
+START_TEST(test_feed_string) {
+  const uint8_t data[] = {
+    66, 255, 255, 255, 127, 97, 98, 99, 100, 101, 102, 103, 104 };
+  const size_t  size   = 13;
+
+  /* Create parser */
+  pb_parser_t parser = pb_parser_create(&descriptor);
+
+  /* Feed fragment and assert buffer holds only the received part */
+  trace_t trace = {};
+  ck_assert_uint_eq(PB_ERROR_PARTIAL,
+    pb_parser_feed(&parser, data, size, handler, &trace));
+  ck_assert_uint_eq(8, pb_buffer_size(&(parser.buffer)));
+  ck_assert_uint_eq(8, pb_buffer_capacity(&(parser.buffer)));
+  ck_assert_uint_eq(0, trace.size);
+
+  /* Free all allocated memory */
+  pb_parser_destroy(&parser);
+} END_TEST
+
+/*
+ * Feed a truncated message.
+ */
+START_TEST(test_feed_partial) {
+  pb_parser_t parser = pb_parser_create(&descriptor);
+
+  /* Feed message without last byte */
+  trace_t trace = {};
+  ck_assert_uint_eq(PB_ERROR_PARTIAL,
+    pb_parser_feed(&parser, message, sizeof(message) - 1, handler, &trace));
+  fail_if(pb_parser_done(&parser));
+
+  /* Feed empty fragment */
+  ck_assert_uint_eq(PB_ERROR_PARTIAL,
+    pb_parser_feed(&parser, NULL, 0, handler, &trace));
+
+  /* Feed last byte */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_parser_feed(&parser, &(message[sizeof(message) - 1]), 1,
+      handler, &trace));
+  fail_unless(pb_parser_done(&parser));
+
+  /* Free all allocated memory */
+  pb_parser_destroy(&parser);
+} END_TEST
+
+/*
+ * Reset a parser after feeding a truncated message.
+ */
+START_TEST(test_reset) {
+  pb_parser_t parser = pb_parser_create(&descriptor);
+
+  /* Feed truncated string */
+  trace_t trace = {};
+  ck_assert_uint_eq(PB_ERROR_PARTIAL,
+    pb_parser_feed(&parser, &(message[25]), 4, handler, &trace));
+  fail_if(pb_parser_done(&parser));
+
+  /* Reset parser */
+  pb_parser_reset(&parser);
+  fail_unless(pb_parser_done(&parser));
+
+  /* Feed message */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_parser_feed(&parser, message, 3, handler, &trace));
+
+  /* Assert handler invocations */
+  const uint8_t expect[] = { 1, 4, 44, 1, 0, 0 };
+  ck_assert_uint_eq(sizeof(expect), trace.size);
+  fail_if(memcmp(expect, trace.data, trace.size));
+
+  /* Free all allocated memory */
+  pb_parser_destroy(&parser);
+} END_TEST
+
+/*
+ * Feed a message with an invalid tag.
+ */
+START_TEST(test_feed_invalid_tag) {
+  const uint8_t data[] = {
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255 };
+  const size_t  size   = 10;
+
+  /* Create parser */
+  pb_parser_t parser = pb_parser_create(&descriptor);
+
+  /* Feed message using the handler */
+  ck_assert_uint_eq(PB_ERROR_VARINT,
+    pb_parser_feed(&parser, data, size, handler, NULL));
+
+  /* Free all allocated memory */
+  pb_parser_destroy(&parser);
+} END_TEST
+
+/*
+ * Feed a message with an invalid wiretype.
+ */
+START_TEST(test_feed_invalid_wiretype) {
+  const uint8_t data[] = { 107, 1 };
+  const size_t  size   = 2;
+
+  /* Create parser */
+  pb_parser_t parser = pb_parser_create(&descriptor);
+
+  /* Feed message using the handler */
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_parser_feed(&parser, data, size, handler, NULL));
+
+  /* Free all allocated memory */
+  pb_parser_destroy(&parser);
+} END_TEST
+
+/*
+ * Feed a message with an invalid value.
+ */
+START_TEST(test_feed_invalid_value) {
+  const uint8_t data[] = { 8, 255, 255, 255, 255, 255, 1 };
+  const size_t  size   = 7;
+
+  /* Create parser */
+  pb_parser_t parser = pb_parser_create(&descriptor);
+
+  /* Feed message using the handler */
+  ck_assert_uint_eq(PB_ERROR_VARINT,
+    pb_parser_feed(&parser, data, size, handler, NULL));
+
+  /* Free all allocated memory */
+  pb_parser_destroy(&parser);
+} END_TEST
+
+/*
+ * Feed a message with an invalid varint.
+ */
+START_TEST(test_feed_invalid_varint) {
+  const uint8_t data[] = {
+    16, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 1 };
+  const size_t  size   = 12;
+
+  /* Create parser */
+  pb_parser_t parser = pb_parser_create(&descriptor);
+
+  /* Feed message using the handler */
+  ck_assert_uint_eq(PB_ERROR_VARINT,
+    pb_parser_feed(&parser, data, size, handler, NULL));
+
+  /* Free all allocated memory */
+  pb_parser_destroy(&parser);
+} END_TEST
+
+/*
+ * Feed a message with an invalid packed field.
+ */
+START_TEST(test_feed_invalid_packed) {
+  const uint8_t data[] = { 50, 6, 0, 0, 128, 63, 0, 0, 0, 64 };
+  const size_t  size   = 10;
+
+  /* Create parser */
+  pb_parser_t parser = pb_parser_create(&descriptor);
+
+  /* Feed message using the handler */
+  trace_t trace = {};
+  ck_assert_uint_eq(PB_ERROR_OFFSET,
+    pb_parser_feed(&parser, data, size, handler, &trace));
+
+  /* Free all allocated memory */
+  pb_parser_destroy(&parser);
+} END_TEST
+
+/*
+ * Feed a message with a field exceeding a nested message.
+ */
+START_TEST(test_feed_invalid_message) {
+  const uint8_t data[] = { 90, 2, 8, 172, 2 };
+  const size_t  size   = 5;
+
+  /* Create parser */
+  pb_parser_t parser = pb_parser_create(&descriptor);
+
+  /* Feed message using the handler */
+  trace_t trace = {};
+  ck_assert_uint_eq(PB_ERROR_OFFSET,
+    pb_parser_feed(&parser, data, size, handler, &trace));
+
+  /* Free all allocated memory */
+  pb_parser_destroy(&parser);
+} END_TEST
+
+/*
+ * Feed a message with a nested message exceeding its enclosing message.
+ */
+START_TEST(test_feed_invalid_message_length) {
+  const uint8_t data[] = { 90, 3, 90, 5, 8 };
+  const size_t  size   = 5;
+
+  /* Create parser */
+  pb_parser_t parser = pb_parser_create(&descriptor);
+
+  /* Feed message using the handler */
+  trace_t trace = {};
+  ck_assert_uint_eq(PB_ERROR_OFFSET,
+    pb_parser_feed(&parser, data, size, handler, &trace));
+
+  /* Free all allocated memory */
+  pb_parser_destroy(&parser);
+} END_TEST
+
+/*
+ * Feed a message with nested messages exceeding the maximum depth.
+ */
+START_TEST(test_feed_invalid_message_depth) {
+  uint8_t data[101 * 3];
+  for (size_t d = 0; d < 101; d++) {
+    size_t length = 16383 - d * 3;
+    data[d * 3]     = 90;
+    data[d * 3 + 1] = (length & 0x7F) | 0x80;
+    data[d * 3 + 2] = length >> 7;
+  }
+
+  /* Create parser */
+  pb_parser_t parser = pb_parser_create(&descriptor);
+
+  /* Feed message using the handler */
+  ck_assert_uint_eq(PB_ERROR_PARTIAL,
+    pb_parser_feed(&parser, data, 100 * 3, handler_ignore, NULL));
+  ck_assert_uint_eq(100, pb_parser_depth(&parser));
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_parser_feed(&parser, &(data[100 * 3]), 3, handler_ignore, NULL));
+
+  /* Free all allocated memory */
+  pb_parser_destroy(&parser);
+} END_TEST
+
+/* ----------------------------------------------------------------------------
+ * Program
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a test suite for all registered test cases and run it.
+ *
+ * Tests must be run sequentially (in no-fork mode) or code coverage
+ * cannot be determined properly.
+ */
+int
+main(void) {
+  void *suite = suite_create("protobluff/core/parser"),
+       *tcase = NULL;
+
+  /* Add tests to test case "create" */
+  tcase = tcase_create("create");
+  tcase_add_test(tcase, test_create);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "feed" */
+  tcase = tcase_create("feed");
+  tcase_add_test(tcase, test_feed);
+  tcase_add_test(tcase, test_feed_fragments);
+  tcase_add_test(tcase, test_feed_message);
+  tcase_add_test(tcase, test_feed_message_large);
+  tcase_add_test(tcase, test_feed_string);
+  tcase_add_test(tcase, test_feed_partial);
+  tcase_add_test(tcase, test_feed_invalid_tag);
+  tcase_add_test(tcase, test_feed_invalid_wiretype);
+  tcase_add_test(tcase, test_feed_invalid_value);
+  tcase_add_test(tcase, test_feed_invalid_varint);
+  tcase_add_test(tcase, test_feed_invalid_packed);
+  tcase_add_test(tcase, test_feed_invalid_message);
+  tcase_add_test(tcase, test_feed_invalid_message_length);
+  tcase_add_test(tcase, test_feed_invalid_message_depth);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "reset" */
+  tcase = tcase_create("reset");
+  tcase_add_test(tcase, test_reset);
+  suite_add_tcase(suite, tcase);
+
+  /* Create a test suite runner in no-fork mode */
+  void *runner = srunner_create(suite);
+  srunner_set_fork_status(runner, CK_NOFORK);
+
+  /* Execute test suite runner */
+  srunner_run_all(runner, CK_NORMAL);
+  int failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+
+  /* Exit with status code */
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
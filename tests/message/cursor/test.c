@@ -1610,6 +1610,48 @@ START_TEST(test_seek_packed_invalid) {
   pb_journal_destroy(&journal);
 } END_TEST
 
+/*
+ * Seek a cursor from its current position to a packed fixed-size value.
+ */
+START_TEST(test_seek_packed_fixed) {
+  uint8_t data[3 + 100 * 4] = { 42, 0x90, 0x03 };
+  const size_t size = 3 + 100 * 4;
+  for (size_t v = 0; v < 100; ++v) {
+    float value = v;
+    memcpy(&(data[3 + v * 4]), &value, sizeof(float));
+  }
+
+  /* Create journal, message and cursor */
+  pb_journal_t journal = pb_journal_create(data, size);
+  pb_message_t message = pb_message_create(&descriptor, &journal);
+  pb_cursor_t  cursor  = pb_cursor_create(&message, 5);
+
+  /* Assert cursor validity and error */
+  fail_unless(pb_cursor_valid(&cursor));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_cursor_error(&cursor));
+
+  /* Seek value with cursor */
+  float value = 77;
+  fail_unless(pb_cursor_seek(&cursor, &value));
+
+  /* Assert cursor tag, position and value */
+  ck_assert_uint_eq(5, pb_cursor_tag(&cursor));
+  ck_assert_uint_eq(77, cursor.pos);
+  fail_unless(pb_cursor_match(&cursor, &value));
+
+  /* Seek value with cursor again */
+  fail_if(pb_cursor_seek(&cursor, &value));
+
+  /* Assert cursor validity and error */
+  fail_if(pb_cursor_valid(&cursor));
+  ck_assert_uint_eq(PB_ERROR_EOM, pb_cursor_error(&cursor));
+
+  /* Free all allocated memory */
+  pb_cursor_destroy(&cursor);
+  pb_message_destroy(&message);
+  pb_journal_destroy(&journal);
+} END_TEST
+
 /*
  * Seek a cursor from its current position to a string field.
  */
@@ -1774,6 +1816,146 @@ START_TEST(test_seek_invalid_type) {
   pb_journal_destroy(&journal);
 } END_TEST
 
+/*
+ * Seek a cursor from its current position to a value within a range.
+ */
+START_TEST(test_seek_range) {
+  const uint8_t data[] = { 8, 1, 16, 2, 8, 3, 8, 4 };
+  const size_t  size   = 8;
+
+  /* Create journal, message and cursor */
+  pb_journal_t journal = pb_journal_create(data, size);
+  pb_message_t message = pb_message_create(&descriptor, &journal);
+  pb_cursor_t  cursor  = pb_cursor_create(&message, 1);
+
+  /* Assert cursor validity and error */
+  fail_unless(pb_cursor_valid(&cursor));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_cursor_error(&cursor));
+
+  /* Seek value within range with cursor */
+  uint32_t min = 2, max = 3, value;
+  fail_unless(pb_cursor_seek_range(&cursor, &min, &max));
+
+  /* Assert cursor tag and value */
+  ck_assert_uint_eq(1, pb_cursor_tag(&cursor));
+  fail_if(pb_cursor_get(&cursor, &value));
+  ck_assert_uint_eq(3, value);
+
+  /* Seek value within range with cursor again */
+  fail_if(pb_cursor_seek_range(&cursor, &min, &max));
+
+  /* Assert cursor validity and error */
+  fail_if(pb_cursor_valid(&cursor));
+  ck_assert_uint_eq(PB_ERROR_EOM, pb_cursor_error(&cursor));
+
+  /* Free all allocated memory */
+  pb_cursor_destroy(&cursor);
+  pb_message_destroy(&message);
+  pb_journal_destroy(&journal);
+} END_TEST
+
+/*
+ * Seek a cursor from its current position to a packed value within a range.
+ */
+START_TEST(test_seek_range_packed) {
+  const uint8_t data[] = { 26, 4, 1, 2, 3, 4, 8, 1, 26, 3, 1, 144, 3 };
+  const size_t  size   = 13;
+
+  /* Create journal, message and cursor */
+  pb_journal_t journal = pb_journal_create(data, size);
+  pb_message_t message = pb_message_create(&descriptor, &journal);
+  pb_cursor_t  cursor  = pb_cursor_create(&message, 3);
+
+  /* Assert cursor validity and error */
+  fail_unless(pb_cursor_valid(&cursor));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_cursor_error(&cursor));
+
+  /* Seek value within range with cursor */
+  uint32_t min = 100, max = 1000, value;
+  fail_unless(pb_cursor_seek_range(&cursor, &min, &max));
+
+  /* Assert cursor tag, position and value */
+  ck_assert_uint_eq(3, pb_cursor_tag(&cursor));
+  ck_assert_uint_eq(5, cursor.pos);
+  fail_if(pb_cursor_get(&cursor, &value));
+  ck_assert_uint_eq(400, value);
+
+  /* Seek value within range with cursor again */
+  fail_if(pb_cursor_seek_range(&cursor, &min, &max));
+
+  /* Assert cursor validity and error */
+  fail_if(pb_cursor_valid(&cursor));
+  ck_assert_uint_eq(PB_ERROR_EOM, pb_cursor_error(&cursor));
+
+  /* Free all allocated memory */
+  pb_cursor_destroy(&cursor);
+  pb_message_destroy(&message);
+  pb_journal_destroy(&journal);
+} END_TEST
+
+/*
+ * Seek a cursor from its current position to a string within a range.
+ */
+START_TEST(test_seek_range_string) {
+  const uint8_t data[] = { 66, 1, 65 };
+  const size_t  size   = 3;
+
+  /* Create journal, message and cursor */
+  pb_journal_t journal = pb_journal_create(data, size);
+  pb_message_t message = pb_message_create(&descriptor, &journal);
+  pb_cursor_t  cursor  = pb_cursor_create(&message, 8);
+
+  /* Seek value within range with cursor */
+  pb_string_t min = pb_string_init_from_chars("A"),
+              max = pb_string_init_from_chars("B");
+  fail_if(pb_cursor_seek_range(&cursor, &min, &max));
+
+  /* Assert cursor validity and error */
+  fail_unless(pb_cursor_valid(&cursor));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_cursor_error(&cursor));
+
+  /* Free all allocated memory */
+  pb_cursor_destroy(&cursor);
+  pb_message_destroy(&message);
+  pb_journal_destroy(&journal);
+} END_TEST
+
+/*
+ * Find the positions of all fields containing the value.
+ */
+START_TEST(test_find) {
+  const uint8_t data[] = { 26, 5, 1, 2, 1, 3, 1, 8, 1, 26, 2, 1, 4 };
+  const size_t  size   = 13;
+
+  /* Create journal, message and cursor */
+  pb_journal_t journal = pb_journal_create(data, size);
+  pb_message_t message = pb_message_create(&descriptor, &journal);
+  pb_cursor_t  cursor  = pb_cursor_create(&message, 3);
+
+  /* Assert cursor validity and error */
+  fail_unless(pb_cursor_valid(&cursor));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_cursor_error(&cursor));
+
+  /* Find positions of value with cursor */
+  size_t pos[2]; uint32_t value = 1;
+  ck_assert_uint_eq(2, pb_cursor_find(&cursor, &value, pos, 2));
+  ck_assert_uint_eq(2, pos[0]);
+  ck_assert_uint_eq(4, pos[1]);
+
+  /* Find remaining positions of value with cursor */
+  ck_assert_uint_eq(1, pb_cursor_find(&cursor, &value, pos, 2));
+  ck_assert_uint_eq(5, pos[0]);
+
+  /* Assert cursor validity and error */
+  fail_if(pb_cursor_valid(&cursor));
+  ck_assert_uint_eq(PB_ERROR_EOM, pb_cursor_error(&cursor));
+
+  /* Free all allocated memory */
+  pb_cursor_destroy(&cursor);
+  pb_message_destroy(&message);
+  pb_journal_destroy(&journal);
+} END_TEST
+
 /*
  * Compare the value of the current field of a cursor.
  */
@@ -3555,11 +3737,20 @@ main(void) {
   tcase_add_test(tcase, test_seek_packed_merged);
   tcase_add_test(tcase, test_seek_packed_nested);
   tcase_add_test(tcase, test_seek_packed_invalid);
+  tcase_add_test(tcase, test_seek_packed_fixed);
   tcase_add_test(tcase, test_seek_string);
   tcase_add_test(tcase, test_seek_unaligned);
   tcase_add_test(tcase, test_seek_invalid);
   tcase_add_test(tcase, test_seek_invalid_tag);
   tcase_add_test(tcase, test_seek_invalid_type);
+  tcase_add_test(tcase, test_seek_range);
+  tcase_add_test(tcase, test_seek_range_packed);
+  tcase_add_test(tcase, test_seek_range_string);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "find" */
+  tcase = tcase_create("find");
+  tcase_add_test(tcase, test_find);
   suite_add_tcase(suite, tcase);
 
   /* Add tests to test case "match" */
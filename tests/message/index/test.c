@@ -0,0 +1,595 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <protobluff/descriptor.h>
+
+#include "message/common.h"
+#include "message/cursor.h"
+#include "message/index.h"
+#include "message/journal.h"
+#include "message/message.h"
+
+/* ----------------------------------------------------------------------------
+ * Descriptors
+ * ------------------------------------------------------------------------- */
+
+/* Descriptor */
+static pb_descriptor_t
+descriptor = { {
+  (const pb_field_descriptor_t []){
+    {  1, "F01", STRING,  OPTIONAL },
+    {  2, "F02", UINT32,  REPEATED },
+    {  3, "F03", FIXED32, REPEATED, NULL, NULL, PACKED },
+    {  4, "F04", UINT32,  REPEATED, NULL, NULL, PACKED },
+    {  5, "F05", FIXED64, REPEATED, NULL, NULL, PACKED },
+    {  6, "F06", UINT32,  OPTIONAL }
+  }, 6 } };
+
+/* ----------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create an index over a message for a repeated field.
+ */
+START_TEST(test_create) {
+  const uint8_t data[] = { 16, 1, 16, 2 };
+  const size_t  size   = 4;
+
+  /* Create journal, message and index */
+  pb_journal_t journal = pb_journal_create(data, size);
+  pb_message_t message = pb_message_create(&descriptor, &journal);
+  pb_index_t   index   = pb_index_create(&message, 2);
+
+  /* Assert index validity and error */
+  fail_unless(pb_index_valid(&index));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_index_error(&index));
+
+  /* Assert index tag and size */
+  ck_assert_uint_eq(2, pb_index_tag(&index));
+  ck_assert_uint_eq(2, pb_index_size(&index));
+
+  /* Assert same contents but different location */
+  fail_unless(pb_message_equals(&message, pb_index_message(&index)));
+  ck_assert_ptr_ne(&message, pb_index_message(&index));
+
+  /* Free all allocated memory */
+  pb_index_destroy(&index);
+  pb_message_destroy(&message);
+  pb_journal_destroy(&journal);
+} END_TEST
+
+/*
+ * Create an index over a message for an absent field.
+ */
+START_TEST(test_create_absent) {
+  const uint8_t data[] = { 16, 1 };
+  const size_t  size   = 2;
+
+  /* Create journal, message and index */
+  pb_journal_t journal = pb_journal_create(data, size);
+  pb_message_t message = pb_message_create(&descriptor, &journal);
+  pb_index_t   index   = pb_index_create(&message, 3);
+
+  /* Assert index validity and size */
+  fail_unless(pb_index_valid(&index));
+  ck_assert_uint_eq(0, pb_index_size(&index));
+
+  /* Free all allocated memory */
+  pb_index_destroy(&index);
+  pb_message_destroy(&message);
+  pb_journal_destroy(&journal);
+} END_TEST
+
+/*
+ * Create an index over a message for a non-repeated field.
+ */
+START_TEST(test_create_optional) {
+  const uint8_t data[] = { 48, 1 };
+  const size_t  size   = 2;
+
+  /* Create journal, message and index */
+  pb_journal_t journal = pb_journal_create(data, size);
+  pb_message_t message = pb_message_create(&descriptor, &journal);
+  pb_index_t   index   = pb_index_create(&message, 6);
+
+  /* Assert index validity and error */
+  fail_if(pb_index_valid(&index));
+  ck_assert_uint_eq(PB_ERROR_INVALID, pb_index_error(&index));
+  ck_assert_uint_eq(0, pb_index_size(&index));
+
+  /* Free all allocated memory */
+  pb_index_destroy(&index);
+  pb_message_destroy(&message);
+  pb_journal_destroy(&journal);
+} END_TEST
+
+/*
+ * Create an index over an invalid message.
+ */
+START_TEST(test_create_message_invalid) {
+  pb_message_t message = pb_message_create_invalid();
+  pb_index_t   index   = pb_index_create(&message, 2);
+
+  /* Assert index validity and error */
+  fail_if(pb_index_valid(&index));
+  ck_assert_uint_eq(PB_ERROR_INVALID, pb_index_error(&index));
+
+  /* Free all allocated memory */
+  pb_index_destroy(&index);
+  pb_message_destroy(&message);
+} END_TEST
+
+/*
+ * Create cursors from an index over a repeated field.
+ */
+START_TEST(test_cursor) {
+  uint8_t data[3 + 200 * 2] = { 10, 1, 'A' };
+  const size_t size = 3 + 200 * 2;
+  for (size_t v = 0; v < 200; ++v) {
+    data[3 + v * 2]     = 16;
+    data[3 + v * 2 + 1] = v % 128;
+  }
+
+  /* Create journal, message and index */
+  pb_journal_t journal = pb_journal_create(data, size);
+  pb_message_t message = pb_message_create(&descriptor, &journal);
+  pb_index_t   index   = pb_index_create(&message, 2);
+
+  /* Assert index size */
+  ck_assert_uint_eq(200, pb_index_size(&index));
+
+  /* Create cursors for all positions in reverse order */
+  for (size_t p = 200; p > 0; --p) {
+    pb_cursor_t cursor = pb_cursor_create_from_index(&index, p - 1);
+
+    /* Assert cursor validity, position and tag */
+    fail_unless(pb_cursor_valid(&cursor));
+    ck_assert_uint_eq(p - 1, cursor.pos);
+    ck_assert_uint_eq(2, pb_cursor_tag(&cursor));
+
+    /* Read value from cursor */
+    uint32_t value;
+    fail_if(pb_cursor_get(&cursor, &value));
+    ck_assert_uint_eq((p - 1) % 128, value);
+
+    /* Free all allocated memory */
+    pb_cursor_destroy(&cursor);
+  }
+
+  /* Free all allocated memory */
+  pb_index_destroy(&index);
+  pb_message_destroy(&message);
+  pb_journal_destroy(&journal);
+} END_TEST
+
+/*
+ * Create a cursor from an index and advance it.
+ */
+START_TEST(test_cursor_next) {
+  uint8_t data[200 * 2];
+  const size_t size = 200 * 2;
+  for (size_t v = 0; v < 200; ++v) {
+    data[v * 2]     = 16;
+    data[v * 2 + 1] = v % 128;
+  }
+
+  /* Create journal, message, index and cursor */
+  pb_journal_t journal = pb_journal_create(data, size);
+  pb_message_t message = pb_message_create(&descriptor, &journal);
+  pb_index_t   index   = pb_index_create(&message, 2);
+  pb_cursor_t  cursor  = pb_cursor_create_from_index(&index, 150);
+
+  /* Walk through remaining occurrences */
+  for (size_t p = 150; p < 200; ++p) {
+    fail_unless(pb_cursor_valid(&cursor));
+    ck_assert_uint_eq(p, cursor.pos);
+
+    /* Read value from cursor */
+    uint32_t value;
+    fail_if(pb_cursor_get(&cursor, &value));
+    ck_assert_uint_eq(p % 128, value);
+    pb_cursor_next(&cursor);
+  }
+
+  /* Assert cursor validity and error */
+  fail_if(pb_cursor_valid(&cursor));
+  ck_assert_uint_eq(PB_ERROR_EOM, pb_cursor_error(&cursor));
+
+  /* Free all allocated memory */
+  pb_cursor_destroy(&cursor);
+  pb_index_destroy(&index);
+  pb_message_destroy(&message);
+  pb_journal_destroy(&journal);
+} END_TEST
+
+/*
+ * Create a cursor from an index for a position out of bounds.
+ */
+START_TEST(test_cursor_bounds) {
+  const uint8_t data[] = { 16, 1, 16, 2 };
+  const size_t  size   = 4;
+
+  /* Create journal, message, index and cursor */
+  pb_journal_t journal = pb_journal_create(data, size);
+  pb_message_t message = pb_message_create(&descriptor, &journal);
+  pb_index_t   index   = pb_index_create(&message, 2);
+  pb_cursor_t  cursor  = pb_cursor_create_from_index(&index, 2);
+
+  /* Assert cursor validity and error */
+  fail_if(pb_cursor_valid(&cursor));
+  ck_assert_uint_eq(PB_ERROR_EOM, pb_cursor_error(&cursor));
+
+  /* Free all allocated memory */
+  pb_cursor_destroy(&cursor);
+  pb_index_destroy(&index);
+  pb_message_destroy(&message);
+  pb_journal_destroy(&journal);
+} END_TEST
+
+/*
+ * Create cursors from an index over a packed field of fixed-size values.
+ */
+START_TEST(test_cursor_packed) {
+  uint8_t data[3 + 1000 * 4] = { 26, 0xA0, 0x1F };
+  const size_t size = 3 + 1000 * 4;
+  for (size_t v = 0; v < 1000; ++v) {
+    data[3 + v * 4]     = v & 0xFF;
+    data[3 + v * 4 + 1] = v >> 8;
+    data[3 + v * 4 + 2] = 0;
+    data[3 + v * 4 + 3] = 0;
+  }
+
+  /* Create journal, message and index */
+  pb_journal_t journal = pb_journal_create(data, size);
+  pb_message_t message = pb_message_create(&descriptor, &journal);
+  pb_index_t   index   = pb_index_create(&message, 3);
+
+  /* Assert index size */
+  ck_assert_uint_eq(1000, pb_index_size(&index));
+
+  /* Create cursors for a selection of positions */
+  for (size_t p = 0; p < 1000; p += 37) {
+    pb_cursor_t cursor = pb_cursor_create_from_index(&index, p);
+
+    /* Assert cursor validity and position */
+    fail_unless(pb_cursor_valid(&cursor));
+    ck_assert_uint_eq(p, cursor.pos);
+
+    /* Read value from cursor */
+    uint32_t value;
+    fail_if(pb_cursor_get(&cursor, &value));
+    ck_assert_uint_eq(p, value);
+
+    /* Free all allocated memory */
+    pb_cursor_destroy(&cursor);
+  }
+
+  /* Create cursor for last position and advance it */
+  pb_cursor_t cursor = pb_cursor_create_from_index(&index, 999);
+  fail_unless(pb_cursor_valid(&cursor));
+  fail_if(pb_cursor_next(&cursor));
+  ck_assert_uint_eq(PB_ERROR_EOM, pb_cursor_error(&cursor));
+
+  /* Free all allocated memory */
+  pb_cursor_destroy(&cursor);
+  pb_index_destroy(&index);
+  pb_message_destroy(&message);
+  pb_journal_destroy(&journal);
+} END_TEST
+
+/*
+ * Create cursors from an index over a merged packed field.
+ */
+START_TEST(test_cursor_packed_merged) {
+  const uint8_t data[] = { 42, 16, 1, 0, 0, 0, 0, 0, 0, 0,
+                                   2, 0, 0, 0, 0, 0, 0, 0,
+                           16, 1,
+                           42,  8, 3, 0, 0, 0, 0, 0, 0, 0,
+                           42, 16, 4, 0, 0, 0, 0, 0, 0, 0,
+                                   5, 0, 0, 0, 0, 0, 0, 0 };
+  const size_t  size   = 48;
+
+  /* Create journal, message and index */
+  pb_journal_t journal = pb_journal_create(data, size);
+  pb_message_t message = pb_message_create(&descriptor, &journal);
+  pb_index_t   index   = pb_index_create(&message, 5);
+
+  /* Assert index size */
+  ck_assert_uint_eq(5, pb_index_size(&index));
+
+  /* Create cursors for all positions */
+  for (size_t p = 0; p < 5; ++p) {
+    pb_cursor_t cursor = pb_cursor_create_from_index(&index, p);
+
+    /* Assert cursor validity and position */
+    fail_unless(pb_cursor_valid(&cursor));
+    ck_assert_uint_eq(p, cursor.pos);
+
+    /* Read value from cursor */
+    uint64_t value;
+    fail_if(pb_cursor_get(&cursor, &value));
+    ck_assert_uint_eq(p + 1, value);
+
+    /* Free all allocated memory */
+    pb_cursor_destroy(&cursor);
+  }
+
+  /* Free all allocated memory */
+  pb_index_destroy(&index);
+  pb_message_destroy(&message);
+  pb_journal_destroy(&journal);
+} END_TEST
+
+/*
+ * Create cursors from an index over a packed field of variable-sized values.
+ */
+START_TEST(test_cursor_packed_varint) {
+  uint8_t data[3 + 300] = { 34, 0xAC, 0x02 };
+  const size_t size = 3 + 300;
+  for (size_t v = 0; v < 300; ++v)
+    data[3 + v] = v % 128;
+
+  /* Create journal, message and index */
+  pb_journal_t journal = pb_journal_create(data, size);
+  pb_message_t message = pb_message_create(&descriptor, &journal);
+  pb_index_t   index   = pb_index_create(&message, 4);
+
+  /* Assert index size */
+  ck_assert_uint_eq(300, pb_index_size(&index));
+
+  /* Create cursors for all positions */
+  for (size_t p = 0; p < 300; ++p) {
+    pb_cursor_t cursor = pb_cursor_create_from_index(&index, p);
+
+    /* Assert cursor validity and position */
+    fail_unless(pb_cursor_valid(&cursor));
+    ck_assert_uint_eq(p, cursor.pos);
+
+    /* Read value from cursor */
+    uint32_t value;
+    fail_if(pb_cursor_get(&cursor, &value));
+    ck_assert_uint_eq(p % 128, value);
+
+    /* Free all allocated memory */
+    pb_cursor_destroy(&cursor);
+  }
+
+  /* Free all allocated memory */
+  pb_index_destroy(&index);
+  pb_message_destroy(&message);
+  pb_journal_destroy(&journal);
+} END_TEST
+
+/*
+ * Create cursors from an index after a change before the indexed field.
+ */
+START_TEST(test_cursor_moved) {
+  uint8_t data[3 + 100 * 2] = { 10, 1, 'A' };
+  const size_t size = 3 + 100 * 2;
+  for (size_t v = 0; v < 100; ++v) {
+    data[3 + v * 2]     = 16;
+    data[3 + v * 2 + 1] = v;
+  }
+
+  /* Create journal, message and index */
+  pb_journal_t journal = pb_journal_create(data, size);
+  pb_message_t message = pb_message_create(&descriptor, &journal);
+  pb_index_t   index   = pb_index_create(&message, 2);
+
+  /* Assert index size */
+  ck_assert_uint_eq(100, pb_index_size(&index));
+
+  /* Write a longer value before the indexed field */
+  pb_string_t value = pb_string_init_from_chars("SOME STRING");
+  fail_if(pb_message_put(&message, 1, &value));
+  ck_assert_uint_eq(100, pb_index_size(&index));
+
+  /* Create cursors for a selection of positions */
+  for (size_t p = 0; p < 100; p += 9) {
+    pb_cursor_t cursor = pb_cursor_create_from_index(&index, p);
+
+    /* Assert cursor validity and position */
+    fail_unless(pb_cursor_valid(&cursor));
+    ck_assert_uint_eq(p, cursor.pos);
+
+    /* Read value from cursor */
+    uint32_t value;
+    fail_if(pb_cursor_get(&cursor, &value));
+    ck_assert_uint_eq(p, value);
+
+    /* Free all allocated memory */
+    pb_cursor_destroy(&cursor);
+  }
+
+  /* Free all allocated memory */
+  pb_index_destroy(&index);
+  pb_message_destroy(&message);
+  pb_journal_destroy(&journal);
+} END_TEST
+
+/*
+ * Create cursors from an index after a field was appended.
+ */
+START_TEST(test_cursor_appended) {
+  uint8_t data[100 * 2];
+  const size_t size = 100 * 2;
+  for (size_t v = 0; v < 100; ++v) {
+    data[v * 2]     = 16;
+    data[v * 2 + 1] = v;
+  }
+
+  /* Create journal, message and index */
+  pb_journal_t journal = pb_journal_create(data, size);
+  pb_message_t message = pb_message_create(&descriptor, &journal);
+  pb_index_t   index   = pb_index_create(&message, 2);
+
+  /* Assert index size */
+  ck_assert_uint_eq(100, pb_index_size(&index));
+
+  /* Append values to the indexed field */
+  for (uint32_t v = 100; v < 110; ++v)
+    fail_if(pb_message_put(&message, 2, &v));
+  ck_assert_uint_eq(110, pb_index_size(&index));
+
+  /* Create cursors for all positions */
+  for (size_t p = 0; p < 110; ++p) {
+    pb_cursor_t cursor = pb_cursor_create_from_index(&index, p);
+
+    /* Assert cursor validity and position */
+    fail_unless(pb_cursor_valid(&cursor));
+    ck_assert_uint_eq(p, cursor.pos);
+
+    /* Read value from cursor */
+    uint32_t value;
+    fail_if(pb_cursor_get(&cursor, &value));
+    ck_assert_uint_eq(p, value);
+
+    /* Free all allocated memory */
+    pb_cursor_destroy(&cursor);
+  }
+
+  /* Free all allocated memory */
+  pb_index_destroy(&index);
+  pb_message_destroy(&message);
+  pb_journal_destroy(&journal);
+} END_TEST
+
+/*
+ * Create cursors from an index after an indexed field was erased.
+ */
+START_TEST(test_cursor_erased) {
+  uint8_t data[100 * 2];
+  const size_t size = 100 * 2;
+  for (size_t v = 0; v < 100; ++v) {
+    data[v * 2]     = 16;
+    data[v * 2 + 1] = v;
+  }
+
+  /* Create journal, message and index */
+  pb_journal_t journal = pb_journal_create(data, size);
+  pb_message_t message = pb_message_create(&descriptor, &journal);
+  pb_index_t   index   = pb_index_create(&message, 2);
+
+  /* Erase field from cursor */
+  pb_cursor_t cursor = pb_cursor_create_from_index(&index, 10);
+  fail_if(pb_cursor_erase(&cursor));
+  pb_cursor_destroy(&cursor);
+
+  /* Assert index size */
+  ck_assert_uint_eq(99, pb_index_size(&index));
+
+  /* Create cursors for all positions */
+  for (size_t p = 0; p < 99; ++p) {
+    pb_cursor_t cursor = pb_cursor_create_from_index(&index, p);
+
+    /* Assert cursor validity and position */
+    fail_unless(pb_cursor_valid(&cursor));
+    ck_assert_uint_eq(p, cursor.pos);
+
+    /* Read value from cursor */
+    uint32_t value;
+    fail_if(pb_cursor_get(&cursor, &value));
+    ck_assert_uint_eq(p < 10 ? p : p + 1, value);
+
+    /* Free all allocated memory */
+    pb_cursor_destroy(&cursor);
+  }
+
+  /* Free all allocated memory */
+  pb_index_destroy(&index);
+  pb_message_destroy(&message);
+  pb_journal_destroy(&journal);
+} END_TEST
+
+/*
+ * Create a cursor from an invalid index.
+ */
+START_TEST(test_cursor_invalid) {
+  pb_message_t message = pb_message_create_invalid();
+  pb_index_t   index   = pb_index_create(&message, 2);
+  pb_cursor_t  cursor  = pb_cursor_create_from_index(&index, 0);
+
+  /* Assert cursor validity and error */
+  fail_if(pb_cursor_valid(&cursor));
+  ck_assert_uint_eq(PB_ERROR_INVALID, pb_cursor_error(&cursor));
+
+  /* Free all allocated memory */
+  pb_cursor_destroy(&cursor);
+  pb_index_destroy(&index);
+  pb_message_destroy(&message);
+} END_TEST
+
+/* ----------------------------------------------------------------------------
+ * Program
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a test suite for all registered test cases and run it.
+ *
+ * Tests must be run sequentially (in no-fork mode) or code coverage
+ * cannot be determined properly.
+ */
+int
+main(void) {
+  void *suite = suite_create("protobluff/message/index"),
+       *tcase = NULL;
+
+  /* Add tests to test case "create" */
+  tcase = tcase_create("create");
+  tcase_add_test(tcase, test_create);
+  tcase_add_test(tcase, test_create_absent);
+  tcase_add_test(tcase, test_create_optional);
+  tcase_add_test(tcase, test_create_message_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "cursor" */
+  tcase = tcase_create("cursor");
+  tcase_add_test(tcase, test_cursor);
+  tcase_add_test(tcase, test_cursor_next);
+  tcase_add_test(tcase, test_cursor_bounds);
+  tcase_add_test(tcase, test_cursor_packed);
+  tcase_add_test(tcase, test_cursor_packed_merged);
+  tcase_add_test(tcase, test_cursor_packed_varint);
+  tcase_add_test(tcase, test_cursor_moved);
+  tcase_add_test(tcase, test_cursor_appended);
+  tcase_add_test(tcase, test_cursor_erased);
+  tcase_add_test(tcase, test_cursor_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Create a test suite runner in no-fork mode */
+  void *runner = srunner_create(suite);
+  srunner_set_fork_status(runner, CK_NOFORK);
+
+  /* Execute test suite runner */
+  srunner_run_all(runner, CK_NORMAL);
+  int failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+
+  /* Exit with status code */
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -23,8 +23,10 @@
 #include <assert.h>
 #include <check.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include "core/allocator.h"
 #include "message/common.h"
@@ -61,6 +63,47 @@ allocator_resize_fail(void *data, void *block, size_t size) {
   return NULL;
 }
 
+/* ----------------------------------------------------------------------------
+ * Files
+ * ------------------------------------------------------------------------- */
+
+/* File used for memory mapping */
+#define FILE_MMAP "journal.mmap"
+
+/* Shared memory object used for memory mapping */
+#define SHM_NAME "/protobluff-journal.shm"
+
+/*!
+ * Write data to a file, replacing its contents.
+ *
+ * \param[in] data[] Raw data
+ * \param[in] size   Raw data size
+ */
+static void
+file_write(const uint8_t data[], size_t size) {
+  FILE *file = fopen(FILE_MMAP, "wb");
+  assert(file);
+  if (size)
+    fwrite(data, 1, size, file);
+  fclose(file);
+}
+
+/*!
+ * Read the contents of a file.
+ *
+ * \param[out] data[] Raw data
+ * \param[in]  size   Raw data size
+ * \return            Bytes read
+ */
+static size_t
+file_read(uint8_t data[], size_t size) {
+  FILE *file = fopen(FILE_MMAP, "rb");
+  assert(file);
+  size_t read = fread(data, 1, size, file);
+  fclose(file);
+  return read;
+}
+
 /* ----------------------------------------------------------------------------
  * Tests
  * ------------------------------------------------------------------------- */
@@ -142,6 +185,33 @@ START_TEST(test_create_zero_copy) {
   pb_journal_destroy(&journal);
 } END_TEST
 
+/*
+ * Create a copy-on-write journal.
+ */
+START_TEST(test_create_copy_on_write) {
+  uint8_t data[] = "SOME DATA";
+  size_t  size   = 9;
+
+  /* Create journal */
+  pb_journal_t journal = pb_journal_create_copy_on_write(data, size);
+
+  /* Assert journal validity and error */
+  fail_unless(pb_journal_valid(&journal));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_journal_error(&journal));
+
+  /* Assert journal size and version */
+  fail_if(pb_journal_empty(&journal));
+  ck_assert_uint_eq(size, pb_journal_size(&journal));
+  ck_assert_uint_eq(0, pb_journal_version(&journal));
+
+  /* Assert same contents and location */
+  fail_if(memcmp(data, pb_journal_data(&journal), size));
+  ck_assert_ptr_eq(data, pb_journal_data(&journal));
+
+  /* Free all allocated memory */
+  pb_journal_destroy(&journal);
+} END_TEST
+
 /*
  * Create an invalid journal.
  */
@@ -245,6 +315,38 @@ START_TEST(test_write) {
   pb_journal_destroy(&journal);
 } END_TEST
 
+/*
+ * Write data to a journal backed by inline storage.
+ */
+START_TEST(test_write_inline) {
+  uint8_t block[16];
+
+  /* Create journal */
+  pb_journal_t journal = pb_journal_create_inline(block, sizeof(block));
+
+  /* Assert journal validity and error */
+  fail_unless(pb_journal_valid(&journal));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_journal_error(&journal));
+
+  /* Write data into inline storage: "" => "SOME DATA" */
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_journal_write(&journal, 0, 0, 0,
+    (const uint8_t *)"SOME DATA", 9));
+  ck_assert_ptr_eq(block, pb_journal_data(&journal));
+
+  /* Write data beyond inline storage: "SOME DATA" => "SOME MORE DATA" */
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_journal_write(&journal, 0, 5, 5,
+    (const uint8_t *)"MORE DATA ", 10));
+  ck_assert_ptr_ne(block, pb_journal_data(&journal));
+
+  /* Assert journal size, version and contents */
+  ck_assert_uint_eq(19, pb_journal_size(&journal));
+  ck_assert_uint_eq(2, pb_journal_version(&journal));
+  fail_if(memcmp("SOME MORE DATA DATA", pb_journal_data(&journal), 19));
+
+  /* Free all allocated memory */
+  pb_journal_destroy(&journal);
+} END_TEST
+
 /*
  * Write data of the same length to a zero-copy journal.
  */
@@ -278,6 +380,146 @@ START_TEST(test_write_zero_copy) {
   pb_journal_destroy(&journal);
 } END_TEST
 
+/*
+ * Write data to a copy-on-write journal.
+ */
+START_TEST(test_write_copy_on_write) {
+  uint8_t data[] = "SOME DATA";
+  size_t  size   = 9;
+
+  /* Create journal */
+  pb_journal_t journal = pb_journal_create_copy_on_write(data, size);
+
+  /* Assert journal validity and error */
+  fail_unless(pb_journal_valid(&journal));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_journal_error(&journal));
+
+  /* Update journal in place: "SOME DATA" => "MORE DATA" */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_journal_write(&journal, 0, 0, 4, (uint8_t *)"MORE", 4));
+
+  /* Assert same contents and location */
+  ck_assert_uint_eq(0, pb_journal_version(&journal));
+  fail_if(memcmp("MORE DATA", pb_journal_data(&journal), size));
+  ck_assert_ptr_eq(data, pb_journal_data(&journal));
+
+  /* Update journal: "MORE DATA" => "SOME MORE DATA" */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_journal_write(&journal, 0, 0, 0, (uint8_t *)"SOME ", 5));
+
+  /* Assert journal size and version */
+  ck_assert_uint_eq(14, pb_journal_size(&journal));
+  ck_assert_uint_eq(1, pb_journal_version(&journal));
+
+  /* Assert new contents in different location and original data intact */
+  fail_if(memcmp("SOME MORE DATA", pb_journal_data(&journal), 14));
+  ck_assert_ptr_ne(data, pb_journal_data(&journal));
+  fail_if(memcmp("MORE DATA", data, size));
+
+  /* Update journal again: "SOME MORE DATA" => "SOME DATA" */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_journal_write(&journal, 0, 0, 10, (uint8_t *)"SOME ", 5));
+  ck_assert_uint_eq(2, pb_journal_version(&journal));
+  fail_if(memcmp("SOME DATA", pb_journal_data(&journal), 9));
+
+  /* Free all allocated memory */
+  pb_journal_destroy(&journal);
+} END_TEST
+
+/*
+ * Write data to a journal backed by a memory-mapped file.
+ */
+START_TEST(test_write_mmap) {
+  file_write((const uint8_t *)"MORE DATA", 9);
+
+  /* Create journal */
+  pb_journal_t journal = pb_journal_create_mmap(FILE_MMAP, PB_BUFFER_WRITE);
+
+  /* Assert journal validity and error */
+  fail_unless(pb_journal_valid(&journal));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_journal_error(&journal));
+  ck_assert_uint_eq(9, pb_journal_size(&journal));
+
+  /* Update journal: "MORE DATA" => "SOME MORE DATA" */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_journal_write(&journal, 0, 0, 0, (uint8_t *)"SOME ", 5));
+
+  /* Assert journal size and version */
+  ck_assert_uint_eq(14, pb_journal_size(&journal));
+  ck_assert_uint_eq(1, pb_journal_version(&journal));
+  fail_if(memcmp("SOME MORE DATA", pb_journal_data(&journal), 14));
+
+  /* Assert changes were written to file */
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_journal_sync(&journal));
+  uint8_t file[16];
+  ck_assert_uint_eq(14, file_read(file, sizeof(file)));
+  fail_if(memcmp("SOME MORE DATA", file, 14));
+
+  /* Free all allocated memory */
+  pb_journal_destroy(&journal);
+  remove(FILE_MMAP);
+} END_TEST
+
+/*
+ * Write data to a read-only journal backed by a memory-mapped file.
+ */
+START_TEST(test_write_mmap_read) {
+  file_write((const uint8_t *)"MORE DATA", 9);
+
+  /* Create journal */
+  pb_journal_t journal = pb_journal_create_mmap(FILE_MMAP, PB_BUFFER_READ);
+
+  /* Assert journal validity and error */
+  fail_unless(pb_journal_valid(&journal));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_journal_error(&journal));
+
+  /* Update journal in place: "MORE DATA" => "SOME DATA" */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_journal_write(&journal, 0, 0, 4, (uint8_t *)"SOME", 4));
+  fail_if(memcmp("SOME DATA", pb_journal_data(&journal), 9));
+
+  /* Assert journal can't grow */
+  ck_assert_uint_eq(PB_ERROR_ALLOC,
+    pb_journal_write(&journal, 0, 0, 0, (uint8_t *)"SOME ", 5));
+  ck_assert_uint_eq(9, pb_journal_size(&journal));
+  ck_assert_uint_eq(0, pb_journal_version(&journal));
+
+  /* Assert file is unchanged */
+  uint8_t file[16];
+  ck_assert_uint_eq(9, file_read(file, sizeof(file)));
+  fail_if(memcmp("MORE DATA", file, 9));
+
+  /* Free all allocated memory */
+  pb_journal_destroy(&journal);
+  remove(FILE_MMAP);
+} END_TEST
+
+/*
+ * Write data to a journal backed by a shared memory object.
+ */
+START_TEST(test_write_shm) {
+  pb_journal_t journal = pb_journal_create_shm(SHM_NAME, PB_BUFFER_WRITE);
+
+  /* Assert journal validity and error */
+  fail_unless(pb_journal_valid(&journal));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_journal_error(&journal));
+
+  /* Write to journal: "" => "SOME DATA" */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_journal_write(&journal, 0, 0, 0, (uint8_t *)"SOME DATA", 9));
+
+  /* Map shared memory object again in read mode and assert contents */
+  pb_journal_t shared = pb_journal_create_shm(SHM_NAME, PB_BUFFER_READ);
+  fail_unless(pb_journal_valid(&shared));
+  ck_assert_uint_eq(9, pb_journal_size(&shared));
+  fail_if(memcmp("SOME DATA", pb_journal_data(&shared), 9));
+
+  /* Free all allocated memory */
+  pb_journal_destroy(&shared);
+  pb_journal_destroy(&journal);
+  shm_unlink(SHM_NAME);
+} END_TEST
+
 /*
  * Write data to an invalid journal.
  */
@@ -437,6 +679,104 @@ START_TEST(test_write_invalid_zero_copy) {
   pb_journal_destroy(&journal);
 } END_TEST
 
+/*
+ * Write data to a copy-on-write journal for which promotion fails.
+ */
+START_TEST(test_write_invalid_copy_on_write) {
+  uint8_t data[] = "SOME DATA";
+  size_t  size   = 9;
+
+  /* Patch allocator */
+  pb_allocator_t allocator = {
+    .proc = {
+      .allocate = allocator_allocate_fail,
+      .resize   = allocator_default.proc.resize,
+      .free     = allocator_default.proc.free
+    }
+  };
+
+  /* Create journal */
+  pb_journal_t journal =
+    pb_journal_create_copy_on_write_with_allocator(&allocator, data, size);
+
+  /* Assert journal validity and error */
+  fail_unless(pb_journal_valid(&journal));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_journal_error(&journal));
+
+  /* Try to update journal */
+  uint8_t new_data[] = "AWE";
+  ck_assert_uint_eq(PB_ERROR_ALLOC,
+    pb_journal_write(&journal, 0, 0, 0, new_data, 3));
+
+  /* Assert journal validity, size and version */
+  fail_unless(pb_journal_valid(&journal));
+  ck_assert_uint_eq(9, pb_journal_size(&journal));
+  ck_assert_uint_eq(0, pb_journal_version(&journal));
+
+  /* Assert same contents and location */
+  fail_if(memcmp("SOME DATA", pb_journal_data(&journal), size));
+  ck_assert_ptr_eq(data, pb_journal_data(&journal));
+
+  /* Free all allocated memory */
+  pb_journal_destroy(&journal);
+} END_TEST
+
+/*
+ * Reset a journal, retaining the capacity of its buffer.
+ */
+START_TEST(test_reset) {
+  const uint8_t data[] = "SOME DATA";
+  const size_t  size   = 9;
+
+  /* Create journal and append data: "SOME DATA" => "SOME DATA DATA" */
+  pb_journal_t journal = pb_journal_create(data, size);
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_journal_write(&journal, 0, size, size, data + 4, 5));
+  const uint8_t *location = pb_journal_data(&journal);
+
+  /* Reset journal and assert size and version */
+  pb_journal_reset(&journal);
+  fail_unless(pb_journal_valid(&journal));
+  fail_unless(pb_journal_empty(&journal));
+  ck_assert_uint_eq(0, pb_journal_version(&journal));
+
+  /* Write data to journal and assert same location */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_journal_write(&journal, 0, 0, 0, data, size));
+  fail_if(memcmp(data, pb_journal_data(&journal), size));
+  ck_assert_ptr_eq(location, pb_journal_data(&journal));
+  ck_assert_uint_eq(1, pb_journal_version(&journal));
+
+  /* Free all allocated memory */
+  pb_journal_destroy(&journal);
+} END_TEST
+
+/*
+ * Reset a copy-on-write journal.
+ */
+START_TEST(test_reset_copy_on_write) {
+  uint8_t data[] = "SOME DATA";
+  size_t  size   = 9;
+
+  /* Create journal and reset it */
+  pb_journal_t journal = pb_journal_create_copy_on_write(data, size);
+  pb_journal_reset(&journal);
+
+  /* Assert journal validity and size */
+  fail_unless(pb_journal_valid(&journal));
+  fail_unless(pb_journal_empty(&journal));
+
+  /* Write data to journal and assert original data intact */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_journal_write(&journal, 0, 0, 0, (const uint8_t *)"DATA", 4));
+  fail_if(memcmp("DATA", pb_journal_data(&journal), 4));
+  ck_assert_ptr_ne(data, pb_journal_data(&journal));
+  fail_if(memcmp("SOME DATA", data, size));
+
+  /* Free all allocated memory */
+  pb_journal_destroy(&journal);
+} END_TEST
+
 /*
  * Clear data from a journal.
  */
@@ -468,6 +808,34 @@ START_TEST(test_clear) {
   pb_journal_destroy(&journal);
 } END_TEST
 
+/*
+ * Clear data from a journal backed by inline storage.
+ */
+START_TEST(test_clear_inline) {
+  uint8_t block[16];
+
+  /* Create journal and write data: "" => "SOME DATA" */
+  pb_journal_t journal = pb_journal_create_inline(block, sizeof(block));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_journal_write(&journal, 0, 0, 0,
+    (const uint8_t *)"SOME DATA", 9));
+
+  /* Clear journal partially: "SOME DATA" => "DATA" */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_journal_clear(&journal, 0, 0, 5));
+  fail_if(memcmp("DATA", pb_journal_data(&journal), 4));
+  ck_assert_ptr_eq(block, pb_journal_data(&journal));
+
+  /* Clear journal completely and assert retained inline storage */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_journal_clear(&journal, 0, 0, 4));
+  fail_unless(pb_journal_empty(&journal));
+  ck_assert_ptr_eq(block, pb_journal_data(&journal));
+  ck_assert_uint_eq(3, pb_journal_version(&journal));
+
+  /* Free all allocated memory */
+  pb_journal_destroy(&journal);
+} END_TEST
+
 /*
  * Clear data from a zero-copy journal.
  */
@@ -499,6 +867,72 @@ START_TEST(test_clear_zero_copy) {
   pb_journal_destroy(&journal);
 } END_TEST
 
+/*
+ * Clear data from a copy-on-write journal.
+ */
+START_TEST(test_clear_copy_on_write) {
+  uint8_t data[] = "SOME DATA";
+  size_t  size   = 9;
+
+  /* Create journal */
+  pb_journal_t journal = pb_journal_create_copy_on_write(data, size);
+
+  /* Assert journal validity and error */
+  fail_unless(pb_journal_valid(&journal));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_journal_error(&journal));
+
+  /* Clear data from journal: "SOME DATA" => "DATA" */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_journal_clear(&journal, 0, 0, 5));
+
+  /* Assert journal size and version */
+  ck_assert_uint_eq(4, pb_journal_size(&journal));
+  ck_assert_uint_eq(1, pb_journal_version(&journal));
+
+  /* Assert new contents in different location and original data intact */
+  fail_if(memcmp("DATA", pb_journal_data(&journal), 4));
+  ck_assert_ptr_ne(data, pb_journal_data(&journal));
+  fail_if(memcmp("SOME DATA", data, size));
+
+  /* Free all allocated memory */
+  pb_journal_destroy(&journal);
+} END_TEST
+
+/*
+ * Clear data from a journal backed by a memory-mapped file.
+ */
+START_TEST(test_clear_mmap) {
+  file_write((const uint8_t *)"SOME DATA", 9);
+
+  /* Create journal */
+  pb_journal_t journal = pb_journal_create_mmap(FILE_MMAP, PB_BUFFER_WRITE);
+
+  /* Clear data from journal: "SOME DATA" => "" */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_journal_clear(&journal, 0, 0, 9));
+
+  /* Assert journal size and version */
+  fail_unless(pb_journal_empty(&journal));
+  ck_assert_uint_eq(1, pb_journal_version(&journal));
+
+  /* Assert file was truncated */
+  uint8_t file[16];
+  ck_assert_uint_eq(0, file_read(file, sizeof(file)));
+
+  /* Update journal: "" => "DATA" */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_journal_write(&journal, 0, 0, 0, (uint8_t *)"DATA", 4));
+  ck_assert_uint_eq(2, pb_journal_version(&journal));
+
+  /* Free all allocated memory */
+  pb_journal_destroy(&journal);
+
+  /* Assert changes were written to file */
+  ck_assert_uint_eq(4, file_read(file, sizeof(file)));
+  fail_if(memcmp("DATA", file, 4));
+  remove(FILE_MMAP);
+} END_TEST
+
 /*
  * Clear data from an invalid journal.
  */
@@ -1051,6 +1485,7 @@ main(void) {
   tcase_add_test(tcase, test_create);
   tcase_add_test(tcase, test_create_empty);
   tcase_add_test(tcase, test_create_zero_copy);
+  tcase_add_test(tcase, test_create_copy_on_write);
   tcase_add_test(tcase, test_create_invalid);
   tcase_add_test(tcase, test_create_invalid_allocate);
   suite_add_tcase(suite, tcase);
@@ -1058,22 +1493,37 @@ main(void) {
   /* Add tests to test case "write" */
   tcase = tcase_create("write");
   tcase_add_test(tcase, test_write);
+  tcase_add_test(tcase, test_write_inline);
   tcase_add_test(tcase, test_write_zero_copy);
+  tcase_add_test(tcase, test_write_copy_on_write);
+  tcase_add_test(tcase, test_write_mmap);
+  tcase_add_test(tcase, test_write_mmap_read);
+  tcase_add_test(tcase, test_write_shm);
   tcase_add_test(tcase, test_write_invalid);
   tcase_add_test(tcase, test_write_invalid_allocate);
   tcase_add_test(tcase, test_write_invalid_resize);
   tcase_add_test(tcase, test_write_invalid_zero_copy);
+  tcase_add_test(tcase, test_write_invalid_copy_on_write);
   suite_add_tcase(suite, tcase);
 
   /* Add tests to test case "clear" */
   tcase = tcase_create("clear");
   tcase_add_test(tcase, test_clear);
+  tcase_add_test(tcase, test_clear_inline);
   tcase_add_test(tcase, test_clear_zero_copy);
+  tcase_add_test(tcase, test_clear_copy_on_write);
+  tcase_add_test(tcase, test_clear_mmap);
   tcase_add_test(tcase, test_clear_invalid);
   tcase_add_test(tcase, test_clear_invalid_allocate);
   tcase_add_test(tcase, test_clear_invalid_resize);
   suite_add_tcase(suite, tcase);
 
+  /* Add tests to test case "reset" */
+  tcase = tcase_create("reset");
+  tcase_add_test(tcase, test_reset);
+  tcase_add_test(tcase, test_reset_copy_on_write);
+  suite_add_tcase(suite, tcase);
+
   /* Add tests to test case "align" */
   tcase = tcase_create("align");
   tcase_add_test(tcase, test_align);
@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <protobluff/descriptor.h>
+
+#include "core/buffer.h"
+#include "core/common.h"
+#include "core/varint.h"
+#include "util/aggregate.h"
+#include "util/path.h"
+#include "util/record.h"
+
+/* ----------------------------------------------------------------------------
+ * Files
+ * ------------------------------------------------------------------------- */
+
+/* File used for records */
+#define FILE_RECORD "aggregate.bin"
+
+/* ----------------------------------------------------------------------------
+ * Descriptors
+ * ------------------------------------------------------------------------- */
+
+/* Descriptor */
+static pb_descriptor_t
+descriptor = { {
+  (const pb_field_descriptor_t []){
+    {  1, "latency",  UINT32,  OPTIONAL },
+    {  2, "name",     STRING,  OPTIONAL },
+    {  3, "codes",    SINT32,  REPEATED, NULL, NULL, PACKED }
+  }, 3 } };
+
+/* ----------------------------------------------------------------------------
+ * Fixtures
+ * ------------------------------------------------------------------------- */
+
+/* Number of messages */
+#define MESSAGES 1000
+
+/* Raw data of messages */
+static uint8_t data[MESSAGES][8];
+
+/* Messages with latencies 0 to 999, codes -1, 0 and 1 and a name */
+static pb_buffer_t messages[MESSAGES];
+
+/* Paths */
+static pb_path_t latency, codes;
+
+/*
+ * Create messages and paths.
+ */
+static void
+setup(void) {
+  for (uint32_t m = 0; m < MESSAGES; m++) {
+    size_t size = 0;
+    data[m][size++] = 26;
+    data[m][size++] = 3;
+    data[m][size++] = 1;
+    data[m][size++] = 0;
+    data[m][size++] = 2;
+    data[m][size++] = 8;
+    size += pb_varint_pack_uint32(&(data[m][size]), &m);
+    messages[m] = pb_buffer_create_zero_copy(data[m], size);
+  }
+  latency = pb_path_create(&descriptor, "latency");
+  codes   = pb_path_create(&descriptor, "codes");
+}
+
+/*
+ * Destroy paths.
+ */
+static void
+teardown(void) {
+  pb_path_destroy(&latency);
+  pb_path_destroy(&codes);
+}
+
+/* ----------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Aggregate a field over a batch of buffers in the calling thread.
+ */
+START_TEST(test_buffers) {
+  pb_aggregate_t aggregate = pb_aggregate_create(&latency);
+
+  /* Assert aggregate validity and error */
+  fail_unless(pb_aggregate_valid(&aggregate));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_aggregate_error(&aggregate));
+  ck_assert_uint_eq(0, pb_aggregate_count(&aggregate));
+
+  /* Aggregate buffers */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_aggregate_buffers(&aggregate, messages, MESSAGES, 1));
+
+  /* Assert results */
+  ck_assert_uint_eq(MESSAGES, pb_aggregate_count(&aggregate));
+  fail_unless(pb_aggregate_sum(&aggregate) == 499500);
+  fail_unless(pb_aggregate_min(&aggregate) == 0);
+  fail_unless(pb_aggregate_max(&aggregate) == 999);
+  ck_assert_uint_eq(0, pb_aggregate_bins(&aggregate));
+
+  /* Free all allocated memory */
+  pb_aggregate_destroy(&aggregate);
+} END_TEST
+
+/*
+ * Aggregate a field over a batch of buffers using several threads.
+ */
+START_TEST(test_buffers_threads) {
+  for (size_t threads = 0; threads <= 8; threads++) {
+    pb_aggregate_t aggregate = pb_aggregate_create(&latency);
+    ck_assert_uint_eq(PB_ERROR_NONE,
+      pb_aggregate_buffers(&aggregate, messages, MESSAGES, threads));
+
+    /* Assert results */
+    ck_assert_uint_eq(MESSAGES, pb_aggregate_count(&aggregate));
+    fail_unless(pb_aggregate_sum(&aggregate) == 499500);
+    fail_unless(pb_aggregate_min(&aggregate) == 0);
+    fail_unless(pb_aggregate_max(&aggregate) == 999);
+
+    /* Free all allocated memory */
+    pb_aggregate_destroy(&aggregate);
+  }
+} END_TEST
+
+/*
+ * Aggregate a repeated signed field over a batch of buffers.
+ */
+START_TEST(test_buffers_repeated) {
+  pb_aggregate_t aggregate = pb_aggregate_create(&codes);
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_aggregate_buffers(&aggregate, messages, MESSAGES, 4));
+
+  /* Assert results */
+  ck_assert_uint_eq(MESSAGES * 3, pb_aggregate_count(&aggregate));
+  fail_unless(pb_aggregate_sum(&aggregate) == 0);
+  fail_unless(pb_aggregate_min(&aggregate) == -1);
+  fail_unless(pb_aggregate_max(&aggregate) == 1);
+
+  /* Free all allocated memory */
+  pb_aggregate_destroy(&aggregate);
+} END_TEST
+
+/*
+ * Aggregate a batch containing a buffer which cannot be decoded.
+ */
+START_TEST(test_buffers_invalid) {
+  pb_aggregate_t aggregate = pb_aggregate_create(&latency);
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_aggregate_buffers(&aggregate, messages, 10, 1));
+
+  /* Truncate a message */
+  pb_buffer_t buffers[MESSAGES];
+  memcpy(buffers, messages, sizeof(buffers));
+  buffers[500] = pb_buffer_create_zero_copy(data[500], 7);
+
+  /* Assert error and unaltered aggregate */
+  ck_assert_uint_ne(PB_ERROR_NONE,
+    pb_aggregate_buffers(&aggregate, buffers, MESSAGES, 4));
+  ck_assert_uint_eq(10, pb_aggregate_count(&aggregate));
+  fail_unless(pb_aggregate_sum(&aggregate) == 45);
+
+  /* Free all allocated memory */
+  pb_aggregate_destroy(&aggregate);
+} END_TEST
+
+/*
+ * Aggregate a field into a histogram.
+ */
+START_TEST(test_histogram) {
+  pb_aggregate_t aggregate =
+    pb_aggregate_create_with_histogram(&latency, 0, 1000, 10);
+  fail_unless(pb_aggregate_valid(&aggregate));
+
+  /* Aggregate buffers */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_aggregate_buffers(&aggregate, messages, MESSAGES, 3));
+
+  /* Assert histogram */
+  ck_assert_uint_eq(10, pb_aggregate_bins(&aggregate));
+  for (size_t b = 0; b < 10; b++)
+    ck_assert_uint_eq(100, pb_aggregate_bin(&aggregate, b));
+
+  /* Free all allocated memory */
+  pb_aggregate_destroy(&aggregate);
+} END_TEST
+
+/*
+ * Aggregate a field into a histogram with values outside of its bounds.
+ */
+START_TEST(test_histogram_bounds) {
+  pb_aggregate_t aggregate =
+    pb_aggregate_create_with_histogram(&latency, 100, 200, 2);
+  fail_unless(pb_aggregate_valid(&aggregate));
+
+  /* Aggregate buffers */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_aggregate_buffers(&aggregate, messages, MESSAGES, 2));
+
+  /* Assert histogram */
+  ck_assert_uint_eq(150, pb_aggregate_bin(&aggregate, 0));
+  ck_assert_uint_eq(850, pb_aggregate_bin(&aggregate, 1));
+
+  /* Reset aggregate and assert results */
+  pb_aggregate_reset(&aggregate);
+  ck_assert_uint_eq(0, pb_aggregate_count(&aggregate));
+  ck_assert_uint_eq(0, pb_aggregate_bin(&aggregate, 0));
+
+  /* Free all allocated memory */
+  pb_aggregate_destroy(&aggregate);
+} END_TEST
+
+/*
+ * Aggregate a field over a record file.
+ */
+START_TEST(test_file) {
+  remove(FILE_RECORD);
+
+  /* Write records */
+  pb_record_writer_t writer =
+    pb_record_writer_create(FILE_RECORD, PB_RECORD_SYNC_NONE);
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_record_writer_write(&writer, messages, MESSAGES));
+  pb_record_writer_destroy(&writer);
+
+  /* Aggregate file */
+  pb_aggregate_t aggregate =
+    pb_aggregate_create_with_histogram(&latency, 0, 1000, 4);
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_aggregate_file(&aggregate, FILE_RECORD, 4));
+
+  /* Assert results */
+  ck_assert_uint_eq(MESSAGES, pb_aggregate_count(&aggregate));
+  fail_unless(pb_aggregate_sum(&aggregate) == 499500);
+  fail_unless(pb_aggregate_min(&aggregate) == 0);
+  fail_unless(pb_aggregate_max(&aggregate) == 999);
+  ck_assert_uint_eq(250, pb_aggregate_bin(&aggregate, 3));
+
+  /* Free all allocated memory */
+  pb_aggregate_destroy(&aggregate);
+} END_TEST
+
+/*
+ * Aggregate a field over a record file from an invalid path.
+ */
+START_TEST(test_file_invalid_path) {
+  pb_aggregate_t aggregate = pb_aggregate_create(&latency);
+
+  /* Assert error */
+  ck_assert_uint_eq(PB_ERROR_IO,
+    pb_aggregate_file(&aggregate, "/nonexistent/aggregate.bin", 4));
+
+  /* Free all allocated memory */
+  pb_aggregate_destroy(&aggregate);
+} END_TEST
+
+/*
+ * Create an aggregate for a field which is not numeric.
+ */
+START_TEST(test_create_invalid) {
+  pb_path_t path = pb_path_create(&descriptor, "name");
+  pb_aggregate_t aggregate = pb_aggregate_create(&path);
+
+  /* Assert aggregate validity and error */
+  fail_if(pb_aggregate_valid(&aggregate));
+  ck_assert_uint_eq(PB_ERROR_INVALID, pb_aggregate_error(&aggregate));
+
+  /* Assert aggregation error */
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_aggregate_buffers(&aggregate, messages, MESSAGES, 1));
+
+  /* Free all allocated memory */
+  pb_aggregate_destroy(&aggregate);
+  pb_path_destroy(&path);
+} END_TEST
+
+/* ----------------------------------------------------------------------------
+ * Program
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a test suite for all registered test cases and run it.
+ *
+ * Tests must be run sequentially (in no-fork mode) or code coverage
+ * cannot be determined properly.
+ */
+int
+main(void) {
+  void *suite = suite_create("protobluff/util/aggregate"),
+       *tcase = NULL;
+
+  /* Add tests to test case "buffers" */
+  tcase = tcase_create("buffers");
+  tcase_add_checked_fixture(tcase, setup, teardown);
+  tcase_add_test(tcase, test_buffers);
+  tcase_add_test(tcase, test_buffers_threads);
+  tcase_add_test(tcase, test_buffers_repeated);
+  tcase_add_test(tcase, test_buffers_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "histogram" */
+  tcase = tcase_create("histogram");
+  tcase_add_checked_fixture(tcase, setup, teardown);
+  tcase_add_test(tcase, test_histogram);
+  tcase_add_test(tcase, test_histogram_bounds);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "file" */
+  tcase = tcase_create("file");
+  tcase_add_checked_fixture(tcase, setup, teardown);
+  tcase_add_test(tcase, test_file);
+  tcase_add_test(tcase, test_file_invalid_path);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "create" */
+  tcase = tcase_create("create");
+  tcase_add_checked_fixture(tcase, setup, teardown);
+  tcase_add_test(tcase, test_create_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Create a test suite runner in no-fork mode */
+  void *runner = srunner_create(suite);
+  srunner_set_fork_status(runner, CK_NOFORK);
+
+  /* Execute test suite runner */
+  srunner_run_all(runner, CK_NORMAL);
+  int failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+
+  /* Exit with status code */
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,456 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/common.h"
+#include "util/arena_allocator.h"
+
+/* ----------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create an arena allocator.
+ */
+START_TEST(test_create) {
+  pb_allocator_t allocator = pb_arena_allocator_create();
+  ck_assert_ptr_ne(NULL, allocator.data);
+  pb_arena_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Create an arena allocator with a minimum capacity.
+ */
+START_TEST(test_create_with_capacity) {
+  pb_allocator_t allocator = pb_arena_allocator_create_with_capacity(128);
+  ck_assert_ptr_ne(NULL, allocator.data);
+  pb_arena_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Create an arena allocator backed by hugepages.
+ */
+START_TEST(test_create_with_hugepages) {
+  pb_allocator_t allocator = pb_arena_allocator_create_with_hugepages(128);
+
+  /* Assert alignment to hugepage boundary, if memory could be mapped */
+  if (allocator.data)
+    ck_assert_uint_eq(0, (uintptr_t)allocator.data % (2 * 1024 * 1024));
+  pb_arena_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Create an arena allocator using a caller-provided initial block.
+ */
+START_TEST(test_create_with_block) {
+  uint8_t memory[1024];
+  pb_allocator_t allocator =
+    pb_arena_allocator_create_with_block(memory, sizeof(memory));
+  ck_assert_ptr_ne(NULL, allocator.data);
+
+  /* Assert memory blocks are located inside the initial block */
+  uint8_t *block = pb_allocator_allocate(&allocator, 128);
+  ck_assert_ptr_ne(NULL, block);
+  fail_unless(block > memory && block + 128 <= memory + sizeof(memory));
+
+  /* Allocate beyond the initial block */
+  block = pb_allocator_allocate(&allocator, 2048);
+  ck_assert_ptr_ne(NULL, block);
+  fail_if(block > memory && block < memory + sizeof(memory));
+
+  /* Free all allocated memory */
+  pb_arena_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Create an arena allocator using an initial block which is too small.
+ */
+START_TEST(test_create_with_block_invalid) {
+  uint8_t memory[16];
+  pb_allocator_t allocator =
+    pb_arena_allocator_create_with_block(memory, sizeof(memory));
+  ck_assert_ptr_eq(NULL, allocator.data);
+
+  /* Try to allocate a block */
+  ck_assert_ptr_eq(NULL, pb_allocator_allocate(&allocator, 16));
+
+  /* Free all allocated memory */
+  pb_arena_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Allocate a memory block of given size.
+ */
+START_TEST(test_allocate) {
+  pb_allocator_t allocator = pb_arena_allocator_create();
+
+  /* Allocate a block */
+  void *block1 = pb_allocator_allocate(&allocator, 16);
+  ck_assert_ptr_ne(NULL, block1);
+
+  /* Allocate another block */
+  void *block2 = pb_allocator_allocate(&allocator, 3);
+  ck_assert_ptr_ne(NULL, block2);
+
+  /* Assert different and aligned blocks */
+  ck_assert_ptr_ne(block1, block2);
+  ck_assert_uint_eq(0, (uintptr_t)block1 % 16);
+  ck_assert_uint_eq(0, (uintptr_t)block2 % 16);
+
+  /* Free all allocated memory */
+  pb_arena_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Allocate memory blocks exceeding the capacity of a block.
+ */
+START_TEST(test_allocate_over_capacity) {
+  pb_allocator_t allocator = pb_arena_allocator_create_with_capacity(64);
+
+  /* Allocate blocks and write to them */
+  uint8_t *block[10];
+  for (size_t b = 0; b < 10; b++) {
+    block[b] = pb_allocator_allocate(&allocator, 24 * (b + 1));
+    ck_assert_ptr_ne(NULL, block[b]);
+    memset(block[b], b, 24 * (b + 1));
+  }
+
+  /* Assert blocks were not overwritten */
+  for (size_t b = 0; b < 10; b++)
+    for (size_t i = 0; i < 24 * (b + 1); i++)
+      ck_assert_uint_eq(b, block[b][i]);
+
+  /* Free all allocated memory */
+  pb_arena_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Allocate memory blocks beyond the first hugepage of an arena allocator.
+ */
+START_TEST(test_allocate_hugepages) {
+  pb_allocator_t allocator = pb_arena_allocator_create_with_hugepages(1);
+
+  /* Allocate blocks spanning several hugepages and write to them */
+  uint8_t *block[3];
+  for (size_t b = 0; b < 3; b++) {
+    block[b] = pb_allocator_allocate(&allocator, 1536 * 1024);
+    ck_assert_ptr_ne(NULL, block[b]);
+    memset(block[b], b, 1536 * 1024);
+  }
+
+  /* Assert blocks were not overwritten */
+  for (size_t b = 0; b < 3; b++)
+    for (size_t i = 0; i < 1536 * 1024; i += 4096)
+      ck_assert_uint_eq(b, block[b][i]);
+
+  /* Reset arena and allocate again */
+  pb_arena_allocator_reset(&allocator);
+  ck_assert_ptr_ne(NULL, pb_allocator_allocate(&allocator, 4096 * 1024));
+
+  /* Free all allocated memory */
+  pb_arena_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Allocate a memory block of given size for an invalid allocator.
+ */
+START_TEST(test_allocate_invalid) {
+  pb_allocator_t allocator = pb_arena_allocator_create();
+  pb_allocator_t allocator_invalid = {
+    .proc = {
+      .allocate = allocator.proc.allocate,
+      .resize   = allocator.proc.resize,
+      .free     = allocator.proc.free
+    },
+    .data = NULL
+  };
+
+  /* Try to allocate blocks */
+  ck_assert_ptr_eq(NULL, pb_allocator_allocate(&allocator_invalid, 16));
+  ck_assert_ptr_eq(NULL, pb_allocator_allocate(&allocator_invalid, 16));
+
+  /* Free all allocated memory */
+  pb_arena_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Change the size of the last allocated memory block in place.
+ */
+START_TEST(test_resize) {
+  pb_allocator_t allocator = pb_arena_allocator_create();
+
+  /* Allocate a block */
+  void *block1 = pb_allocator_resize(&allocator, NULL, 16);
+  ck_assert_ptr_ne(NULL, block1);
+
+  /* Resize the block */
+  void *block2 = pb_allocator_resize(&allocator, block1, 128);
+  ck_assert_ptr_eq(block1, block2);
+
+  /* Free all allocated memory */
+  pb_arena_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Change the size of a memory block which is not the last one.
+ */
+START_TEST(test_resize_move) {
+  pb_allocator_t allocator = pb_arena_allocator_create();
+
+  /* Allocate blocks */
+  uint8_t *block1 = pb_allocator_allocate(&allocator, 16);
+  uint8_t *block2 = pb_allocator_allocate(&allocator, 16);
+  ck_assert_ptr_ne(NULL, block1);
+  ck_assert_ptr_ne(NULL, block2);
+  memcpy(block1, "SOME DATA", 9);
+
+  /* Shrink the first block */
+  ck_assert_ptr_eq(block1, pb_allocator_resize(&allocator, block1, 9));
+
+  /* Grow the first block */
+  uint8_t *block3 = pb_allocator_resize(&allocator, block1, 128);
+  ck_assert_ptr_ne(NULL, block3);
+  ck_assert_ptr_ne(block1, block3);
+  fail_if(memcmp("SOME DATA", block3, 9));
+
+  /* Free all allocated memory */
+  pb_arena_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Change the size of a memory block beyond the capacity of a block.
+ */
+START_TEST(test_resize_over_capacity) {
+  pb_allocator_t allocator = pb_arena_allocator_create_with_capacity(64);
+
+  /* Allocate a block */
+  uint8_t *block1 = pb_allocator_allocate(&allocator, 16);
+  ck_assert_ptr_ne(NULL, block1);
+  memcpy(block1, "SOME DATA", 9);
+
+  /* Resize the block */
+  uint8_t *block2 = pb_allocator_resize(&allocator, block1, 128);
+  ck_assert_ptr_ne(NULL, block2);
+  fail_if(memcmp("SOME DATA", block2, 9));
+
+  /* Assert space of the moved block was reclaimed */
+  pb_arena_allocator_reset(&allocator);
+  ck_assert_ptr_eq(block1, pb_allocator_allocate(&allocator, 16));
+
+  /* Free all allocated memory */
+  pb_arena_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Change the size of a previously allocated block for an invalid allocator.
+ */
+START_TEST(test_resize_invalid) {
+  pb_allocator_t allocator = pb_arena_allocator_create();
+  pb_allocator_t allocator_invalid = {
+    .proc = {
+      .allocate = allocator.proc.allocate,
+      .resize   = allocator.proc.resize,
+      .free     = allocator.proc.free
+    },
+    .data = NULL
+  };
+
+  /* Allocate a block */
+  void *block = pb_allocator_resize(&allocator_invalid, NULL, 16);
+  ck_assert_ptr_eq(NULL, block);
+
+  /* Resize the block */
+  block = pb_allocator_resize(&allocator_invalid, block, 128);
+  ck_assert_ptr_eq(NULL, block);
+
+  /* Free all allocated memory */
+  pb_arena_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Free an allocated memory block.
+ */
+START_TEST(test_free) {
+  pb_allocator_t allocator = pb_arena_allocator_create();
+
+  /* Allocate blocks */
+  void *block1 = pb_allocator_allocate(&allocator, 16);
+  void *block2 = pb_allocator_allocate(&allocator, 16);
+  ck_assert_ptr_ne(NULL, block1);
+  ck_assert_ptr_ne(NULL, block2);
+
+  /* Free the last block and assert its space is reused */
+  pb_allocator_free(&allocator, block2);
+  ck_assert_ptr_eq(block2, pb_allocator_allocate(&allocator, 16));
+
+  /* Free the first block and assert its space is not reused */
+  pb_allocator_free(&allocator, block1);
+  ck_assert_ptr_ne(block1, pb_allocator_allocate(&allocator, 16));
+
+  /* Free all allocated memory */
+  pb_arena_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Free an allocated memory block for an invalid allocator.
+ */
+START_TEST(test_free_invalid) {
+  pb_allocator_t allocator = pb_arena_allocator_create();
+  pb_allocator_t allocator_invalid = {
+    .proc = {
+      .allocate = allocator.proc.allocate,
+      .resize   = allocator.proc.resize,
+      .free     = allocator.proc.free
+    },
+    .data = NULL
+  };
+
+  /* Try to free a non-allocated block */
+  char block[] = "DOESN'T MATTER";
+  pb_allocator_free(&allocator_invalid, block);
+
+  /* Free all allocated memory */
+  pb_arena_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Reset an arena allocator.
+ */
+START_TEST(test_reset) {
+  pb_allocator_t allocator = pb_arena_allocator_create_with_capacity(64);
+
+  /* Allocate blocks spanning multiple blocks */
+  void *block[10];
+  for (size_t b = 0; b < 10; b++) {
+    block[b] = pb_allocator_allocate(&allocator, 32);
+    ck_assert_ptr_ne(NULL, block[b]);
+  }
+
+  /* Reset arena and assert blocks are reused in the same order */
+  pb_arena_allocator_reset(&allocator);
+  for (size_t b = 0; b < 10; b++)
+    ck_assert_ptr_eq(block[b], pb_allocator_allocate(&allocator, 32));
+
+  /* Free all allocated memory */
+  pb_arena_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Reset an arena allocator and allocate larger memory blocks.
+ */
+START_TEST(test_reset_grow) {
+  pb_allocator_t allocator = pb_arena_allocator_create_with_capacity(64);
+
+  /* Allocate blocks */
+  for (size_t b = 0; b < 4; b++)
+    ck_assert_ptr_ne(NULL, pb_allocator_allocate(&allocator, 32));
+
+  /* Reset arena and allocate blocks exceeding retained blocks */
+  pb_arena_allocator_reset(&allocator);
+  for (size_t b = 0; b < 4; b++) {
+    uint8_t *block = pb_allocator_allocate(&allocator, 128);
+    ck_assert_ptr_ne(NULL, block);
+    memset(block, 0, 128);
+  }
+
+  /* Free all allocated memory */
+  pb_arena_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Reset an invalid arena allocator.
+ */
+START_TEST(test_reset_invalid) {
+  pb_allocator_t allocator = {};
+  pb_arena_allocator_reset(&allocator);
+  pb_arena_allocator_destroy(&allocator);
+} END_TEST
+
+/* ----------------------------------------------------------------------------
+ * Program
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a test suite for all registered test cases and run it.
+ *
+ * Tests must be run sequentially (in no-fork mode) or code coverage
+ * cannot be determined properly.
+ */
+int
+main(void) {
+  void *suite = suite_create("protobluff/util/arena_allocator"),
+       *tcase = NULL;
+
+  /* Add tests to test case "create" */
+  tcase = tcase_create("create");
+  tcase_add_test(tcase, test_create);
+  tcase_add_test(tcase, test_create_with_capacity);
+  tcase_add_test(tcase, test_create_with_hugepages);
+  tcase_add_test(tcase, test_create_with_block);
+  tcase_add_test(tcase, test_create_with_block_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "allocate" */
+  tcase = tcase_create("allocate");
+  tcase_add_test(tcase, test_allocate);
+  tcase_add_test(tcase, test_allocate_over_capacity);
+  tcase_add_test(tcase, test_allocate_hugepages);
+  tcase_add_test(tcase, test_allocate_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "resize" */
+  tcase = tcase_create("resize");
+  tcase_add_test(tcase, test_resize);
+  tcase_add_test(tcase, test_resize_move);
+  tcase_add_test(tcase, test_resize_over_capacity);
+  tcase_add_test(tcase, test_resize_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "free" */
+  tcase = tcase_create("free");
+  tcase_add_test(tcase, test_free);
+  tcase_add_test(tcase, test_free_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "reset" */
+  tcase = tcase_create("reset");
+  tcase_add_test(tcase, test_reset);
+  tcase_add_test(tcase, test_reset_grow);
+  tcase_add_test(tcase, test_reset_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Create a test suite runner in no-fork mode */
+  void *runner = srunner_create(suite);
+  srunner_set_fork_status(runner, CK_NOFORK);
+
+  /* Execute test suite runner */
+  srunner_run_all(runner, CK_NORMAL);
+  int failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+
+  /* Exit with status code */
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
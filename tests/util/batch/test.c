@@ -0,0 +1,509 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <protobluff/descriptor.h>
+
+#include "core/buffer.h"
+#include "core/common.h"
+#include "core/varint.h"
+#include "util/batch.h"
+#include "util/executor.h"
+
+/* ----------------------------------------------------------------------------
+ * Descriptors
+ * ------------------------------------------------------------------------- */
+
+/* Descriptor */
+static pb_descriptor_t
+descriptor = { {
+  (const pb_field_descriptor_t []){
+    {  1, "value", UINT32, OPTIONAL }
+  }, 1 } };
+
+/* ----------------------------------------------------------------------------
+ * Fixtures
+ * ------------------------------------------------------------------------- */
+
+/* Number of buffers */
+#define BUFFERS 5000
+
+/* Number of threads */
+#define THREADS 4
+
+/* Raw data of buffers */
+static uint8_t data[BUFFERS][6];
+
+/* Buffers with values 0 to 4999 */
+static pb_buffer_t buffers[BUFFERS];
+
+/* Raw data of envelope */
+static uint8_t envelope_data[BUFFERS * 8 + 16];
+
+/* Envelope with an identifier, an unknown field and elements in field 2 */
+static pb_buffer_t envelope;
+
+/* Executor */
+static pb_executor_t executor;
+
+/* Results of handlers */
+static struct {
+  uint64_t sums[THREADS];              /* Sums per thread */
+  uint32_t values[BUFFERS];            /* Values per buffer */
+  size_t order[BUFFERS];               /* Order of completion */
+  size_t completed;                    /* Completed buffers */
+  size_t mismatches;                   /* Completions with wrong state */
+  int pools;                           /* Whether pools were provided */
+} results;
+
+/*
+ * Create buffers and executor.
+ */
+static void
+setup(void) {
+  for (uint32_t b = 0; b < BUFFERS; b++) {
+    data[b][0] = 8;
+    buffers[b] = pb_buffer_create_zero_copy(data[b],
+      1 + pb_varint_pack_uint32(&(data[b][1]), &b));
+  }
+
+  /* Create envelope with elements holding values 0 to 4999 */
+  size_t size = 0;
+  envelope_data[size++] = 8;
+  envelope_data[size++] = 42;
+  for (uint32_t b = 0; b < BUFFERS; b++) {
+    envelope_data[size++] = 18;
+    envelope_data[size++] = pb_buffer_size(&(buffers[b]));
+    memcpy(&(envelope_data[size]), data[b], pb_buffer_size(&(buffers[b])));
+    size += pb_buffer_size(&(buffers[b]));
+  }
+  envelope_data[size++] = 29;
+  size += 4;
+  envelope = pb_buffer_create_zero_copy(envelope_data, size);
+  memset(&results, 0, sizeof(results));
+  results.pools = 1;
+  executor = pb_executor_create(THREADS);
+}
+
+/*
+ * Destroy executor.
+ */
+static void
+teardown(void) {
+  pb_executor_destroy(&executor);
+}
+
+/* ----------------------------------------------------------------------------
+ * Handlers
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Sum values per thread and record values per buffer.
+ */
+static pb_error_t
+handler(
+    const pb_field_descriptor_t *descriptor, const void *value, void *user) {
+  pb_batch_context_t *context = user;
+  fail_unless(context->thread < THREADS && context->index < BUFFERS);
+  fail_unless(context->user == &results);
+  if (!context->pool)
+    results.pools = 0;
+  results.sums[context->thread]  += *(const uint32_t *)value;
+  results.values[context->index]  = *(const uint32_t *)value;
+  return PB_ERROR_NONE;
+}
+
+/*
+ * Record the order of completion.
+ */
+static pb_error_t
+complete(pb_batch_context_t *context) {
+  size_t completed =
+    __atomic_fetch_add(&(results.completed), 1, __ATOMIC_RELAXED);
+  results.order[completed] = context->index;
+  return PB_ERROR_NONE;
+}
+
+/*
+ * Accumulate values and field count in the state of the buffer.
+ */
+static pb_error_t
+handler_state(
+    const pb_field_descriptor_t *descriptor, const void *value, void *user) {
+  pb_batch_context_t *context = user;
+  uint64_t *state = context->state;
+  state[0] += *(const uint32_t *)value;
+  state[1]++;
+  return PB_ERROR_NONE;
+}
+
+/*
+ * Check the state of the buffer and record the order of completion.
+ */
+static pb_error_t
+complete_state(pb_batch_context_t *context) {
+  const uint64_t *state = context->state;
+  if (state[0] != context->index || state[1] != 1)
+    results.mismatches++;
+  return complete(context);
+}
+
+/*
+ * Fail at a specific buffer.
+ */
+static pb_error_t
+complete_fail(pb_batch_context_t *context) {
+  return context->index == 2500
+    ? PB_ERROR_INVALID
+    : complete(context);
+}
+
+/* ----------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Decode a batch of buffers.
+ */
+START_TEST(test_decode) {
+  pb_batch_t batch = pb_batch_create(&executor, &descriptor, handler);
+
+  /* Assert batch validity and error */
+  fail_unless(pb_batch_valid(&batch));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_batch_error(&batch));
+  ck_assert_ptr_eq(&descriptor, pb_batch_descriptor(&batch));
+  ck_assert_uint_eq(THREADS, pb_batch_threads(&batch));
+
+  /* Decode buffers and assert results */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_batch_decode(&batch, buffers, BUFFERS, &results));
+  uint64_t sum = 0;
+  for (size_t t = 0; t < THREADS; t++)
+    sum += results.sums[t];
+  ck_assert_uint_eq(12497500, sum);
+  for (size_t b = 0; b < BUFFERS; b++)
+    ck_assert_uint_eq(b, results.values[b]);
+  fail_unless(results.pools);
+
+  /* Free all allocated memory */
+  pb_batch_destroy(&batch);
+} END_TEST
+
+/*
+ * Decode a batch of buffers and complete them in any order.
+ */
+START_TEST(test_decode_complete) {
+  pb_batch_t batch = pb_batch_create_with_completion(&executor,
+    &descriptor, handler, complete, PB_BATCH_ORDER_NONE);
+  fail_unless(pb_batch_valid(&batch));
+
+  /* Decode buffers and assert completions */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_batch_decode(&batch, buffers, BUFFERS, &results));
+  ck_assert_uint_eq(BUFFERS, results.completed);
+
+  /* Free all allocated memory */
+  pb_batch_destroy(&batch);
+} END_TEST
+
+/*
+ * Decode a batch of buffers and complete them in order.
+ */
+START_TEST(test_decode_complete_ordered) {
+  pb_batch_t batch = pb_batch_create_with_completion(&executor,
+    &descriptor, handler, complete, PB_BATCH_ORDER_INDEX);
+  fail_unless(pb_batch_valid(&batch));
+
+  /* Decode buffers twice and assert order of completions */
+  for (size_t r = 0; r < 2; r++) {
+    results.completed = 0;
+    ck_assert_uint_eq(PB_ERROR_NONE,
+      pb_batch_decode(&batch, buffers, BUFFERS, &results));
+    ck_assert_uint_eq(BUFFERS, results.completed);
+    for (size_t b = 0; b < BUFFERS; b++)
+      ck_assert_uint_eq(b, results.order[b]);
+  }
+
+  /* Free all allocated memory */
+  pb_batch_destroy(&batch);
+} END_TEST
+
+/*
+ * Decode a batch of buffers with state and complete them in order.
+ */
+START_TEST(test_decode_complete_ordered_state) {
+  pb_batch_t batch = pb_batch_create_with_state(&executor, &descriptor,
+    handler_state, complete_state, PB_BATCH_ORDER_INDEX, 2 * sizeof(uint64_t));
+  fail_unless(pb_batch_valid(&batch));
+
+  /* Decode buffers and assert state and order of completions */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_batch_decode(&batch, buffers, BUFFERS, &results));
+  ck_assert_uint_eq(BUFFERS, results.completed);
+  ck_assert_uint_eq(0, results.mismatches);
+  for (size_t b = 0; b < BUFFERS; b++)
+    ck_assert_uint_eq(b, results.order[b]);
+
+  /* Free all allocated memory */
+  pb_batch_destroy(&batch);
+} END_TEST
+
+/*
+ * Decode a batch of buffers and fail during completion in order.
+ */
+START_TEST(test_decode_complete_ordered_error) {
+  pb_batch_t batch = pb_batch_create_with_completion(&executor,
+    &descriptor, handler, complete_fail, PB_BATCH_ORDER_INDEX);
+  fail_unless(pb_batch_valid(&batch));
+
+  /* Decode buffers and assert error and prefix of completions */
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_batch_decode(&batch, buffers, BUFFERS, &results));
+  ck_assert_uint_eq(2500, results.completed);
+  for (size_t b = 0; b < results.completed; b++)
+    ck_assert_uint_eq(b, results.order[b]);
+
+  /* Free all allocated memory */
+  pb_batch_destroy(&batch);
+} END_TEST
+
+/*
+ * Decode an empty batch of buffers.
+ */
+START_TEST(test_decode_empty) {
+  pb_batch_t batch = pb_batch_create_with_completion(&executor,
+    &descriptor, handler, complete, PB_BATCH_ORDER_INDEX);
+  fail_unless(pb_batch_valid(&batch));
+
+  /* Decode no buffers */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_batch_decode(&batch, NULL, 0, &results));
+  ck_assert_uint_eq(0, results.completed);
+
+  /* Free all allocated memory */
+  pb_batch_destroy(&batch);
+} END_TEST
+
+/*
+ * Decode a batch containing a buffer which cannot be decoded.
+ */
+START_TEST(test_decode_invalid) {
+  pb_batch_t batch = pb_batch_create(&executor, &descriptor, handler);
+  fail_unless(pb_batch_valid(&batch));
+
+  /* Truncate a buffer */
+  buffers[BUFFERS - 1] = pb_buffer_create_zero_copy(data[BUFFERS - 1], 2);
+
+  /* Assert decoding error */
+  ck_assert_uint_ne(PB_ERROR_NONE,
+    pb_batch_decode(&batch, buffers, BUFFERS, &results));
+
+  /* Free all allocated memory */
+  pb_batch_destroy(&batch);
+} END_TEST
+
+/*
+ * Decode the elements of a repeated field and complete them in order.
+ */
+START_TEST(test_decode_field) {
+  pb_batch_t batch = pb_batch_create_with_completion(&executor,
+    &descriptor, handler, complete, PB_BATCH_ORDER_INDEX);
+  fail_unless(pb_batch_valid(&batch));
+
+  /* Decode elements and assert results and order of completions */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_batch_decode_field(&batch, &envelope, 2, &results));
+  ck_assert_uint_eq(BUFFERS, results.completed);
+  for (size_t b = 0; b < BUFFERS; b++) {
+    ck_assert_uint_eq(b, results.values[b]);
+    ck_assert_uint_eq(b, results.order[b]);
+  }
+
+  /* Free all allocated memory */
+  pb_batch_destroy(&batch);
+} END_TEST
+
+/*
+ * Decode the elements of an absent repeated field.
+ */
+START_TEST(test_decode_field_absent) {
+  pb_batch_t batch = pb_batch_create_with_completion(&executor,
+    &descriptor, handler, complete, PB_BATCH_ORDER_INDEX);
+  fail_unless(pb_batch_valid(&batch));
+
+  /* Decode no elements */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_batch_decode_field(&batch, &envelope, 3, &results));
+  ck_assert_uint_eq(0, results.completed);
+
+  /* Free all allocated memory */
+  pb_batch_destroy(&batch);
+} END_TEST
+
+/*
+ * Decode the elements of a repeated field of a truncated message.
+ */
+START_TEST(test_decode_field_truncated) {
+  pb_batch_t batch = pb_batch_create(&executor, &descriptor, handler);
+  fail_unless(pb_batch_valid(&batch));
+
+  /* Assert decoding error */
+  pb_buffer_t buffer = pb_buffer_create_zero_copy(envelope_data, 5);
+  ck_assert_uint_eq(PB_ERROR_OFFSET,
+    pb_batch_decode_field(&batch, &buffer, 2, &results));
+
+  /* Free all allocated memory */
+  pb_batch_destroy(&batch);
+} END_TEST
+
+/*
+ * Decode the elements of a repeated field of a message with invalid wiretype.
+ */
+START_TEST(test_decode_field_wiretype) {
+  pb_batch_t batch = pb_batch_create(&executor, &descriptor, handler);
+  fail_unless(pb_batch_valid(&batch));
+
+  /* Assert decoding error */
+  uint8_t data[] = { 8, 42, 15, 0 };
+  pb_buffer_t buffer = pb_buffer_create_zero_copy(data, 4);
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_batch_decode_field(&batch, &buffer, 2, &results));
+
+  /* Free all allocated memory */
+  pb_batch_destroy(&batch);
+} END_TEST
+
+/*
+ * Validate the elements of a repeated field.
+ */
+START_TEST(test_check_field) {
+  pb_batch_t batch = pb_batch_create_with_completion(&executor,
+    &descriptor, handler, complete, PB_BATCH_ORDER_INDEX);
+  fail_unless(pb_batch_valid(&batch));
+
+  /* Validate elements and assert that no handlers were invoked */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_batch_check_field(&batch, &envelope, 2));
+  ck_assert_uint_eq(0, results.completed);
+  ck_assert_uint_eq(0, results.values[BUFFERS - 1]);
+
+  /* Free all allocated memory */
+  pb_batch_destroy(&batch);
+} END_TEST
+
+/*
+ * Validate the elements of a repeated field with an invalid element.
+ */
+START_TEST(test_check_field_invalid) {
+  pb_batch_t batch = pb_batch_create(&executor, &descriptor, handler);
+  fail_unless(pb_batch_valid(&batch));
+
+  /* Corrupt varint of last element */
+  envelope_data[pb_buffer_size(&envelope) - 6] |= 0x80;
+
+  /* Assert validation error */
+  ck_assert_uint_eq(PB_ERROR_VARINT,
+    pb_batch_check_field(&batch, &envelope, 2));
+
+  /* Free all allocated memory */
+  pb_batch_destroy(&batch);
+} END_TEST
+
+/*
+ * Create a batch using an invalid executor.
+ */
+START_TEST(test_create_invalid) {
+  pb_executor_t invalid = pb_executor_create_invalid();
+  pb_batch_t batch = pb_batch_create(&invalid, &descriptor, handler);
+
+  /* Assert batch validity and error */
+  fail_if(pb_batch_valid(&batch));
+  ck_assert_uint_eq(PB_ERROR_ALLOC, pb_batch_error(&batch));
+
+  /* Assert decoding error */
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_batch_decode(&batch, buffers, BUFFERS, &results));
+
+  /* Free all allocated memory */
+  pb_batch_destroy(&batch);
+} END_TEST
+
+/* ----------------------------------------------------------------------------
+ * Program
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a test suite for all registered test cases and run it.
+ *
+ * Tests must be run sequentially (in no-fork mode) or code coverage
+ * cannot be determined properly.
+ */
+int
+main(void) {
+  void *suite = suite_create("protobluff/util/batch"),
+       *tcase = NULL;
+
+  /* Add tests to test case "create" */
+  tcase = tcase_create("create");
+  tcase_add_checked_fixture(tcase, setup, teardown);
+  tcase_add_test(tcase, test_create_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "decode" */
+  tcase = tcase_create("decode");
+  tcase_add_checked_fixture(tcase, setup, teardown);
+  tcase_add_test(tcase, test_decode);
+  tcase_add_test(tcase, test_decode_complete);
+  tcase_add_test(tcase, test_decode_complete_ordered);
+  tcase_add_test(tcase, test_decode_complete_ordered_state);
+  tcase_add_test(tcase, test_decode_complete_ordered_error);
+  tcase_add_test(tcase, test_decode_empty);
+  tcase_add_test(tcase, test_decode_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "field" */
+  tcase = tcase_create("field");
+  tcase_add_checked_fixture(tcase, setup, teardown);
+  tcase_add_test(tcase, test_decode_field);
+  tcase_add_test(tcase, test_decode_field_absent);
+  tcase_add_test(tcase, test_decode_field_truncated);
+  tcase_add_test(tcase, test_decode_field_wiretype);
+  tcase_add_test(tcase, test_check_field);
+  tcase_add_test(tcase, test_check_field_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Create a test suite runner in no-fork mode */
+  void *runner = srunner_create(suite);
+  srunner_set_fork_status(runner, CK_NOFORK);
+
+  /* Execute test suite runner */
+  srunner_run_all(runner, CK_NORMAL);
+  int failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+
+  /* Exit with status code */
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,399 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/buffer.h"
+#include "core/common.h"
+#include "util/block.h"
+#include "util/record.h"
+
+/* ----------------------------------------------------------------------------
+ * Files
+ * ------------------------------------------------------------------------- */
+
+/* File used for blocks */
+#define FILE_BLOCK "block.bin"
+
+/* ----------------------------------------------------------------------------
+ * Fixtures
+ * ------------------------------------------------------------------------- */
+
+/* Number of records */
+#define RECORDS 1000
+
+/* Raw data of records */
+static uint8_t data[RECORDS][32];
+
+/* Records of varying size */
+static pb_buffer_t records[RECORDS];
+
+/*
+ * Create compressible records of varying size, including empty ones, which
+ * start with their number followed by a common pattern.
+ */
+static void
+setup(void) {
+  for (size_t r = 0; r < RECORDS; r++) {
+    for (size_t b = 0; b < 32; b++)
+      data[r][b] = b < 2 ? r >> (b * 8) : 'a' + b % 8;
+    records[r] = r % 33
+      ? pb_buffer_create_zero_copy(data[r], r % 33)
+      : pb_buffer_create_empty();
+  }
+}
+
+/*
+ * Determine the size of a file.
+ *
+ * \return Size
+ */
+static size_t
+file_size(void) {
+  FILE *file = fopen(FILE_BLOCK, "rb");
+  fail_unless(file);
+  fseek(file, 0, SEEK_END);
+  size_t size = ftell(file);
+  fclose(file);
+  return size;
+}
+
+/*
+ * Read all records from a file and assert they match.
+ */
+static void
+file_read(void) {
+  pb_block_reader_t reader = pb_block_reader_create(FILE_BLOCK);
+
+  /* Assert reader validity and error */
+  fail_unless(pb_block_reader_valid(&reader));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_block_reader_error(&reader));
+
+  /* Read and compare records */
+  for (size_t r = 0; r < RECORDS; r++) {
+    pb_buffer_t record;
+    ck_assert_uint_eq(PB_ERROR_NONE, pb_block_reader_next(&reader, &record));
+    ck_assert_uint_eq(pb_buffer_size(&(records[r])), pb_buffer_size(&record));
+    if (pb_buffer_size(&record))
+      fail_if(memcmp(pb_buffer_data(&(records[r])),
+        pb_buffer_data(&record), pb_buffer_size(&record)));
+    pb_buffer_destroy(&record);
+  }
+
+  /* Assert end of records */
+  pb_buffer_t record;
+  ck_assert_uint_eq(PB_ERROR_EOM, pb_block_reader_next(&reader, &record));
+
+  /* Free all allocated memory */
+  pb_block_reader_destroy(&reader);
+}
+
+/* ----------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Write records to compressed blocks and read them.
+ */
+START_TEST(test_write) {
+  remove(FILE_BLOCK);
+
+  /* Create writer */
+  pb_block_writer_t writer =
+    pb_block_writer_create_with_size(FILE_BLOCK, PB_RECORD_SYNC_CLOSE, 1024);
+
+  /* Assert writer validity and error */
+  fail_unless(pb_block_writer_valid(&writer));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_block_writer_error(&writer));
+
+  /* Write records in batches */
+  for (size_t r = 0; r < RECORDS; r += 100)
+    ck_assert_uint_eq(PB_ERROR_NONE,
+      pb_block_writer_write(&writer, &(records[r]), 100));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_block_writer_flush(&writer));
+  pb_block_writer_destroy(&writer);
+
+  /* Assert records were compressed */
+  size_t size = 0;
+  for (size_t r = 0; r < RECORDS; r++)
+    size += 1 + pb_buffer_size(&(records[r]));
+  fail_unless(file_size() < size / 2);
+  file_read();
+} END_TEST
+
+/*
+ * Write records with the default block size, relying on the writer to write
+ * the pending block when it's destroyed.
+ */
+START_TEST(test_write_default) {
+  remove(FILE_BLOCK);
+
+  /* Create writer and write records */
+  pb_block_writer_t writer =
+    pb_block_writer_create(FILE_BLOCK, PB_RECORD_SYNC_NONE);
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_block_writer_write(&writer, records, RECORDS));
+
+  /* Assert nothing was written, as the block is still pending */
+  ck_assert_uint_eq(0, file_size());
+  pb_block_writer_destroy(&writer);
+  file_read();
+} END_TEST
+
+/*
+ * Write incompressible records, which are stored uncompressed.
+ */
+START_TEST(test_write_incompressible) {
+  uint32_t state = 42;
+  for (size_t r = 0; r < RECORDS; r++) {
+    for (size_t b = 0; b < 32; b++) {
+      state = state * 1103515245 + 12345;
+      data[r][b] = state >> 16;
+    }
+  }
+  remove(FILE_BLOCK);
+
+  /* Create writer and write records */
+  pb_block_writer_t writer =
+    pb_block_writer_create_with_size(FILE_BLOCK, PB_RECORD_SYNC_NONE, 256);
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_block_writer_write(&writer, records, RECORDS));
+  pb_block_writer_destroy(&writer);
+  file_read();
+
+  /* Restore compressible records */
+  setup();
+} END_TEST
+
+/*
+ * Write records larger than the block size.
+ */
+START_TEST(test_write_large) {
+  remove(FILE_BLOCK);
+
+  /* Create writer and write records */
+  pb_block_writer_t writer =
+    pb_block_writer_create_with_size(FILE_BLOCK, PB_RECORD_SYNC_WRITE, 8);
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_block_writer_write(&writer, records, RECORDS));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_block_writer_flush(&writer));
+  pb_block_writer_destroy(&writer);
+  file_read();
+} END_TEST
+
+/*
+ * Write to a block writer for an invalid path.
+ */
+START_TEST(test_write_invalid_path) {
+  pb_block_writer_t writer =
+    pb_block_writer_create("/nonexistent/block.bin", PB_RECORD_SYNC_NONE);
+
+  /* Assert writer validity and error */
+  fail_if(pb_block_writer_valid(&writer));
+  ck_assert_uint_eq(PB_ERROR_IO, pb_block_writer_error(&writer));
+
+  /* Assert write and flush error */
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_block_writer_write(&writer, records, RECORDS));
+  ck_assert_uint_eq(PB_ERROR_INVALID, pb_block_writer_flush(&writer));
+
+  /* Free all allocated memory */
+  pb_block_writer_destroy(&writer);
+} END_TEST
+
+/*
+ * Read a block with a corrupted byte.
+ */
+START_TEST(test_read_corrupted) {
+  remove(FILE_BLOCK);
+
+  /* Create writer and write records into a single block */
+  pb_block_writer_t writer =
+    pb_block_writer_create(FILE_BLOCK, PB_RECORD_SYNC_NONE);
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_block_writer_write(&writer, records, RECORDS));
+  pb_block_writer_destroy(&writer);
+
+  /* Corrupt a byte of compressed data */
+  FILE *file = fopen(FILE_BLOCK, "r+b");
+  fail_unless(file);
+  fseek(file, -1, SEEK_END);
+  fputc(0xFF, file);
+  fclose(file);
+
+  /* Create reader */
+  pb_block_reader_t reader = pb_block_reader_create(FILE_BLOCK);
+  fail_unless(pb_block_reader_valid(&reader));
+
+  /* Assert corruption is detected and block is skipped */
+  pb_buffer_t record;
+  ck_assert_uint_eq(PB_ERROR_INVALID, pb_block_reader_next(&reader, &record));
+  ck_assert_uint_eq(PB_ERROR_EOM, pb_block_reader_next(&reader, &record));
+
+  /* Free all allocated memory */
+  pb_block_reader_destroy(&reader);
+} END_TEST
+
+/*
+ * Write a record which is too large for a block.
+ */
+START_TEST(test_write_oversized) {
+  remove(FILE_BLOCK);
+
+  /* Create writer and a record claiming the largest size a block can hold */
+  pb_block_writer_t writer =
+    pb_block_writer_create(FILE_BLOCK, PB_RECORD_SYNC_NONE);
+  pb_buffer_t record =
+    pb_buffer_create_zero_copy_internal(data[0], UINT32_MAX);
+
+  /* Assert record is rejected before it is copied */
+  ck_assert_uint_eq(PB_ERROR_OFFSET,
+    pb_block_writer_write(&writer, &record, 1));
+  ck_assert_uint_eq(0, pb_buffer_size(&(writer.block)));
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&record);
+  pb_block_writer_destroy(&writer);
+} END_TEST
+
+/*
+ * Read a block whose header claims an impossible decompressed size.
+ */
+START_TEST(test_read_oversized) {
+  remove(FILE_BLOCK);
+
+  /* Write a block header claiming 4 GB, followed by a few compressed bytes */
+  uint8_t block[12] = { 0xFF, 0xFF, 0xFF, 0xFF };
+  pb_buffer_t buffer = pb_buffer_create(block, sizeof(block));
+  pb_record_writer_t writer =
+    pb_record_writer_create(FILE_BLOCK, PB_RECORD_SYNC_NONE);
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_record_writer_write(&writer, &buffer, 1));
+  pb_record_writer_destroy(&writer);
+
+  /* Create reader */
+  pb_block_reader_t reader = pb_block_reader_create(FILE_BLOCK);
+  fail_unless(pb_block_reader_valid(&reader));
+
+  /* Assert block is rejected without allocating memory */
+  pb_buffer_t record;
+  ck_assert_uint_eq(PB_ERROR_INVALID, pb_block_reader_next(&reader, &record));
+  ck_assert_uint_eq(0, pb_buffer_size(&(reader.block)));
+
+  /* Free all allocated memory */
+  pb_block_reader_destroy(&reader);
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
+/*
+ * Read a block which is too short to hold a header.
+ */
+START_TEST(test_read_truncated) {
+  remove(FILE_BLOCK);
+
+  /* Write a record which is not a block */
+  pb_record_writer_t writer =
+    pb_record_writer_create(FILE_BLOCK, PB_RECORD_SYNC_NONE);
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_record_writer_write(&writer, &(records[4]), 1));
+  pb_record_writer_destroy(&writer);
+
+  /* Create reader */
+  pb_block_reader_t reader = pb_block_reader_create(FILE_BLOCK);
+  fail_unless(pb_block_reader_valid(&reader));
+
+  /* Assert block error */
+  pb_buffer_t record;
+  ck_assert_uint_eq(PB_ERROR_OFFSET, pb_block_reader_next(&reader, &record));
+
+  /* Free all allocated memory */
+  pb_block_reader_destroy(&reader);
+} END_TEST
+
+/*
+ * Read blocks from an invalid path.
+ */
+START_TEST(test_read_invalid_path) {
+  pb_block_reader_t reader = pb_block_reader_create("/nonexistent/block.bin");
+
+  /* Assert reader validity and error */
+  fail_if(pb_block_reader_valid(&reader));
+  ck_assert_uint_ne(PB_ERROR_NONE, pb_block_reader_error(&reader));
+
+  /* Assert read error */
+  pb_buffer_t record;
+  ck_assert_uint_eq(PB_ERROR_INVALID, pb_block_reader_next(&reader, &record));
+
+  /* Free all allocated memory */
+  pb_block_reader_destroy(&reader);
+} END_TEST
+
+/* ----------------------------------------------------------------------------
+ * Program
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a test suite for all registered test cases and run it.
+ *
+ * Tests must be run sequentially (in no-fork mode) or code coverage
+ * cannot be determined properly.
+ */
+int
+main(void) {
+  void *suite = suite_create("protobluff/util/block"),
+       *tcase = NULL;
+  setup();
+
+  /* Add tests to test case "write" */
+  tcase = tcase_create("write");
+  tcase_add_test(tcase, test_write);
+  tcase_add_test(tcase, test_write_default);
+  tcase_add_test(tcase, test_write_incompressible);
+  tcase_add_test(tcase, test_write_large);
+  tcase_add_test(tcase, test_write_oversized);
+  tcase_add_test(tcase, test_write_invalid_path);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "read" */
+  tcase = tcase_create("read");
+  tcase_add_test(tcase, test_read_corrupted);
+  tcase_add_test(tcase, test_read_oversized);
+  tcase_add_test(tcase, test_read_truncated);
+  tcase_add_test(tcase, test_read_invalid_path);
+  suite_add_tcase(suite, tcase);
+
+  /* Create a test suite runner in no-fork mode */
+  void *runner = srunner_create(suite);
+  srunner_set_fork_status(runner, CK_NOFORK);
+
+  /* Execute test suite runner */
+  srunner_run_all(runner, CK_NORMAL);
+  int failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+
+  /* Exit with status code */
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <protobluff/descriptor.h>
+
+#include "core/allocator.h"
+#include "core/common.h"
+#include "core/descriptor.h"
+#include "core/encoder.h"
+#include "message/journal.h"
+#include "util/budget_allocator.h"
+#include "util/chunk_allocator.h"
+
+/* ----------------------------------------------------------------------------
+ * Descriptors
+ * ------------------------------------------------------------------------- */
+
+/* Descriptor */
+static pb_descriptor_t
+descriptor = { {
+  (const pb_field_descriptor_t []){
+    {  1, "F01", STRING,  REPEATED }
+  }, 1 } };
+
+/* ----------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a budget allocator.
+ */
+START_TEST(test_create) {
+  pb_allocator_t allocator = pb_budget_allocator_create(64);
+  ck_assert_ptr_ne(NULL, allocator.data);
+
+  /* Assert initial usage */
+  ck_assert_uint_eq(0, pb_budget_allocator_current(&allocator));
+  ck_assert_uint_eq(0, pb_budget_allocator_peak(&allocator));
+
+  /* Free all allocated memory */
+  pb_budget_allocator_destroy(&allocator);
+  ck_assert_ptr_eq(NULL, allocator.data);
+} END_TEST
+
+/*
+ * Create a budget allocator wrapping an allocator.
+ */
+START_TEST(test_create_with_allocator) {
+  pb_allocator_t chunk = pb_chunk_allocator_create();
+  pb_allocator_t allocator =
+    pb_budget_allocator_create_with_allocator(&chunk, 64);
+
+  /* Allocate a block and write to it */
+  void *block = pb_allocator_allocate(&allocator, 16);
+  ck_assert_ptr_ne(NULL, block);
+  memset(block, 0, 16);
+  ck_assert_uint_eq(16, pb_budget_allocator_current(&allocator));
+
+  /* Free all allocated memory */
+  pb_allocator_free(&allocator, block);
+  pb_budget_allocator_destroy(&allocator);
+  pb_chunk_allocator_destroy(&chunk);
+} END_TEST
+
+/*
+ * Allocate memory blocks within and beyond the budget.
+ */
+START_TEST(test_allocate) {
+  pb_allocator_t allocator = pb_budget_allocator_create(64);
+
+  /* Allocate blocks within budget */
+  void *block1 = pb_allocator_allocate(&allocator, 40);
+  ck_assert_ptr_ne(NULL, block1);
+  void *block2 = pb_allocator_allocate(&allocator, 24);
+  ck_assert_ptr_ne(NULL, block2);
+
+  /* Allocate block beyond budget */
+  ck_assert_ptr_eq(NULL, pb_allocator_allocate(&allocator, 1));
+  ck_assert_uint_eq(64, pb_budget_allocator_current(&allocator));
+
+  /* Free a block and allocate again */
+  pb_allocator_free(&allocator, block2);
+  ck_assert_uint_eq(40, pb_budget_allocator_current(&allocator));
+  block2 = pb_allocator_allocate(&allocator, 16);
+  ck_assert_ptr_ne(NULL, block2);
+
+  /* Assert peak */
+  ck_assert_uint_eq(56, pb_budget_allocator_current(&allocator));
+  ck_assert_uint_eq(64, pb_budget_allocator_peak(&allocator));
+
+  /* Free all allocated memory */
+  pb_allocator_free(&allocator, block1);
+  pb_allocator_free(&allocator, block2);
+  ck_assert_uint_eq(0, pb_budget_allocator_current(&allocator));
+  pb_budget_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Allocate a memory block from an invalid budget allocator.
+ */
+START_TEST(test_allocate_invalid) {
+  pb_allocator_t allocator = pb_budget_allocator_create(64);
+  pb_allocator_t allocator_invalid = {
+    .proc = allocator.proc,
+    .data = NULL
+  };
+
+  /* Assert failing operations */
+  ck_assert_ptr_eq(NULL, pb_allocator_allocate(&allocator_invalid, 16));
+  ck_assert_ptr_eq(NULL, pb_allocator_resize(&allocator_invalid, NULL, 16));
+  ck_assert_uint_eq(0, pb_budget_allocator_current(&allocator_invalid));
+  ck_assert_uint_eq(0, pb_budget_allocator_peak(&allocator_invalid));
+
+  /* Free all allocated memory */
+  pb_budget_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Resize a memory block within and beyond the budget.
+ */
+START_TEST(test_resize) {
+  pb_allocator_t allocator = pb_budget_allocator_create(64);
+
+  /* Allocate block and grow it within budget */
+  uint8_t *block = pb_allocator_resize(&allocator, NULL, 16);
+  ck_assert_ptr_ne(NULL, block);
+  memset(block, 1, 16);
+  block = pb_allocator_resize(&allocator, block, 64);
+  ck_assert_ptr_ne(NULL, block);
+  ck_assert_uint_eq(64, pb_budget_allocator_current(&allocator));
+
+  /* Grow block beyond budget and assert unaltered block */
+  ck_assert_ptr_eq(NULL, pb_allocator_resize(&allocator, block, 65));
+  ck_assert_uint_eq(64, pb_budget_allocator_current(&allocator));
+  for (size_t i = 0; i < 16; i++)
+    ck_assert_uint_eq(1, block[i]);
+
+  /* Shrink block */
+  block = pb_allocator_resize(&allocator, block, 8);
+  ck_assert_ptr_ne(NULL, block);
+  ck_assert_uint_eq(8, pb_budget_allocator_current(&allocator));
+  ck_assert_uint_eq(64, pb_budget_allocator_peak(&allocator));
+
+  /* Free all allocated memory */
+  pb_allocator_free(&allocator, block);
+  pb_budget_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Write to a journal until the budget is exhausted.
+ */
+START_TEST(test_journal) {
+  pb_allocator_t allocator = pb_budget_allocator_create(256);
+  pb_journal_t journal = pb_journal_create_empty_with_allocator(&allocator);
+
+  /* Grow journal until budget is exhausted */
+  const uint8_t data[] = "SOME DATA";
+  pb_error_t error;
+  size_t size = 0;
+  while (!(error = pb_journal_write(&journal, 0, size, size, data, 9)))
+    size += 9;
+  ck_assert_uint_eq(PB_ERROR_ALLOC, error);
+  fail_if(size == 0);
+
+  /* Assert intact journal and bounded usage */
+  ck_assert_uint_eq(size, pb_journal_size(&journal));
+  fail_if(memcmp(data, pb_journal_data(&journal) + size - 9, 9));
+  fail_if(pb_budget_allocator_peak(&allocator) > 256);
+
+  /* Assert journal still works within budget */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_journal_clear(&journal, 0, 0, 9));
+  ck_assert_uint_eq(size - 9, pb_journal_size(&journal));
+
+  /* Free all allocated memory */
+  pb_journal_destroy(&journal);
+  ck_assert_uint_eq(0, pb_budget_allocator_current(&allocator));
+  pb_budget_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Encode values until the budget is exhausted.
+ */
+START_TEST(test_encoder) {
+  pb_allocator_t allocator = pb_budget_allocator_create(64);
+  pb_encoder_t encoder =
+    pb_encoder_create_with_allocator(&allocator, &descriptor);
+
+  /* Encode values until budget is exhausted */
+  pb_string_t value = pb_string_init_from_chars("SOME DATA");
+  pb_error_t error;
+  size_t count = 0;
+  while (!(error = pb_encoder_encode(&encoder, 1, &value, 1)))
+    count++;
+  ck_assert_uint_eq(PB_ERROR_ALLOC, error);
+  ck_assert_uint_eq(5, count);
+
+  /* Assert bounded usage */
+  fail_if(pb_budget_allocator_peak(&allocator) > 64);
+
+  /* Free all allocated memory */
+  pb_encoder_destroy(&encoder);
+  ck_assert_uint_eq(0, pb_budget_allocator_current(&allocator));
+  pb_budget_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Reset the high-water mark of a budget allocator.
+ */
+START_TEST(test_reset) {
+  pb_allocator_t allocator = pb_budget_allocator_create(64);
+
+  /* Allocate and free blocks */
+  void *block1 = pb_allocator_allocate(&allocator, 32);
+  void *block2 = pb_allocator_allocate(&allocator, 16);
+  pb_allocator_free(&allocator, block2);
+  ck_assert_uint_eq(48, pb_budget_allocator_peak(&allocator));
+
+  /* Reset high-water mark */
+  pb_budget_allocator_reset(&allocator);
+  ck_assert_uint_eq(32, pb_budget_allocator_peak(&allocator));
+
+  /* Free all allocated memory */
+  pb_allocator_free(&allocator, block1);
+  pb_budget_allocator_destroy(&allocator);
+} END_TEST
+
+/* ----------------------------------------------------------------------------
+ * Program
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a test suite for all registered test cases and run it.
+ *
+ * Tests must be run sequentially (in no-fork mode) or code coverage
+ * cannot be determined properly.
+ */
+int
+main(void) {
+  void *suite = suite_create("protobluff/util/budget_allocator"),
+       *tcase = NULL;
+
+  /* Add tests to test case "create" */
+  tcase = tcase_create("create");
+  tcase_add_test(tcase, test_create);
+  tcase_add_test(tcase, test_create_with_allocator);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "allocate" */
+  tcase = tcase_create("allocate");
+  tcase_add_test(tcase, test_allocate);
+  tcase_add_test(tcase, test_allocate_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "resize" */
+  tcase = tcase_create("resize");
+  tcase_add_test(tcase, test_resize);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "journal" */
+  tcase = tcase_create("journal");
+  tcase_add_test(tcase, test_journal);
+  tcase_add_test(tcase, test_encoder);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "reset" */
+  tcase = tcase_create("reset");
+  tcase_add_test(tcase, test_reset);
+  suite_add_tcase(suite, tcase);
+
+  /* Create a test suite runner in no-fork mode */
+  void *runner = srunner_create(suite);
+  srunner_set_fork_status(runner, CK_NOFORK);
+
+  /* Execute test suite runner */
+  srunner_run_all(runner, CK_NORMAL);
+  int failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+
+  /* Exit with status code */
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,452 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/common.h"
+#include "util/cache_allocator.h"
+
+/* ----------------------------------------------------------------------------
+ * Thread routines
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Free all memory blocks in a shared array from a thread.
+ *
+ * \param[in,out] data Shared array, terminated by the allocator
+ * \return             Nothing
+ */
+static void *
+thread_free(void *data) {
+  void **blocks = data;
+  pb_allocator_t *allocator = blocks[0];
+  for (size_t b = 1; blocks[b]; b++)
+    pb_allocator_free(allocator, blocks[b]);
+  return NULL;
+}
+
+/*!
+ * Allocate and free memory blocks of varying size from a thread.
+ *
+ * \param[in,out] data Allocator
+ * \return             Nothing
+ */
+static void *
+thread_churn(void *data) {
+  pb_allocator_t *allocator = data;
+  void *blocks[100];
+  for (size_t r = 0; r < 50; r++) {
+    for (size_t b = 0; b < 100; b++) {
+      blocks[b] = pb_allocator_allocate(allocator, 1 + (b * 97 + r) % 2048);
+      memset(blocks[b], (int)b, 1);
+    }
+    for (size_t b = 0; b < 100; b++) {
+      if (*(uint8_t *)blocks[b] != (uint8_t)b)
+        return allocator;
+      pb_allocator_free(allocator, blocks[b]);
+    }
+  }
+  return NULL;
+}
+
+/* ----------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a cache allocator.
+ */
+START_TEST(test_create) {
+  pb_allocator_t allocator = pb_cache_allocator_create();
+  ck_assert_ptr_ne(NULL, allocator.data);
+  pb_cache_allocator_destroy(&allocator);
+  ck_assert_ptr_eq(NULL, allocator.data);
+} END_TEST
+
+/*
+ * Allocate a memory block of given size.
+ */
+START_TEST(test_allocate) {
+  pb_allocator_t allocator = pb_cache_allocator_create();
+
+  /* Allocate a block */
+  void *block1 = pb_allocator_allocate(&allocator, 16);
+  ck_assert_ptr_ne(NULL, block1);
+
+  /* Allocate another block */
+  void *block2 = pb_allocator_allocate(&allocator, 16);
+  ck_assert_ptr_ne(NULL, block2);
+
+  /* Assert different blocks */
+  ck_assert_ptr_ne(block1, block2);
+
+  /* Free all allocated memory */
+  pb_allocator_free(&allocator, block1);
+  pb_allocator_free(&allocator, block2);
+  pb_cache_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Allocate a memory block exceeding the largest size class.
+ */
+START_TEST(test_allocate_large) {
+  pb_allocator_t allocator = pb_cache_allocator_create();
+
+  /* Allocate a block and write to it */
+  void *block = pb_allocator_allocate(&allocator, 100000);
+  ck_assert_ptr_ne(NULL, block);
+  memset(block, 0, 100000);
+
+  /* Free all allocated memory */
+  pb_allocator_free(&allocator, block);
+  pb_cache_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Allocate a memory block of given size for an invalid allocator.
+ */
+START_TEST(test_allocate_invalid) {
+  pb_allocator_t allocator = pb_cache_allocator_create();
+  pb_allocator_t allocator_invalid = {
+    .proc = {
+      .allocate = allocator.proc.allocate,
+      .resize   = allocator.proc.resize,
+      .free     = allocator.proc.free
+    },
+    .data = NULL
+  };
+
+  /* Try to allocate blocks */
+  ck_assert_ptr_eq(NULL, pb_allocator_allocate(&allocator_invalid, 16));
+  ck_assert_ptr_eq(NULL, pb_allocator_allocate(&allocator_invalid, 16));
+
+  /* Free all allocated memory */
+  pb_cache_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Change the size of a previously allocated memory block.
+ */
+START_TEST(test_resize) {
+  pb_allocator_t allocator = pb_cache_allocator_create();
+
+  /* Allocate a block and write to it */
+  void *block = pb_allocator_allocate(&allocator, 20);
+  ck_assert_ptr_ne(NULL, block);
+  memcpy(block, "SOME DATA TO BE KEPT", 20);
+
+  /* Resize block within its size class */
+  ck_assert_ptr_eq(block, pb_allocator_resize(&allocator, block, 32));
+
+  /* Resize block beyond its size class */
+  void *moved = pb_allocator_resize(&allocator, block, 64);
+  ck_assert_ptr_ne(NULL, moved);
+  ck_assert_ptr_ne(block, moved);
+  fail_if(memcmp(moved, "SOME DATA TO BE KEPT", 20));
+
+  /* Free all allocated memory */
+  pb_allocator_free(&allocator, moved);
+  pb_cache_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Change the size of a memory block between small and large.
+ */
+START_TEST(test_resize_large) {
+  pb_allocator_t allocator = pb_cache_allocator_create();
+
+  /* Allocate a block and write to it */
+  void *block = pb_allocator_allocate(&allocator, 20);
+  ck_assert_ptr_ne(NULL, block);
+  memcpy(block, "SOME DATA TO BE KEPT", 20);
+
+  /* Resize block to be large and larger */
+  block = pb_allocator_resize(&allocator, block, 100000);
+  ck_assert_ptr_ne(NULL, block);
+  block = pb_allocator_resize(&allocator, block, 200000);
+  ck_assert_ptr_ne(NULL, block);
+  fail_if(memcmp(block, "SOME DATA TO BE KEPT", 20));
+
+  /* Resize block to be small again */
+  block = pb_allocator_resize(&allocator, block, 20);
+  ck_assert_ptr_ne(NULL, block);
+  fail_if(memcmp(block, "SOME DATA TO BE KEPT", 20));
+
+  /* Free all allocated memory */
+  pb_allocator_free(&allocator, block);
+  pb_cache_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Change the size of a memory block that was not allocated before.
+ */
+START_TEST(test_resize_null) {
+  pb_allocator_t allocator = pb_cache_allocator_create();
+
+  /* Allocate a block through resizing */
+  void *block = pb_allocator_resize(&allocator, NULL, 16);
+  ck_assert_ptr_ne(NULL, block);
+
+  /* Free all allocated memory */
+  pb_allocator_free(&allocator, block);
+  pb_cache_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Change the size of a previously allocated block for an invalid allocator.
+ */
+START_TEST(test_resize_invalid) {
+  pb_allocator_t allocator = pb_cache_allocator_create();
+  pb_allocator_t allocator_invalid = {
+    .proc = {
+      .allocate = allocator.proc.allocate,
+      .resize   = allocator.proc.resize,
+      .free     = allocator.proc.free
+    },
+    .data = NULL
+  };
+
+  /* Allocate a block */
+  void *block = pb_allocator_allocate(&allocator, 16);
+  ck_assert_ptr_ne(NULL, block);
+
+  /* Try to resize block */
+  ck_assert_ptr_eq(NULL, pb_allocator_resize(&allocator_invalid, block, 32));
+
+  /* Free all allocated memory */
+  pb_allocator_free(&allocator, block);
+  pb_cache_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Free an allocated memory block and reuse it from the thread cache.
+ */
+START_TEST(test_free) {
+  pb_allocator_t allocator = pb_cache_allocator_create();
+
+  /* Allocate and free a block */
+  void *block = pb_allocator_allocate(&allocator, 100);
+  ck_assert_ptr_ne(NULL, block);
+  pb_allocator_free(&allocator, block);
+
+  /* Assert block is reused for the same size class */
+  ck_assert_ptr_eq(block, pb_allocator_allocate(&allocator, 128));
+  pb_allocator_free(&allocator, block);
+
+  /* Free all allocated memory */
+  pb_cache_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Free more memory blocks than the thread cache retains.
+ */
+START_TEST(test_free_overflow) {
+  pb_allocator_t allocator = pb_cache_allocator_create();
+  void *blocks[200], *reused[200];
+
+  /* Allocate and free blocks */
+  for (size_t b = 0; b < 200; b++) {
+    blocks[b] = pb_allocator_allocate(&allocator, 16);
+    ck_assert_ptr_ne(NULL, blocks[b]);
+  }
+  for (size_t b = 0; b < 200; b++)
+    pb_allocator_free(&allocator, blocks[b]);
+
+  /* Assert blocks are reused from thread cache and depot */
+  for (size_t b = 0; b < 200; b++) {
+    void *block = pb_allocator_allocate(&allocator, 16);
+    size_t found = 0;
+    for (size_t c = 0; c < 200; c++)
+      found |= blocks[c] == block;
+    ck_assert_uint_eq(1, found);
+    reused[b] = block;
+  }
+  for (size_t b = 0; b < 200; b++)
+    pb_allocator_free(&allocator, reused[b]);
+
+  /* Free all allocated memory */
+  pb_cache_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Free memory blocks allocated by another thread.
+ */
+START_TEST(test_free_thread) {
+  pb_allocator_t allocator = pb_cache_allocator_create();
+  void *blocks[102] = { &allocator };
+
+  /* Allocate blocks and free them from another thread */
+  for (size_t b = 1; b < 101; b++) {
+    blocks[b] = pb_allocator_allocate(&allocator, 16);
+    ck_assert_ptr_ne(NULL, blocks[b]);
+  }
+  pthread_t thread;
+  ck_assert_int_eq(0, pthread_create(&thread, NULL, thread_free, blocks));
+  ck_assert_int_eq(0, pthread_join(thread, NULL));
+
+  /* Assert blocks migrated back through the depot */
+  for (size_t b = 1; b < 101; b++) {
+    void *block = pb_allocator_allocate(&allocator, 16);
+    size_t found = 0;
+    for (size_t c = 1; c < 101; c++)
+      found |= blocks[c] == block;
+    ck_assert_uint_eq(1, found);
+    pb_allocator_free(&allocator, block);
+  }
+
+  /* Free all allocated memory */
+  pb_cache_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Allocate and free memory blocks from multiple threads concurrently.
+ */
+START_TEST(test_free_concurrent) {
+  pb_allocator_t allocator = pb_cache_allocator_create();
+
+  /* Start threads and wait for them to finish */
+  pthread_t threads[8];
+  for (size_t t = 0; t < 8; t++)
+    ck_assert_int_eq(0,
+      pthread_create(&(threads[t]), NULL, thread_churn, &allocator));
+  for (size_t t = 0; t < 8; t++) {
+    void *result;
+    ck_assert_int_eq(0, pthread_join(threads[t], &result));
+    ck_assert_ptr_eq(NULL, result);
+  }
+
+  /* Free all allocated memory */
+  pb_cache_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Free an allocated memory block for an invalid allocator.
+ */
+START_TEST(test_free_invalid) {
+  pb_allocator_t allocator = pb_cache_allocator_create();
+  pb_allocator_t allocator_invalid = {
+    .proc = {
+      .allocate = allocator.proc.allocate,
+      .resize   = allocator.proc.resize,
+      .free     = allocator.proc.free
+    },
+    .data = NULL
+  };
+
+  /* Allocate a block */
+  void *block = pb_allocator_allocate(&allocator, 16);
+  ck_assert_ptr_ne(NULL, block);
+
+  /* Try to free block */
+  pb_allocator_free(&allocator_invalid, block);
+
+  /* Free all allocated memory */
+  pb_allocator_free(&allocator, block);
+  pb_cache_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Move all memory blocks cached by the calling thread to the depot.
+ */
+START_TEST(test_flush) {
+  pb_allocator_t allocator = pb_cache_allocator_create();
+
+  /* Flush before and after the thread cache is used */
+  pb_cache_allocator_flush(&allocator);
+  void *block = pb_allocator_allocate(&allocator, 16);
+  ck_assert_ptr_ne(NULL, block);
+  pb_allocator_free(&allocator, block);
+  pb_cache_allocator_flush(&allocator);
+
+  /* Assert block is reused from depot */
+  ck_assert_ptr_eq(block, pb_allocator_allocate(&allocator, 16));
+  pb_allocator_free(&allocator, block);
+
+  /* Free all allocated memory */
+  pb_cache_allocator_destroy(&allocator);
+} END_TEST
+
+/* ----------------------------------------------------------------------------
+ * Program
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a test suite for all registered test cases and run it.
+ *
+ * Tests must be run sequentially (in no-fork mode) or code coverage
+ * cannot be determined properly.
+ */
+int
+main(void) {
+  void *suite = suite_create("protobluff/util/cache_allocator"),
+       *tcase = NULL;
+
+  /* Add tests to test case "create" */
+  tcase = tcase_create("create");
+  tcase_add_test(tcase, test_create);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "allocate" */
+  tcase = tcase_create("allocate");
+  tcase_add_test(tcase, test_allocate);
+  tcase_add_test(tcase, test_allocate_large);
+  tcase_add_test(tcase, test_allocate_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "resize" */
+  tcase = tcase_create("resize");
+  tcase_add_test(tcase, test_resize);
+  tcase_add_test(tcase, test_resize_large);
+  tcase_add_test(tcase, test_resize_null);
+  tcase_add_test(tcase, test_resize_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "free" */
+  tcase = tcase_create("free");
+  tcase_add_test(tcase, test_free);
+  tcase_add_test(tcase, test_free_overflow);
+  tcase_add_test(tcase, test_free_thread);
+  tcase_add_test(tcase, test_free_concurrent);
+  tcase_add_test(tcase, test_free_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "flush" */
+  tcase = tcase_create("flush");
+  tcase_add_test(tcase, test_flush);
+  suite_add_tcase(suite, tcase);
+
+  /* Create a test suite runner in no-fork mode */
+  void *runner = srunner_create(suite);
+  srunner_set_fork_status(runner, CK_NOFORK);
+
+  /* Execute test suite runner */
+  srunner_run_all(runner, CK_NORMAL);
+  int failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+
+  /* Exit with status code */
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -21,6 +21,7 @@
  */
 
 #include <check.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "core/common.h"
@@ -67,6 +68,24 @@ START_TEST(test_allocate) {
   pb_chunk_allocator_destroy(&allocator);
 } END_TEST
 
+/*
+ * Allocate and resize memory blocks and check their alignment.
+ */
+START_TEST(test_allocate_aligned) {
+  pb_allocator_t allocator = pb_chunk_allocator_create();
+
+  /* Allocate and resize blocks */
+  for (size_t b = 1; b < 64; b++) {
+    void *block = pb_allocator_allocate(&allocator, b);
+    ck_assert_uint_eq(0, (uintptr_t)block % 16);
+    block = pb_allocator_resize(&allocator, block, b * 1024);
+    ck_assert_uint_eq(0, (uintptr_t)block % 16);
+  }
+
+  /* Free all allocated memory */
+  pb_chunk_allocator_destroy(&allocator);
+} END_TEST
+
 /*
  * Allocate a memory block of given size for an invalid allocator.
  */
@@ -210,6 +229,56 @@ START_TEST(test_free_unordered) {
   pb_chunk_allocator_destroy(&allocator);
 } END_TEST
 
+/*
+ * Free an allocated memory block and recycle its chunk.
+ */
+START_TEST(test_free_recycle) {
+  pb_allocator_t allocator = pb_chunk_allocator_create_with_capacity(16);
+
+  /* Allocate blocks of different size classes */
+  void *block1 = pb_allocator_allocate(&allocator, 8);
+  void *block2 = pb_allocator_allocate(&allocator, 40);
+  ck_assert_ptr_ne(NULL, block1);
+  ck_assert_ptr_ne(NULL, block2);
+
+  /* Free both blocks */
+  pb_allocator_free(&allocator, block1);
+  pb_allocator_free(&allocator, block2);
+
+  /* Assert chunks are recycled for the same size classes */
+  ck_assert_ptr_eq(block2, pb_allocator_allocate(&allocator, 33));
+  ck_assert_ptr_eq(block1, pb_allocator_allocate(&allocator, 15));
+
+  /* Free all allocated memory */
+  pb_chunk_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Free more allocated memory blocks than are retained for recycling.
+ */
+START_TEST(test_free_retain) {
+  pb_allocator_t allocator = pb_chunk_allocator_create_with_capacity(16);
+
+  /* Allocate blocks of small and large size classes */
+  void *block[200];
+  for (size_t b = 0; b < 200; b++) {
+    block[b] = pb_allocator_allocate(&allocator, b % 2 ? 8 : 1024);
+    ck_assert_ptr_ne(NULL, block[b]);
+  }
+
+  /* Free every other block, then resize and free the rest */
+  for (size_t b = 0; b < 200; b += 2)
+    pb_allocator_free(&allocator, block[b]);
+  for (size_t b = 1; b < 200; b += 2) {
+    block[b] = pb_allocator_resize(&allocator, block[b], 64);
+    ck_assert_ptr_ne(NULL, block[b]);
+    pb_allocator_free(&allocator, block[b]);
+  }
+
+  /* Free all allocated memory */
+  pb_chunk_allocator_destroy(&allocator);
+} END_TEST
+
 /*
  * Free an allocated memory block for an invalid allocator.
  */
@@ -256,6 +325,7 @@ main(void) {
   /* Add tests to test case "allocate" */
   tcase = tcase_create("allocate");
   tcase_add_test(tcase, test_allocate);
+  tcase_add_test(tcase, test_allocate_aligned);
   tcase_add_test(tcase, test_allocate_invalid);
   suite_add_tcase(suite, tcase);
 
@@ -270,6 +340,8 @@ main(void) {
   tcase = tcase_create("free");
   tcase_add_test(tcase, test_free);
   tcase_add_test(tcase, test_free_unordered);
+  tcase_add_test(tcase, test_free_recycle);
+  tcase_add_test(tcase, test_free_retain);
   tcase_add_test(tcase, test_free_invalid);
   suite_add_tcase(suite, tcase);
 
@@ -0,0 +1,441 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <protobluff/descriptor.h>
+
+#include "core/buffer.h"
+#include "core/common.h"
+#include "core/varint.h"
+#include "util/container.h"
+#include "util/path.h"
+#include "util/record.h"
+
+/* ----------------------------------------------------------------------------
+ * Files
+ * ------------------------------------------------------------------------- */
+
+/* File used for containers */
+#define FILE_CONTAINER "container.bin"
+
+/* ----------------------------------------------------------------------------
+ * Descriptors
+ * ------------------------------------------------------------------------- */
+
+/* Descriptor */
+static pb_descriptor_t
+descriptor = { {
+  (const pb_field_descriptor_t []){
+    {  1, "key",      UINT32,  OPTIONAL },
+    {  2, "name",     STRING,  OPTIONAL }
+  }, 2 } };
+
+/* ----------------------------------------------------------------------------
+ * Fixtures
+ * ------------------------------------------------------------------------- */
+
+/* Number of records */
+#define RECORDS 100
+
+/* Raw data of records */
+static uint8_t data[RECORDS][6];
+
+/* Records with keys 0, 2, 4, ... */
+static pb_buffer_t records[RECORDS];
+
+/*
+ * Create records with ascending keys and varying sizes.
+ */
+static void
+setup(void) {
+  for (size_t r = 0; r < RECORDS; r++) {
+    uint32_t key = r * 2;
+    data[r][0] = 8;
+    size_t size = 1 + pb_varint_pack_uint32(&(data[r][1]), &key);
+    records[r] = pb_buffer_create_zero_copy(data[r], size);
+  }
+}
+
+/*
+ * Write all records to a container in batches.
+ *
+ * \param[in] key      Key path
+ * \param[in] interval Key sampling interval
+ */
+static void
+container_write(const pb_path_t *key, size_t interval) {
+  remove(FILE_CONTAINER);
+  pb_container_writer_t writer = key
+    ? pb_container_writer_create_with_keys(FILE_CONTAINER, key, interval)
+    : pb_container_writer_create(FILE_CONTAINER);
+  fail_unless(pb_container_writer_valid(&writer));
+
+  /* Write records in batches of varying size */
+  for (size_t r = 0, batch = 1; r < RECORDS; r += batch++) {
+    size_t size = r + batch > RECORDS ? RECORDS - r : batch;
+    ck_assert_uint_eq(PB_ERROR_NONE,
+      pb_container_writer_write(&writer, &(records[r]), size));
+  }
+  ck_assert_uint_eq(RECORDS, pb_container_writer_size(&writer));
+
+  /* Finish container */
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_container_writer_finish(&writer));
+  fail_if(pb_container_writer_valid(&writer));
+
+  /* Free all allocated memory */
+  pb_container_writer_destroy(&writer);
+}
+
+/* ----------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Write records to a container and retrieve them by number.
+ */
+START_TEST(test_get) {
+  container_write(NULL, 0);
+
+  /* Create reader */
+  pb_container_reader_t reader = pb_container_reader_create(FILE_CONTAINER);
+
+  /* Assert reader validity and error */
+  fail_unless(pb_container_reader_valid(&reader));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_container_reader_error(&reader));
+  ck_assert_uint_eq(RECORDS, pb_container_reader_size(&reader));
+
+  /* Retrieve records in reverse order */
+  for (size_t r = RECORDS; r > 0; r--) {
+    pb_buffer_t record;
+    ck_assert_uint_eq(PB_ERROR_NONE,
+      pb_container_reader_get(&reader, r - 1, &record));
+
+    /* Assert record size and contents */
+    ck_assert_uint_eq(pb_buffer_size(&(records[r - 1])),
+      pb_buffer_size(&record));
+    fail_if(memcmp(pb_buffer_data(&(records[r - 1])),
+      pb_buffer_data(&record), pb_buffer_size(&record)));
+
+    /* Free all allocated memory */
+    pb_buffer_destroy(&record);
+  }
+
+  /* Free all allocated memory */
+  pb_container_reader_destroy(&reader);
+} END_TEST
+
+/*
+ * Retrieve a record beyond the end of a container.
+ */
+START_TEST(test_get_offset) {
+  container_write(NULL, 0);
+
+  /* Create reader */
+  pb_container_reader_t reader = pb_container_reader_create(FILE_CONTAINER);
+  fail_unless(pb_container_reader_valid(&reader));
+
+  /* Assert record retrieval error */
+  pb_buffer_t record;
+  ck_assert_uint_eq(PB_ERROR_OFFSET,
+    pb_container_reader_get(&reader, RECORDS, &record));
+
+  /* Free all allocated memory */
+  pb_container_reader_destroy(&reader);
+} END_TEST
+
+/*
+ * Seek records by key.
+ */
+START_TEST(test_seek) {
+  pb_path_t key = pb_path_create(&descriptor, "key");
+  container_write(&key, 16);
+
+  /* Create reader */
+  pb_container_reader_t reader = pb_container_reader_create(FILE_CONTAINER);
+  fail_unless(pb_container_reader_valid(&reader));
+
+  /* Seek existing and non-existing keys */
+  for (uint64_t value = 0; value <= RECORDS * 2 - 2; value++) {
+    size_t position;
+    ck_assert_uint_eq(PB_ERROR_NONE,
+      pb_container_reader_seek(&reader, &key, value, &position));
+    ck_assert_uint_eq((value + 1) / 2, position);
+  }
+
+  /* Seek key beyond the last one */
+  size_t position;
+  ck_assert_uint_eq(PB_ERROR_ABSENT,
+    pb_container_reader_seek(&reader, &key, RECORDS * 2, &position));
+
+  /* Free all allocated memory */
+  pb_container_reader_destroy(&reader);
+  pb_path_destroy(&key);
+} END_TEST
+
+/*
+ * Seek records by key with every key sampled.
+ */
+START_TEST(test_seek_dense) {
+  pb_path_t key = pb_path_create(&descriptor, "key");
+  container_write(&key, 1);
+
+  /* Create reader */
+  pb_container_reader_t reader = pb_container_reader_create(FILE_CONTAINER);
+  fail_unless(pb_container_reader_valid(&reader));
+
+  /* Seek existing and non-existing keys */
+  for (uint64_t value = 0; value <= RECORDS * 2 - 2; value++) {
+    size_t position;
+    ck_assert_uint_eq(PB_ERROR_NONE,
+      pb_container_reader_seek(&reader, &key, value, &position));
+    ck_assert_uint_eq((value + 1) / 2, position);
+  }
+
+  /* Free all allocated memory */
+  pb_container_reader_destroy(&reader);
+  pb_path_destroy(&key);
+} END_TEST
+
+/*
+ * Seek records in a container without key samples.
+ */
+START_TEST(test_seek_invalid) {
+  pb_path_t key = pb_path_create(&descriptor, "key");
+  container_write(NULL, 0);
+
+  /* Create reader */
+  pb_container_reader_t reader = pb_container_reader_create(FILE_CONTAINER);
+  fail_unless(pb_container_reader_valid(&reader));
+
+  /* Assert seek error */
+  size_t position;
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_container_reader_seek(&reader, &key, 0, &position));
+
+  /* Free all allocated memory */
+  pb_container_reader_destroy(&reader);
+  pb_path_destroy(&key);
+} END_TEST
+
+/*
+ * Write records without keys to a container with key samples.
+ */
+START_TEST(test_write_absent) {
+  pb_path_t key = pb_path_create(&descriptor, "name");
+  remove(FILE_CONTAINER);
+
+  /* Create writer */
+  pb_container_writer_t writer =
+    pb_container_writer_create_with_keys(FILE_CONTAINER, &key, 1);
+  fail_unless(pb_container_writer_valid(&writer));
+
+  /* Assert nothing is written */
+  ck_assert_uint_eq(PB_ERROR_ABSENT,
+    pb_container_writer_write(&writer, records, RECORDS));
+  ck_assert_uint_eq(0, pb_container_writer_size(&writer));
+  fail_unless(pb_container_writer_valid(&writer));
+
+  /* Finish container */
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_container_writer_finish(&writer));
+  pb_container_writer_destroy(&writer);
+
+  /* Create reader and assert emptiness */
+  pb_container_reader_t reader = pb_container_reader_create(FILE_CONTAINER);
+  fail_unless(pb_container_reader_valid(&reader));
+  ck_assert_uint_eq(0, pb_container_reader_size(&reader));
+
+  /* Free all allocated memory */
+  pb_container_reader_destroy(&reader);
+  pb_path_destroy(&key);
+} END_TEST
+
+/*
+ * Write to a container writer for an invalid path.
+ */
+START_TEST(test_write_invalid_path) {
+  pb_container_writer_t writer =
+    pb_container_writer_create("/nonexistent/container.bin");
+
+  /* Assert writer validity and error */
+  fail_if(pb_container_writer_valid(&writer));
+  ck_assert_uint_eq(PB_ERROR_IO, pb_container_writer_error(&writer));
+
+  /* Assert write and finish error */
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_container_writer_write(&writer, records, RECORDS));
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_container_writer_finish(&writer));
+
+  /* Free all allocated memory */
+  pb_container_writer_destroy(&writer);
+} END_TEST
+
+/*
+ * Read a plain record file, which is not a container.
+ */
+START_TEST(test_read_invalid) {
+  remove(FILE_CONTAINER);
+
+  /* Write records without index */
+  pb_record_writer_t writer =
+    pb_record_writer_create(FILE_CONTAINER, PB_RECORD_SYNC_NONE);
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_record_writer_write(&writer, records, RECORDS));
+  pb_record_writer_destroy(&writer);
+
+  /* Create reader */
+  pb_container_reader_t reader = pb_container_reader_create(FILE_CONTAINER);
+
+  /* Assert reader validity and error */
+  fail_if(pb_container_reader_valid(&reader));
+  ck_assert_uint_eq(PB_ERROR_INVALID, pb_container_reader_error(&reader));
+
+  /* Assert record retrieval error */
+  pb_buffer_t record;
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_container_reader_get(&reader, 0, &record));
+
+  /* Free all allocated memory */
+  pb_container_reader_destroy(&reader);
+} END_TEST
+
+/*
+ * Read containers with crafted footers whose offsets wrap around.
+ */
+START_TEST(test_read_crafted) {
+  const uint64_t footers[][6] = {
+    { 0, 1, UINT64_MAX - 7, 0, 0, 0 },
+    { 0, UINT64_MAX / 8 + 1, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, UINT64_MAX / 8 + 1, 1 },
+    { 0, 0, 0, 8, UINT64_MAX, 1 },
+    { 0, 0, 0, 0, 1, 1 }
+  };
+  for (size_t f = 0; f < sizeof(footers) / sizeof(footers[0]); f++) {
+    remove(FILE_CONTAINER);
+
+    /* Write footer */
+    FILE *file = fopen(FILE_CONTAINER, "wb");
+    fail_unless(file != NULL);
+    fail_unless(fwrite(footers[f], sizeof(footers[f]), 1, file) == 1);
+    fail_unless(fwrite("pbcont\0\1", 8, 1, file) == 1);
+    fclose(file);
+
+    /* Assert reader validity and error */
+    pb_container_reader_t reader = pb_container_reader_create(FILE_CONTAINER);
+    fail_if(pb_container_reader_valid(&reader));
+    ck_assert_uint_eq(PB_ERROR_INVALID, pb_container_reader_error(&reader));
+
+    /* Free all allocated memory */
+    pb_container_reader_destroy(&reader);
+  }
+} END_TEST
+
+/*
+ * Write a container next to a file which has the name of a scratch file.
+ */
+START_TEST(test_write_scratch) {
+  FILE *file = fopen(FILE_CONTAINER ".index", "wb");
+  fail_unless(file != NULL);
+  fclose(file);
+
+  /* Write container and assert file is still present */
+  container_write(NULL, 0);
+  fail_unless((file = fopen(FILE_CONTAINER ".index", "rb")) != NULL);
+  fclose(file);
+  remove(FILE_CONTAINER ".index");
+} END_TEST
+
+/*
+ * Read a container from an invalid path.
+ */
+START_TEST(test_read_invalid_path) {
+  pb_container_reader_t reader =
+    pb_container_reader_create("/nonexistent/container.bin");
+
+  /* Assert reader validity and error */
+  fail_if(pb_container_reader_valid(&reader));
+  ck_assert_uint_eq(PB_ERROR_IO, pb_container_reader_error(&reader));
+
+  /* Free all allocated memory */
+  pb_container_reader_destroy(&reader);
+} END_TEST
+
+/* ----------------------------------------------------------------------------
+ * Program
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a test suite for all registered test cases and run it.
+ *
+ * Tests must be run sequentially (in no-fork mode) or code coverage
+ * cannot be determined properly.
+ */
+int
+main(void) {
+  void *suite = suite_create("protobluff/util/container"),
+       *tcase = NULL;
+  setup();
+
+  /* Add tests to test case "get" */
+  tcase = tcase_create("get");
+  tcase_add_test(tcase, test_get);
+  tcase_add_test(tcase, test_get_offset);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "seek" */
+  tcase = tcase_create("seek");
+  tcase_add_test(tcase, test_seek);
+  tcase_add_test(tcase, test_seek_dense);
+  tcase_add_test(tcase, test_seek_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "write" */
+  tcase = tcase_create("write");
+  tcase_add_test(tcase, test_write_absent);
+  tcase_add_test(tcase, test_write_invalid_path);
+  tcase_add_test(tcase, test_write_scratch);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "read" */
+  tcase = tcase_create("read");
+  tcase_add_test(tcase, test_read_invalid);
+  tcase_add_test(tcase, test_read_crafted);
+  tcase_add_test(tcase, test_read_invalid_path);
+  suite_add_tcase(suite, tcase);
+
+  /* Create a test suite runner in no-fork mode */
+  void *runner = srunner_create(suite);
+  srunner_set_fork_status(runner, CK_NOFORK);
+
+  /* Execute test suite runner */
+  srunner_run_all(runner, CK_NORMAL);
+  int failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+
+  /* Exit with status code */
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
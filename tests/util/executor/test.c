@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/common.h"
+#include "util/executor.h"
+
+/* ----------------------------------------------------------------------------
+ * Fixtures
+ * ------------------------------------------------------------------------- */
+
+/* Number of tasks */
+#define TASKS 10000
+
+/* Executions per task */
+static unsigned int executions[TASKS];
+
+/* Threads that executed tasks */
+static size_t threads[TASKS];
+
+/* Whether a task of the first thread was stolen */
+static int stolen;
+
+/*
+ * Reset executions.
+ */
+static void
+setup(void) {
+  memset(executions, 0, sizeof(executions));
+  memset(threads, 0, sizeof(threads));
+  stolen = 0;
+}
+
+/* ----------------------------------------------------------------------------
+ * Tasks
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Count the execution of a task.
+ */
+static pb_error_t
+task_count(size_t index, size_t thread, void *user) {
+  fail_unless(index < TASKS);
+  executions[index]++;
+  threads[index] = thread;
+  return PB_ERROR_NONE;
+}
+
+/*
+ * Block the first task of the first thread until another task of the first
+ * thread was stolen by another thread.
+ */
+static pb_error_t
+task_steal(size_t index, size_t thread, void *user) {
+  pb_executor_t *executor = user;
+  if (index == 0) {
+    for (size_t spin = 0; spin < 1000000000 &&
+        !__atomic_load_n(&stolen, __ATOMIC_ACQUIRE); spin++);
+  } else if (thread && index < TASKS / pb_executor_size(executor)) {
+    __atomic_store_n(&stolen, 1, __ATOMIC_RELEASE);
+  }
+  return task_count(index, thread, user);
+}
+
+/*
+ * Fail at a specific task.
+ */
+static pb_error_t
+task_fail(size_t index, size_t thread, void *user) {
+  return index == 42
+    ? PB_ERROR_INVALID
+    : task_count(index, thread, user);
+}
+
+/* ----------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create an executor and execute tasks.
+ */
+START_TEST(test_run) {
+  pb_executor_t executor = pb_executor_create(4);
+
+  /* Assert executor validity and error */
+  fail_unless(pb_executor_valid(&executor));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_executor_error(&executor));
+  ck_assert_uint_eq(4, pb_executor_size(&executor));
+
+  /* Execute tasks and assert executions */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_executor_run(&executor, TASKS, task_count, NULL));
+  for (size_t t = 0; t < TASKS; t++) {
+    ck_assert_uint_eq(1, executions[t]);
+    fail_unless(threads[t] < 4);
+  }
+
+  /* Free all allocated memory */
+  pb_executor_destroy(&executor);
+} END_TEST
+
+/*
+ * Execute tasks using an executor multiple times.
+ */
+START_TEST(test_run_repeated) {
+  pb_executor_t executor = pb_executor_create(3);
+  fail_unless(pb_executor_valid(&executor));
+
+  /* Execute tasks and assert executions */
+  for (size_t r = 1; r <= 100; r++) {
+    memset(executions, 0, sizeof(executions));
+    ck_assert_uint_eq(PB_ERROR_NONE,
+      pb_executor_run(&executor, r * 10, task_count, NULL));
+    for (size_t t = 0; t < r * 10; t++)
+      ck_assert_uint_eq(1, executions[t]);
+  }
+
+  /* Free all allocated memory */
+  pb_executor_destroy(&executor);
+} END_TEST
+
+/*
+ * Execute tasks with an uneven workload, so tasks must be stolen.
+ */
+START_TEST(test_run_steal) {
+  pb_executor_t executor = pb_executor_create(4);
+  fail_unless(pb_executor_valid(&executor));
+
+  /* Execute tasks and assert executions */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_executor_run(&executor, TASKS, task_steal, &executor));
+  fail_unless(stolen);
+  for (size_t t = 0; t < TASKS; t++)
+    ck_assert_uint_eq(1, executions[t]);
+
+  /* Free all allocated memory */
+  pb_executor_destroy(&executor);
+} END_TEST
+
+/*
+ * Execute tasks of which one fails.
+ */
+START_TEST(test_run_error) {
+  pb_executor_t executor = pb_executor_create(4);
+  fail_unless(pb_executor_valid(&executor));
+
+  /* Assert error and executions */
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_executor_run(&executor, TASKS, task_fail, NULL));
+  ck_assert_uint_eq(0, executions[42]);
+  for (size_t t = 0; t < TASKS; t++)
+    fail_unless(executions[t] <= 1);
+
+  /* Free all allocated memory */
+  pb_executor_destroy(&executor);
+} END_TEST
+
+/*
+ * Execute no tasks.
+ */
+START_TEST(test_run_empty) {
+  pb_executor_t executor = pb_executor_create(4);
+  fail_unless(pb_executor_valid(&executor));
+
+  /* Execute no tasks */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_executor_run(&executor, 0, task_count, NULL));
+
+  /* Free all allocated memory */
+  pb_executor_destroy(&executor);
+} END_TEST
+
+/*
+ * Create an executor with a single thread.
+ */
+START_TEST(test_create_single) {
+  pb_executor_t executor = pb_executor_create(1);
+  fail_unless(pb_executor_valid(&executor));
+  ck_assert_uint_eq(1, pb_executor_size(&executor));
+
+  /* Execute tasks and assert executions in calling thread */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_executor_run(&executor, TASKS, task_count, NULL));
+  for (size_t t = 0; t < TASKS; t++) {
+    ck_assert_uint_eq(1, executions[t]);
+    ck_assert_uint_eq(0, threads[t]);
+  }
+
+  /* Free all allocated memory */
+  pb_executor_destroy(&executor);
+} END_TEST
+
+/*
+ * Create an executor with one thread per processor.
+ */
+START_TEST(test_create_default) {
+  pb_executor_t executor = pb_executor_create(0);
+  fail_unless(pb_executor_valid(&executor));
+  fail_unless(pb_executor_size(&executor) > 0);
+
+  /* Free all allocated memory */
+  pb_executor_destroy(&executor);
+} END_TEST
+
+/*
+ * Execute tasks using an invalid executor.
+ */
+START_TEST(test_run_invalid) {
+  pb_executor_t executor = pb_executor_create_invalid();
+
+  /* Assert executor validity and error */
+  fail_if(pb_executor_valid(&executor));
+  ck_assert_uint_eq(PB_ERROR_ALLOC, pb_executor_error(&executor));
+
+  /* Assert execution error */
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_executor_run(&executor, TASKS, task_count, NULL));
+
+  /* Free all allocated memory */
+  pb_executor_destroy(&executor);
+} END_TEST
+
+/* ----------------------------------------------------------------------------
+ * Program
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a test suite for all registered test cases and run it.
+ *
+ * Tests must be run sequentially (in no-fork mode) or code coverage
+ * cannot be determined properly.
+ */
+int
+main(void) {
+  void *suite = suite_create("protobluff/util/executor"),
+       *tcase = NULL;
+
+  /* Add tests to test case "create" */
+  tcase = tcase_create("create");
+  tcase_add_checked_fixture(tcase, setup, NULL);
+  tcase_add_test(tcase, test_create_single);
+  tcase_add_test(tcase, test_create_default);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "run" */
+  tcase = tcase_create("run");
+  tcase_add_checked_fixture(tcase, setup, NULL);
+  tcase_add_test(tcase, test_run);
+  tcase_add_test(tcase, test_run_repeated);
+  tcase_add_test(tcase, test_run_steal);
+  tcase_add_test(tcase, test_run_error);
+  tcase_add_test(tcase, test_run_empty);
+  tcase_add_test(tcase, test_run_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Create a test suite runner in no-fork mode */
+  void *runner = srunner_create(suite);
+  srunner_set_fork_status(runner, CK_NOFORK);
+
+  /* Execute test suite runner */
+  srunner_run_all(runner, CK_NORMAL);
+  int failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+
+  /* Exit with status code */
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,445 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <protobluff/descriptor.h>
+
+#include "core/buffer.h"
+#include "core/common.h"
+#include "core/descriptor.h"
+#include "util/filter.h"
+
+/* ----------------------------------------------------------------------------
+ * Descriptors
+ * ------------------------------------------------------------------------- */
+
+/* Meta descriptor */
+static pb_descriptor_t
+descriptor_meta = { {
+  (const pb_field_descriptor_t []){
+    {  1, "source",  STRING,  OPTIONAL },
+    {  2, "score",   DOUBLE,  OPTIONAL }
+  }, 2 } };
+
+/* Descriptor */
+static pb_descriptor_t
+descriptor = { {
+  (const pb_field_descriptor_t []){
+    {  1, "status",  UINT32,  OPTIONAL },
+    {  2, "latency", INT64,   OPTIONAL },
+    {  3, "tags",    STRING,  REPEATED },
+    {  4, "meta",    MESSAGE, OPTIONAL, &descriptor_meta },
+    {  5, "codes",   SINT32,  REPEATED, NULL, NULL, PACKED },
+    {  6, "flag",    BOOL,    OPTIONAL },
+    {  7, "items",   MESSAGE, REPEATED, &descriptor_meta }
+  }, 7 } };
+
+/* ----------------------------------------------------------------------------
+ * Fixtures
+ * ------------------------------------------------------------------------- */
+
+/* Slow message tagged "x" */
+static const uint8_t data1[] = {
+  8, 3, 16, 150, 1, 26, 1, 'x', 26, 1, 'y' };
+
+/* Fast message tagged "x" */
+static const uint8_t data2[] = {
+  8, 3, 16, 50, 26, 1, 'x' };
+
+/* Slow message tagged "z" with a status occurring twice */
+static const uint8_t data3[] = {
+  8, 2, 8, 3, 16, 200, 1, 26, 1, 'z' };
+
+/* Message with submessage and packed field */
+static const uint8_t data4[] = {
+  34, 14, 10, 3, 'a', 'b', 'c', 17, 0, 0, 0, 0, 0, 0, 248, 63,
+  42, 2, 1, 4 };
+
+/* Buffers */
+static pb_buffer_t buffers[4];
+
+/*
+ * Create buffers.
+ */
+static void
+setup(void) {
+  buffers[0] = pb_buffer_create(data1, sizeof(data1));
+  buffers[1] = pb_buffer_create(data2, sizeof(data2));
+  buffers[2] = pb_buffer_create(data3, sizeof(data3));
+  buffers[3] = pb_buffer_create(data4, sizeof(data4));
+}
+
+/*
+ * Destroy buffers.
+ */
+static void
+teardown(void) {
+  for (size_t b = 0; b < 4; ++b)
+    pb_buffer_destroy(&buffers[b]);
+}
+
+/*
+ * Match all buffers against an expression and return a bitmap of matches.
+ */
+static unsigned int
+matches(const char expression[]) {
+  pb_filter_t filter = pb_filter_create(&descriptor, expression);
+  fail_unless(pb_filter_valid(&filter), expression);
+
+  /* Match buffers one by one */
+  unsigned int result = 0;
+  for (size_t b = 0; b < 4; ++b) {
+    int match = -1;
+    ck_assert_uint_eq(PB_ERROR_NONE,
+      pb_filter_match(&filter, &buffers[b], &match));
+    result |= match << b;
+  }
+
+  /* Free all allocated memory */
+  pb_filter_destroy(&filter);
+  return result;
+}
+
+/* ----------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a filter from an expression.
+ */
+START_TEST(test_create) {
+  pb_filter_t filter = pb_filter_create(&descriptor,
+    "status == 3 && latency > 100 && tags contains \"x\"");
+
+  /* Assert filter validity and error */
+  fail_unless(pb_filter_valid(&filter));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_filter_error(&filter));
+
+  /* Assert filter descriptor */
+  fail_unless(pb_filter_descriptor(&filter) == &descriptor);
+
+  /* Free all allocated memory */
+  pb_filter_destroy(&filter);
+} END_TEST
+
+/*
+ * Create filters from expressions which cannot be compiled.
+ */
+START_TEST(test_create_invalid) {
+  const char *expressions[] = {
+    "", " ", "status ==", "status == x", "status == 3 x", "unknown == 1",
+    "status == 1 &&", "(status == 1", "status == 1)", "status = 1",
+    "tags == 1", "status contains 3", "meta == 1", "items.source == \"a\"",
+    "status == -1", "flag == 1", "tags == \"x", "latency == 1.5",
+    "status == 99999999999999999999", "status[0] == 1", "!" };
+
+  /* Assert filter validity and error */
+  for (size_t e = 0; e < sizeof(expressions) / sizeof(*expressions); ++e) {
+    pb_filter_t filter = pb_filter_create(&descriptor, expressions[e]);
+    fail_if(pb_filter_valid(&filter), expressions[e]);
+    ck_assert_uint_eq(PB_ERROR_INVALID, pb_filter_error(&filter));
+
+    /* Free all allocated memory */
+    pb_filter_destroy(&filter);
+  }
+} END_TEST
+
+/*
+ * Match buffers against a conjunction.
+ */
+START_TEST(test_match) {
+  ck_assert_uint_eq(1,
+    matches("status == 3 && latency > 100 && tags contains \"x\""));
+  ck_assert_uint_eq(5,
+    matches("status==3&&latency>100"));
+} END_TEST
+
+/*
+ * Match buffers against disjunctions, negations and parentheses.
+ */
+START_TEST(test_match_logic) {
+  ck_assert_uint_eq(15, matches("status == 3 || meta"));
+  ck_assert_uint_eq(15, matches("status == 3 || !status"));
+  ck_assert_uint_eq(8, matches("!(status == 3) || meta.source == \"abc\""));
+  ck_assert_uint_eq(2, matches("tags contains \"x\" && !(latency >= 150)"));
+  ck_assert_uint_eq(6, matches("(latency < 100 || latency > 150) && tags"));
+} END_TEST
+
+/*
+ * Match buffers against comparisons of all kinds.
+ */
+START_TEST(test_match_compare) {
+  ck_assert_uint_eq(3, matches("latency != 200"));
+  ck_assert_uint_eq(2, matches("latency <= 50"));
+  ck_assert_uint_eq(5, matches("latency >= 150"));
+  ck_assert_uint_eq(8, matches("meta.source < \"abd\""));
+  ck_assert_uint_eq(0, matches("meta.source < \"ab\""));
+  ck_assert_uint_eq(8, matches("meta.score >= 1.5"));
+  ck_assert_uint_eq(0, matches("meta.score > 1.5"));
+} END_TEST
+
+/*
+ * Match buffers against a non-repeated field occurring multiple times.
+ */
+START_TEST(test_match_last) {
+  ck_assert_uint_eq(0, matches("status == 2"));
+  ck_assert_uint_eq(7, matches("status == 3"));
+} END_TEST
+
+/*
+ * Match buffers against presence of fields.
+ */
+START_TEST(test_match_present) {
+  ck_assert_uint_eq(8, matches("meta"));
+  ck_assert_uint_eq(8, matches("meta.score"));
+  ck_assert_uint_eq(8, matches("!tags"));
+  ck_assert_uint_eq(0, matches("flag"));
+} END_TEST
+
+/*
+ * Match buffers against absent fields.
+ */
+START_TEST(test_match_absent) {
+  ck_assert_uint_eq(0, matches("flag == true"));
+  ck_assert_uint_eq(0, matches("flag == false"));
+  ck_assert_uint_eq(0, matches("status != 1 && meta"));
+} END_TEST
+
+/*
+ * Match buffers against a repeated field.
+ */
+START_TEST(test_match_repeated) {
+  ck_assert_uint_eq(3, matches("tags contains \"x\""));
+  ck_assert_uint_eq(1, matches("tags == \"y\""));
+  ck_assert_uint_eq(7, matches("tags != \"x\" || tags == \"x\""));
+} END_TEST
+
+/*
+ * Match buffers against a packed field.
+ */
+START_TEST(test_match_packed) {
+  ck_assert_uint_eq(8, matches("codes contains -1"));
+  ck_assert_uint_eq(8, matches("codes > 1"));
+  ck_assert_uint_eq(0, matches("codes > 2"));
+} END_TEST
+
+/*
+ * Match a buffer against a string literal with escape sequences.
+ */
+START_TEST(test_match_escape) {
+  const uint8_t data[] = { 26, 3, 'a', '"', '\\' };
+  const size_t  size   = 5;
+
+  /* Create filter and buffer */
+  pb_buffer_t buffer = pb_buffer_create(data, size);
+  pb_filter_t filter = pb_filter_create(&descriptor,
+    "tags contains \"a\\\"\\\\\"");
+
+  /* Match buffer */
+  int match = 0;
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_filter_match(&filter, &buffer, &match));
+  ck_assert_uint_eq(1, match);
+
+  /* Free all allocated memory */
+  pb_filter_destroy(&filter);
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
+/*
+ * Match a buffer whose result is determined before reaching invalid data.
+ */
+START_TEST(test_match_early) {
+  const uint8_t data[] = { 26, 1, 'x', 8, 128 };
+  const size_t  size   = 5;
+
+  /* Create filters and buffer */
+  pb_buffer_t buffer  = pb_buffer_create(data, size);
+  pb_filter_t filter1 = pb_filter_create(&descriptor,
+                          "tags contains \"x\" || status == 1"),
+              filter2 = pb_filter_create(&descriptor,
+                          "tags contains \"x\" && status == 1");
+
+  /* Match buffer */
+  int match = 0;
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_filter_match(&filter1, &buffer, &match));
+  ck_assert_uint_eq(1, match);
+  ck_assert_uint_eq(PB_ERROR_VARINT,
+    pb_filter_match(&filter2, &buffer, &match));
+
+  /* Free all allocated memory */
+  pb_filter_destroy(&filter2);
+  pb_filter_destroy(&filter1);
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
+/*
+ * Match an invalid buffer or a buffer against an invalid filter.
+ */
+START_TEST(test_match_invalid) {
+  pb_buffer_t buffer  = pb_buffer_create_invalid();
+  pb_filter_t filter1 = pb_filter_create(&descriptor, "status == 3"),
+              filter2 = pb_filter_create(&descriptor, "status == ");
+
+  /* Match buffers */
+  int match = 0;
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_filter_match(&filter1, &buffer, &match));
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_filter_match(&filter2, &buffers[0], &match));
+
+  /* Free all allocated memory */
+  pb_filter_destroy(&filter2);
+  pb_filter_destroy(&filter1);
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
+/*
+ * Select a batch of buffers.
+ */
+START_TEST(test_select) {
+  pb_filter_t filter = pb_filter_create(&descriptor,
+    "status == 3 && latency > 100");
+
+  /* Select buffers */
+  uint8_t selection[1];
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_filter_select(&filter, buffers, 4, selection));
+  ck_assert_uint_eq(5, selection[0]);
+
+  /* Assert selected buffers */
+  fail_unless(pb_filter_selected(selection, 0));
+  fail_if(pb_filter_selected(selection, 1));
+  fail_unless(pb_filter_selected(selection, 2));
+  fail_if(pb_filter_selected(selection, 3));
+
+  /* Free all allocated memory */
+  pb_filter_destroy(&filter);
+} END_TEST
+
+/*
+ * Select a large batch of buffers.
+ */
+START_TEST(test_select_large) {
+  pb_filter_t filter = pb_filter_create(&descriptor, "tags contains \"x\"");
+
+  /* Create batch of buffers */
+  pb_buffer_t batch[20];
+  for (size_t b = 0; b < 20; ++b)
+    batch[b] = buffers[b % 4];
+
+  /* Select buffers */
+  uint8_t selection[3];
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_filter_select(&filter, batch, 20, selection));
+  ck_assert_uint_eq(0x33, selection[0]);
+  ck_assert_uint_eq(0x33, selection[1]);
+  ck_assert_uint_eq(0x03, selection[2]);
+
+  /* Free all allocated memory */
+  pb_filter_destroy(&filter);
+} END_TEST
+
+/*
+ * Select a batch of buffers containing an invalid buffer.
+ */
+START_TEST(test_select_invalid) {
+  pb_filter_t filter = pb_filter_create(&descriptor, "status == 3");
+
+  /* Create batch of buffers */
+  pb_buffer_t batch[3] = {
+    buffers[0], pb_buffer_create_invalid(), buffers[1]
+  };
+
+  /* Select buffers */
+  uint8_t selection[1];
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_filter_select(&filter, batch, 3, selection));
+  ck_assert_uint_eq(5, selection[0]);
+
+  /* Free all allocated memory */
+  pb_filter_destroy(&filter);
+} END_TEST
+
+/* ----------------------------------------------------------------------------
+ * Program
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a test suite for all registered test cases and run it.
+ *
+ * Tests must be run sequentially (in no-fork mode) or code coverage
+ * cannot be determined properly.
+ */
+int
+main(void) {
+  void *suite = suite_create("protobluff/util/filter"),
+       *tcase = NULL;
+
+  /* Add tests to test case "create" */
+  tcase = tcase_create("create");
+  tcase_add_test(tcase, test_create);
+  tcase_add_test(tcase, test_create_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "match" */
+  tcase = tcase_create("match");
+  tcase_add_checked_fixture(tcase, setup, teardown);
+  tcase_add_test(tcase, test_match);
+  tcase_add_test(tcase, test_match_logic);
+  tcase_add_test(tcase, test_match_compare);
+  tcase_add_test(tcase, test_match_last);
+  tcase_add_test(tcase, test_match_present);
+  tcase_add_test(tcase, test_match_absent);
+  tcase_add_test(tcase, test_match_repeated);
+  tcase_add_test(tcase, test_match_packed);
+  tcase_add_test(tcase, test_match_escape);
+  tcase_add_test(tcase, test_match_early);
+  tcase_add_test(tcase, test_match_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "select" */
+  tcase = tcase_create("select");
+  tcase_add_checked_fixture(tcase, setup, teardown);
+  tcase_add_test(tcase, test_select);
+  tcase_add_test(tcase, test_select_large);
+  tcase_add_test(tcase, test_select_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Create a test suite runner in no-fork mode */
+  void *runner = srunner_create(suite);
+  srunner_set_fork_status(runner, CK_NOFORK);
+
+  /* Execute test suite runner */
+  srunner_run_all(runner, CK_NORMAL);
+  int failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+
+  /* Exit with status code */
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/common.h"
+#include "util/lz.h"
+
+/* ----------------------------------------------------------------------------
+ * Fixtures
+ * ------------------------------------------------------------------------- */
+
+/* Size of data */
+#define SIZE 8192
+
+/* Source, target and decompressed data */
+static uint8_t source[SIZE], target[SIZE * 2], result[SIZE];
+
+/*
+ * Fill data with pseudo-random bytes.
+ */
+static void
+fill_random(uint8_t data[], size_t size) {
+  uint32_t state = 42;
+  for (size_t b = 0; b < size; b++) {
+    state = state * 1103515245 + 12345;
+    data[b] = state >> 16;
+  }
+}
+
+/*
+ * Fill data with pseudo-random words from a small vocabulary.
+ */
+static void
+fill_words(uint8_t data[], size_t size) {
+  static const char *words[] = {
+    "alpha ", "beta ", "gamma ", "delta ", "epsilon ", "zeta ", "eta "
+  };
+  uint32_t state = 42;
+  for (size_t b = 0; b < size;) {
+    state = state * 1103515245 + 12345;
+    const char *word = words[(state >> 16) % 7];
+    for (size_t c = 0; word[c] && b < size; c++)
+      data[b++] = word[c];
+  }
+}
+
+/*
+ * Compress and decompress data, and assert the result matches.
+ */
+static size_t
+roundtrip(const uint8_t data[], size_t size) {
+  size_t compressed = pb_lz_compress(data, size, target, sizeof(target));
+  fail_unless(compressed);
+
+  /* Decompress and compare */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_lz_decompress(target, compressed, result, size));
+  fail_if(memcmp(data, result, size));
+  return compressed;
+}
+
+/* ----------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Compress and decompress repetitive data.
+ */
+START_TEST(test_compress) {
+  fill_words(source, SIZE);
+  fail_unless(roundtrip(source, SIZE) < SIZE / 2);
+} END_TEST
+
+/*
+ * Compress and decompress a single repeated byte with overlapping matches.
+ */
+START_TEST(test_compress_repeated) {
+  memset(source, 'x', SIZE);
+  fail_unless(roundtrip(source, SIZE) < 64);
+} END_TEST
+
+/*
+ * Compress and decompress data of all sizes below the minimum match length.
+ */
+START_TEST(test_compress_small) {
+  fill_words(source, 16);
+  for (size_t size = 0; size <= 16; size++)
+    roundtrip(source, size);
+} END_TEST
+
+/*
+ * Compress and decompress incompressible data.
+ */
+START_TEST(test_compress_random) {
+  fill_random(source, SIZE);
+  fail_unless(roundtrip(source, SIZE) > SIZE);
+} END_TEST
+
+/*
+ * Compress incompressible data into a target buffer smaller than the source.
+ */
+START_TEST(test_compress_overflow) {
+  fill_random(source, SIZE);
+  ck_assert_uint_eq(0, pb_lz_compress(source, SIZE, target, SIZE - 1));
+} END_TEST
+
+/*
+ * Decompress truncated data.
+ */
+START_TEST(test_decompress_truncated) {
+  fill_words(source, SIZE);
+  size_t compressed = pb_lz_compress(source, SIZE, target, sizeof(target));
+  fail_unless(compressed);
+
+  /* Assert decompression error for every truncation */
+  for (size_t size = 0; size < compressed; size++)
+    ck_assert_uint_eq(PB_ERROR_INVALID,
+      pb_lz_decompress(target, size, result, SIZE));
+} END_TEST
+
+/*
+ * Decompress data into a target buffer of the wrong size.
+ */
+START_TEST(test_decompress_capacity) {
+  fill_words(source, SIZE);
+  size_t compressed = pb_lz_compress(source, SIZE, target, sizeof(target));
+  fail_unless(compressed);
+
+  /* Assert decompression error */
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_lz_decompress(target, compressed, result, SIZE - 1));
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_lz_decompress(target, compressed, result, SIZE / 2));
+} END_TEST
+
+/*
+ * Decompress data with a match pointing before the start of the output.
+ */
+START_TEST(test_decompress_offset) {
+  const uint8_t data[] = { 0x10, 'a', 2, 0, 0x00, 'b' };
+  uint8_t output[8];
+
+  /* Assert decompression error */
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_lz_decompress(data, 6, output, 6));
+
+  /* Assert decompression error for a zero offset */
+  const uint8_t zero[] = { 0x10, 'a', 0, 0, 0x00, 'b' };
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_lz_decompress(zero, 6, output, 6));
+} END_TEST
+
+/* ----------------------------------------------------------------------------
+ * Program
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a test suite for all registered test cases and run it.
+ *
+ * Tests must be run sequentially (in no-fork mode) or code coverage
+ * cannot be determined properly.
+ */
+int
+main(void) {
+  void *suite = suite_create("protobluff/util/lz"),
+       *tcase = NULL;
+
+  /* Add tests to test case "compress" */
+  tcase = tcase_create("compress");
+  tcase_add_test(tcase, test_compress);
+  tcase_add_test(tcase, test_compress_repeated);
+  tcase_add_test(tcase, test_compress_small);
+  tcase_add_test(tcase, test_compress_random);
+  tcase_add_test(tcase, test_compress_overflow);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "decompress" */
+  tcase = tcase_create("decompress");
+  tcase_add_test(tcase, test_decompress_truncated);
+  tcase_add_test(tcase, test_decompress_capacity);
+  tcase_add_test(tcase, test_decompress_offset);
+  suite_add_tcase(suite, tcase);
+
+  /* Create a test suite runner in no-fork mode */
+  void *runner = srunner_create(suite);
+  srunner_set_fork_status(runner, CK_NOFORK);
+
+  /* Execute test suite runner */
+  srunner_run_all(runner, CK_NORMAL);
+  int failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+
+  /* Exit with status code */
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,534 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <protobluff/descriptor.h>
+
+#include "core/buffer.h"
+#include "core/common.h"
+#include "core/decoder.h"
+#include "core/descriptor.h"
+#include "util/path.h"
+
+/* ----------------------------------------------------------------------------
+ * Type definitions
+ * ------------------------------------------------------------------------- */
+
+typedef struct values_t {
+  uint64_t data[8];                    /*!< Values */
+  size_t size;                         /*!< Value count */
+} values_t;
+
+/* ----------------------------------------------------------------------------
+ * Descriptors
+ * ------------------------------------------------------------------------- */
+
+/* Item descriptor */
+static pb_descriptor_t
+descriptor_item = { {
+  (const pb_field_descriptor_t []){
+    {  1, "name",     STRING,  OPTIONAL },
+    {  2, "price",    UINT64,  OPTIONAL },
+    {  3, "children", MESSAGE, REPEATED, &descriptor_item }
+  }, 3 } };
+
+/* Meta descriptor */
+static pb_descriptor_t
+descriptor_meta = { {
+  (const pb_field_descriptor_t []){
+    {  1, "source",   STRING,  OPTIONAL }
+  }, 1 } };
+
+/* Descriptor */
+static pb_descriptor_t
+descriptor = { {
+  (const pb_field_descriptor_t []){
+    {  1, "id",       UINT32,  OPTIONAL },
+    {  2, "items",    MESSAGE, REPEATED, &descriptor_item },
+    {  3, "meta",     MESSAGE, OPTIONAL, &descriptor_meta },
+    {  4, "codes",    UINT32,  REPEATED, NULL, NULL, PACKED }
+  }, 4 } };
+
+/* ----------------------------------------------------------------------------
+ * Fixtures
+ * ------------------------------------------------------------------------- */
+
+/* Message with repeated, packed and multiply occurring non-repeated fields */
+static const uint8_t data[] = {
+  8, 5,
+  18, 5, 10, 1, 'a', 16, 1,
+  18, 7, 10, 1, 'b', 16, 2, 16, 3,
+  34, 3, 1, 2, 3,
+  32, 4,
+  8, 6,
+  26, 3, 10, 1, 'x',
+  26, 3, 10, 1, 'y' };
+static const size_t size = 37;
+
+/* ----------------------------------------------------------------------------
+ * Handlers
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Collect values, reducing strings to their first character and messages to
+ * the number of bytes they span.
+ */
+static pb_error_t
+handler(
+    const pb_field_descriptor_t *descriptor, const void *value, void *user) {
+  values_t *values = user;
+  fail_if(values->size == 8);
+  switch (pb_field_descriptor_type(descriptor)) {
+    case PB_TYPE_UINT32:
+      values->data[values->size++] = *(const uint32_t *)value;
+      break;
+    case PB_TYPE_UINT64:
+      values->data[values->size++] = *(const uint64_t *)value;
+      break;
+    case PB_TYPE_STRING:
+      values->data[values->size++] = pb_string_data(value)[0];
+      break;
+    case PB_TYPE_MESSAGE:
+      values->data[values->size++] = pb_buffer_size(
+        pb_decoder_buffer((const pb_decoder_t *)value));
+      break;
+    default:
+      ck_abort();
+  }
+  return PB_ERROR_NONE;
+}
+
+/*
+ * Abort after the first value.
+ */
+static pb_error_t
+handler_abort(
+    const pb_field_descriptor_t *descriptor, const void *value, void *user) {
+  return PB_ERROR_ABSENT;
+}
+
+/* ----------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a path from field names.
+ */
+START_TEST(test_create) {
+  pb_path_t path = pb_path_create(&descriptor, "items.name");
+
+  /* Assert path validity and error */
+  fail_unless(pb_path_valid(&path));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_path_error(&path));
+
+  /* Assert path descriptor and size */
+  fail_unless(pb_path_descriptor(&path) == &descriptor);
+  ck_assert_uint_eq(2, pb_path_size(&path));
+
+  /* Free all allocated memory */
+  pb_path_destroy(&path);
+} END_TEST
+
+/*
+ * Create a path with an index and a wildcard.
+ */
+START_TEST(test_create_index) {
+  pb_path_t path = pb_path_create(&descriptor,
+    "items[1].children[*].name");
+
+  /* Assert path validity and error */
+  fail_unless(pb_path_valid(&path));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_path_error(&path));
+
+  /* Assert path size */
+  ck_assert_uint_eq(3, pb_path_size(&path));
+
+  /* Free all allocated memory */
+  pb_path_destroy(&path);
+} END_TEST
+
+/*
+ * Create paths which cannot be resolved.
+ */
+START_TEST(test_create_invalid) {
+  const char *paths[] = {
+    "", ".", "items.", ".items", "items..name", "items.unknown",
+    "id.name", "id[0]", "items[]", "items[x]", "items[1", "items[1]x",
+    "items[*", "items.name[0]" };
+
+  /* Assert path validity and error */
+  for (size_t p = 0; p < sizeof(paths) / sizeof(*paths); ++p) {
+    pb_path_t path = pb_path_create(&descriptor, paths[p]);
+    fail_if(pb_path_valid(&path), paths[p]);
+    ck_assert_uint_eq(PB_ERROR_INVALID, pb_path_error(&path));
+
+    /* Free all allocated memory */
+    pb_path_destroy(&path);
+  }
+} END_TEST
+
+/*
+ * Create a path from a branch of tags.
+ */
+START_TEST(test_create_from_tags) {
+  pb_path_t path = pb_path_create_from_tags(&descriptor,
+    (const pb_tag_t []){ 2, 3, 1 }, 3);
+
+  /* Assert path validity and error */
+  fail_unless(pb_path_valid(&path));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_path_error(&path));
+
+  /* Assert path size */
+  ck_assert_uint_eq(3, pb_path_size(&path));
+
+  /* Free all allocated memory */
+  pb_path_destroy(&path);
+} END_TEST
+
+/*
+ * Create a path from a branch of tags which cannot be resolved.
+ */
+START_TEST(test_create_from_tags_invalid) {
+  pb_path_t path = pb_path_create_from_tags(&descriptor,
+    (const pb_tag_t []){ 1, 1 }, 2);
+
+  /* Assert path validity and error */
+  fail_if(pb_path_valid(&path));
+  ck_assert_uint_eq(PB_ERROR_INVALID, pb_path_error(&path));
+
+  /* Free all allocated memory */
+  pb_path_destroy(&path);
+} END_TEST
+
+/*
+ * Evaluate a path selecting all occurrences of a repeated submessage.
+ */
+START_TEST(test_evaluate) {
+  pb_buffer_t buffer = pb_buffer_create(data, size);
+  pb_path_t   path   = pb_path_create(&descriptor, "items[*].name");
+  values_t    values = {};
+
+  /* Evaluate path */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_path_evaluate(&path, &buffer, handler, &values));
+
+  /* Assert values */
+  ck_assert_uint_eq(2, values.size);
+  ck_assert_uint_eq('a', values.data[0]);
+  ck_assert_uint_eq('b', values.data[1]);
+
+  /* Free all allocated memory */
+  pb_path_destroy(&path);
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
+/*
+ * Evaluate a path selecting a specific occurrence of a repeated submessage.
+ */
+START_TEST(test_evaluate_index) {
+  pb_buffer_t buffer = pb_buffer_create(data, size);
+  pb_path_t   path   = pb_path_create(&descriptor, "items[1].price");
+  values_t    values = {};
+
+  /* Evaluate path */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_path_evaluate(&path, &buffer, handler, &values));
+
+  /* Assert values */
+  ck_assert_uint_eq(1, values.size);
+  ck_assert_uint_eq(3, values.data[0]);
+
+  /* Free all allocated memory */
+  pb_path_destroy(&path);
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
+/*
+ * Evaluate a path selecting an occurrence which does not exist.
+ */
+START_TEST(test_evaluate_index_absent) {
+  pb_buffer_t buffer = pb_buffer_create(data, size);
+  pb_path_t   path   = pb_path_create(&descriptor, "items[2].price");
+  values_t    values = {};
+
+  /* Evaluate path */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_path_evaluate(&path, &buffer, handler, &values));
+
+  /* Assert values */
+  ck_assert_uint_eq(0, values.size);
+
+  /* Free all allocated memory */
+  pb_path_destroy(&path);
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
+/*
+ * Evaluate a path on non-repeated fields occurring multiple times.
+ */
+START_TEST(test_evaluate_last) {
+  pb_buffer_t buffer = pb_buffer_create(data, size);
+  pb_path_t   path   = pb_path_create(&descriptor, "items.price");
+  values_t    values = {};
+
+  /* Evaluate path */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_path_evaluate(&path, &buffer, handler, &values));
+
+  /* Assert values */
+  ck_assert_uint_eq(2, values.size);
+  ck_assert_uint_eq(1, values.data[0]);
+  ck_assert_uint_eq(3, values.data[1]);
+
+  /* Free all allocated memory */
+  pb_path_destroy(&path);
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
+/*
+ * Evaluate a path on a non-repeated field inside a merged submessage.
+ */
+START_TEST(test_evaluate_last_merged) {
+  pb_buffer_t buffer = pb_buffer_create(data, size);
+  pb_path_t   path   = pb_path_create(&descriptor, "meta.source");
+  values_t    values = {};
+
+  /* Evaluate path */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_path_evaluate(&path, &buffer, handler, &values));
+
+  /* Assert values */
+  ck_assert_uint_eq(1, values.size);
+  ck_assert_uint_eq('y', values.data[0]);
+
+  /* Free all allocated memory */
+  pb_path_destroy(&path);
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
+/*
+ * Evaluate a path on a packed field.
+ */
+START_TEST(test_evaluate_packed) {
+  pb_buffer_t buffer = pb_buffer_create(data, size);
+  pb_path_t   path   = pb_path_create(&descriptor, "codes");
+  values_t    values = {};
+
+  /* Evaluate path */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_path_evaluate(&path, &buffer, handler, &values));
+
+  /* Assert values */
+  ck_assert_uint_eq(4, values.size);
+  for (size_t v = 0; v < 4; ++v)
+    ck_assert_uint_eq(v + 1, values.data[v]);
+
+  /* Free all allocated memory */
+  pb_path_destroy(&path);
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
+/*
+ * Evaluate a path selecting a specific occurrence of a packed field.
+ */
+START_TEST(test_evaluate_packed_index) {
+  pb_buffer_t buffer = pb_buffer_create(data, size);
+  pb_path_t   path   = pb_path_create(&descriptor, "codes[3]");
+  values_t    values = {};
+
+  /* Evaluate path */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_path_evaluate(&path, &buffer, handler, &values));
+
+  /* Assert values */
+  ck_assert_uint_eq(1, values.size);
+  ck_assert_uint_eq(4, values.data[0]);
+
+  /* Free all allocated memory */
+  pb_path_destroy(&path);
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
+/*
+ * Evaluate a path ending in a submessage.
+ */
+START_TEST(test_evaluate_message) {
+  pb_buffer_t buffer = pb_buffer_create(data, size);
+  pb_path_t   path   = pb_path_create_from_tags(&descriptor,
+    (const pb_tag_t []){ 2 }, 1);
+  values_t    values = {};
+
+  /* Evaluate path */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_path_evaluate(&path, &buffer, handler, &values));
+
+  /* Assert values */
+  ck_assert_uint_eq(2, values.size);
+  ck_assert_uint_eq(5, values.data[0]);
+  ck_assert_uint_eq(7, values.data[1]);
+
+  /* Free all allocated memory */
+  pb_path_destroy(&path);
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
+/*
+ * Evaluate a path multiple times on different buffers.
+ */
+START_TEST(test_evaluate_reuse) {
+  pb_buffer_t buffer1 = pb_buffer_create(data, size),
+              buffer2 = pb_buffer_create(data, 9);
+  pb_path_t   path    = pb_path_create(&descriptor, "items.name");
+  values_t    values  = {};
+
+  /* Evaluate path */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_path_evaluate(&path, &buffer1, handler, &values));
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_path_evaluate(&path, &buffer2, handler, &values));
+
+  /* Assert values */
+  ck_assert_uint_eq(3, values.size);
+  ck_assert_uint_eq('a', values.data[2]);
+
+  /* Free all allocated memory */
+  pb_path_destroy(&path);
+  pb_buffer_destroy(&buffer2);
+  pb_buffer_destroy(&buffer1);
+} END_TEST
+
+/*
+ * Evaluate a path with a handler returning an error.
+ */
+START_TEST(test_evaluate_abort) {
+  pb_buffer_t buffer = pb_buffer_create(data, size);
+  pb_path_t   path   = pb_path_create(&descriptor, "codes");
+
+  /* Evaluate path */
+  ck_assert_uint_eq(PB_ERROR_ABSENT,
+    pb_path_evaluate(&path, &buffer, handler_abort, NULL));
+
+  /* Free all allocated memory */
+  pb_path_destroy(&path);
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
+/*
+ * Evaluate a path on a buffer with an invalid length prefix.
+ */
+START_TEST(test_evaluate_invalid_length) {
+  const uint8_t data[] = { 18, 100, 10, 1, 'a' };
+  const size_t  size   = 5;
+
+  /* Create path and buffer */
+  pb_buffer_t buffer = pb_buffer_create(data, size);
+  pb_path_t   path   = pb_path_create(&descriptor, "items.name");
+  values_t    values = {};
+
+  /* Evaluate path */
+  ck_assert_uint_eq(PB_ERROR_OFFSET,
+    pb_path_evaluate(&path, &buffer, handler, &values));
+
+  /* Free all allocated memory */
+  pb_path_destroy(&path);
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
+/*
+ * Evaluate an invalid path or a path on an invalid buffer.
+ */
+START_TEST(test_evaluate_invalid) {
+  pb_buffer_t buffer1 = pb_buffer_create(data, size),
+              buffer2 = pb_buffer_create_invalid();
+  pb_path_t   path1   = pb_path_create(&descriptor, "items.name"),
+              path2   = pb_path_create(&descriptor, "items.unknown");
+
+  /* Evaluate paths */
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_path_evaluate(&path1, &buffer2, handler, NULL));
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_path_evaluate(&path2, &buffer1, handler, NULL));
+
+  /* Free all allocated memory */
+  pb_path_destroy(&path2);
+  pb_path_destroy(&path1);
+  pb_buffer_destroy(&buffer2);
+  pb_buffer_destroy(&buffer1);
+} END_TEST
+
+/* ----------------------------------------------------------------------------
+ * Program
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a test suite for all registered test cases and run it.
+ *
+ * Tests must be run sequentially (in no-fork mode) or code coverage
+ * cannot be determined properly.
+ */
+int
+main(void) {
+  void *suite = suite_create("protobluff/util/path"),
+       *tcase = NULL;
+
+  /* Add tests to test case "create" */
+  tcase = tcase_create("create");
+  tcase_add_test(tcase, test_create);
+  tcase_add_test(tcase, test_create_index);
+  tcase_add_test(tcase, test_create_invalid);
+  tcase_add_test(tcase, test_create_from_tags);
+  tcase_add_test(tcase, test_create_from_tags_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "evaluate" */
+  tcase = tcase_create("evaluate");
+  tcase_add_test(tcase, test_evaluate);
+  tcase_add_test(tcase, test_evaluate_index);
+  tcase_add_test(tcase, test_evaluate_index_absent);
+  tcase_add_test(tcase, test_evaluate_last);
+  tcase_add_test(tcase, test_evaluate_last_merged);
+  tcase_add_test(tcase, test_evaluate_packed);
+  tcase_add_test(tcase, test_evaluate_packed_index);
+  tcase_add_test(tcase, test_evaluate_message);
+  tcase_add_test(tcase, test_evaluate_reuse);
+  tcase_add_test(tcase, test_evaluate_abort);
+  tcase_add_test(tcase, test_evaluate_invalid_length);
+  tcase_add_test(tcase, test_evaluate_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Create a test suite runner in no-fork mode */
+  void *runner = srunner_create(suite);
+  srunner_set_fork_status(runner, CK_NOFORK);
+
+  /* Execute test suite runner */
+  srunner_run_all(runner, CK_NORMAL);
+  int failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+
+  /* Exit with status code */
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,374 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <protobluff/descriptor.h>
+
+#include "core/allocator.h"
+#include "core/buffer.h"
+#include "core/common.h"
+#include "core/descriptor.h"
+#include "core/encoder.h"
+#include "message/journal.h"
+#include "util/chunk_allocator.h"
+#include "util/pool.h"
+
+/* ----------------------------------------------------------------------------
+ * Descriptors
+ * ------------------------------------------------------------------------- */
+
+/* Descriptor */
+static pb_descriptor_t
+descriptor = { {
+  (const pb_field_descriptor_t []){
+    {  1, "F01", UINT32,  OPTIONAL },
+    {  2, "F02", STRING,  OPTIONAL }
+  }, 2 } };
+
+/* ----------------------------------------------------------------------------
+ * Thread routines
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Retrieve the pool of a thread.
+ *
+ * \param[in] data Unused
+ * \return         Pool
+ */
+static void *
+thread_pool(void *data) {
+  (void)data;
+  return pb_pool_local();
+}
+
+/* ----------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a pool.
+ */
+START_TEST(test_create) {
+  pb_pool_t pool = pb_pool_create();
+
+  /* Assert pool validity and error */
+  fail_unless(pb_pool_valid(&pool));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_pool_error(&pool));
+
+  /* Free all allocated memory */
+  pb_pool_destroy(&pool);
+  fail_if(pb_pool_valid(&pool));
+} END_TEST
+
+/*
+ * Create a pool using a custom allocator.
+ */
+START_TEST(test_create_with_allocator) {
+  pb_allocator_t allocator = pb_chunk_allocator_create();
+  pb_pool_t pool = pb_pool_create_with_allocator(&allocator);
+
+  /* Assert pool validity and error */
+  fail_unless(pb_pool_valid(&pool));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_pool_error(&pool));
+
+  /* Acquire journal and assert allocator */
+  pb_journal_t journal = pb_pool_acquire_journal(&pool);
+  fail_unless(pb_journal_valid(&journal));
+  ck_assert_ptr_eq(&allocator,
+    pb_buffer_allocator(pb_journal_buffer(&journal)));
+
+  /* Free all allocated memory */
+  pb_pool_release_journal(&pool, &journal);
+  pb_pool_destroy(&pool);
+  pb_chunk_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Create a pool for which the allocation fails.
+ */
+START_TEST(test_create_invalid) {
+  pb_pool_t pool = pb_pool_create_invalid();
+
+  /* Assert pool validity and error */
+  fail_if(pb_pool_valid(&pool));
+  ck_assert_uint_eq(PB_ERROR_ALLOC, pb_pool_error(&pool));
+
+  /* Assert invalid journals and encoders */
+  pb_journal_t journal = pb_pool_acquire_journal(&pool);
+  fail_if(pb_journal_valid(&journal));
+  pb_encoder_t encoder = pb_pool_acquire_encoder(&pool, &descriptor);
+  fail_if(pb_encoder_valid(&encoder));
+
+  /* Free all allocated memory */
+  pb_pool_destroy(&pool);
+} END_TEST
+
+/*
+ * Acquire and release a journal, retaining its capacity.
+ */
+START_TEST(test_journal) {
+  pb_pool_t pool = pb_pool_create();
+
+  /* Acquire journal and write data to it */
+  pb_journal_t journal = pb_pool_acquire_journal(&pool);
+  fail_unless(pb_journal_valid(&journal));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_journal_write(&journal, 0, 0, 0,
+    (const uint8_t *)"SOME DATA", 9));
+  const uint8_t *data = pb_journal_data(&journal);
+
+  /* Release journal and assert it cannot be used anymore */
+  pb_pool_release_journal(&pool, &journal);
+  fail_if(pb_journal_valid(&journal));
+
+  /* Acquire recycled journal and assert it is empty */
+  journal = pb_pool_acquire_journal(&pool);
+  fail_unless(pb_journal_valid(&journal));
+  fail_unless(pb_journal_empty(&journal));
+  ck_assert_uint_eq(0, pb_journal_version(&journal));
+
+  /* Write data to journal and assert same location */
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_journal_write(&journal, 0, 0, 0,
+    (const uint8_t *)"DATA", 4));
+  fail_if(memcmp("DATA", pb_journal_data(&journal), 4));
+  ck_assert_ptr_eq(data, pb_journal_data(&journal));
+
+  /* Free all allocated memory */
+  pb_pool_release_journal(&pool, &journal);
+  pb_pool_destroy(&pool);
+} END_TEST
+
+/*
+ * Release a zero-copy journal, which is not recycled.
+ */
+START_TEST(test_journal_zero_copy) {
+  uint8_t data[] = "SOME DATA";
+  size_t  size   = 9;
+
+  /* Create pool and zero-copy journal */
+  pb_pool_t pool = pb_pool_create();
+  pb_journal_t journal = pb_journal_create_zero_copy(data, size);
+
+  /* Release journal and assert it was not recycled */
+  pb_pool_release_journal(&pool, &journal);
+  fail_if(pb_journal_valid(&journal));
+  ck_assert_uint_eq(0, pool.journal.size);
+
+  /* Free all allocated memory */
+  pb_pool_destroy(&pool);
+} END_TEST
+
+/*
+ * Release a copy-on-write journal, which is not recycled.
+ */
+START_TEST(test_journal_copy_on_write) {
+  uint8_t data[] = "SOME DATA";
+  size_t  size   = 9;
+
+  /* Create pool and copy-on-write journal */
+  pb_pool_t pool = pb_pool_create();
+  pb_journal_t journal = pb_journal_create_copy_on_write(data, size);
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_journal_clear(&journal, 0, 0, 5));
+
+  /* Release journal and assert it was not recycled */
+  pb_pool_release_journal(&pool, &journal);
+  fail_if(pb_journal_valid(&journal));
+  ck_assert_uint_eq(0, pool.journal.size);
+
+  /* Free all allocated memory */
+  pb_pool_destroy(&pool);
+} END_TEST
+
+/*
+ * Release a journal backed by inline storage, which is not recycled.
+ */
+START_TEST(test_journal_inline) {
+  uint8_t block[16];
+
+  /* Create pool and journal backed by inline storage */
+  pb_pool_t pool = pb_pool_create();
+  pb_journal_t journal = pb_journal_create_inline(block, sizeof(block));
+
+  /* Release journal and assert it was not recycled */
+  pb_pool_release_journal(&pool, &journal);
+  fail_if(pb_journal_valid(&journal));
+  ck_assert_uint_eq(0, pool.journal.size);
+
+  /* Free all allocated memory */
+  pb_pool_destroy(&pool);
+} END_TEST
+
+/*
+ * Release more journals than a pool retains.
+ */
+START_TEST(test_journal_full) {
+  pb_pool_t pool = pb_pool_create();
+
+  /* Acquire journals */
+  pb_journal_t journals[32];
+  for (size_t j = 0; j < 32; j++) {
+    journals[j] = pb_pool_acquire_journal(&pool);
+    fail_unless(pb_journal_valid(&journals[j]));
+  }
+
+  /* Release journals and assert retained journals */
+  for (size_t j = 0; j < 32; j++)
+    pb_pool_release_journal(&pool, &journals[j]);
+  ck_assert_uint_eq(16, pool.journal.size);
+
+  /* Free all allocated memory */
+  pb_pool_destroy(&pool);
+} END_TEST
+
+/*
+ * Acquire and release an encoder, retaining its capacity.
+ */
+START_TEST(test_encoder) {
+  pb_pool_t pool = pb_pool_create();
+
+  /* Acquire encoder and encode a value */
+  pb_encoder_t encoder = pb_pool_acquire_encoder(&pool, &descriptor);
+  fail_unless(pb_encoder_valid(&encoder));
+  pb_string_t value = pb_string_init_from_chars("SOME DATA");
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_encoder_encode(&encoder, 2, &value, 1));
+  const uint8_t *data = pb_buffer_data(pb_encoder_buffer(&encoder));
+
+  /* Release encoder and assert it cannot be used anymore */
+  pb_pool_release_encoder(&pool, &encoder);
+  fail_if(pb_encoder_valid(&encoder));
+
+  /* Acquire recycled encoder and assert it is empty */
+  encoder = pb_pool_acquire_encoder(&pool, &descriptor);
+  fail_unless(pb_encoder_valid(&encoder));
+  fail_unless(pb_buffer_empty(pb_encoder_buffer(&encoder)));
+
+  /* Encode value again and assert same location */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_encoder_encode(&encoder, 2, &value, 1));
+  ck_assert_ptr_eq(data, pb_buffer_data(pb_encoder_buffer(&encoder)));
+
+  /* Free all allocated memory */
+  pb_pool_release_encoder(&pool, &encoder);
+  pb_pool_destroy(&pool);
+} END_TEST
+
+/*
+ * Release an encoder using a different allocator, which is not recycled.
+ */
+START_TEST(test_encoder_foreign) {
+  pb_allocator_t allocator = pb_chunk_allocator_create();
+  pb_pool_t pool = pb_pool_create();
+
+  /* Create encoder using a different allocator */
+  pb_encoder_t encoder =
+    pb_encoder_create_with_allocator(&allocator, &descriptor);
+  fail_unless(pb_encoder_valid(&encoder));
+
+  /* Release encoder and assert it was not recycled */
+  pb_pool_release_encoder(&pool, &encoder);
+  fail_if(pb_encoder_valid(&encoder));
+  ck_assert_uint_eq(0, pool.encoder.size);
+
+  /* Free all allocated memory */
+  pb_pool_destroy(&pool);
+  pb_chunk_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Retrieve the pool of the calling thread.
+ */
+START_TEST(test_local) {
+  pb_pool_t *pool = pb_pool_local();
+  ck_assert_ptr_ne(NULL, pool);
+  fail_unless(pb_pool_valid(pool));
+
+  /* Assert same pool for the same thread */
+  ck_assert_ptr_eq(pool, pb_pool_local());
+
+  /* Assert different pool for a different thread */
+  pthread_t thread;
+  void *other = NULL;
+  ck_assert_int_eq(0, pthread_create(&thread, NULL, thread_pool, NULL));
+  ck_assert_int_eq(0, pthread_join(thread, &other));
+  ck_assert_ptr_ne(NULL, other);
+  ck_assert_ptr_ne(pool, other);
+} END_TEST
+
+/* ----------------------------------------------------------------------------
+ * Program
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a test suite for all registered test cases and run it.
+ *
+ * Tests must be run sequentially (in no-fork mode) or code coverage
+ * cannot be determined properly.
+ */
+int
+main(void) {
+  void *suite = suite_create("protobluff/util/pool"),
+       *tcase = NULL;
+
+  /* Add tests to test case "create" */
+  tcase = tcase_create("create");
+  tcase_add_test(tcase, test_create);
+  tcase_add_test(tcase, test_create_with_allocator);
+  tcase_add_test(tcase, test_create_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "journal" */
+  tcase = tcase_create("journal");
+  tcase_add_test(tcase, test_journal);
+  tcase_add_test(tcase, test_journal_zero_copy);
+  tcase_add_test(tcase, test_journal_copy_on_write);
+  tcase_add_test(tcase, test_journal_inline);
+  tcase_add_test(tcase, test_journal_full);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "encoder" */
+  tcase = tcase_create("encoder");
+  tcase_add_test(tcase, test_encoder);
+  tcase_add_test(tcase, test_encoder_foreign);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "local" */
+  tcase = tcase_create("local");
+  tcase_add_test(tcase, test_local);
+  suite_add_tcase(suite, tcase);
+
+  /* Create a test suite runner in no-fork mode */
+  void *runner = srunner_create(suite);
+  srunner_set_fork_status(runner, CK_NOFORK);
+
+  /* Execute test suite runner */
+  srunner_run_all(runner, CK_NORMAL);
+  int failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+
+  /* Exit with status code */
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
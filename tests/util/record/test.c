@@ -0,0 +1,414 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <assert.h>
+#include <check.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/buffer.h"
+#include "core/common.h"
+#include "util/record.h"
+
+/* ----------------------------------------------------------------------------
+ * Files
+ * ------------------------------------------------------------------------- */
+
+/* File used for records */
+#define FILE_RECORD "record.bin"
+
+/*!
+ * Write data to a file, replacing its contents.
+ *
+ * \param[in] data[] Raw data
+ * \param[in] size   Raw data size
+ */
+static void
+file_write(const uint8_t data[], size_t size) {
+  FILE *file = fopen(FILE_RECORD, "wb");
+  assert(file);
+  if (size)
+    fwrite(data, 1, size, file);
+  fclose(file);
+}
+
+/* ----------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Write records to a file and read them.
+ */
+START_TEST(test_write) {
+  uint8_t data[] = { 8, 127, 16, 127 };
+  remove(FILE_RECORD);
+
+  /* Create records and writer */
+  pb_buffer_t records[] = {
+    pb_buffer_create_zero_copy(data, 4),
+    pb_buffer_create_empty(),
+    pb_buffer_create_zero_copy(data, 2)
+  };
+  pb_record_writer_t writer =
+    pb_record_writer_create(FILE_RECORD, PB_RECORD_SYNC_NONE);
+
+  /* Assert writer validity and error */
+  fail_unless(pb_record_writer_valid(&writer));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_record_writer_error(&writer));
+
+  /* Write and sync records */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_record_writer_write(&writer, records, 3));
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_record_writer_sync(&writer));
+  pb_record_writer_destroy(&writer);
+
+  /* Create reader */
+  pb_record_reader_t reader = pb_record_reader_create(FILE_RECORD);
+
+  /* Assert reader validity and error */
+  fail_unless(pb_record_reader_valid(&reader));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_record_reader_error(&reader));
+
+  /* Read and assert records */
+  for (size_t r = 0; r < 3; r++) {
+    pb_buffer_t record;
+    ck_assert_uint_eq(PB_ERROR_NONE,
+      pb_record_reader_next(&reader, &record));
+    ck_assert_uint_eq(pb_buffer_size(&(records[r])), pb_buffer_size(&record));
+    if (pb_buffer_size(&record))
+      fail_if(memcmp(pb_buffer_data(&(records[r])), pb_buffer_data(&record),
+        pb_buffer_size(&record)));
+    pb_buffer_destroy(&record);
+  }
+
+  /* Assert end of file */
+  pb_buffer_t record;
+  ck_assert_uint_eq(PB_ERROR_EOM,
+    pb_record_reader_next(&reader, &record));
+
+  /* Free all allocated memory */
+  pb_record_reader_destroy(&reader);
+  for (size_t r = 0; r < 3; r++)
+    pb_buffer_destroy(&(records[r]));
+  remove(FILE_RECORD);
+} END_TEST
+
+/*
+ * Write more records than fit into a single system call.
+ */
+START_TEST(test_write_batch) {
+  uint64_t values[200];
+  pb_buffer_t records[200];
+  remove(FILE_RECORD);
+
+  /* Create records and writer */
+  for (size_t r = 0; r < 200; r++) {
+    values[r]  = r;
+    records[r] = pb_buffer_create_zero_copy(
+      (uint8_t *)&(values[r]), sizeof(uint64_t));
+  }
+  pb_record_writer_t writer =
+    pb_record_writer_create(FILE_RECORD, PB_RECORD_SYNC_WRITE);
+
+  /* Write records */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_record_writer_write(&writer, records, 200));
+  pb_record_writer_destroy(&writer);
+
+  /* Read and assert records */
+  pb_record_reader_t reader = pb_record_reader_create(FILE_RECORD);
+  pb_buffer_t record;
+  size_t count = 0;
+  while (!pb_record_reader_next(&reader, &record)) {
+    uint64_t value;
+    ck_assert_uint_eq(sizeof(uint64_t), pb_buffer_size(&record));
+    memcpy(&value, pb_buffer_data(&record), sizeof(uint64_t));
+    ck_assert_uint_eq(count++, value);
+    pb_buffer_destroy(&record);
+  }
+  ck_assert_uint_eq(200, count);
+
+  /* Free all allocated memory */
+  pb_record_reader_destroy(&reader);
+  for (size_t r = 0; r < 200; r++)
+    pb_buffer_destroy(&(records[r]));
+  remove(FILE_RECORD);
+} END_TEST
+
+/*
+ * Append records to a file with several writers.
+ */
+START_TEST(test_write_append) {
+  uint8_t data[] = { 8, 127 };
+  remove(FILE_RECORD);
+
+  /* Write a record with two writers */
+  pb_buffer_t buffer = pb_buffer_create_zero_copy(data, 2);
+  for (size_t w = 0; w < 2; w++) {
+    pb_record_writer_t writer =
+      pb_record_writer_create(FILE_RECORD, PB_RECORD_SYNC_CLOSE);
+    ck_assert_uint_eq(PB_ERROR_NONE,
+      pb_record_writer_write(&writer, &buffer, 1));
+    pb_record_writer_destroy(&writer);
+  }
+
+  /* Read and assert records */
+  pb_record_reader_t reader = pb_record_reader_create(FILE_RECORD);
+  pb_buffer_t record;
+  size_t count = 0;
+  while (!pb_record_reader_next(&reader, &record)) {
+    ck_assert_uint_eq(2, pb_buffer_size(&record));
+    pb_buffer_destroy(&record);
+    count++;
+  }
+  ck_assert_uint_eq(2, count);
+
+  /* Free all allocated memory */
+  pb_record_reader_destroy(&reader);
+  pb_buffer_destroy(&buffer);
+  remove(FILE_RECORD);
+} END_TEST
+
+/*
+ * Write an invalid record.
+ */
+START_TEST(test_write_invalid) {
+  uint8_t data[] = { 8, 127 };
+  remove(FILE_RECORD);
+
+  /* Create records and writer */
+  pb_buffer_t records[] = {
+    pb_buffer_create_zero_copy(data, 2),
+    pb_buffer_create_invalid()
+  };
+  pb_record_writer_t writer =
+    pb_record_writer_create(FILE_RECORD, PB_RECORD_SYNC_NONE);
+
+  /* Write records */
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_record_writer_write(&writer, records, 2));
+  pb_record_writer_destroy(&writer);
+
+  /* Assert that no record was written */
+  pb_record_reader_t reader = pb_record_reader_create(FILE_RECORD);
+  pb_buffer_t record;
+  ck_assert_uint_eq(PB_ERROR_EOM,
+    pb_record_reader_next(&reader, &record));
+
+  /* Free all allocated memory */
+  pb_record_reader_destroy(&reader);
+  pb_buffer_destroy(&(records[0]));
+  pb_buffer_destroy(&(records[1]));
+  remove(FILE_RECORD);
+} END_TEST
+
+/*
+ * Create a record writer for an invalid path.
+ */
+START_TEST(test_write_invalid_path) {
+  pb_record_writer_t writer =
+    pb_record_writer_create("missing/" FILE_RECORD, PB_RECORD_SYNC_NONE);
+
+  /* Assert writer validity and error */
+  fail_if(pb_record_writer_valid(&writer));
+  ck_assert_uint_eq(PB_ERROR_IO, pb_record_writer_error(&writer));
+
+  /* Write and sync records */
+  pb_buffer_t buffer = pb_buffer_create_empty();
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_record_writer_write(&writer, &buffer, 1));
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_record_writer_sync(&writer));
+
+  /* Free all allocated memory */
+  pb_record_writer_destroy(&writer);
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
+/*
+ * Read records larger than the readahead window.
+ */
+START_TEST(test_read_readahead) {
+  const size_t size = 700 * 1024;
+  uint8_t *data = calloc(size, 1);
+  remove(FILE_RECORD);
+
+  /* Write records */
+  pb_buffer_t buffer = pb_buffer_create_zero_copy(data, size);
+  pb_record_writer_t writer =
+    pb_record_writer_create(FILE_RECORD, PB_RECORD_SYNC_NONE);
+  for (size_t r = 0; r < 4; r++) {
+    data[0] = r;
+    ck_assert_uint_eq(PB_ERROR_NONE,
+      pb_record_writer_write(&writer, &buffer, 1));
+  }
+  pb_record_writer_destroy(&writer);
+
+  /* Read and assert records */
+  pb_record_reader_t reader = pb_record_reader_create(FILE_RECORD);
+  pb_buffer_t record;
+  size_t count = 0;
+  while (!pb_record_reader_next(&reader, &record)) {
+    ck_assert_uint_eq(size, pb_buffer_size(&record));
+    ck_assert_uint_eq(count++, pb_buffer_data(&record)[0]);
+    pb_buffer_destroy(&record);
+  }
+  ck_assert_uint_eq(4, count);
+
+  /* Free all allocated memory */
+  pb_record_reader_destroy(&reader);
+  pb_buffer_destroy(&buffer);
+  free(data);
+  remove(FILE_RECORD);
+} END_TEST
+
+/*
+ * Read records from an empty file.
+ */
+START_TEST(test_read_empty) {
+  file_write(NULL, 0);
+
+  /* Create reader */
+  pb_record_reader_t reader = pb_record_reader_create(FILE_RECORD);
+  fail_unless(pb_record_reader_valid(&reader));
+
+  /* Assert end of file */
+  pb_buffer_t record;
+  ck_assert_uint_eq(PB_ERROR_EOM,
+    pb_record_reader_next(&reader, &record));
+
+  /* Free all allocated memory */
+  pb_record_reader_destroy(&reader);
+  remove(FILE_RECORD);
+} END_TEST
+
+/*
+ * Read records from a file with a truncated record.
+ */
+START_TEST(test_read_truncated) {
+  const uint8_t data[] = { 2, 8, 127, 5, 8, 127 };
+  file_write(data, 6);
+
+  /* Create reader */
+  pb_record_reader_t reader = pb_record_reader_create(FILE_RECORD);
+  pb_buffer_t record;
+
+  /* Read complete and truncated record */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_record_reader_next(&reader, &record));
+  pb_buffer_destroy(&record);
+  ck_assert_uint_eq(PB_ERROR_OFFSET,
+    pb_record_reader_next(&reader, &record));
+
+  /* Free all allocated memory */
+  pb_record_reader_destroy(&reader);
+  remove(FILE_RECORD);
+} END_TEST
+
+/*
+ * Read records from a file with an invalid length prefix.
+ */
+START_TEST(test_read_invalid_length) {
+  const uint8_t data[] = { 255, 255 };
+  file_write(data, 2);
+
+  /* Create reader */
+  pb_record_reader_t reader = pb_record_reader_create(FILE_RECORD);
+
+  /* Read record */
+  pb_buffer_t record;
+  ck_assert_uint_eq(PB_ERROR_VARINT,
+    pb_record_reader_next(&reader, &record));
+
+  /* Free all allocated memory */
+  pb_record_reader_destroy(&reader);
+  remove(FILE_RECORD);
+} END_TEST
+
+/*
+ * Create a record reader for an invalid path.
+ */
+START_TEST(test_read_invalid_path) {
+  pb_record_reader_t reader =
+    pb_record_reader_create("missing/" FILE_RECORD);
+
+  /* Assert reader validity and error */
+  fail_if(pb_record_reader_valid(&reader));
+  ck_assert_uint_eq(PB_ERROR_ALLOC, pb_record_reader_error(&reader));
+
+  /* Read record */
+  pb_buffer_t record;
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_record_reader_next(&reader, &record));
+
+  /* Free all allocated memory */
+  pb_record_reader_destroy(&reader);
+} END_TEST
+
+/* ----------------------------------------------------------------------------
+ * Program
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a test suite for all registered test cases and run it.
+ *
+ * Tests must be run sequentially (in no-fork mode) or code coverage
+ * cannot be determined properly.
+ */
+int
+main(void) {
+  void *suite = suite_create("protobluff/util/record"),
+       *tcase = NULL;
+
+  /* Add tests to test case "write" */
+  tcase = tcase_create("write");
+  tcase_add_test(tcase, test_write);
+  tcase_add_test(tcase, test_write_batch);
+  tcase_add_test(tcase, test_write_append);
+  tcase_add_test(tcase, test_write_invalid);
+  tcase_add_test(tcase, test_write_invalid_path);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "read" */
+  tcase = tcase_create("read");
+  tcase_add_test(tcase, test_read_readahead);
+  tcase_add_test(tcase, test_read_empty);
+  tcase_add_test(tcase, test_read_truncated);
+  tcase_add_test(tcase, test_read_invalid_length);
+  tcase_add_test(tcase, test_read_invalid_path);
+  suite_add_tcase(suite, tcase);
+
+  /* Create a test suite runner in no-fork mode */
+  void *runner = srunner_create(suite);
+  srunner_set_fork_status(runner, CK_NOFORK);
+
+  /* Execute test suite runner */
+  srunner_run_all(runner, CK_NORMAL);
+  int failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+
+  /* Exit with status code */
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
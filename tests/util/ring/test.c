@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Enable POSIX shared memory, processes and sleeping */
+#ifndef _GNU_SOURCE
+  #define _GNU_SOURCE
+#endif
+
+#include <check.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "core/buffer.h"
+#include "core/common.h"
+#include "util/ring.h"
+
+/* ----------------------------------------------------------------------------
+ * Names
+ * ------------------------------------------------------------------------- */
+
+/*!
+ * Create a shared memory object name unique to the test process.
+ *
+ * \param[out] name[] Name
+ */
+static void
+name_create(char name[64]) {
+  snprintf(name, 64, "/protobluff-ring-%d", (int)getpid());
+}
+
+/*!
+ * Wait briefly before retrying an operation on a ring.
+ */
+static void
+backoff(void) {
+  const struct timespec delay = { .tv_sec = 0, .tv_nsec = 10000 };
+  nanosleep(&delay, NULL);
+}
+
+/* ----------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a ring and open it.
+ */
+START_TEST(test_create) {
+  char name[64];
+  name_create(name);
+
+  /* Create and open ring */
+  pb_ring_t producer = pb_ring_create(name, 4, 64);
+  pb_ring_t consumer = pb_ring_open(name);
+
+  /* Assert ring validity and error */
+  fail_unless(pb_ring_valid(&producer));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_ring_error(&producer));
+  fail_unless(pb_ring_valid(&consumer));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_ring_error(&consumer));
+
+  /* Free all allocated memory */
+  pb_ring_destroy(&consumer);
+  pb_ring_destroy(&producer);
+  fail_if(pb_ring_valid(&producer));
+  shm_unlink(name);
+} END_TEST
+
+/*
+ * Create a ring that already exists.
+ */
+START_TEST(test_create_exists) {
+  char name[64];
+  name_create(name);
+
+  /* Create ring twice */
+  pb_ring_t producer = pb_ring_create(name, 4, 64);
+  pb_ring_t ring     = pb_ring_create(name, 8, 64);
+
+  /* Assert ring validity and error */
+  fail_unless(pb_ring_valid(&producer));
+  fail_if(pb_ring_valid(&ring));
+  ck_assert_uint_eq(PB_ERROR_IO, pb_ring_error(&ring));
+
+  /* Assert existing ring is left intact */
+  pb_ring_t consumer = pb_ring_open(name);
+  fail_unless(pb_ring_valid(&consumer));
+  ck_assert_uint_eq(producer.size, consumer.size);
+
+  /* Free all allocated memory */
+  pb_ring_destroy(&consumer);
+  pb_ring_destroy(&producer);
+  shm_unlink(name);
+} END_TEST
+
+/*
+ * Create a ring whose size overflows.
+ */
+START_TEST(test_create_overflow) {
+  char name[64];
+  name_create(name);
+
+  /* Create rings */
+  pb_ring_t slots = pb_ring_create(name, SIZE_MAX / 64, 64);
+  pb_ring_t size  = pb_ring_create(name, 4, SIZE_MAX - 4);
+
+  /* Assert ring validity and error */
+  fail_if(pb_ring_valid(&slots));
+  ck_assert_uint_eq(PB_ERROR_IO, pb_ring_error(&slots));
+  fail_if(pb_ring_valid(&size));
+  ck_assert_uint_eq(PB_ERROR_IO, pb_ring_error(&size));
+
+  /* Assert no shared memory object was created */
+  pb_ring_t ring = pb_ring_open(name);
+  fail_if(pb_ring_valid(&ring));
+} END_TEST
+
+/*
+ * Open a ring that does not exist.
+ */
+START_TEST(test_create_invalid) {
+  char name[64];
+  name_create(name);
+
+  /* Open ring */
+  pb_ring_t ring = pb_ring_open(name);
+
+  /* Assert ring validity and error */
+  fail_if(pb_ring_valid(&ring));
+  ck_assert_uint_eq(PB_ERROR_IO, pb_ring_error(&ring));
+
+  /* Assert failing operations */
+  pb_buffer_t buffer = pb_buffer_create_empty();
+  ck_assert_uint_eq(PB_ERROR_INVALID, pb_ring_push(&ring, &buffer));
+  ck_assert_uint_eq(PB_ERROR_INVALID, pb_ring_peek(&ring, &buffer));
+  pb_ring_pop(&ring);
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&buffer);
+  pb_ring_destroy(&ring);
+} END_TEST
+
+/*
+ * Push messages to a ring and consume them without copying.
+ */
+START_TEST(test_push) {
+  char name[64];
+  name_create(name);
+
+  /* Create and open ring */
+  pb_ring_t producer = pb_ring_create(name, 4, 64);
+  pb_ring_t consumer = pb_ring_open(name);
+
+  /* Push messages to ring */
+  const uint8_t data[] = "SOME DATA";
+  for (size_t m = 1; m <= 9; m++) {
+    pb_buffer_t buffer = pb_buffer_create(data, m);
+    ck_assert_uint_eq(PB_ERROR_NONE, pb_ring_push(&producer, &buffer));
+    pb_buffer_destroy(&buffer);
+
+    /* Consume message and assert contents */
+    pb_buffer_t message;
+    ck_assert_uint_eq(PB_ERROR_NONE, pb_ring_peek(&consumer, &message));
+    ck_assert_uint_eq(m, pb_buffer_size(&message));
+    fail_if(memcmp(data, pb_buffer_data(&message), m));
+    pb_ring_pop(&consumer);
+  }
+
+  /* Assert empty ring */
+  pb_buffer_t message;
+  ck_assert_uint_eq(PB_ERROR_ABSENT, pb_ring_peek(&consumer, &message));
+  pb_ring_pop(&consumer);
+  ck_assert_uint_eq(PB_ERROR_ABSENT, pb_ring_peek(&consumer, &message));
+
+  /* Free all allocated memory */
+  pb_ring_destroy(&consumer);
+  pb_ring_destroy(&producer);
+  shm_unlink(name);
+} END_TEST
+
+/*
+ * Push messages to a ring until it is full.
+ */
+START_TEST(test_push_full) {
+  char name[64];
+  name_create(name);
+
+  /* Create ring and buffer */
+  pb_ring_t ring = pb_ring_create(name, 4, 64);
+  const uint8_t data[] = "SOME DATA";
+  pb_buffer_t buffer = pb_buffer_create(data, 9);
+
+  /* Push messages until ring is full */
+  for (size_t m = 0; m < 4; m++)
+    ck_assert_uint_eq(PB_ERROR_NONE, pb_ring_push(&ring, &buffer));
+  ck_assert_uint_eq(PB_ERROR_ALLOC, pb_ring_push(&ring, &buffer));
+
+  /* Pop message and push again */
+  pb_ring_pop(&ring);
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_ring_push(&ring, &buffer));
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&buffer);
+  pb_ring_destroy(&ring);
+  shm_unlink(name);
+} END_TEST
+
+/*
+ * Push a message that is larger than a slot.
+ */
+START_TEST(test_push_invalid) {
+  char name[64];
+  name_create(name);
+
+  /* Create ring and buffer */
+  pb_ring_t ring = pb_ring_create(name, 4, 8);
+  const uint8_t data[] = "SOME DATA";
+  pb_buffer_t buffer = pb_buffer_create(data, 9);
+
+  /* Push message */
+  ck_assert_uint_eq(PB_ERROR_INVALID, pb_ring_push(&ring, &buffer));
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&buffer);
+  pb_ring_destroy(&ring);
+  shm_unlink(name);
+} END_TEST
+
+/*
+ * Peek a message with a corrupted length.
+ */
+START_TEST(test_peek_invalid) {
+  char name[64];
+  name_create(name);
+
+  /* Create ring and buffer */
+  pb_ring_t ring = pb_ring_create(name, 4, 64);
+  const uint8_t data[] = "SOME DATA";
+  pb_buffer_t buffer = pb_buffer_create(data, 9);
+
+  /* Push message and corrupt length in slot after header */
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_ring_push(&ring, &buffer));
+  *(size_t *)((uint8_t *)ring.data + 3 * 64) = SIZE_MAX;
+
+  /* Peek message */
+  pb_buffer_t message;
+  ck_assert_uint_eq(PB_ERROR_INVALID, pb_ring_peek(&ring, &message));
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&buffer);
+  pb_ring_destroy(&ring);
+  shm_unlink(name);
+} END_TEST
+
+/*
+ * Pass messages from a producer process to a consumer process.
+ */
+START_TEST(test_process) {
+  char name[64];
+  name_create(name);
+
+  /* Create ring before forking, so the consumer can open it */
+  pb_ring_t producer = pb_ring_create(name, 4, 64);
+  fail_unless(pb_ring_valid(&producer));
+
+  /* Push numbered messages from child process */
+  pid_t pid = fork();
+  ck_assert_int_ne(-1, pid);
+  if (!pid) {
+    for (size_t m = 0; m < 1000; m++) {
+      pb_buffer_t buffer = pb_buffer_create((const uint8_t *)&m, sizeof(m));
+      while (pb_ring_push(&producer, &buffer) == PB_ERROR_ALLOC)
+        backoff();
+      pb_buffer_destroy(&buffer);
+    }
+    _exit(EXIT_SUCCESS);
+  }
+  pb_ring_destroy(&producer);
+
+  /* Consume messages in order */
+  pb_ring_t consumer = pb_ring_open(name);
+  fail_unless(pb_ring_valid(&consumer));
+  for (size_t m = 0; m < 1000; m++) {
+    pb_buffer_t message;
+    pb_error_t error;
+    while ((error = pb_ring_peek(&consumer, &message)) == PB_ERROR_ABSENT)
+      backoff();
+    ck_assert_uint_eq(PB_ERROR_NONE, error);
+    ck_assert_uint_eq(sizeof(m), pb_buffer_size(&message));
+    fail_if(memcmp(&m, pb_buffer_data(&message), sizeof(m)));
+    pb_ring_pop(&consumer);
+  }
+
+  /* Wait for child process */
+  int status;
+  ck_assert_int_eq(pid, waitpid(pid, &status, 0));
+  fail_unless(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+
+  /* Free all allocated memory */
+  pb_ring_destroy(&consumer);
+  shm_unlink(name);
+} END_TEST
+
+/* ----------------------------------------------------------------------------
+ * Program
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a test suite for all registered test cases and run it.
+ *
+ * Tests must be run sequentially (in no-fork mode) or code coverage
+ * cannot be determined properly.
+ */
+int
+main(void) {
+  void *suite = suite_create("protobluff/util/ring"),
+       *tcase = NULL;
+
+  /* Add tests to test case "create" */
+  tcase = tcase_create("create");
+  tcase_add_test(tcase, test_create);
+  tcase_add_test(tcase, test_create_exists);
+  tcase_add_test(tcase, test_create_overflow);
+  tcase_add_test(tcase, test_create_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "push" */
+  tcase = tcase_create("push");
+  tcase_add_test(tcase, test_push);
+  tcase_add_test(tcase, test_push_full);
+  tcase_add_test(tcase, test_push_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "peek" */
+  tcase = tcase_create("peek");
+  tcase_add_test(tcase, test_peek_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "process" */
+  tcase = tcase_create("process");
+  tcase_add_test(tcase, test_process);
+  suite_add_tcase(suite, tcase);
+
+  /* Create a test suite runner in no-fork mode */
+  void *runner = srunner_create(suite);
+  srunner_set_fork_status(runner, CK_NOFORK);
+
+  /* Execute test suite runner */
+  srunner_run_all(runner, CK_NORMAL);
+  int failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+
+  /* Exit with status code */
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
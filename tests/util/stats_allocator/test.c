@@ -0,0 +1,399 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/allocator.h"
+#include "core/buffer.h"
+#include "core/common.h"
+#include "util/chunk_allocator.h"
+#include "util/stats_allocator.h"
+
+/* ----------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a stats allocator.
+ */
+START_TEST(test_create) {
+  pb_allocator_t allocator = pb_stats_allocator_create();
+  ck_assert_ptr_ne(NULL, allocator.data);
+
+  /* Assert empty statistics */
+  pb_allocator_stats_t stats;
+  pb_stats_allocator_query(&allocator, &stats);
+  ck_assert_uint_eq(0, stats.allocations);
+  ck_assert_uint_eq(0, stats.current);
+  ck_assert_uint_eq(0, stats.peak);
+
+  /* Free all allocated memory */
+  pb_stats_allocator_destroy(&allocator);
+  ck_assert_ptr_eq(NULL, allocator.data);
+} END_TEST
+
+/*
+ * Create a stats allocator wrapping an allocator.
+ */
+START_TEST(test_create_with_allocator) {
+  pb_allocator_t chunk = pb_chunk_allocator_create();
+  pb_allocator_t allocator = pb_stats_allocator_create_with_allocator(&chunk);
+
+  /* Allocate a block and write to it */
+  void *block = pb_allocator_allocate(&allocator, 16);
+  ck_assert_ptr_ne(NULL, block);
+  memset(block, 0, 16);
+
+  /* Assert statistics */
+  pb_allocator_stats_t stats;
+  pb_stats_allocator_query(&allocator, &stats);
+  ck_assert_uint_eq(1, stats.allocations);
+  ck_assert_uint_eq(16, stats.current);
+
+  /* Free all allocated memory */
+  pb_allocator_free(&allocator, block);
+  pb_stats_allocator_destroy(&allocator);
+  pb_chunk_allocator_destroy(&chunk);
+} END_TEST
+
+/*
+ * Allocate memory blocks and track live bytes.
+ */
+START_TEST(test_allocate) {
+  pb_allocator_t allocator = pb_stats_allocator_create();
+
+  /* Allocate blocks */
+  void *block1 = pb_allocator_allocate(&allocator, 10);
+  ck_assert_ptr_ne(NULL, block1);
+  void *block2 = pb_allocator_allocate(&allocator, 20);
+  ck_assert_ptr_ne(NULL, block2);
+
+  /* Assert statistics */
+  pb_allocator_stats_t stats;
+  pb_stats_allocator_query(&allocator, &stats);
+  ck_assert_uint_eq(2, stats.allocations);
+  ck_assert_uint_eq(0, stats.frees);
+  ck_assert_uint_eq(30, stats.requested);
+  ck_assert_uint_eq(30, stats.current);
+  ck_assert_uint_eq(30, stats.peak);
+
+  /* Free a block and assert statistics */
+  pb_allocator_free(&allocator, block2);
+  pb_stats_allocator_query(&allocator, &stats);
+  ck_assert_uint_eq(1, stats.frees);
+  ck_assert_uint_eq(10, stats.current);
+  ck_assert_uint_eq(30, stats.peak);
+
+  /* Free all allocated memory */
+  pb_allocator_free(&allocator, block1);
+  pb_stats_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Allocate a memory block of given size for an invalid allocator.
+ */
+START_TEST(test_allocate_invalid) {
+  pb_allocator_t allocator = pb_stats_allocator_create();
+  pb_allocator_t allocator_invalid = {
+    .proc = {
+      .allocate = allocator.proc.allocate,
+      .resize   = allocator.proc.resize,
+      .free     = allocator.proc.free
+    },
+    .data = NULL
+  };
+
+  /* Try to allocate blocks */
+  ck_assert_ptr_eq(NULL, pb_allocator_allocate(&allocator_invalid, 16));
+
+  /* Assert empty statistics */
+  pb_allocator_stats_t stats;
+  pb_stats_allocator_query(&allocator_invalid, &stats);
+  ck_assert_uint_eq(0, stats.allocations);
+
+  /* Free all allocated memory */
+  pb_stats_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Change the size of memory blocks and track moved bytes.
+ */
+START_TEST(test_resize) {
+  pb_allocator_t allocator = pb_stats_allocator_create();
+
+  /* Allocate a block through resizing and write to it */
+  void *block = pb_allocator_resize(&allocator, NULL, 20);
+  ck_assert_ptr_ne(NULL, block);
+  memcpy(block, "SOME DATA TO BE KEPT", 20);
+
+  /* Grow and shrink block */
+  block = pb_allocator_resize(&allocator, block, 1000);
+  ck_assert_ptr_ne(NULL, block);
+  block = pb_allocator_resize(&allocator, block, 40);
+  ck_assert_ptr_ne(NULL, block);
+  fail_if(memcmp(block, "SOME DATA TO BE KEPT", 20));
+
+  /* Assert statistics */
+  pb_allocator_stats_t stats;
+  pb_stats_allocator_query(&allocator, &stats);
+  ck_assert_uint_eq(0, stats.allocations);
+  ck_assert_uint_eq(3, stats.resizes);
+  ck_assert_uint_eq(1060, stats.requested);
+  ck_assert_uint_eq(40, stats.current);
+  ck_assert_uint_eq(1000, stats.peak);
+
+  /* Free all allocated memory */
+  pb_allocator_free(&allocator, block);
+  pb_stats_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Change the size of a memory block that must be moved.
+ */
+START_TEST(test_resize_moved) {
+  pb_allocator_t chunk = pb_chunk_allocator_create_with_capacity(64);
+  pb_allocator_t allocator = pb_stats_allocator_create_with_allocator(&chunk);
+
+  /* Allocate blocks, so the first one cannot grow in place */
+  void *block1 = pb_allocator_allocate(&allocator, 16);
+  ck_assert_ptr_ne(NULL, block1);
+  void *block2 = pb_allocator_allocate(&allocator, 16);
+  ck_assert_ptr_ne(NULL, block2);
+
+  /* Resize first block */
+  void *moved = pb_allocator_resize(&allocator, block1, 4096);
+  ck_assert_ptr_ne(NULL, moved);
+
+  /* Assert bytes moved, if the block was moved */
+  pb_allocator_stats_t stats;
+  pb_stats_allocator_query(&allocator, &stats);
+  ck_assert_uint_eq(moved != block1 ? 16 : 0, stats.moved);
+  ck_assert_uint_eq(4112, stats.current);
+
+  /* Free all allocated memory */
+  pb_allocator_free(&allocator, moved);
+  pb_allocator_free(&allocator, block2);
+  pb_stats_allocator_destroy(&allocator);
+  pb_chunk_allocator_destroy(&chunk);
+} END_TEST
+
+/*
+ * Track the allocations of a buffer.
+ */
+START_TEST(test_buffer) {
+  pb_allocator_t allocator = pb_stats_allocator_create();
+
+  /* Create buffer and grow it */
+  pb_buffer_t buffer = pb_buffer_create_with_allocator(
+    &allocator, (const uint8_t *)"SOME DATA", 9);
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_buffer_error(&buffer));
+  uint8_t *data = pb_buffer_grow(&buffer, 14);
+  ck_assert_ptr_ne(NULL, data);
+  memcpy(data, " AND MORE DATA", 14);
+
+  /* Assert statistics */
+  pb_allocator_stats_t stats;
+  pb_stats_allocator_query(&allocator, &stats);
+  ck_assert_uint_eq(23, stats.current);
+
+  /* Destroy buffer and assert statistics */
+  pb_buffer_destroy(&buffer);
+  pb_stats_allocator_query(&allocator, &stats);
+  ck_assert_uint_eq(0, stats.current);
+  ck_assert_uint_eq(stats.allocations + stats.resizes, stats.frees + 1);
+
+  /* Free all allocated memory */
+  pb_stats_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Sample the call sites of allocations.
+ */
+START_TEST(test_sites) {
+  pb_allocator_t allocator =
+    pb_stats_allocator_create_with_sampling(&allocator_default, 1);
+  void *blocks[4];
+
+  /* Allocate blocks from two distinct call sites */
+  blocks[0] = allocator.proc.allocate(allocator.data, 10);
+  for (size_t b = 1; b < 4; b++)
+    blocks[b] = allocator.proc.allocate(allocator.data, 100);
+
+  /* Assert call sites ordered by bytes */
+  pb_allocator_site_t sites[4];
+  ck_assert_uint_eq(2, pb_stats_allocator_sites(&allocator, sites, 4));
+  ck_assert_uint_eq(3, sites[0].count);
+  ck_assert_uint_eq(300, sites[0].bytes);
+  ck_assert_uint_eq(1, sites[1].count);
+  ck_assert_uint_eq(10, sites[1].bytes);
+  ck_assert_ptr_ne(sites[0].address, sites[1].address);
+
+  /* Assert only the largest call site is written */
+  ck_assert_uint_eq(1, pb_stats_allocator_sites(&allocator, sites, 1));
+  ck_assert_uint_eq(300, sites[0].bytes);
+
+  /* Free all allocated memory */
+  for (size_t b = 0; b < 4; b++)
+    pb_allocator_free(&allocator, blocks[b]);
+  pb_stats_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Sample the call sites of allocations with a sampling period.
+ */
+START_TEST(test_sites_period) {
+  pb_allocator_t allocator =
+    pb_stats_allocator_create_with_sampling(&allocator_default, 4);
+
+  /* Allocate and free blocks */
+  for (size_t b = 0; b < 16; b++) {
+    void *block = pb_allocator_allocate(&allocator, 8);
+    ck_assert_ptr_ne(NULL, block);
+    pb_allocator_free(&allocator, block);
+  }
+
+  /* Assert every fourth call was sampled */
+  pb_allocator_site_t sites[1];
+  ck_assert_uint_eq(1, pb_stats_allocator_sites(&allocator, sites, 1));
+  ck_assert_uint_eq(4, sites[0].count);
+  ck_assert_uint_eq(32, sites[0].bytes);
+
+  /* Free all allocated memory */
+  pb_stats_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Sample no call sites if sampling is disabled.
+ */
+START_TEST(test_sites_disabled) {
+  pb_allocator_t allocator = pb_stats_allocator_create();
+
+  /* Allocate a block */
+  void *block = pb_allocator_allocate(&allocator, 8);
+  ck_assert_ptr_ne(NULL, block);
+
+  /* Assert no call sites */
+  pb_allocator_site_t sites[1];
+  ck_assert_uint_eq(0, pb_stats_allocator_sites(&allocator, sites, 1));
+
+  /* Free all allocated memory */
+  pb_allocator_free(&allocator, block);
+  pb_stats_allocator_destroy(&allocator);
+} END_TEST
+
+/*
+ * Reset the statistics of a stats allocator.
+ */
+START_TEST(test_reset) {
+  pb_allocator_t allocator =
+    pb_stats_allocator_create_with_sampling(&allocator_default, 1);
+
+  /* Allocate blocks and free one of them */
+  void *block1 = pb_allocator_allocate(&allocator, 10);
+  ck_assert_ptr_ne(NULL, block1);
+  void *block2 = pb_allocator_allocate(&allocator, 20);
+  ck_assert_ptr_ne(NULL, block2);
+  pb_allocator_free(&allocator, block2);
+
+  /* Reset statistics and assert live bytes are kept */
+  pb_stats_allocator_reset(&allocator);
+  pb_allocator_stats_t stats;
+  pb_stats_allocator_query(&allocator, &stats);
+  ck_assert_uint_eq(0, stats.allocations);
+  ck_assert_uint_eq(0, stats.frees);
+  ck_assert_uint_eq(0, stats.requested);
+  ck_assert_uint_eq(10, stats.current);
+  ck_assert_uint_eq(10, stats.peak);
+
+  /* Assert no call sites */
+  pb_allocator_site_t sites[1];
+  ck_assert_uint_eq(0, pb_stats_allocator_sites(&allocator, sites, 1));
+
+  /* Free all allocated memory */
+  pb_allocator_free(&allocator, block1);
+  pb_stats_allocator_destroy(&allocator);
+} END_TEST
+
+/* ----------------------------------------------------------------------------
+ * Program
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a test suite for all registered test cases and run it.
+ *
+ * Tests must be run sequentially (in no-fork mode) or code coverage
+ * cannot be determined properly.
+ */
+int
+main(void) {
+  void *suite = suite_create("protobluff/util/stats_allocator"),
+       *tcase = NULL;
+
+  /* Add tests to test case "create" */
+  tcase = tcase_create("create");
+  tcase_add_test(tcase, test_create);
+  tcase_add_test(tcase, test_create_with_allocator);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "allocate" */
+  tcase = tcase_create("allocate");
+  tcase_add_test(tcase, test_allocate);
+  tcase_add_test(tcase, test_allocate_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "resize" */
+  tcase = tcase_create("resize");
+  tcase_add_test(tcase, test_resize);
+  tcase_add_test(tcase, test_resize_moved);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "buffer" */
+  tcase = tcase_create("buffer");
+  tcase_add_test(tcase, test_buffer);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "sites" */
+  tcase = tcase_create("sites");
+  tcase_add_test(tcase, test_sites);
+  tcase_add_test(tcase, test_sites_period);
+  tcase_add_test(tcase, test_sites_disabled);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "reset" */
+  tcase = tcase_create("reset");
+  tcase_add_test(tcase, test_reset);
+  suite_add_tcase(suite, tcase);
+
+  /* Create a test suite runner in no-fork mode */
+  void *runner = srunner_create(suite);
+  srunner_set_fork_status(runner, CK_NOFORK);
+
+  /* Execute test suite runner */
+  srunner_run_all(runner, CK_NORMAL);
+  int failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+
+  /* Exit with status code */
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
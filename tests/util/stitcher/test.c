@@ -0,0 +1,337 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <protobluff/descriptor.h>
+
+#include "core/buffer.h"
+#include "core/chain.h"
+#include "core/common.h"
+#include "core/decoder.h"
+#include "core/encoder.h"
+#include "util/executor.h"
+#include "util/stitcher.h"
+
+/* ----------------------------------------------------------------------------
+ * Descriptors
+ * ------------------------------------------------------------------------- */
+
+/* Descriptor for item */
+static pb_descriptor_t
+item_descriptor = { {
+  (const pb_field_descriptor_t []){
+    {  1, "value", UINT32, OPTIONAL }
+  }, 1 } };
+
+/* Descriptor for envelope */
+static pb_descriptor_t
+descriptor = { {
+  (const pb_field_descriptor_t []){
+    {  1, "id",    UINT32,  OPTIONAL },
+    {  2, "items", MESSAGE, REPEATED, &item_descriptor },
+    {  3, "codes", UINT32,  REPEATED, NULL, NULL, PACKED }
+  }, 3 } };
+
+/* ----------------------------------------------------------------------------
+ * Fixtures
+ * ------------------------------------------------------------------------- */
+
+/* Number of items */
+#define ITEMS 1000
+
+/* Items with values 0 to 999 */
+static pb_encoder_t items[ITEMS];
+
+/* Codes with values 0 to 999 */
+static uint32_t codes[ITEMS];
+
+/* Reference encoder and encoder */
+static pb_encoder_t reference, encoder;
+
+/* Executor */
+static pb_executor_t executor;
+
+/*
+ * Create items, encoders and executor.
+ */
+static void
+setup(void) {
+  for (uint32_t i = 0; i < ITEMS; i++) {
+    items[i] = pb_encoder_create(&item_descriptor);
+    codes[i] = i;
+    fail_if(pb_encoder_encode(&(items[i]), 1, &i, 1));
+  }
+  uint32_t id = 42;
+  reference = pb_encoder_create(&descriptor);
+  encoder   = pb_encoder_create(&descriptor);
+  fail_if(pb_encoder_encode(&reference, 1, &id, 1));
+  fail_if(pb_encoder_encode(&encoder, 1, &id, 1));
+  executor = pb_executor_create(4);
+}
+
+/*
+ * Destroy items, encoders and executor.
+ */
+static void
+teardown(void) {
+  for (size_t i = 0; i < ITEMS; i++)
+    pb_encoder_destroy(&(items[i]));
+  pb_encoder_destroy(&reference);
+  pb_encoder_destroy(&encoder);
+  pb_executor_destroy(&executor);
+}
+
+/* ----------------------------------------------------------------------------
+ * Handlers
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Sum values of codes.
+ */
+static pb_error_t
+handler(
+    const pb_field_descriptor_t *descriptor, const void *value, void *user) {
+  uint64_t *sum = user;
+  if (pb_field_descriptor_tag(descriptor) == 3)
+    *sum += *(const uint32_t *)value;
+  return PB_ERROR_NONE;
+}
+
+/* ----------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Encode a repeated field in parallel and stitch it with a single copy.
+ */
+START_TEST(test_stitch) {
+  pb_stitcher_t stitcher = pb_stitcher_create(&executor);
+
+  /* Assert stitcher validity and error */
+  fail_unless(pb_stitcher_valid(&stitcher));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_stitcher_error(&stitcher));
+
+  /* Encode items serially and in parallel */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_encoder_encode(&reference, 2, items, ITEMS));
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_stitcher_encode(&stitcher, &encoder, 2, items, ITEMS));
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_stitcher_stitch(&stitcher, &encoder));
+
+  /* Assert encoded data */
+  const pb_buffer_t *buffer = pb_encoder_buffer(&encoder);
+  ck_assert_uint_eq(pb_buffer_size(pb_encoder_buffer(&reference)),
+    pb_buffer_size(buffer));
+  fail_if(memcmp(pb_buffer_data(pb_encoder_buffer(&reference)),
+    pb_buffer_data(buffer), pb_buffer_size(buffer)));
+
+  /* Free all allocated memory */
+  pb_stitcher_destroy(&stitcher);
+} END_TEST
+
+/*
+ * Encode a repeated field in parallel and retrieve a chain.
+ */
+START_TEST(test_chain) {
+  pb_stitcher_t stitcher = pb_stitcher_create(&executor);
+  fail_unless(pb_stitcher_valid(&stitcher));
+
+  /* Encode items serially and in parallel twice */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_encoder_encode(&reference, 2, items, ITEMS));
+  for (size_t r = 0; r < 2; r++)
+    ck_assert_uint_eq(PB_ERROR_NONE,
+      pb_stitcher_encode(&stitcher, &encoder, 2, items, ITEMS));
+
+  /* Assert chain and encoded data */
+  pb_chain_t chain = pb_stitcher_chain(&stitcher);
+  fail_unless(pb_chain_valid(&chain));
+  fail_unless(pb_chain_size(&chain) > 2);
+  ck_assert_uint_eq(pb_buffer_size(pb_encoder_buffer(&reference)),
+    pb_chain_length(&chain));
+  const uint8_t *data = pb_buffer_data(pb_encoder_buffer(&reference));
+  for (size_t s = 0; s < pb_chain_size(&chain); s++) {
+    const pb_buffer_t *segment = pb_chain_segment(&chain, s);
+    fail_if(memcmp(data, pb_buffer_data(segment), pb_buffer_size(segment)));
+    data += pb_buffer_size(segment);
+  }
+
+  /* Free all allocated memory */
+  pb_chain_destroy(&chain);
+  pb_stitcher_destroy(&stitcher);
+} END_TEST
+
+/*
+ * Encode a packed repeated field in parallel.
+ */
+START_TEST(test_packed) {
+  pb_stitcher_t stitcher = pb_stitcher_create(&executor);
+  fail_unless(pb_stitcher_valid(&stitcher));
+
+  /* Encode codes in parallel */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_stitcher_encode(&stitcher, &encoder, 3, codes, ITEMS));
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_stitcher_stitch(&stitcher, &encoder));
+
+  /* Decode codes and assert sum */
+  uint64_t sum = 0;
+  pb_decoder_t decoder =
+    pb_decoder_create(&descriptor, pb_encoder_buffer(&encoder));
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_decoder_decode(&decoder, handler, &sum));
+  ck_assert_uint_eq(499500, sum);
+
+  /* Free all allocated memory */
+  pb_decoder_destroy(&decoder);
+  pb_stitcher_destroy(&stitcher);
+} END_TEST
+
+/*
+ * Encode a small repeated field, which is not split.
+ */
+START_TEST(test_small) {
+  pb_stitcher_t stitcher = pb_stitcher_create(&executor);
+  fail_unless(pb_stitcher_valid(&stitcher));
+
+  /* Encode items in parallel and assert chain */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_stitcher_encode(&stitcher, &encoder, 2, items, 10));
+  pb_chain_t chain = pb_stitcher_chain(&stitcher);
+  ck_assert_uint_eq(2, pb_chain_size(&chain));
+
+  /* Free all allocated memory */
+  pb_chain_destroy(&chain);
+  pb_stitcher_destroy(&stitcher);
+} END_TEST
+
+/*
+ * Encode an empty repeated field.
+ */
+START_TEST(test_empty) {
+  pb_stitcher_t stitcher = pb_stitcher_create(&executor);
+  fail_unless(pb_stitcher_valid(&stitcher));
+
+  /* Encode no items and assert chain */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_stitcher_encode(&stitcher, &encoder, 2, NULL, 0));
+  pb_chain_t chain = pb_stitcher_chain(&stitcher);
+  ck_assert_uint_eq(1, pb_chain_size(&chain));
+  ck_assert_uint_eq(2, pb_chain_length(&chain));
+
+  /* Stitch and assert unaltered encoder */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_stitcher_stitch(&stitcher, &encoder));
+  ck_assert_uint_eq(2, pb_buffer_size(pb_encoder_buffer(&encoder)));
+
+  /* Free all allocated memory */
+  pb_chain_destroy(&chain);
+  pb_stitcher_destroy(&stitcher);
+} END_TEST
+
+/*
+ * Encode a field which is not repeated.
+ */
+START_TEST(test_encode_invalid) {
+  pb_stitcher_t stitcher = pb_stitcher_create(&executor);
+  fail_unless(pb_stitcher_valid(&stitcher));
+
+  /* Assert encoding errors */
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_stitcher_encode(&stitcher, &encoder, 1, codes, ITEMS));
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_stitcher_encode(&stitcher, &encoder, 4, codes, ITEMS));
+
+  /* Free all allocated memory */
+  pb_stitcher_destroy(&stitcher);
+} END_TEST
+
+/*
+ * Create a stitcher using an invalid executor.
+ */
+START_TEST(test_create_invalid) {
+  pb_executor_t invalid = pb_executor_create_invalid();
+  pb_stitcher_t stitcher = pb_stitcher_create(&invalid);
+
+  /* Assert stitcher validity and error */
+  fail_if(pb_stitcher_valid(&stitcher));
+  ck_assert_uint_eq(PB_ERROR_ALLOC, pb_stitcher_error(&stitcher));
+
+  /* Assert encoding and stitching errors */
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_stitcher_encode(&stitcher, &encoder, 2, items, ITEMS));
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_stitcher_stitch(&stitcher, &encoder));
+
+  /* Free all allocated memory */
+  pb_stitcher_destroy(&stitcher);
+} END_TEST
+
+/* ----------------------------------------------------------------------------
+ * Program
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a test suite for all registered test cases and run it.
+ *
+ * Tests must be run sequentially (in no-fork mode) or code coverage
+ * cannot be determined properly.
+ */
+int
+main(void) {
+  void *suite = suite_create("protobluff/util/stitcher"),
+       *tcase = NULL;
+
+  /* Add tests to test case "create" */
+  tcase = tcase_create("create");
+  tcase_add_checked_fixture(tcase, setup, teardown);
+  tcase_add_test(tcase, test_create_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "encode" */
+  tcase = tcase_create("encode");
+  tcase_add_checked_fixture(tcase, setup, teardown);
+  tcase_add_test(tcase, test_stitch);
+  tcase_add_test(tcase, test_chain);
+  tcase_add_test(tcase, test_packed);
+  tcase_add_test(tcase, test_small);
+  tcase_add_test(tcase, test_empty);
+  tcase_add_test(tcase, test_encode_invalid);
+  suite_add_tcase(suite, tcase);
+
+  /* Create a test suite runner in no-fork mode */
+  void *runner = srunner_create(suite);
+  srunner_set_fork_status(runner, CK_NOFORK);
+
+  /* Execute test suite runner */
+  srunner_run_all(runner, CK_NORMAL);
+  int failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+
+  /* Exit with status code */
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,389 @@
+/*
+ * Copyright (c) 2013-2020 Martin Donath <martin.donath@squidfunk.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <protobluff/descriptor.h>
+
+#include "core/buffer.h"
+#include "core/common.h"
+#include "util/path.h"
+#include "util/transposer.h"
+
+/* ----------------------------------------------------------------------------
+ * Descriptors
+ * ------------------------------------------------------------------------- */
+
+/* Item descriptor */
+static pb_descriptor_t
+descriptor_item = { {
+  (const pb_field_descriptor_t []){
+    {  1, "name",     STRING,  OPTIONAL },
+    {  2, "price",    UINT64,  OPTIONAL }
+  }, 2 } };
+
+/* Meta descriptor */
+static pb_descriptor_t
+descriptor_meta = { {
+  (const pb_field_descriptor_t []){
+    {  1, "source",   STRING,  OPTIONAL }
+  }, 1 } };
+
+/* Descriptor */
+static pb_descriptor_t
+descriptor = { {
+  (const pb_field_descriptor_t []){
+    {  1, "id",       UINT32,  OPTIONAL },
+    {  2, "items",    MESSAGE, REPEATED, &descriptor_item },
+    {  3, "meta",     MESSAGE, OPTIONAL, &descriptor_meta },
+    {  4, "codes",    UINT32,  REPEATED, NULL, NULL, PACKED }
+  }, 4 } };
+
+/* ----------------------------------------------------------------------------
+ * Fixtures
+ * ------------------------------------------------------------------------- */
+
+/* Message with repeated, packed and multiply occurring non-repeated fields */
+static uint8_t data[] = {
+  8, 5,
+  18, 5, 10, 1, 'a', 16, 1,
+  18, 7, 10, 1, 'b', 16, 2, 16, 3,
+  34, 3, 1, 2, 3,
+  32, 4,
+  8, 6,
+  26, 3, 10, 1, 'x',
+  26, 3, 10, 1, 'y' };
+
+/* Message with an identifier only */
+static uint8_t data_id[] = { 8, 7 };
+
+/* Paths of columns */
+static const char *names[] = {
+  "id", "meta.source", "items[1].price", "items[0].name", "codes[3]"
+};
+
+/* Paths */
+static pb_path_t paths[5];
+
+/*
+ * Create paths for all columns.
+ */
+static void
+setup(void) {
+  for (size_t p = 0; p < 5; p++) {
+    paths[p] = pb_path_create(&descriptor, names[p]);
+    fail_unless(pb_path_valid(&(paths[p])));
+  }
+}
+
+/*
+ * Destroy paths for all columns.
+ */
+static void
+teardown(void) {
+  for (size_t p = 0; p < 5; p++)
+    pb_path_destroy(&(paths[p]));
+}
+
+/*
+ * Assert the columns of the message with all fields, an empty message and
+ * the message with an identifier only, starting at a given row.
+ */
+static void
+assert_rows(const pb_transposer_t *transposer, size_t row) {
+  const uint32_t *id = pb_transposer_values(transposer, 0);
+  ck_assert_uint_eq(6, id[row]);
+  ck_assert_uint_eq(0, id[row + 1]);
+  ck_assert_uint_eq(7, id[row + 2]);
+  fail_unless(pb_transposer_present(transposer, 0, row));
+  fail_if(pb_transposer_present(transposer, 0, row + 1));
+  fail_unless(pb_transposer_present(transposer, 0, row + 2));
+
+  /* Assert column of strings from merged submessages */
+  const uint32_t *offsets = pb_transposer_offsets(transposer, 1);
+  const char *source = pb_transposer_values(transposer, 1);
+  ck_assert_uint_eq(1, offsets[row + 1] - offsets[row]);
+  ck_assert_uint_eq('y', source[offsets[row]]);
+  ck_assert_uint_eq(offsets[row + 1], offsets[row + 3]);
+  fail_unless(pb_transposer_present(transposer, 1, row));
+  fail_if(pb_transposer_present(transposer, 1, row + 1));
+  fail_if(pb_transposer_present(transposer, 1, row + 2));
+
+  /* Assert columns of selected occurrences of repeated submessages */
+  const uint64_t *price = pb_transposer_values(transposer, 2);
+  ck_assert_uint_eq(3, price[row]);
+  ck_assert_uint_eq(0, price[row + 1]);
+  offsets = pb_transposer_offsets(transposer, 3);
+  ck_assert_uint_eq('a',
+    ((const char *)pb_transposer_values(transposer, 3))[offsets[row]]);
+
+  /* Assert column of selected occurrence of packed field */
+  const uint32_t *codes = pb_transposer_values(transposer, 4);
+  ck_assert_uint_eq(4, codes[row]);
+  fail_if(pb_transposer_present(transposer, 4, row + 2));
+}
+
+/* ----------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a transposer and append a batch of messages.
+ */
+START_TEST(test_append) {
+  pb_transposer_t transposer =
+    pb_transposer_create(&descriptor, paths, 5);
+
+  /* Assert transposer validity and error */
+  fail_unless(pb_transposer_valid(&transposer));
+  ck_assert_uint_eq(PB_ERROR_NONE, pb_transposer_error(&transposer));
+  fail_unless(pb_transposer_descriptor(&transposer) == &descriptor);
+
+  /* Create messages and append them */
+  pb_buffer_t messages[] = {
+    pb_buffer_create_zero_copy(data, sizeof(data)),
+    pb_buffer_create_empty(),
+    pb_buffer_create_zero_copy(data_id, sizeof(data_id))
+  };
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_transposer_append(&transposer, messages, 3));
+
+  /* Assert rows and columns */
+  ck_assert_uint_eq(3, pb_transposer_size(&transposer));
+  ck_assert_ptr_eq(NULL, pb_transposer_offsets(&transposer, 0));
+  ck_assert_uint_eq(5, pb_transposer_validity(&transposer, 0)[0]);
+  assert_rows(&transposer, 0);
+
+  /* Free all allocated memory */
+  for (size_t m = 0; m < 3; m++)
+    pb_buffer_destroy(&(messages[m]));
+  pb_transposer_destroy(&transposer);
+} END_TEST
+
+/*
+ * Append batches of messages spanning several bytes of the validity bitmap.
+ */
+START_TEST(test_append_batches) {
+  pb_transposer_t transposer =
+    pb_transposer_create(&descriptor, paths, 5);
+  fail_unless(pb_transposer_valid(&transposer));
+
+  /* Create messages and append them repeatedly */
+  pb_buffer_t messages[] = {
+    pb_buffer_create_zero_copy(data, sizeof(data)),
+    pb_buffer_create_empty(),
+    pb_buffer_create_zero_copy(data_id, sizeof(data_id))
+  };
+  for (size_t b = 0; b < 10; b++)
+    ck_assert_uint_eq(PB_ERROR_NONE,
+      pb_transposer_append(&transposer, messages, 3));
+
+  /* Assert rows and columns */
+  ck_assert_uint_eq(30, pb_transposer_size(&transposer));
+  for (size_t b = 0; b < 10; b++)
+    assert_rows(&transposer, b * 3);
+
+  /* Free all allocated memory */
+  for (size_t m = 0; m < 3; m++)
+    pb_buffer_destroy(&(messages[m]));
+  pb_transposer_destroy(&transposer);
+} END_TEST
+
+/*
+ * Append a message which cannot be decoded.
+ */
+START_TEST(test_append_invalid) {
+  uint8_t truncated[] = { 8, 5, 26, 3, 10 };
+  pb_transposer_t transposer =
+    pb_transposer_create(&descriptor, paths, 5);
+  fail_unless(pb_transposer_valid(&transposer));
+
+  /* Create messages and append them */
+  pb_buffer_t messages[] = {
+    pb_buffer_create_zero_copy(data_id, sizeof(data_id)),
+    pb_buffer_create_zero_copy(truncated, sizeof(truncated)),
+    pb_buffer_create_zero_copy(data_id, sizeof(data_id))
+  };
+  ck_assert_uint_ne(PB_ERROR_NONE,
+    pb_transposer_append(&transposer, messages, 3));
+
+  /* Assert only the preceding row was appended */
+  ck_assert_uint_eq(1, pb_transposer_size(&transposer));
+  ck_assert_uint_eq(7,
+    ((const uint32_t *)pb_transposer_values(&transposer, 0))[0]);
+  ck_assert_uint_eq(0, pb_transposer_offsets(&transposer, 1)[1]);
+
+  /* Free all allocated memory */
+  for (size_t m = 0; m < 3; m++)
+    pb_buffer_destroy(&(messages[m]));
+  pb_transposer_destroy(&transposer);
+} END_TEST
+
+/*
+ * Reset a transposer and append messages again.
+ */
+START_TEST(test_reset) {
+  pb_transposer_t transposer =
+    pb_transposer_create(&descriptor, paths, 5);
+  fail_unless(pb_transposer_valid(&transposer));
+
+  /* Create messages and append them */
+  pb_buffer_t messages[] = {
+    pb_buffer_create_zero_copy(data, sizeof(data)),
+    pb_buffer_create_empty(),
+    pb_buffer_create_zero_copy(data_id, sizeof(data_id))
+  };
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_transposer_append(&transposer, messages, 3));
+
+  /* Reset transposer and assert emptiness */
+  pb_transposer_reset(&transposer);
+  ck_assert_uint_eq(0, pb_transposer_size(&transposer));
+  ck_assert_uint_eq(0, pb_transposer_offsets(&transposer, 1)[0]);
+
+  /* Append messages again and assert rows */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_transposer_append(&transposer, messages, 3));
+  ck_assert_uint_eq(3, pb_transposer_size(&transposer));
+  assert_rows(&transposer, 0);
+
+  /* Free all allocated memory */
+  for (size_t m = 0; m < 3; m++)
+    pb_buffer_destroy(&(messages[m]));
+  pb_transposer_destroy(&transposer);
+} END_TEST
+
+/*
+ * Create a transposer with a path ending in a submessage.
+ */
+START_TEST(test_create_invalid) {
+  pb_path_t path = pb_path_create(&descriptor, "meta");
+  fail_unless(pb_path_valid(&path));
+
+  /* Create transposer */
+  pb_transposer_t transposer =
+    pb_transposer_create(&descriptor, &path, 1);
+
+  /* Assert transposer validity and error */
+  fail_if(pb_transposer_valid(&transposer));
+  ck_assert_uint_eq(PB_ERROR_INVALID, pb_transposer_error(&transposer));
+
+  /* Assert append error */
+  pb_buffer_t message = pb_buffer_create_zero_copy(data, sizeof(data));
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_transposer_append(&transposer, &message, 1));
+
+  /* Free all allocated memory */
+  pb_buffer_destroy(&message);
+  pb_transposer_destroy(&transposer);
+  pb_path_destroy(&path);
+} END_TEST
+
+/*
+ * Create a transposer with paths matching all occurrences of repeated fields.
+ */
+START_TEST(test_create_invalid_repeated) {
+  const char *repeated[] = { "codes", "items[*].price", "items.name" };
+  for (size_t p = 0; p < 3; p++) {
+    pb_path_t path = pb_path_create(&descriptor, repeated[p]);
+    fail_unless(pb_path_valid(&path));
+
+    /* Create transposer */
+    pb_transposer_t transposer =
+      pb_transposer_create(&descriptor, &path, 1);
+
+    /* Assert transposer validity and error */
+    fail_if(pb_transposer_valid(&transposer));
+    ck_assert_uint_eq(PB_ERROR_INVALID, pb_transposer_error(&transposer));
+
+    /* Free all allocated memory */
+    pb_transposer_destroy(&transposer);
+    pb_path_destroy(&path);
+  }
+} END_TEST
+
+/*
+ * Create a transposer with a path for another descriptor.
+ */
+START_TEST(test_create_invalid_descriptor) {
+  pb_path_t path = pb_path_create(&descriptor_meta, "source");
+  fail_unless(pb_path_valid(&path));
+
+  /* Create transposer */
+  pb_transposer_t transposer =
+    pb_transposer_create(&descriptor, &path, 1);
+
+  /* Assert transposer validity and error */
+  fail_if(pb_transposer_valid(&transposer));
+  ck_assert_uint_eq(PB_ERROR_INVALID, pb_transposer_error(&transposer));
+
+  /* Free all allocated memory */
+  pb_transposer_destroy(&transposer);
+  pb_path_destroy(&path);
+} END_TEST
+
+/* ----------------------------------------------------------------------------
+ * Program
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Create a test suite for all registered test cases and run it.
+ *
+ * Tests must be run sequentially (in no-fork mode) or code coverage
+ * cannot be determined properly.
+ */
+int
+main(void) {
+  void *suite = suite_create("protobluff/util/transposer"),
+       *tcase = NULL;
+
+  /* Add tests to test case "create" */
+  tcase = tcase_create("create");
+  tcase_add_test(tcase, test_create_invalid);
+  tcase_add_test(tcase, test_create_invalid_repeated);
+  tcase_add_test(tcase, test_create_invalid_descriptor);
+  suite_add_tcase(suite, tcase);
+
+  /* Add tests to test case "append" */
+  tcase = tcase_create("append");
+  tcase_add_checked_fixture(tcase, setup, teardown);
+  tcase_add_test(tcase, test_append);
+  tcase_add_test(tcase, test_append_batches);
+  tcase_add_test(tcase, test_append_invalid);
+  tcase_add_test(tcase, test_reset);
+  suite_add_tcase(suite, tcase);
+
+  /* Create a test suite runner in no-fork mode */
+  void *runner = srunner_create(suite);
+  srunner_set_fork_status(runner, CK_NOFORK);
+
+  /* Execute test suite runner */
+  srunner_run_all(runner, CK_NORMAL);
+  int failed = srunner_ntests_failed(runner);
+  srunner_free(runner);
+
+  /* Exit with status code */
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -28,6 +28,7 @@
 #include <protobluff/descriptor.h>
 
 #include "core/buffer.h"
+#include "core/chain.h"
 #include "core/common.h"
 #include "core/descriptor.h"
 #include "util/validator.h"
@@ -358,6 +359,75 @@ START_TEST(test_check_invalid_length) {
   pb_buffer_destroy(&buffer);
 } END_TEST
 
+/*
+ * Check a chain of buffers with a message spanning segments.
+ */
+START_TEST(test_check_chain) {
+  const uint8_t data[] = { 8, 127, 16, 127, 34, 4, 8, 127, 16, 127 };
+
+  /* Create validator and chain */
+  pb_buffer_t segments[] = {
+    pb_buffer_create_zero_copy((uint8_t *)data, 5),
+    pb_buffer_create_zero_copy((uint8_t *)data + 5, 3),
+    pb_buffer_create_zero_copy((uint8_t *)data + 8, 2)
+  };
+  pb_chain_t     chain     = pb_chain_create(segments, 3);
+  pb_validator_t validator = pb_validator_create(&descriptor);
+
+  /* Check chain */
+  ck_assert_uint_eq(PB_ERROR_NONE,
+    pb_validator_check_chain(&validator, &chain));
+
+  /* Free all allocated memory */
+  pb_validator_destroy(&validator);
+  pb_chain_destroy(&chain);
+  for (size_t s = 0; s < 3; s++)
+    pb_buffer_destroy(&(segments[s]));
+} END_TEST
+
+/*
+ * Check a chain of buffers with an absent required field.
+ */
+START_TEST(test_check_chain_absent) {
+  const uint8_t data[] = { 8, 127, 16, 127, 34, 2, 8, 127 };
+
+  /* Create validator and chain */
+  pb_buffer_t segments[] = {
+    pb_buffer_create_zero_copy((uint8_t *)data, 6),
+    pb_buffer_create_zero_copy((uint8_t *)data + 6, 2)
+  };
+  pb_chain_t     chain     = pb_chain_create(segments, 2);
+  pb_validator_t validator = pb_validator_create(&descriptor);
+
+  /* Check chain */
+  ck_assert_uint_eq(PB_ERROR_ABSENT,
+    pb_validator_check_chain(&validator, &chain));
+
+  /* Free all allocated memory */
+  pb_validator_destroy(&validator);
+  pb_chain_destroy(&chain);
+  for (size_t s = 0; s < 2; s++)
+    pb_buffer_destroy(&(segments[s]));
+} END_TEST
+
+/*
+ * Check an invalid chain of buffers.
+ */
+START_TEST(test_check_chain_invalid) {
+  pb_buffer_t    buffer    = pb_buffer_create_invalid();
+  pb_chain_t     chain     = pb_chain_create(&buffer, 1);
+  pb_validator_t validator = pb_validator_create(&descriptor);
+
+  /* Check chain */
+  ck_assert_uint_eq(PB_ERROR_INVALID,
+    pb_validator_check_chain(&validator, &chain));
+
+  /* Free all allocated memory */
+  pb_validator_destroy(&validator);
+  pb_chain_destroy(&chain);
+  pb_buffer_destroy(&buffer);
+} END_TEST
+
 /* ----------------------------------------------------------------------------
  * Program
  * ------------------------------------------------------------------------- */
@@ -391,6 +461,13 @@ main(void) {
   tcase_add_test(tcase, test_check_invalid_length);
   suite_add_tcase(suite, tcase);
 
+  /* Add tests to test case "check_chain" */
+  tcase = tcase_create("check_chain");
+  tcase_add_test(tcase, test_check_chain);
+  tcase_add_test(tcase, test_check_chain_absent);
+  tcase_add_test(tcase, test_check_chain_invalid);
+  suite_add_tcase(suite, tcase);
+
   /* Create a test suite runner in no-fork mode */
   void *runner = srunner_create(suite);
   srunner_set_fork_status(runner, CK_NOFORK);